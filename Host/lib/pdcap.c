@@ -0,0 +1,444 @@
+#include "pdcap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "usb_pd_decode.h"
+#include "usb_pd_record.h"
+
+static const char file_magic[8] = {'P', 'D', 'C', 'A', 'P', '\r', '\n', 0x1A};
+static const char block_magic[4] = {'P', 'C', 'B', 'K'};
+static const char footer_magic[8] = {'P', 'D', 'C', 'A', 'P', 'I', 'D', 'X'};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t block_bytes;
+    uint32_t reserved;
+    uint64_t created_unix;
+} file_header_t;
+
+typedef struct {
+    char magic[4];
+    uint32_t crc;       // CRC32 of the payload
+    pdcap_block_t info;
+} block_header_t;
+
+typedef struct {
+    uint64_t index_offset;
+    uint64_t index_count;
+    uint64_t messages;
+    uint32_t index_crc;
+    uint32_t version;
+    char magic[8];
+} footer_t;
+
+_Static_assert(sizeof(file_header_t) == 32, "file header layout");
+_Static_assert(sizeof(pdcap_block_t) == 64, "index entry layout");
+_Static_assert(sizeof(block_header_t) == 72, "block header layout");
+_Static_assert(sizeof(footer_t) == 40, "footer layout");
+
+/* ---- CRC32 (IEEE, reflected) ---- */
+
+static uint32_t crc32_table[256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+static void crc32_build(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320u & (uint32_t) - (int32_t)(c & 1));
+        crc32_table[i] = c;
+    }
+}
+
+static void crc32_init(void) {
+    pthread_once(&crc32_once, crc32_build);
+}
+
+static uint32_t crc32_buf(const void *data, size_t n) {
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    while (n--) crc = (crc >> 8) ^ crc32_table[(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
+
+unsigned pdcap_key_from_name(const char *name) {
+    if (!strcmp(name, "RX_RESET") || !strcmp(name, "HardReset") || !strcmp(name, "Hard_Reset")) {
+        return PDCAP_KEY_RESET;
+    }
+    for (uint8_t ext = 0; ext < 2; ext++) {
+        for (uint8_t data = 0; data < (ext ? 1 : 2); data++) {
+            for (uint8_t t = 0; t < 32; t++) {
+                const char *n = pd_msg_type_name(ext, data, t);
+                if (n && !strcmp(n, name)) {
+                    return ext ? PDCAP_KEY_EXT(t) : (data ? PDCAP_KEY_DATA(t) : PDCAP_KEY_CTRL(t));
+                }
+            }
+        }
+    }
+    return PDCAP_KEY_NONE;
+}
+
+/* ---- writer ---- */
+
+struct pdcap_writer {
+    FILE *fp;
+    uint8_t *buf;
+    uint32_t block_bytes;
+    uint32_t len;
+    pdcap_block_t cur;
+    uint64_t file_off;
+    uint64_t base_ms;
+    uint64_t last_ms;   // capture time of the last message written
+    uint32_t last_ts;
+    int have_ts;
+    uint64_t total;
+    pdcap_block_t *index;
+    size_t n_index;
+    size_t cap_index;
+};
+
+static int write_all(pdcap_writer_t *w, const void *p, size_t n) {
+    if (n && fwrite(p, 1, n, w->fp) != n) return -1;
+    w->file_off += n;
+    return 0;
+}
+
+static void block_begin(pdcap_writer_t *w) {
+    if (w->len) return;
+    memset(&w->cur, 0, sizeof(w->cur));
+    w->cur.base_ms = w->base_ms;
+    w->cur.first_ms = w->cur.last_ms = w->last_ms;
+    w->cur.first_msg = w->total;
+}
+
+static int flush_block(pdcap_writer_t *w) {
+    if (!w->len) return 0;
+
+    if (w->n_index == w->cap_index) {
+        size_t cap = w->cap_index ? w->cap_index * 2 : 256;
+        pdcap_block_t *idx = realloc(w->index, cap * sizeof(*idx));
+        if (!idx) return -1;
+        w->index = idx;
+        w->cap_index = cap;
+    }
+
+    block_header_t hdr;
+    memcpy(hdr.magic, block_magic, sizeof(hdr.magic));
+    w->cur.offset = w->file_off;
+    w->cur.bytes = w->len;
+    hdr.crc = crc32_buf(w->buf, w->len);
+    hdr.info = w->cur;
+    if (write_all(w, &hdr, sizeof(hdr)) || write_all(w, w->buf, w->len)) return -1;
+
+    w->index[w->n_index++] = w->cur;
+    w->len = 0;
+    return 0;
+}
+
+pdcap_writer_t *pdcap_writer_open(const char *path, uint32_t block_bytes) {
+    crc32_init();
+    if (!block_bytes) block_bytes = PDCAP_BLOCK_BYTES;
+    if (block_bytes < PD_RECORD_MAX_LEN) block_bytes = PD_RECORD_MAX_LEN;
+
+    pdcap_writer_t *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->block_bytes = block_bytes;
+    w->buf = malloc(block_bytes);
+    w->fp = fopen(path, "wb");
+    if (!w->buf || !w->fp) {
+        int err = errno;
+        if (w->fp) fclose(w->fp);
+        free(w->buf);
+        free(w);
+        errno = err;
+        return NULL;
+    }
+
+    file_header_t fh;
+    memset(&fh, 0, sizeof(fh));
+    memcpy(fh.magic, file_magic, sizeof(fh.magic));
+    fh.version = PDCAP_VERSION;
+    fh.header_size = sizeof(fh);
+    fh.block_bytes = block_bytes;
+    fh.created_unix = (uint64_t)time(NULL);
+    if (write_all(w, &fh, sizeof(fh))) {
+        int err = errno;
+        fclose(w->fp);
+        free(w->buf);
+        free(w);
+        errno = err;
+        return NULL;
+    }
+    return w;
+}
+
+static int append_record(pdcap_writer_t *w, const uint8_t *rec, size_t n) {
+    if (w->len + n > w->block_bytes && flush_block(w)) return -1;
+    block_begin(w);
+    memcpy(&w->buf[w->len], rec, n);
+    w->len += (uint32_t)n;
+    return 0;
+}
+
+int pdcap_writer_add(pdcap_writer_t *w, const pdd_message_t *msg) {
+    uint8_t rec[PD_RECORD_MAX_LEN];
+    uint32_t ts = msg->timestamp_ms;
+
+    if (w->have_ts && ts < w->last_ts) {
+        /* Device reset or u32 wrap: new block, keep capture time monotonic */
+        if (flush_block(w)) return -1;
+        w->base_ms += (uint64_t)w->last_ts - ts;
+    }
+    uint64_t ms = w->base_ms + ts;
+    if (w->len && w->cur.count && ms - w->cur.first_ms >= PDCAP_BLOCK_SPAN_MS && flush_block(w)) return -1;
+
+    size_t n = pdd_encode_binary(msg, rec, sizeof(rec));
+    if (!n) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (w->len + n > w->block_bytes && flush_block(w)) return -1;
+    block_begin(w);
+    if (!w->cur.count) w->cur.first_ms = ms;
+    w->cur.last_ms = ms;
+    w->cur.count++;
+    unsigned key = pdcap_type_key(msg);
+    w->cur.types[key >> 6] |= 1ull << (key & 63);
+    memcpy(&w->buf[w->len], rec, n);
+    w->len += (uint32_t)n;
+
+    w->last_ts = ts;
+    w->have_ts = 1;
+    w->last_ms = ms;
+    w->total++;
+    return 0;
+}
+
+int pdcap_writer_add_notice(pdcap_writer_t *w, const char *line, size_t len) {
+    uint8_t rec[PD_RECORD_MAX_LEN];
+    return append_record(w, rec, pd_record_encode_text(rec, line, len));
+}
+
+int pdcap_writer_flush(pdcap_writer_t *w) {
+    if (flush_block(w)) return -1;
+    return fflush(w->fp) ? -1 : 0;
+}
+
+uint64_t pdcap_writer_bytes(const pdcap_writer_t *w) {
+    return w->file_off + w->len;
+}
+
+int pdcap_writer_close(pdcap_writer_t *w) {
+    int rc = flush_block(w);
+
+    /* Index is 8-byte aligned so the reader can use it in place */
+    static const uint8_t pad[8];
+    if (!rc) rc = write_all(w, pad, (size_t)(-w->file_off & 7));
+
+    footer_t ft;
+    memset(&ft, 0, sizeof(ft));
+    ft.index_offset = w->file_off;
+    ft.index_count = w->n_index;
+    ft.messages = w->total;
+    ft.index_crc = crc32_buf(w->index, w->n_index * sizeof(*w->index));
+    ft.version = PDCAP_VERSION;
+    memcpy(ft.magic, footer_magic, sizeof(ft.magic));
+    if (!rc) rc = write_all(w, w->index, w->n_index * sizeof(*w->index));
+    if (!rc) rc = write_all(w, &ft, sizeof(ft));
+    if (fclose(w->fp) && !rc) rc = -1;
+
+    free(w->index);
+    free(w->buf);
+    free(w);
+    return rc;
+}
+
+/* ---- reader ---- */
+
+struct pdcap_reader {
+    const uint8_t *map;
+    size_t size;
+    const pdcap_block_t *index;
+    pdcap_block_t *owned; // rebuilt index, if recovered
+    size_t n;
+    uint64_t messages;
+    int recovered;
+};
+
+static int load_footer(pdcap_reader_t *r) {
+    footer_t ft;
+    if (r->size < sizeof(file_header_t) + sizeof(ft)) return -1;
+    memcpy(&ft, r->map + r->size - sizeof(ft), sizeof(ft));
+    if (memcmp(ft.magic, footer_magic, sizeof(ft.magic)) || ft.version != PDCAP_VERSION) return -1;
+    if (ft.index_offset & 7 || ft.index_offset > r->size - sizeof(ft) ||
+        ft.index_count != (r->size - sizeof(ft) - ft.index_offset) / sizeof(pdcap_block_t) ||
+        ft.index_offset + ft.index_count * sizeof(pdcap_block_t) + sizeof(ft) != r->size) {
+        return -1;
+    }
+    const pdcap_block_t *idx = (const pdcap_block_t *)(r->map + ft.index_offset);
+    if (crc32_buf(idx, ft.index_count * sizeof(*idx)) != ft.index_crc) return -1;
+    r->index = idx;
+    r->n = (size_t)ft.index_count;
+    r->messages = ft.messages;
+    return 0;
+}
+
+/* Rebuild the index from block headers (no footer: recording was interrupted) */
+static int rebuild_index(pdcap_reader_t *r) {
+    size_t cap = 0;
+    uint64_t off = sizeof(file_header_t);
+
+    r->n = 0;
+    r->messages = 0;
+    while (off + sizeof(block_header_t) <= r->size) {
+        block_header_t hdr;
+        memcpy(&hdr, r->map + off, sizeof(hdr));
+        if (memcmp(hdr.magic, block_magic, sizeof(hdr.magic)) || hdr.info.offset != off ||
+            hdr.info.bytes > r->size - off - sizeof(hdr) ||
+            crc32_buf(r->map + off + sizeof(hdr), hdr.info.bytes) != hdr.crc) {
+            break;
+        }
+        if (r->n == cap) {
+            cap = cap ? cap * 2 : 256;
+            pdcap_block_t *idx = realloc(r->owned, cap * sizeof(*idx));
+            if (!idx) return -1;
+            r->owned = idx;
+        }
+        r->owned[r->n++] = hdr.info;
+        r->messages += hdr.info.count;
+        off += sizeof(hdr) + hdr.info.bytes;
+    }
+    r->index = r->owned;
+    r->recovered = 1;
+    return 0;
+}
+
+pdcap_reader_t *pdcap_open(const char *path) {
+    crc32_init();
+
+    pdcap_reader_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) goto fail;
+
+    /* The mapping outlives the descriptor, so batch tools can hold many captures open */
+    struct stat st;
+    if (fstat(fd, &st)) goto fail_fd;
+    if ((size_t)st.st_size < sizeof(file_header_t)) {
+        errno = EINVAL;
+        goto fail_fd;
+    }
+    r->size = (size_t)st.st_size;
+    void *map = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) goto fail_fd;
+    r->map = map;
+    close(fd);
+
+    file_header_t fh;
+    memcpy(&fh, r->map, sizeof(fh));
+    if (memcmp(fh.magic, file_magic, sizeof(fh.magic)) || fh.version != PDCAP_VERSION) {
+        errno = EINVAL;
+        goto fail;
+    }
+    if (load_footer(r) && rebuild_index(r)) goto fail;
+    return r;
+
+fail_fd:
+    close(fd);
+fail: {
+    int err = errno;
+    pdcap_close(r);
+    errno = err;
+    return NULL;
+}
+}
+
+void pdcap_close(pdcap_reader_t *r) {
+    if (!r) return;
+    if (r->map) munmap((void *)r->map, r->size);
+    free(r->owned);
+    free(r);
+}
+
+size_t pdcap_block_count(const pdcap_reader_t *r) {
+    return r->n;
+}
+
+const pdcap_block_t *pdcap_block(const pdcap_reader_t *r, size_t i) {
+    return i < r->n ? &r->index[i] : NULL;
+}
+
+uint64_t pdcap_message_count(const pdcap_reader_t *r) {
+    return r->messages;
+}
+
+int pdcap_recovered(const pdcap_reader_t *r) {
+    return r->recovered;
+}
+
+size_t pdcap_seek_time(const pdcap_reader_t *r, uint64_t ms) {
+    size_t lo = 0, hi = r->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->index[mid].last_ms < ms) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+size_t pdcap_read_block(const pdcap_reader_t *r, size_t i, const pdd_callbacks_t *cb, void *user) {
+    if (i >= r->n) return 0;
+    const pdcap_block_t *b = &r->index[i];
+    pdd_decoder_t dec;
+    pdd_init(&dec, PDD_MODE_BINARY, cb, user);
+    return pdd_feed(&dec, r->map + b->offset + sizeof(block_header_t), b->bytes);
+}
+
+typedef struct {
+    uint64_t base_ms;
+    uint64_t from_ms;
+    unsigned key;
+    uint64_t remaining;
+    pdd_message_t *out;
+    uint64_t out_ms;
+} find_ctx_t;
+
+static void find_on_message(void *user, const pdd_message_t *msg) {
+    find_ctx_t *f = user;
+    if (!f->remaining) return;
+    uint64_t ms = f->base_ms + msg->timestamp_ms;
+    if (ms < f->from_ms || pdcap_type_key(msg) != f->key) return;
+    if (--f->remaining == 0) {
+        *f->out = *msg;
+        f->out_ms = ms;
+    }
+}
+
+int pdcap_find(const pdcap_reader_t *r, uint64_t from_ms, unsigned key, uint64_t nth, pdd_message_t *out,
+               uint64_t *out_ms) {
+    if (key > 127 || !nth) return 0;
+
+    pdd_callbacks_t cb = {.on_message = find_on_message};
+    find_ctx_t f = {.from_ms = from_ms, .key = key, .remaining = nth, .out = out};
+    for (size_t i = pdcap_seek_time(r, from_ms); i < r->n; i++) {
+        const pdcap_block_t *b = &r->index[i];
+        if (!(b->types[key >> 6] & (1ull << (key & 63)))) continue;
+        f.base_ms = b->base_ms;
+        pdcap_read_block(r, i, &cb, &f);
+        if (!f.remaining) {
+            if (out_ms) *out_ms = f.out_ms;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+ * pdcap - indexed capture container for long sniffer sessions.
+ *
+ *   file header | block | block | ... | index | footer
+ *
+ * A block is a block header followed by binary device records
+ * (usb_pd_record.h), so block payloads decode with libpdd as-is. Blocks are
+ * appended as they fill (or every PDCAP_BLOCK_SPAN_MS); the index (one
+ * pdcap_block_t per block) and the footer are written on close. A file
+ * without a valid footer (recording killed) is recovered by walking the
+ * block headers; only the unflushed tail is lost.
+ *
+ * Capture time is a 64-bit monotonic millisecond clock: the device u32
+ * timestamp plus a per-block base that absorbs device resets and wraps.
+ * On-disk integers are little-endian; the reader mmap()s the file.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pdd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PDCAP_VERSION        1
+#define PDCAP_BLOCK_BYTES    65536 // default block payload size
+#define PDCAP_BLOCK_SPAN_MS  60000 // a block never covers more capture time than this
+
+/* Message type keys for the per-block type bitmaps */
+#define PDCAP_KEY_CTRL(t)    (t)         // 0..31
+#define PDCAP_KEY_DATA(t)    (32u + (t)) // 32..63
+#define PDCAP_KEY_EXT(t)     (64u + (t)) // 64..95
+#define PDCAP_KEY_RESET      96u         // RX_RESET (Hard/Cable Reset)
+#define PDCAP_KEY_UNKNOWN    127u        // no header
+#define PDCAP_KEY_NONE       0xFFu
+
+static inline unsigned pdcap_type_key(const pdd_message_t *msg) {
+    if (msg->flags & PDD_MSG_RX_RESET) return PDCAP_KEY_RESET;
+    if (msg->frame_len < 2) return PDCAP_KEY_UNKNOWN;
+    if (msg->extended) return PDCAP_KEY_EXT(msg->msg_type);
+    return msg->num_do ? PDCAP_KEY_DATA(msg->msg_type) : PDCAP_KEY_CTRL(msg->msg_type);
+}
+
+/* Key for a message type name as printed by the device ("Request", "RX_RESET", ...); PDCAP_KEY_NONE if unknown */
+unsigned pdcap_key_from_name(const char *name);
+
+/* Index entry; also embedded in every block header */
+typedef struct {
+    uint64_t offset;    // file offset of the block header
+    uint64_t base_ms;   // capture time = base_ms + device timestamp
+    uint64_t first_ms;  // capture time of the first/last message
+    uint64_t last_ms;
+    uint64_t first_msg; // capture-wide ordinal of the first message
+    uint64_t types[2];  // bit k set: block holds a message with type key k
+    uint32_t count;     // messages in the block
+    uint32_t bytes;     // payload bytes following the block header
+} pdcap_block_t;
+
+/* ---- writer ---- */
+
+typedef struct pdcap_writer pdcap_writer_t;
+
+/* block_bytes 0 selects PDCAP_BLOCK_BYTES. NULL on error (errno set). */
+pdcap_writer_t *pdcap_writer_open(const char *path, uint32_t block_bytes);
+/* 0 on success, -1 on I/O error (errno set) */
+int pdcap_writer_add(pdcap_writer_t *w, const pdd_message_t *msg);
+int pdcap_writer_add_notice(pdcap_writer_t *w, const char *line, size_t len);
+/* Flush the open block to disk without closing */
+int pdcap_writer_flush(pdcap_writer_t *w);
+/* Write index and footer, free the writer; 0 on success */
+int pdcap_writer_close(pdcap_writer_t *w);
+uint64_t pdcap_writer_bytes(const pdcap_writer_t *w);
+
+/* ---- reader ---- */
+
+typedef struct pdcap_reader pdcap_reader_t;
+
+/* NULL on error (errno set; EINVAL for a file that is not a capture) */
+pdcap_reader_t *pdcap_open(const char *path);
+void pdcap_close(pdcap_reader_t *r);
+
+size_t pdcap_block_count(const pdcap_reader_t *r);
+const pdcap_block_t *pdcap_block(const pdcap_reader_t *r, size_t i);
+uint64_t pdcap_message_count(const pdcap_reader_t *r);
+/* 1 if the footer was missing and the index was rebuilt from block headers */
+int pdcap_recovered(const pdcap_reader_t *r);
+
+/* First block that may hold a message at or after ms (binary search); == block count if none */
+size_t pdcap_seek_time(const pdcap_reader_t *r, uint64_t ms);
+
+/* Decode block i through cb; returns the number of messages emitted */
+size_t pdcap_read_block(const pdcap_reader_t *r, size_t i, const pdd_callbacks_t *cb, void *user);
+
+/*
+ * Find the nth (1-based) message with type key at or after capture time
+ * from_ms. Blocks whose bitmap lacks the key are skipped without decoding.
+ * Returns 1 and fills out/out_ms if found, 0 otherwise.
+ */
+int pdcap_find(const pdcap_reader_t *r, uint64_t from_ms, unsigned key, uint64_t nth, pdd_message_t *out,
+               uint64_t *out_ms);
+
+#ifdef __cplusplus
+}
+#endif
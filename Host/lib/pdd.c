@@ -0,0 +1,508 @@
+#include "pdd.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "usb_pd_decode.h"
+#include "usb_pd_header.h"
+#include "usb_pd_link.h"
+#include "usb_pd_record.h"
+
+enum {
+    ST_LINE_START = 0, // next byte starts a text line or a record
+    ST_TEXT,           // inside a text line
+    ST_RECORD,         // inside a binary record
+    ST_HUNT,           // resync after a bad record: drop bytes until SYNC or '\n'
+    ST_LINK,           // inside a 0x00-delimited link frame
+};
+
+/* Table-driven CRC8 (same polynomial as pd_record_crc8) */
+static uint8_t crc8_table[256];
+static pthread_once_t crc8_once = PTHREAD_ONCE_INIT;
+
+static void crc8_build(void) {
+    for (int i = 0; i < 256; i++) {
+        uint8_t b = (uint8_t)i;
+        crc8_table[i] = pd_record_crc8(0, &b, 1);
+    }
+}
+
+static void crc8_init(void) {
+    pthread_once(&crc8_once, crc8_build);
+}
+
+static inline uint8_t crc8_fast(const uint8_t *p, size_t n) {
+    uint8_t crc = 0;
+    while (n--) crc = crc8_table[crc ^ *p++];
+    return crc;
+}
+
+static inline uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void emit_error(pdd_decoder_t *dec, pdd_error_t err) {
+    dec->stats.errors++;
+    if (dec->cb.on_error) dec->cb.on_error(dec->user, err, dec->offset);
+}
+
+static void emit_message(pdd_decoder_t *dec, const pdd_message_t *msg) {
+    dec->stats.messages++;
+    if (dec->cb.on_message) dec->cb.on_message(dec->user, msg);
+}
+
+static void emit_notice(pdd_decoder_t *dec, const char *line, size_t len) {
+    dec->stats.notices++;
+    if (dec->cb.on_notice) dec->cb.on_notice(dec->user, line, len);
+}
+
+void pdd_message_finish(pdd_message_t *msg) {
+    msg->header = 0;
+    msg->msg_type = msg->msg_id = msg->num_do = msg->extended = msg->power_role = msg->spec_rev = 0;
+    msg->crc = 0;
+    memset(msg->data_objects, 0, sizeof(msg->data_objects));
+    msg->flags &= (uint8_t)~PDD_MSG_HAS_CRC;
+
+    if (msg->flags & PDD_MSG_RX_RESET) {
+        msg->type_name = "RX_RESET";
+        msg->direction = "";
+        return;
+    }
+    if (msg->frame_len < 2) {
+        msg->type_name = "Unknown";
+        msg->direction = "";
+        return;
+    }
+
+    pd_header_t hdr;
+    msg->header = pd_header_read(msg->frame);
+    pd_header_decode(msg->header, &hdr);
+    msg->msg_type = hdr.msg_type;
+    msg->msg_id = hdr.msg_id;
+    msg->num_do = hdr.num_do;
+    msg->extended = hdr.extended;
+    msg->power_role = hdr.power_role;
+    msg->spec_rev = hdr.spec_rev;
+
+    uint8_t data_len = (uint8_t)(2 + hdr.num_do * 4);
+    for (uint8_t i = 0; i < hdr.num_do && (uint8_t)(2 + i * 4 + 4) <= msg->frame_len; i++) {
+        msg->data_objects[i] = rd32(&msg->frame[2 + i * 4]);
+    }
+    if (msg->frame_len >= data_len + 4) {
+        msg->crc = rd32(&msg->frame[data_len]);
+        msg->flags |= PDD_MSG_HAS_CRC;
+    }
+
+    const char *name = pd_msg_type_name(hdr.extended, hdr.num_do, hdr.msg_type);
+    if (name == NULL) {
+        name = hdr.extended ? "Unknown_Ext" : (hdr.num_do == 0 ? "Unknown_Ctrl" : "Unknown_Data");
+    }
+    msg->type_name = name;
+    msg->direction = pd_direction_label(msg->sop, hdr.power_role);
+}
+
+/* ---- binary records ---- */
+
+static void handle_record(pdd_decoder_t *dec) {
+    const uint8_t *rec = dec->buf;
+    uint8_t kind = rec[1];
+    uint8_t len = rec[2];
+    const uint8_t *payload = &rec[3];
+
+    if (kind == PD_RECORD_KIND_TEXT) {
+        emit_notice(dec, (const char *)payload, len);
+        return;
+    }
+    if (kind != PD_RECORD_KIND_FRAME) {
+        return; /* unknown kinds are skipped for forward compatibility */
+    }
+    if (len < PD_RECORD_FRAME_FIXED || len - PD_RECORD_FRAME_FIXED > PDD_FRAME_MAX) {
+        emit_error(dec, PDD_ERR_BAD_RECORD);
+        return;
+    }
+
+    pdd_message_t msg;
+    msg.timestamp_ms = rd32(&payload[0]);
+    msg.vbus_mv = (uint16_t)(payload[4] | (payload[5] << 8));
+    msg.seq = rd32(&payload[6]);
+    msg.sop = payload[10] & PD_RECORD_STATUS_SOP_MASK;
+    msg.flags = PDD_MSG_BINARY;
+    if (payload[10] & PD_RECORD_STATUS_RX_RESET) msg.flags |= PDD_MSG_RX_RESET;
+    msg.frame_len = (uint8_t)(len - PD_RECORD_FRAME_FIXED);
+    memcpy(msg.frame, &payload[PD_RECORD_FRAME_FIXED], msg.frame_len);
+    pdd_message_finish(&msg);
+    emit_message(dec, &msg);
+}
+
+/* ---- link frames ---- */
+
+static void finish_link(pdd_decoder_t *dec) {
+    if (dec->truncated) {
+        emit_error(dec, PDD_ERR_BAD_LINK);
+        return;
+    }
+    pd_link_rx_t rx;
+    pd_link_rx_result_t r = PD_LINK_RX_NONE;
+    pd_link_rx_init(&rx);
+    for (uint16_t i = 0; i < dec->buf_len; i++) r = pd_link_rx_feed(&rx, dec->buf[i]);
+    if (r != PD_LINK_RX_FRAME) {
+        emit_error(dec, PDD_ERR_BAD_LINK);
+        return;
+    }
+    dec->stats.links++;
+    if (dec->cb.on_link) dec->cb.on_link(dec->user, rx.op, rx.seq, rx.data, rx.data_len);
+}
+
+/* ---- text lines ---- */
+
+static inline int hexval(uint8_t c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/* Parse n hex digits; returns -1 on failure */
+static int64_t parse_hex(const uint8_t *p, const uint8_t *end, int n) {
+    if (end - p < n) return -1;
+    int64_t v = 0;
+    for (int i = 0; i < n; i++) {
+        int h = hexval(p[i]);
+        if (h < 0) return -1;
+        v = (v << 4) | h;
+    }
+    return v;
+}
+
+/* Parse a decimal number followed by suffix; returns -1 on mismatch */
+static int64_t parse_dec_suffix(const uint8_t *p, const uint8_t *end, const char *suffix) {
+    int64_t v = 0;
+    const uint8_t *s = p;
+    while (s < end && *s >= '0' && *s <= '9') {
+        v = v * 10 + (*s - '0');
+        s++;
+    }
+    if (s == p) return -1;
+    size_t sl = strlen(suffix);
+    if ((size_t)(end - s) < sl || memcmp(s, suffix, sl) != 0) return -1;
+    return v;
+}
+
+#define FIELD_MAX 12
+
+/* Returns 1 if the line is a PD message (emitted), 0 if it is a notice, -1 on parse error */
+static int parse_pd_line(pdd_decoder_t *dec, const uint8_t *line, size_t len) {
+    const uint8_t *f[FIELD_MAX];
+    const uint8_t *fe[FIELD_MAX];
+    int nf = 0;
+
+    /* Split on 0x1F; field 0 is the "> " prefix */
+    const uint8_t *p = line;
+    const uint8_t *end = line + len;
+    while (nf < FIELD_MAX) {
+        const uint8_t *sep = memchr(p, 0x1F, (size_t)(end - p));
+        f[nf] = p;
+        fe[nf] = sep ? sep : end;
+        nf++;
+        if (!sep) break;
+        p = sep + 1;
+    }
+    if (nf < 6) return 0;
+
+    /* ms / mV / #seq: CC and debug lines have no mV column */
+    int64_t ts = parse_dec_suffix(f[1], fe[1], "ms");
+    int64_t mv = parse_dec_suffix(f[2], fe[2], "mV");
+    if (ts < 0 || mv < 0 || fe[3] - f[3] < 2 || f[3][0] != '#') return 0;
+    int64_t seq = parse_dec_suffix(f[3] + 1, fe[3], "");
+    if (seq < 0) return -1;
+
+    pdd_message_t msg;
+    msg.timestamp_ms = (uint32_t)ts;
+    msg.vbus_mv = (uint16_t)mv;
+    msg.seq = (uint32_t)seq;
+    msg.flags = 0;
+    msg.frame_len = 0;
+
+    /* SOP label (left-aligned, space padded) */
+    size_t sl = (size_t)(fe[4] - f[4]);
+    while (sl && f[4][sl - 1] == ' ') sl--;
+    if (sl == 5 && memcmp(f[4], "SOP''", 5) == 0) msg.sop = PD_SOP2;
+    else if (sl == 4 && memcmp(f[4], "SOP'", 4) == 0) msg.sop = PD_SOP1;
+    else if (sl == 3 && memcmp(f[4], "SOP", 3) == 0) msg.sop = PD_SOP0;
+    else msg.sop = PD_SOP_NONE;
+
+    if (fe[5] - f[5] >= 8 && memcmp(f[5], "RX_RESET", 8) == 0) {
+        msg.flags |= PDD_MSG_RX_RESET;
+        pdd_message_finish(&msg);
+        emit_message(dec, &msg);
+        return 1;
+    }
+
+    /* Raw frame column "[H]0xHHHH[0]0xDDDDDDDD...[CRC]0xCCCCCCCC" */
+    int raw = -1;
+    for (int i = 6; i < nf; i++) {
+        if (fe[i] - f[i] >= 9 && f[i][0] == '[' && f[i][1] == 'H' && f[i][2] == ']') {
+            raw = i;
+            break;
+        }
+    }
+    if (raw < 0) return -1;
+
+    p = f[raw] + 3;
+    end = fe[raw];
+    if (end - p < 6 || p[0] != '0' || p[1] != 'x') return -1;
+    int64_t h = parse_hex(p + 2, end, 4);
+    if (h < 0) return -1;
+    msg.frame[0] = (uint8_t)h;
+    msg.frame[1] = (uint8_t)(h >> 8);
+    msg.frame_len = 2;
+    p += 6;
+
+    while (p < end && *p == '[') {
+        const uint8_t *close = memchr(p, ']', (size_t)(end - p));
+        if (!close || end - close < 11 || close[1] != '0' || close[2] != 'x') break;
+        int64_t v = parse_hex(close + 3, end, 8);
+        if (v < 0 || msg.frame_len + 4 > PDD_FRAME_MAX) return -1;
+        msg.frame[msg.frame_len++] = (uint8_t)v;
+        msg.frame[msg.frame_len++] = (uint8_t)(v >> 8);
+        msg.frame[msg.frame_len++] = (uint8_t)(v >> 16);
+        msg.frame[msg.frame_len++] = (uint8_t)(v >> 24);
+        p = close + 11;
+    }
+
+    pdd_message_finish(&msg);
+    emit_message(dec, &msg);
+    return 1;
+}
+
+static void handle_line(pdd_decoder_t *dec, int truncated) {
+    size_t len = dec->buf_len;
+    while (len && (dec->buf[len - 1] == '\r')) len--;
+    if (len == 0) return;
+
+    if (truncated) {
+        emit_error(dec, PDD_ERR_LINE_TOO_LONG);
+    } else if (len > 3 && dec->buf[0] == '>' && dec->buf[1] == ' ' && dec->buf[2] == 0x1F) {
+        int r = parse_pd_line(dec, dec->buf, len);
+        if (r > 0) return;
+        if (r < 0) {
+            emit_error(dec, PDD_ERR_BAD_LINE);
+            return;
+        }
+    }
+    emit_notice(dec, (const char *)dec->buf, len);
+}
+
+/* ---- byte stream ---- */
+
+static void feed_bytes(pdd_decoder_t *dec, const uint8_t *p, const uint8_t *end);
+
+static void start_record(pdd_decoder_t *dec) {
+    dec->buf[0] = PD_RECORD_SYNC;
+    dec->buf_len = 1;
+    dec->rec_need = 3;
+    dec->state = ST_RECORD;
+}
+
+static void finish_record(pdd_decoder_t *dec) {
+    size_t n = dec->buf_len;
+    if (crc8_fast(&dec->buf[1], n - 2) == dec->buf[n - 1]) {
+        dec->state = ST_LINE_START;
+        handle_record(dec);
+        return;
+    }
+
+    /* Bad CRC: the sync may have been a data byte; rescan what followed it */
+    emit_error(dec, PDD_ERR_BAD_CRC);
+    uint8_t replay[PD_RECORD_MAX_LEN];
+    memcpy(replay, &dec->buf[1], n - 1);
+    dec->state = ST_HUNT;
+    dec->buf_len = 0;
+    dec->offset -= n - 1;
+    feed_bytes(dec, replay, replay + n - 1);
+}
+
+static void feed_bytes(pdd_decoder_t *dec, const uint8_t *p, const uint8_t *end) {
+    while (p < end) {
+        switch (dec->state) {
+        case ST_LINE_START:
+            if (*p == 0x00) {
+                /* Link frames are written between lines and records, never inside one */
+                dec->buf[0] = 0x00;
+                dec->buf_len = 1;
+                dec->truncated = 0;
+                dec->state = ST_LINK;
+                p++;
+                dec->offset++;
+            } else if (dec->mode != PDD_MODE_TEXT && *p == PD_RECORD_SYNC) {
+                start_record(dec);
+                p++;
+                dec->offset++;
+            } else if (dec->mode == PDD_MODE_BINARY) {
+                dec->state = ST_HUNT;
+            } else {
+                dec->state = ST_TEXT;
+                dec->buf_len = 0;
+                dec->truncated = 0;
+            }
+            break;
+
+        case ST_TEXT: {
+            const uint8_t *nl = memchr(p, '\n', (size_t)(end - p));
+            size_t n = (size_t)((nl ? nl : end) - p);
+            size_t room = PDD_LINE_MAX - dec->buf_len;
+            if (n > room) {
+                dec->truncated = 1; /* remember truncation until end of line */
+                n = room;
+            }
+            memcpy(&dec->buf[dec->buf_len], p, n);
+            dec->buf_len += (uint16_t)n;
+            size_t consumed = (size_t)((nl ? nl : end) - p);
+            p += consumed;
+            dec->offset += consumed;
+            if (nl) {
+                p++;
+                dec->offset++;
+                handle_line(dec, dec->truncated);
+                dec->truncated = 0;
+                dec->state = ST_LINE_START;
+            }
+            break;
+        }
+
+        case ST_RECORD: {
+            size_t n = (size_t)(dec->rec_need - dec->buf_len);
+            if (n > (size_t)(end - p)) n = (size_t)(end - p);
+            memcpy(&dec->buf[dec->buf_len], p, n);
+            dec->buf_len += (uint16_t)n;
+            p += n;
+            dec->offset += n;
+            if (dec->rec_need == 3 && dec->buf_len == 3) {
+                dec->rec_need = (uint16_t)(PD_RECORD_OVERHEAD + dec->buf[2]);
+            } else if (dec->buf_len == dec->rec_need) {
+                finish_record(dec);
+            }
+            break;
+        }
+
+        case ST_LINK:
+            if (*p != 0x00) {
+                if (dec->buf_len < PD_LINK_MAX_WIRE - 1) {
+                    dec->buf[dec->buf_len++] = *p;
+                } else {
+                    dec->truncated = 1; /* drop the rest up to the closing delimiter */
+                }
+            } else if (dec->buf_len > 1 || dec->truncated) {
+                dec->buf[dec->buf_len++] = 0x00;
+                finish_link(dec);
+                dec->truncated = 0;
+                dec->state = ST_LINE_START;
+            } /* else: repeated delimiter, still the opening one */
+            p++;
+            dec->offset++;
+            break;
+
+        case ST_HUNT: {
+            if (*p == PD_RECORD_SYNC) {
+                start_record(dec);
+            } else if (*p == '\n' && dec->mode != PDD_MODE_BINARY) {
+                dec->state = ST_LINE_START;
+            }
+            p++;
+            dec->offset++;
+            break;
+        }
+
+        default:
+            dec->state = ST_LINE_START;
+            break;
+        }
+    }
+}
+
+void pdd_init(pdd_decoder_t *dec, pdd_mode_t mode, const pdd_callbacks_t *cb, void *user) {
+    memset(dec, 0, offsetof(pdd_decoder_t, buf));
+    dec->mode = mode;
+    if (cb) dec->cb = *cb;
+    dec->user = user;
+    crc8_init();
+    pdd_reset(dec);
+}
+
+void pdd_reset(pdd_decoder_t *dec) {
+    dec->state = ST_LINE_START;
+    dec->truncated = 0;
+    dec->buf_len = 0;
+    dec->rec_need = 0;
+    dec->offset = 0;
+    memset(&dec->stats, 0, sizeof(dec->stats));
+}
+
+size_t pdd_feed(pdd_decoder_t *dec, const uint8_t *data, size_t len) {
+    uint64_t before = dec->stats.messages;
+    dec->stats.bytes += len;
+    feed_bytes(dec, data, data + len);
+    return (size_t)(dec->stats.messages - before);
+}
+
+const pdd_stats_t *pdd_stats(const pdd_decoder_t *dec) {
+    return &dec->stats;
+}
+
+pdd_decoder_t *pdd_create(pdd_mode_t mode, const pdd_callbacks_t *cb, void *user) {
+    pdd_decoder_t *dec = malloc(sizeof(*dec));
+    if (dec) pdd_init(dec, mode, cb, user);
+    return dec;
+}
+
+void pdd_destroy(pdd_decoder_t *dec) {
+    free(dec);
+}
+
+/* ---- encoders ---- */
+
+size_t pdd_format_text(const pdd_message_t *msg, char *out, size_t out_size) {
+    size_t w = 0;
+    int n;
+
+#define PDD_APPEND(...)                                                    \
+    do {                                                                   \
+        n = snprintf(out + w, out_size - w, __VA_ARGS__);                  \
+        if (n < 0 || (size_t)n >= out_size - w) return 0;                  \
+        w += (size_t)n;                                                    \
+    } while (0)
+
+    PDD_APPEND("> \037%ums \037%05umV \037#%03u \037%-5s \037", msg->timestamp_ms, msg->vbus_mv, msg->seq,
+               pd_sop_label(msg->sop));
+
+    if (msg->flags & PDD_MSG_RX_RESET) {
+        PDD_APPEND("RX_RESET\n");
+        return w;
+    }
+
+    PDD_APPEND("%-15s \037%u \037%s \037V%u \037[H]0x%02X%02X", msg->type_name, msg->msg_id, msg->direction,
+               msg->spec_rev + 1, msg->frame[1], msg->frame[0]);
+    if (msg->frame_len > 2) {
+        for (uint8_t i = 0; i < msg->num_do; i++) {
+            PDD_APPEND("[%u]0x%08X", i, (unsigned)msg->data_objects[i]);
+        }
+    }
+    if (msg->flags & PDD_MSG_HAS_CRC) {
+        PDD_APPEND("[CRC]0x%08X", (unsigned)msg->crc);
+    }
+    PDD_APPEND("\n");
+
+#undef PDD_APPEND
+    return w;
+}
+
+size_t pdd_encode_binary(const pdd_message_t *msg, uint8_t *out, size_t out_size) {
+    size_t need = PD_RECORD_OVERHEAD + PD_RECORD_FRAME_FIXED + msg->frame_len;
+    if (out_size < need) return 0;
+    uint8_t status = msg->sop & PD_RECORD_STATUS_SOP_MASK;
+    if (msg->flags & PDD_MSG_RX_RESET) status |= PD_RECORD_STATUS_RX_RESET;
+    return pd_record_encode_frame(out, msg->timestamp_ms, msg->vbus_mv, msg->seq, status, msg->frame,
+                                  (msg->flags & PDD_MSG_RX_RESET) ? 0 : msg->frame_len);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+/*
+ * pdd - host-side streaming decoder for the USB PD Sniffer CDC stream.
+ *
+ * Feed raw bytes from the device (any split) with pdd_feed(); decoded events
+ * are delivered through callbacks. Framed command replies (usb_pd_link.h,
+ * 0x00 ... 0x00) may sit between lines and records in any mode; they are
+ * consumed and reported on their own. The decoder never allocates after
+ * creation. Message type tables and header/extended decoding are the same
+ * sources the firmware uses (User/usb-pd).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PDD_FRAME_MAX 34  // header + 7 DOs + CRC32, same as PD_MSG_MAX_LEN
+#define PDD_LINE_MAX  512 // longest text line kept; longer lines are truncated
+
+/* Input format */
+typedef enum {
+    PDD_MODE_AUTO = 0, // text lines and binary records mixed
+    PDD_MODE_TEXT = 1, // '\037'-separated text lines only
+    PDD_MODE_BINARY = 2, // binary records only (usb_pd_record.h)
+} pdd_mode_t;
+
+/* Message flags */
+#define PDD_MSG_RX_RESET 0x01 // reset signalling, no frame
+#define PDD_MSG_HAS_CRC  0x02 // frame includes the CRC32
+#define PDD_MSG_BINARY   0x04 // decoded from a binary record
+
+/* Decoded PD message; valid only during the callback */
+typedef struct {
+    uint32_t timestamp_ms;
+    uint32_t seq;            // device message counter
+    uint16_t vbus_mv;
+    uint8_t sop;             // PD_SOP_* (0: unknown)
+    uint8_t flags;           // PDD_MSG_*
+    uint16_t header;         // raw 16-bit header
+    uint8_t msg_type;
+    uint8_t msg_id;
+    uint8_t num_do;
+    uint8_t extended;
+    uint8_t power_role;
+    uint8_t spec_rev;
+    uint8_t frame_len;       // bytes in frame[] (header + DOs [+ CRC])
+    uint8_t frame[PDD_FRAME_MAX];
+    uint32_t data_objects[7];
+    uint32_t crc;            // valid if PDD_MSG_HAS_CRC
+    const char *type_name;   // static string, "Unknown" if not in tables
+    const char *direction;   // static string
+} pdd_message_t;
+
+/* Error codes reported through on_error */
+typedef enum {
+    PDD_ERR_BAD_CRC = 1,     // binary record CRC mismatch
+    PDD_ERR_BAD_RECORD = 2,  // binary record with invalid length/kind
+    PDD_ERR_BAD_LINE = 3,    // text line looked like a PD message but did not parse
+    PDD_ERR_LINE_TOO_LONG = 4,
+    PDD_ERR_BAD_LINK = 5,    // link frame with a bad CRC, COBS error or too long
+} pdd_error_t;
+
+typedef struct {
+    void (*on_message)(void *user, const pdd_message_t *msg);
+    /* Non-PD text line (attach/detach, mode notices, debug); not NUL-terminated */
+    void (*on_notice)(void *user, const char *line, size_t len);
+    /* offset: stream byte offset where the problem was detected */
+    void (*on_error)(void *user, pdd_error_t err, uint64_t offset);
+    /* Link frame, usually a command reply: op (0x80 set), seq, data (status byte first) */
+    void (*on_link)(void *user, uint8_t op, uint8_t seq, const uint8_t *data, size_t len);
+} pdd_callbacks_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t messages;
+    uint64_t notices;
+    uint64_t errors;
+    uint64_t links;
+} pdd_stats_t;
+
+/* Decoder state. Treat as opaque; exposed so it can live on the stack. */
+typedef struct {
+    pdd_mode_t mode;
+    pdd_callbacks_t cb;
+    void *user;
+    uint8_t state;
+    uint8_t truncated;
+    uint16_t rec_need;
+    uint16_t buf_len;
+    uint64_t offset;
+    pdd_stats_t stats;
+    uint8_t buf[PDD_LINE_MAX];
+} pdd_decoder_t;
+
+void pdd_init(pdd_decoder_t *dec, pdd_mode_t mode, const pdd_callbacks_t *cb, void *user);
+void pdd_reset(pdd_decoder_t *dec);
+/* Consume len bytes; returns the number of messages emitted by this call */
+size_t pdd_feed(pdd_decoder_t *dec, const uint8_t *data, size_t len);
+const pdd_stats_t *pdd_stats(const pdd_decoder_t *dec);
+
+/* Heap-allocated decoder for language bindings (one allocation per decoder) */
+pdd_decoder_t *pdd_create(pdd_mode_t mode, const pdd_callbacks_t *cb, void *user);
+void pdd_destroy(pdd_decoder_t *dec);
+
+/*
+ * Encoders producing the exact device output, used for synthetic captures
+ * and format conversion. Return bytes written (0 if out_size is too small).
+ */
+size_t pdd_format_text(const pdd_message_t *msg, char *out, size_t out_size);
+size_t pdd_encode_binary(const pdd_message_t *msg, uint8_t *out, size_t out_size);
+
+/* Fill header-derived fields of msg from frame[]/frame_len/sop */
+void pdd_message_finish(pdd_message_t *msg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,181 @@
+#include "pdd_synth.h"
+
+#include <string.h>
+
+#include "usb_pd_header.h"
+
+enum {
+    P_CAPS = 0,
+    P_REQUEST,
+    P_ACCEPT,
+    P_PS_RDY,
+    P_IDLE,
+    P_STATUS,
+    P_HARD_RESET_WAIT,
+};
+
+static const uint16_t fixed_mv[] = {5000, 9000, 12000, 15000, 20000};
+
+static uint32_t rnd(pdd_synth_t *s) {
+    /* xorshift64* */
+    s->rng ^= s->rng >> 12;
+    s->rng ^= s->rng << 25;
+    s->rng ^= s->rng >> 27;
+    return (uint32_t)((s->rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static uint32_t rnd_range(pdd_synth_t *s, uint32_t lo, uint32_t hi) {
+    return lo + rnd(s) % (hi - lo + 1);
+}
+
+/* PD CRC32 (IEEE 802.3, reflected) over header + data */
+static uint32_t pd_crc32(const uint8_t *p, size_t n) {
+    uint32_t crc = 0xFFFFFFFFu;
+    while (n--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320u & (uint32_t)-(int32_t)(crc & 1));
+    }
+    return ~crc;
+}
+
+static void build(pdd_synth_t *s, pdd_message_t *m, uint8_t power_role, uint8_t type, uint8_t ext,
+                  const uint32_t *dos, uint8_t ndo, uint8_t msg_id) {
+    uint16_t h = (uint16_t)(type | (power_role << 5) | (2u << 6) | (power_role << 8) | ((msg_id & 7u) << 9) |
+                            ((ndo & 7u) << 12) | ((ext & 1u) << 15));
+
+    memset(m, 0, sizeof(*m));
+    m->timestamp_ms = s->now_ms;
+    m->seq = ++s->seq;
+    m->vbus_mv = (uint16_t)(s->vbus_mv + rnd_range(s, 0, 40) - 20);
+    m->sop = PD_SOP0;
+    m->frame[0] = (uint8_t)h;
+    m->frame[1] = (uint8_t)(h >> 8);
+    for (uint8_t i = 0; i < ndo; i++) {
+        m->frame[2 + i * 4 + 0] = (uint8_t)dos[i];
+        m->frame[2 + i * 4 + 1] = (uint8_t)(dos[i] >> 8);
+        m->frame[2 + i * 4 + 2] = (uint8_t)(dos[i] >> 16);
+        m->frame[2 + i * 4 + 3] = (uint8_t)(dos[i] >> 24);
+    }
+    uint8_t n = (uint8_t)(2 + ndo * 4);
+    uint32_t crc = pd_crc32(m->frame, n);
+    m->frame[n + 0] = (uint8_t)crc;
+    m->frame[n + 1] = (uint8_t)(crc >> 8);
+    m->frame[n + 2] = (uint8_t)(crc >> 16);
+    m->frame[n + 3] = (uint8_t)(crc >> 24);
+    m->frame_len = (uint8_t)(n + 4);
+    pdd_message_finish(m);
+
+    if (!(type == 0x01 && ndo == 0 && !ext)) {
+        s->ack_pending = 1;
+        s->ack_role = power_role;
+        s->ack_id = msg_id;
+    }
+}
+
+/* Time until the partner's next protocol reply; occasionally late */
+static uint32_t reply_delay(pdd_synth_t *s) {
+    return rnd_range(s, 0, 999) < 2 ? rnd_range(s, 35, 60) : rnd_range(s, 1, 8);
+}
+
+void pdd_synth_init(pdd_synth_t *s, uint64_t seed) {
+    memset(s, 0, sizeof(*s));
+    s->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    s->now_ms = rnd_range(s, 300, 900);
+    s->vbus_mv = 5000;
+    s->contract_mv = 5000;
+    s->phase = P_CAPS;
+}
+
+void pdd_synth_next(pdd_synth_t *s, pdd_message_t *m) {
+    uint32_t dos[7];
+
+    if (s->ack_pending) {
+        s->ack_pending = 0;
+        s->now_ms += rnd_range(s, 0, 1);
+        build(s, m, (uint8_t)!s->ack_role, 0x01, 0, NULL, 0, s->ack_id);
+        return;
+    }
+
+    switch (s->phase) {
+    case P_CAPS:
+        s->num_pdo = (uint8_t)rnd_range(s, 2, 6);
+        for (uint8_t i = 0; i < s->num_pdo && i < 5; i++) {
+            /* Fixed PDO: 3A, bit 23 EPR capable on PDO1 only */
+            dos[i] = ((uint32_t)(fixed_mv[i] / 50) << 10) | 300u | (i == 0 ? (1u << 26) : 0);
+        }
+        if (s->num_pdo == 6) {
+            /* SPR PPS APDO 3.3-21V 3A */
+            dos[5] = (3u << 30) | (210u << 17) | (33u << 8) | 60u;
+        }
+        build(s, m, 1, 0x01, 0, dos, s->num_pdo, s->src_id++);
+        s->phase = P_REQUEST;
+        break;
+
+    case P_REQUEST: {
+        s->now_ms += reply_delay(s);
+        uint8_t pos = (uint8_t)rnd_range(s, 1, s->num_pdo < 5 ? s->num_pdo : 5);
+        s->contract_mv = fixed_mv[pos - 1];
+        dos[0] = ((uint32_t)pos << 28) | (300u << 10) | 300u;
+        build(s, m, 0, 0x02, 0, dos, 1, s->snk_id++);
+        s->phase = P_ACCEPT;
+        break;
+    }
+
+    case P_ACCEPT:
+        s->now_ms += reply_delay(s);
+        build(s, m, 1, 0x03, 0, NULL, 0, s->src_id++);
+        s->phase = P_PS_RDY;
+        break;
+
+    case P_PS_RDY:
+        s->now_ms += rnd_range(s, 20, 200);
+        s->vbus_mv = s->contract_mv;
+        build(s, m, 1, 0x06, 0, NULL, 0, s->src_id++);
+        s->phase = P_IDLE;
+        break;
+
+    case P_IDLE: {
+        s->now_ms += rnd_range(s, 200, 2000);
+        uint32_t r = rnd_range(s, 0, 999);
+        if (r < 2) {
+            /* Hard Reset: no frame, VBUS drops, new session */
+            memset(m, 0, sizeof(*m));
+            m->timestamp_ms = s->now_ms;
+            m->seq = ++s->seq;
+            m->vbus_mv = s->vbus_mv;
+            m->sop = PD_SOP1;
+            m->flags = PDD_MSG_RX_RESET;
+            pdd_message_finish(m);
+            s->src_id = s->snk_id = 0;
+            s->vbus_mv = 0;
+            s->phase = P_HARD_RESET_WAIT;
+        } else if (r < 300) {
+            build(s, m, 0, 0x12, 0, NULL, 0, s->snk_id++); /* GetStatus */
+            s->phase = P_STATUS;
+        } else {
+            /* Sink re-requests a PDO */
+            s->phase = P_REQUEST;
+            pdd_synth_next(s, m);
+        }
+        break;
+    }
+
+    case P_STATUS:
+        s->now_ms += reply_delay(s);
+        /* Status: chunked ext header (7 bytes) + SDB */
+        dos[0] = 0x8007u | ((uint32_t)rnd_range(s, 25, 60) << 16) | (0x02u << 24);
+        dos[1] = 0x00000200u;
+        dos[2] = 0;
+        build(s, m, 1, 0x02, 1, dos, 3, s->src_id++);
+        s->phase = P_IDLE;
+        break;
+
+    case P_HARD_RESET_WAIT:
+    default:
+        s->now_ms += rnd_range(s, 600, 1200);
+        s->vbus_mv = 5000;
+        s->phase = P_CAPS;
+        pdd_synth_next(s, m);
+        break;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ * Synthetic PD traffic generator for benchmarks. Produces a plausible
+ * sniffer timeline: Source_Capabilities / Request / Accept / PS_RDY
+ * negotiations with GoodCRCs, periodic re-requests, GetStatus/Status pairs,
+ * occasional late replies and hard resets. Deterministic for a given seed.
+ */
+
+#include <stdint.h>
+
+#include "pdd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t rng;
+    uint32_t now_ms;
+    uint32_t seq;
+    uint16_t vbus_mv;
+    uint16_t contract_mv;
+    uint8_t phase;
+    uint8_t ack_pending;  // next message is the GoodCRC for ack_role/ack_id
+    uint8_t ack_role;
+    uint8_t ack_id;
+    uint8_t src_id;
+    uint8_t snk_id;
+    uint8_t num_pdo;
+} pdd_synth_t;
+
+void pdd_synth_init(pdd_synth_t *s, uint64_t seed);
+void pdd_synth_next(pdd_synth_t *s, pdd_message_t *msg);
+
+#ifdef __cplusplus
+}
+#endif
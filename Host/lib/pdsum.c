@@ -0,0 +1,192 @@
+#include "pdsum.h"
+
+#include <string.h>
+
+#include "usb_pd_header.h"
+
+/* Control / data message types used by the analyzer */
+#define T_GOODCRC    0x01
+#define T_ACCEPT     0x03
+#define T_REJECT     0x04
+#define T_PS_RDY     0x06
+#define T_WAIT       0x0C
+#define T_SOFT_RESET 0x0D
+#define T_SRC_CAP    0x01
+#define T_REQUEST    0x02
+
+enum {
+    EXPECT_NONE = 0,
+    EXPECT_REQUEST,  // after Source_Capabilities
+    EXPECT_ACCEPT,   // after Request
+    EXPECT_PS_RDY,   // after Accept
+};
+
+#define COUNT(a, field)                 \
+    do {                                \
+        if ((a)->counting) (a)->sum.field++; \
+    } while (0)
+
+void pdsum_init(pdsum_analyzer_t *a) {
+    memset(a, 0, sizeof(*a));
+    a->counting = 1;
+}
+
+/* Fill contract voltage/current from the RDO and the capabilities it refers to */
+static void resolve_contract(pdsum_t *s, const uint32_t *pdo, uint8_t num_pdo) {
+    uint32_t rdo = s->contract_rdo;
+    uint8_t pos = (uint8_t)((rdo >> 28) & 0x0F);
+
+    s->contract_pos = pos;
+    s->contract_pps = 0;
+    s->contract_mv = 0;
+    s->contract_ma = ((rdo >> 10) & 0x3FF) * 10;
+    s->contract_resolved = num_pdo != 0;
+    if (pos == 0 || pos > num_pdo) return;
+
+    uint32_t p = pdo[pos - 1];
+    if ((p >> 30) == 0) {
+        /* Fixed: voltage from the PDO, operating current from the RDO */
+        s->contract_mv = ((p >> 10) & 0x3FF) * 50;
+    } else if ((p >> 28) == 0x0C) {
+        /* SPR PPS: output voltage 20mV, operating current 50mA */
+        s->contract_mv = ((rdo >> 9) & 0xFFF) * 20;
+        s->contract_ma = (rdo & 0x7F) * 50;
+        s->contract_pps = 1;
+    }
+}
+
+static void check_late(pdsum_analyzer_t *a, uint32_t ts, uint32_t limit_ms, int ps_rdy) {
+    if (ts - a->step_ts <= limit_ms) return;
+    if (ps_rdy) COUNT(a, late_ps_rdy);
+    else COUNT(a, late_response);
+}
+
+void pdsum_add(pdsum_analyzer_t *a, const pdd_message_t *msg) {
+    COUNT(a, messages);
+
+    if (msg->flags & PDD_MSG_RX_RESET) {
+        COUNT(a, hard_resets);
+        a->ack_pending = 0;
+        a->last_unacked = 0;
+        a->expect = EXPECT_NONE;
+        return;
+    }
+    if (msg->frame_len < 2) return;
+    if (!strncmp(msg->type_name, "Unknown", 7)) COUNT(a, unknown);
+
+    int is_ctrl = !msg->extended && msg->num_do == 0;
+    int is_data = !msg->extended && msg->num_do != 0;
+
+    /* GoodCRC bookkeeping: every other message must be acked by the next frame */
+    if (is_ctrl && msg->msg_type == T_GOODCRC) {
+        if (a->ack_pending && msg->sop == a->ack_sop && msg->msg_id == a->ack_id &&
+            (msg->sop != PD_SOP0 || msg->power_role != a->ack_role)) {
+            a->last_unacked = 0;
+        }
+        a->ack_pending = 0;
+        return;
+    }
+    if (a->ack_pending) {
+        COUNT(a, missing_goodcrc);
+        a->last_unacked = 1;
+    }
+    if (a->last_unacked && msg->header == a->last_header) {
+        COUNT(a, retries);
+        a->ack_pending = 1;
+        return; /* the retransmission does not restart protocol timers */
+    }
+    a->ack_pending = 1;
+    a->ack_sop = msg->sop;
+    a->ack_role = msg->power_role;
+    a->ack_id = msg->msg_id;
+    a->last_header = msg->header;
+    a->last_unacked = 0;
+
+    if (msg->sop != PD_SOP0) return;
+
+    if (is_data && msg->msg_type == T_SRC_CAP) {
+        a->num_pdo = msg->num_do;
+        memcpy(a->pdo, msg->data_objects, sizeof(a->pdo));
+        /* Kept even while warming up: they are in effect for the rest of this part */
+        a->sum.num_caps = a->num_pdo;
+        memcpy(a->sum.caps, a->pdo, sizeof(a->sum.caps));
+        a->expect = EXPECT_REQUEST;
+        a->step_ts = msg->timestamp_ms;
+    } else if (is_data && msg->msg_type == T_REQUEST) {
+        if (a->expect == EXPECT_REQUEST) check_late(a, msg->timestamp_ms, PDSUM_T_SENDER_RESPONSE_MS, 0);
+        a->rdo = msg->data_objects[0];
+        a->expect = EXPECT_ACCEPT;
+        a->step_ts = msg->timestamp_ms;
+    } else if (is_ctrl && msg->msg_type == T_ACCEPT && a->expect == EXPECT_ACCEPT) {
+        check_late(a, msg->timestamp_ms, PDSUM_T_SENDER_RESPONSE_MS, 0);
+        a->expect = EXPECT_PS_RDY;
+        a->step_ts = msg->timestamp_ms;
+    } else if (is_ctrl && (msg->msg_type == T_REJECT || msg->msg_type == T_WAIT) && a->expect == EXPECT_ACCEPT) {
+        check_late(a, msg->timestamp_ms, PDSUM_T_SENDER_RESPONSE_MS, 0);
+        COUNT(a, rejects);
+        a->expect = EXPECT_NONE;
+    } else if (is_ctrl && msg->msg_type == T_PS_RDY && a->expect == EXPECT_PS_RDY) {
+        check_late(a, msg->timestamp_ms, PDSUM_T_PS_TRANSITION_MS, 1);
+        COUNT(a, contracts);
+        if (a->counting) {
+            a->sum.contract_rdo = a->rdo;
+            resolve_contract(&a->sum, a->pdo, a->num_pdo);
+        }
+        a->expect = EXPECT_NONE;
+    } else if (is_ctrl && msg->msg_type == T_SOFT_RESET) {
+        COUNT(a, soft_resets);
+        a->expect = EXPECT_NONE;
+    }
+}
+
+static void on_message(void *user, const pdd_message_t *msg) {
+    pdsum_add(user, msg);
+}
+
+static void on_notice(void *user, const char *line, size_t len) {
+    (void)line;
+    (void)len;
+    pdsum_analyzer_t *a = user;
+    COUNT(a, notices);
+}
+
+static void on_error(void *user, pdd_error_t err, uint64_t offset) {
+    (void)err;
+    (void)offset;
+    pdsum_analyzer_t *a = user;
+    COUNT(a, decode_errors);
+}
+
+void pdsum_callbacks(pdd_callbacks_t *cb) {
+    cb->on_message = on_message;
+    cb->on_notice = on_notice;
+    cb->on_error = on_error;
+}
+
+void pdsum_merge(pdsum_t *dst, const pdsum_t *src) {
+    dst->messages += src->messages;
+    dst->notices += src->notices;
+    dst->decode_errors += src->decode_errors;
+    dst->unknown += src->unknown;
+    dst->hard_resets += src->hard_resets;
+    dst->soft_resets += src->soft_resets;
+    dst->contracts += src->contracts;
+    dst->rejects += src->rejects;
+    dst->missing_goodcrc += src->missing_goodcrc;
+    dst->retries += src->retries;
+    dst->late_response += src->late_response;
+    dst->late_ps_rdy += src->late_ps_rdy;
+    if (src->contracts) {
+        dst->contract_rdo = src->contract_rdo;
+        dst->contract_mv = src->contract_mv;
+        dst->contract_ma = src->contract_ma;
+        dst->contract_pos = src->contract_pos;
+        dst->contract_pps = src->contract_pps;
+        dst->contract_resolved = src->contract_resolved;
+        if (!dst->contract_resolved && dst->num_caps) resolve_contract(dst, dst->caps, dst->num_caps);
+    }
+    if (src->num_caps) {
+        dst->num_caps = src->num_caps;
+        memcpy(dst->caps, src->caps, sizeof(dst->caps));
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+ * pdsum - per-capture summary: negotiated contract, protocol timing
+ * violations, resets and error counters, plus a threaded batch runner.
+ *
+ * Summaries are plain counters, so partial results for consecutive parts
+ * of a capture merge with pdsum_merge() in capture order. The batch runner
+ * splits indexed captures at fixed block boundaries (independent of the
+ * thread count), so its output does not depend on -j.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pdd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PDSUM_T_SENDER_RESPONSE_MS 30  // tSenderResponse max
+#define PDSUM_T_PS_TRANSITION_MS   550 // tPSTransition max
+#define PDSUM_SPLIT_BLOCKS         64  // pdcap blocks per work item
+
+typedef struct {
+    uint64_t messages;
+    uint64_t notices;
+    uint64_t decode_errors;     // bad records / lines reported by libpdd
+    uint64_t unknown;           // message types not in the tables
+    uint64_t hard_resets;       // RX_RESET
+    uint64_t soft_resets;
+    uint64_t contracts;         // Accept followed by PS_RDY
+    uint64_t rejects;           // Reject / Wait answering a Request
+    uint64_t missing_goodcrc;   // message not acknowledged by the next frame
+    uint64_t retries;           // same message retransmitted after a missing GoodCRC
+    uint64_t late_response;     // Source_Capabilities->Request or Request->Accept over tSenderResponse
+    uint64_t late_ps_rdy;       // Accept->PS_RDY over tPSTransition
+    uint32_t contract_mv;       // last negotiated contract (valid if contracts)
+    uint32_t contract_ma;
+    uint32_t contract_rdo;
+    uint8_t contract_pos;       // object position
+    uint8_t contract_pps;       // 1 if the contract is a PPS APDO
+    uint8_t contract_resolved;  // 0: capabilities not seen yet, resolved by pdsum_merge()
+    uint8_t num_caps;           // last Source_Capabilities in effect at the end (0: none seen)
+    uint32_t caps[7];
+} pdsum_t;
+
+/* Streaming analyzer; state carries across pdsum_add() calls */
+typedef struct {
+    pdsum_t sum;
+    int counting;           // 0: update state only (warm-up before a split point)
+    uint8_t ack_pending;    // last message still waiting for its GoodCRC
+    uint8_t ack_sop;
+    uint8_t ack_role;
+    uint8_t ack_id;
+    uint16_t last_header;   // last non-GoodCRC header and whether it went unacknowledged
+    uint8_t last_unacked;
+    uint8_t num_pdo;
+    uint32_t pdo[7];
+    uint32_t rdo;
+    uint8_t expect;         // next expected step of the negotiation
+    uint32_t step_ts;       // timestamp of the message that started the step
+} pdsum_analyzer_t;
+
+void pdsum_init(pdsum_analyzer_t *a);
+void pdsum_add(pdsum_analyzer_t *a, const pdd_message_t *msg);
+/* libpdd callbacks feeding the analyzer passed as user */
+void pdsum_callbacks(pdd_callbacks_t *cb);
+
+/* dst = dst followed by src */
+void pdsum_merge(pdsum_t *dst, const pdsum_t *src);
+
+/* ---- batch ---- */
+
+typedef struct {
+    const char *path;   // input: indexed capture (.pdcap) or raw device stream
+    pdsum_t sum;        // output
+    int error;          // output: errno if the file could not be read
+} pdsum_file_t;
+
+/* Summarize files on threads workers (0: one per online CPU); -1 on allocation failure */
+int pdsum_batch(pdsum_file_t *files, size_t n, unsigned threads);
+
+#ifdef __cplusplus
+}
+#endif
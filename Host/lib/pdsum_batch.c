@@ -0,0 +1,166 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pdcap.h"
+#include "pdsum.h"
+
+/* One unit of work: a block range of an indexed capture, or a whole raw stream */
+typedef struct {
+    size_t file;
+    const pdcap_reader_t *r; // NULL: raw stream
+    size_t first_block;
+    size_t end_block;
+    pdsum_t sum;
+    int error;
+} work_item_t;
+
+typedef struct {
+    work_item_t *items;
+    size_t n_items;
+    const pdsum_file_t *files;
+    atomic_size_t next;
+} batch_t;
+
+static void run_capture(work_item_t *it) {
+    pdsum_analyzer_t a;
+    pdd_callbacks_t cb;
+    pdsum_init(&a);
+    pdsum_callbacks(&cb);
+
+    /* Warm the protocol state with the preceding block so pairs across the split are measured */
+    if (it->first_block > 0) {
+        a.counting = 0;
+        pdcap_read_block(it->r, it->first_block - 1, &cb, &a);
+        a.counting = 1;
+    }
+    for (size_t i = it->first_block; i < it->end_block; i++) {
+        pdcap_read_block(it->r, i, &cb, &a);
+    }
+    it->sum = a.sum;
+}
+
+static void run_raw(work_item_t *it, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        it->error = errno;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        it->error = errno;
+        close(fd);
+        return;
+    }
+
+    pdsum_analyzer_t a;
+    pdd_callbacks_t cb;
+    pdd_decoder_t dec;
+    pdsum_init(&a);
+    pdsum_callbacks(&cb);
+    pdd_init(&dec, PDD_MODE_AUTO, &cb, &a);
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            it->error = errno;
+            close(fd);
+            return;
+        }
+        pdd_feed(&dec, map, (size_t)st.st_size);
+        munmap(map, (size_t)st.st_size);
+    }
+    close(fd);
+    it->sum = a.sum;
+}
+
+static void *worker(void *arg) {
+    batch_t *b = arg;
+    for (;;) {
+        size_t i = atomic_fetch_add(&b->next, 1);
+        if (i >= b->n_items) break;
+        work_item_t *it = &b->items[i];
+        if (it->error) continue;
+        if (it->r) run_capture(it);
+        else run_raw(it, b->files[it->file].path);
+    }
+    return NULL;
+}
+
+int pdsum_batch(pdsum_file_t *files, size_t n, unsigned threads) {
+    pdcap_reader_t **readers = calloc(n ? n : 1, sizeof(*readers));
+    size_t cap = n ? n : 1, n_items = 0;
+    work_item_t *items = malloc(cap * sizeof(*items));
+    int rc = -1;
+    if (!readers || !items) goto out;
+
+    /* Split indexed captures at fixed block boundaries so results do not depend on the thread count */
+    for (size_t f = 0; f < n; f++) {
+        memset(&files[f].sum, 0, sizeof(files[f].sum));
+        files[f].error = 0;
+        readers[f] = pdcap_open(files[f].path);
+        int err = readers[f] ? 0 : errno;
+        size_t blocks = readers[f] ? pdcap_block_count(readers[f]) : 0;
+        size_t parts = blocks ? (blocks + PDSUM_SPLIT_BLOCKS - 1) / PDSUM_SPLIT_BLOCKS : 1;
+
+        if (n_items + parts > cap) {
+            while (n_items + parts > cap) cap *= 2;
+            work_item_t *grown = realloc(items, cap * sizeof(*items));
+            if (!grown) goto out;
+            items = grown;
+        }
+        for (size_t p = 0; p < parts; p++) {
+            work_item_t *it = &items[n_items++];
+            memset(it, 0, sizeof(*it));
+            it->file = f;
+            it->r = readers[f];
+            it->first_block = p * PDSUM_SPLIT_BLOCKS;
+            it->end_block = it->first_block + PDSUM_SPLIT_BLOCKS < blocks ? it->first_block + PDSUM_SPLIT_BLOCKS : blocks;
+            it->error = (err && err != EINVAL) ? err : 0; /* EINVAL: not a capture, read as raw stream */
+        }
+    }
+
+    if (!threads) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = ncpu > 0 ? (unsigned)ncpu : 1;
+    }
+    if (threads > n_items) threads = n_items ? (unsigned)n_items : 1;
+
+    batch_t b = {.items = items, .n_items = n_items, .files = files};
+    atomic_init(&b.next, 0);
+    if (threads == 1) {
+        worker(&b);
+    } else {
+        pthread_t *tids = malloc(threads * sizeof(*tids));
+        unsigned started = 0;
+        if (tids) {
+            for (; started < threads; started++) {
+                if (pthread_create(&tids[started], NULL, worker, &b)) break;
+            }
+        }
+        if (!started) worker(&b); /* could not start threads: do the work here */
+        for (unsigned t = 0; t < started; t++) pthread_join(tids[t], NULL);
+        free(tids);
+    }
+
+    /* Deterministic merge: items in capture order */
+    for (size_t i = 0; i < n_items; i++) {
+        pdsum_file_t *f = &files[items[i].file];
+        if (items[i].error && !f->error) f->error = items[i].error;
+        pdsum_merge(&f->sum, &items[i].sum);
+    }
+    rc = 0;
+
+out:
+    if (readers) {
+        for (size_t f = 0; f < n; f++) pdcap_close(readers[f]);
+    }
+    free(readers);
+    free(items);
+    return rc;
+}
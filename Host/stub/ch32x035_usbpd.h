@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * Host stand-in for the USBPD registers, enough to build usb_pd_tx.c
+ * into pdtxtest. The bit values are the device's; the registers are a
+ * plain struct the test can inspect.
+ */
+#include <stdint.h>
+
+typedef struct {
+    volatile uint16_t CONFIG;
+    volatile uint16_t BMC_CLK_CNT;
+    volatile uint8_t CONTROL;
+    volatile uint8_t TX_SEL;
+    volatile uint16_t BMC_TX_SZ;
+    volatile uint8_t DATA_BUF;
+    volatile uint8_t STATUS;
+    volatile uint16_t BMC_BYTE_CNT;
+    volatile uint16_t PORT_CC1;
+    volatile uint16_t PORT_CC2;
+    volatile uintptr_t DMA; /* uint32_t on the device; wide enough for a host pointer here */
+} USBPD_TypeDef;
+
+extern USBPD_TypeDef pd_stub_usbpd;
+#define USBPD (&pd_stub_usbpd)
+
+#define CC_SEL          (1 << 2)
+#define IE_TX_END       (1 << 15)
+#define PD_TX_EN        (1 << 0)
+#define BMC_START       (1 << 1)
+#define BMC_AUX_INVALID (0 << 0)
+#define CC_LVE          (1 << 4)
+#define UPD_TMR_TX_48M  (80 - 1)
+
+/* TX_SEL values are only compared by the test */
+#define UPD_SOP0        0x01
+#define UPD_SOP1        0x02
+#define UPD_SOP2        0x03
+#define UPD_HARD_RESET  0x10
+#define UPD_CABLE_RESET 0x11
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Host stand-in: pdtxtest is single-threaded */
+static inline uint32_t irq_save(void) {
+    return 0;
+}
+
+static inline void irq_restore(uint32_t irq) {
+    (void)irq;
+}
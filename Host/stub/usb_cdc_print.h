@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* Host stand-in; pdtxtest provides the functions */
+bool cdc_acm_is_configured(void);
+void cdc_acm_printf(char *format, ...);
@@ -0,0 +1,300 @@
+/*
+ * pdbench - decoder throughput on a synthetic capture.
+ *
+ *   pdbench [-n messages] [-c chunk_bytes] [-s seed] [-o capture.pdcap] [-B files] [-j max_threads]
+ *
+ * Builds the same capture as device text output, binary records and a
+ * mixed stream, then decodes each one fed in chunk_bytes pieces (default
+ * 64, one USB FS packet) and reports MB/s and messages/s. Then writes the
+ * messages to an indexed capture (pdcap.h) and times random seeks, and
+ * runs the batch analyzer (pdsum.h) on it and on a synthetic corpus of
+ * -B files with 1, 2, 4 ... max_threads workers (default: online CPUs).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pdcap.h"
+#include "pdd.h"
+#include "pdd_synth.h"
+#include "pdsum.h"
+
+typedef struct {
+    uint64_t count;
+    uint64_t checksum;
+} bench_sink_t;
+
+static void on_message(void *user, const pdd_message_t *msg) {
+    bench_sink_t *sink = user;
+    sink->count++;
+    sink->checksum += ((uint64_t)msg->seq << 16) ^ msg->header ^ msg->data_objects[0];
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} buf_t;
+
+static void buf_put(buf_t *b, const void *p, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap = (b->cap + n) * 2;
+        b->data = realloc(b->data, b->cap);
+        if (!b->data) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void run(const char *name, pdd_mode_t mode, const buf_t *b, size_t chunk, uint64_t expect,
+                uint64_t expect_sum) {
+    pdd_callbacks_t cb = {.on_message = on_message};
+    double best = 1e30;
+    bench_sink_t sink = {0};
+
+    for (int rep = 0; rep < 3; rep++) {
+        pdd_decoder_t dec;
+        memset(&sink, 0, sizeof(sink));
+        pdd_init(&dec, mode, &cb, &sink);
+        double t0 = now_s();
+        for (size_t off = 0; off < b->len; off += chunk) {
+            size_t n = b->len - off < chunk ? b->len - off : chunk;
+            pdd_feed(&dec, b->data + off, n);
+        }
+        double dt = now_s() - t0;
+        if (dt < best) best = dt;
+    }
+
+    printf("%-7s %9.1f MB %10llu msgs %9.1f MB/s %8.2f Mmsg/s %s\n", name, (double)b->len / 1e6,
+           (unsigned long long)sink.count, (double)b->len / 1e6 / best, (double)sink.count / 1e6 / best,
+           (sink.count == expect && sink.checksum == expect_sum) ? "ok" : "MISMATCH");
+}
+
+static void bench_capture(const char *path, uint64_t n, uint64_t seed) {
+    pdd_synth_t synth;
+    pdd_message_t msg;
+    uint64_t resets = 0;
+
+    pdcap_writer_t *w = pdcap_writer_open(path, 0);
+    if (!w) {
+        perror(path);
+        exit(1);
+    }
+    pdd_synth_init(&synth, seed);
+    double t0 = now_s();
+    for (uint64_t i = 0; i < n; i++) {
+        pdd_synth_next(&synth, &msg);
+        resets += (msg.flags & PDD_MSG_RX_RESET) != 0;
+        if (pdcap_writer_add(w, &msg)) {
+            perror(path);
+            exit(1);
+        }
+    }
+    uint64_t bytes = pdcap_writer_bytes(w);
+    if (pdcap_writer_close(w)) {
+        perror(path);
+        exit(1);
+    }
+    double dt = now_s() - t0;
+    printf("capture %9.1f MB %10llu msgs %9.1f MB/s %8.2f Mmsg/s write\n", (double)bytes / 1e6,
+           (unsigned long long)n, (double)bytes / 1e6 / dt, (double)n / 1e6 / dt);
+
+    pdcap_reader_t *r = pdcap_open(path);
+    if (!r) {
+        perror(path);
+        exit(1);
+    }
+    size_t blocks = pdcap_block_count(r);
+    uint64_t span = blocks ? pdcap_block(r, blocks - 1)->last_ms : 0;
+    const int seeks = 1000;
+    int found = 0;
+    uint64_t rng = seed | 1;
+    t0 = now_s();
+    for (int i = 0; i < seeks; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        uint64_t ms;
+        found += pdcap_find(r, span ? rng % span : 0, PDCAP_KEY_CTRL(0x06), 1, &msg, &ms); /* next PS_RDY */
+    }
+    dt = now_s() - t0;
+    uint64_t ms;
+    int last_reset = resets ? pdcap_find(r, 0, PDCAP_KEY_RESET, resets, &msg, &ms) : 1;
+    printf("seek    %zu blocks, %d/%d found, %.1f us/find, reset index %s\n", blocks, found, seeks,
+           dt * 1e6 / seeks, last_reset ? "ok" : "MISMATCH");
+    pdcap_close(r);
+}
+
+static void write_synthetic(const char *path, uint64_t n, uint64_t seed) {
+    pdd_synth_t synth;
+    pdd_message_t msg;
+    pdcap_writer_t *w = pdcap_writer_open(path, 0);
+    if (!w) {
+        perror(path);
+        exit(1);
+    }
+    pdd_synth_init(&synth, seed);
+    for (uint64_t i = 0; i < n; i++) {
+        pdd_synth_next(&synth, &msg);
+        if (pdcap_writer_add(w, &msg)) {
+            perror(path);
+            exit(1);
+        }
+    }
+    if (pdcap_writer_close(w)) {
+        perror(path);
+        exit(1);
+    }
+}
+
+/* Run the batch analyzer with 1, 2, 4 ... max_threads workers; totals must not change */
+static void bench_batch(const char *name, pdsum_file_t *files, size_t n, unsigned max_threads) {
+    pdsum_t ref;
+    double t1 = 0;
+
+    for (unsigned t = 1;; t = t * 2 > max_threads && t < max_threads ? max_threads : t * 2) {
+        double t0 = now_s();
+        if (pdsum_batch(files, n, t)) {
+            perror("pdsum_batch");
+            exit(1);
+        }
+        double dt = now_s() - t0;
+
+        pdsum_t total;
+        memset(&total, 0, sizeof(total));
+        for (size_t i = 0; i < n; i++) pdsum_merge(&total, &files[i].sum);
+        if (t == 1) {
+            ref = total;
+            t1 = dt;
+        }
+        printf("%-7s %2u thr %10llu msgs %9.1f ms %8.2f Mmsg/s %5.2fx %s\n", name, t,
+               (unsigned long long)total.messages, dt * 1e3, (double)total.messages / 1e6 / dt, t1 / dt,
+               memcmp(&total, &ref, sizeof(total)) ? "MISMATCH" : "ok");
+        if (t >= max_threads) break;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint64_t n = 2000000;
+    size_t chunk = 64;
+    uint64_t seed = 1;
+    const char *capture = NULL;
+    size_t corpus = 0;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned max_threads = ncpu > 0 ? (unsigned)ncpu : 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:s:o:B:j:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            chunk = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            capture = optarg;
+            break;
+        case 'B':
+            corpus = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            max_threads = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-n messages] [-c chunk_bytes] [-s seed] [-o capture.pdcap] [-B files] [-j max_threads]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (chunk == 0) chunk = 64;
+    if (max_threads == 0) max_threads = 1;
+
+    buf_t text = {0}, bin = {0}, mixed = {0};
+    pdd_synth_t synth;
+    pdd_synth_init(&synth, seed);
+    bench_sink_t ref = {0};
+
+    for (uint64_t i = 0; i < n; i++) {
+        pdd_message_t msg;
+        char line[512];
+        uint8_t rec[300];
+        pdd_synth_next(&synth, &msg);
+        on_message(&ref, &msg);
+
+        size_t tl = pdd_format_text(&msg, line, sizeof(line));
+        size_t bl = pdd_encode_binary(&msg, rec, sizeof(rec));
+        buf_put(&text, line, tl);
+        buf_put(&bin, rec, bl);
+        if (i & 1) buf_put(&mixed, rec, bl);
+        else buf_put(&mixed, line, tl);
+        if (i % 1000 == 0) {
+            static const char notice[] = "> \037123ms \037Attach:CC1, CC1:066mV, CC2:220mV, VBUS:05012mV\n";
+            buf_put(&text, notice, sizeof(notice) - 1);
+            buf_put(&mixed, notice, sizeof(notice) - 1);
+        }
+    }
+
+    printf("%llu messages, chunk %zu bytes\n", (unsigned long long)n, chunk);
+    run("text", PDD_MODE_TEXT, &text, chunk, ref.count, ref.checksum);
+    run("binary", PDD_MODE_BINARY, &bin, chunk, ref.count, ref.checksum);
+    run("mixed", PDD_MODE_AUTO, &mixed, chunk, ref.count, ref.checksum);
+
+    free(text.data);
+    free(bin.data);
+    free(mixed.data);
+
+    char tmp[] = "/tmp/pdbench-XXXXXX";
+    if (!capture) {
+        int fd = mkstemp(tmp);
+        if (fd < 0) {
+            perror("mkstemp");
+            return 1;
+        }
+        close(fd);
+    }
+    bench_capture(capture ? capture : tmp, n, seed);
+    pdsum_file_t one = {.path = capture ? capture : tmp};
+    bench_batch("split", &one, 1, max_threads);
+    if (!capture) unlink(tmp);
+
+    if (corpus) {
+        char dir[] = "/tmp/pdbench-corpus-XXXXXX";
+        if (!mkdtemp(dir)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        pdsum_file_t *files = calloc(corpus, sizeof(*files));
+        char (*paths)[64] = calloc(corpus, sizeof(*paths));
+        if (!files || !paths) {
+            perror("calloc");
+            return 1;
+        }
+        for (size_t i = 0; i < corpus; i++) {
+            snprintf(paths[i], sizeof(paths[i]), "%s/%05zu.pdcap", dir, i);
+            write_synthetic(paths[i], n / corpus + 1, seed + i + 1);
+            files[i].path = paths[i];
+        }
+        bench_batch("corpus", files, corpus, max_threads);
+        for (size_t i = 0; i < corpus; i++) unlink(paths[i]);
+        rmdir(dir);
+        free(paths);
+        free(files);
+    }
+    return 0;
+}
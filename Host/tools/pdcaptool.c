@@ -0,0 +1,237 @@
+/*
+ * pdcaptool - record, inspect and search indexed captures (pdcap.h).
+ *
+ *   pdcaptool record <input|-> <out.pdcap>    input: raw device stream (file, tty or stdin)
+ *   pdcaptool info   <file.pdcap>
+ *   pdcaptool dump   <file.pdcap> [-a time] [-c count]
+ *   pdcaptool find   <file.pdcap> <type> [-a time] [-n nth]
+ *
+ * time is capture time: 1500 (ms), 30s, 90m or 2h.
+ * Example: the third Hard Reset after two hours:
+ *   pdcaptool find soak.pdcap RX_RESET -a 2h -n 3
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pdcap.h"
+#include "pdd.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static int parse_time(const char *s, uint64_t *ms) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    if (!strcmp(end, "") || !strcmp(end, "ms")) *ms = (uint64_t)v;
+    else if (!strcmp(end, "s")) *ms = (uint64_t)(v * 1000);
+    else if (!strcmp(end, "m")) *ms = (uint64_t)(v * 60000);
+    else if (!strcmp(end, "h")) *ms = (uint64_t)(v * 3600000);
+    else return -1;
+    return 0;
+}
+
+static void print_time(uint64_t ms) {
+    printf("%llu:%02llu:%02llu.%03llu", (unsigned long long)(ms / 3600000), (unsigned long long)(ms / 60000 % 60),
+           (unsigned long long)(ms / 1000 % 60), (unsigned long long)(ms % 1000));
+}
+
+static void print_message(const pdd_message_t *msg, uint64_t ms) {
+    char line[512];
+    size_t n = pdd_format_text(msg, line, sizeof(line));
+    print_time(ms);
+    printf("  %.*s", (int)n, line);
+}
+
+/* ---- record ---- */
+
+typedef struct {
+    pdcap_writer_t *w;
+    int failed;
+} record_ctx_t;
+
+static void rec_on_message(void *user, const pdd_message_t *msg) {
+    record_ctx_t *c = user;
+    if (!c->failed && pdcap_writer_add(c->w, msg)) c->failed = errno ? errno : EIO;
+}
+
+static void rec_on_notice(void *user, const char *line, size_t len) {
+    record_ctx_t *c = user;
+    if (!c->failed && pdcap_writer_add_notice(c->w, line, len)) c->failed = errno ? errno : EIO;
+}
+
+static int cmd_record(const char *in, const char *out) {
+    int fd = strcmp(in, "-") ? open(in, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        perror(in);
+        return 1;
+    }
+    record_ctx_t ctx = {0};
+    ctx.w = pdcap_writer_open(out, 0);
+    if (!ctx.w) {
+        perror(out);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal; /* no SA_RESTART: read() returns EINTR */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pdd_callbacks_t cb = {.on_message = rec_on_message, .on_notice = rec_on_notice};
+    pdd_decoder_t dec;
+    pdd_init(&dec, PDD_MODE_AUTO, &cb, &ctx);
+
+    static uint8_t buf[1 << 16];
+    while (!stop_requested && !ctx.failed) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        pdd_feed(&dec, buf, (size_t)n);
+    }
+    if (fd != STDIN_FILENO) close(fd);
+
+    const pdd_stats_t *st = pdd_stats(&dec);
+    uint64_t bytes = pdcap_writer_bytes(ctx.w);
+    if (pdcap_writer_close(ctx.w) || ctx.failed) {
+        fprintf(stderr, "%s: %s\n", out, strerror(ctx.failed ? ctx.failed : errno));
+        return 1;
+    }
+    fprintf(stderr, "%llu messages, %llu notices, %llu errors, %llu bytes written\n",
+            (unsigned long long)st->messages, (unsigned long long)st->notices, (unsigned long long)st->errors,
+            (unsigned long long)bytes);
+    return 0;
+}
+
+/* ---- info / dump / find ---- */
+
+static pdcap_reader_t *open_capture(const char *path) {
+    pdcap_reader_t *r = pdcap_open(path);
+    if (!r) perror(path);
+    else if (pdcap_recovered(r)) fprintf(stderr, "%s: no index, rebuilt from block headers\n", path);
+    return r;
+}
+
+static int cmd_info(const char *path) {
+    pdcap_reader_t *r = open_capture(path);
+    if (!r) return 1;
+
+    size_t n = pdcap_block_count(r);
+    uint64_t types[2] = {0, 0};
+    for (size_t i = 0; i < n; i++) {
+        types[0] |= pdcap_block(r, i)->types[0];
+        types[1] |= pdcap_block(r, i)->types[1];
+    }
+    printf("messages: %llu\nblocks:   %zu\n", (unsigned long long)pdcap_message_count(r), n);
+    if (n) {
+        printf("span:     ");
+        print_time(pdcap_block(r, 0)->first_ms);
+        printf(" - ");
+        print_time(pdcap_block(r, n - 1)->last_ms);
+        printf("\n");
+    }
+    printf("types:    %016llx%016llx\n", (unsigned long long)types[1], (unsigned long long)types[0]);
+    pdcap_close(r);
+    return 0;
+}
+
+typedef struct {
+    uint64_t base_ms;
+    uint64_t from_ms;
+    uint64_t remaining;
+} dump_ctx_t;
+
+static void dump_on_message(void *user, const pdd_message_t *msg) {
+    dump_ctx_t *d = user;
+    uint64_t ms = d->base_ms + msg->timestamp_ms;
+    if (!d->remaining || ms < d->from_ms) return;
+    print_message(msg, ms);
+    d->remaining--;
+}
+
+static void dump_on_notice(void *user, const char *line, size_t len) {
+    dump_ctx_t *d = user;
+    if (d->remaining) printf("%.*s\n", (int)len, line);
+}
+
+static int cmd_dump(const char *path, uint64_t from_ms, uint64_t count) {
+    pdcap_reader_t *r = open_capture(path);
+    if (!r) return 1;
+
+    pdd_callbacks_t cb = {.on_message = dump_on_message, .on_notice = dump_on_notice};
+    dump_ctx_t d = {.from_ms = from_ms, .remaining = count};
+    for (size_t i = pdcap_seek_time(r, from_ms); i < pdcap_block_count(r) && d.remaining; i++) {
+        d.base_ms = pdcap_block(r, i)->base_ms;
+        pdcap_read_block(r, i, &cb, &d);
+    }
+    pdcap_close(r);
+    return 0;
+}
+
+static int cmd_find(const char *path, const char *type, uint64_t from_ms, uint64_t nth) {
+    unsigned key = pdcap_key_from_name(type);
+    if (key == PDCAP_KEY_NONE) {
+        fprintf(stderr, "unknown message type: %s\n", type);
+        return 2;
+    }
+    pdcap_reader_t *r = open_capture(path);
+    if (!r) return 1;
+
+    pdd_message_t msg;
+    uint64_t ms;
+    int found = pdcap_find(r, from_ms, key, nth, &msg, &ms);
+    if (found) print_message(&msg, ms);
+    else fprintf(stderr, "not found\n");
+    pdcap_close(r);
+    return found ? 0 : 1;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: pdcaptool record <input|-> <out.pdcap>\n"
+                    "       pdcaptool info   <file.pdcap>\n"
+                    "       pdcaptool dump   <file.pdcap> [-a time] [-c count]\n"
+                    "       pdcaptool find   <file.pdcap> <type> [-a time] [-n nth]\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) return usage();
+    const char *cmd = argv[1];
+
+    if (!strcmp(cmd, "record")) {
+        return argc == 4 ? cmd_record(argv[2], argv[3]) : usage();
+    }
+    if (!strcmp(cmd, "info")) {
+        return cmd_info(argv[2]);
+    }
+
+    int first_opt = !strcmp(cmd, "find") ? 4 : 3;
+    if (argc < first_opt) return usage();
+    uint64_t from_ms = 0, count = UINT64_MAX, nth = 1;
+    for (int i = first_opt; i < argc; i++) {
+        if (i + 1 >= argc) return usage();
+        if (!strcmp(argv[i], "-a")) {
+            if (parse_time(argv[++i], &from_ms)) return usage();
+        } else if (!strcmp(argv[i], "-c")) {
+            count = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-n")) {
+            nth = strtoull(argv[++i], NULL, 0);
+        } else {
+            return usage();
+        }
+    }
+
+    if (!strcmp(cmd, "dump")) return cmd_dump(argv[2], from_ms, count);
+    if (!strcmp(cmd, "find")) return cmd_find(argv[2], argv[3], from_ms, nth);
+    return usage();
+}
@@ -0,0 +1,253 @@
+/*
+ * pdcctrace - replay CC traces through the firmware attach / detach classifier.
+ *
+ *   pdcctrace [-v] [trace ...]
+ *   pdcctrace -x
+ *
+ * A trace has one poll per line: either the device's DTR debug line
+ * ("COND:.., CC1:066mV(..), CC2:220mV(..), VBUS:05012mV, ..") or three
+ * numbers "cc1 cc2 vbus_mV", with CC levels as the device prints them
+ * (0, 22, 45, 55, 66, 95, 123, 220). Blank lines and '#' comments are
+ * skipped; no file or "-" reads stdin. Prints each event, -v every poll.
+ *
+ * -x checks every (CC1, CC2, VBUS) input class from every confirmed state:
+ * held long enough, the classifier must settle on pd_cc_pair(), and a
+ * single differing poll must not detach. Also runs cable / accessory
+ * sequences. Exits 0 if all pass, 1 otherwise.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "usb_pd_cc_fsm.h"
+
+static int s_verbose;
+
+/* Level of one "CCn:" / "VBUS:" field; -1 if absent */
+static long field(const char *line, const char *key) {
+    const char *p = strstr(line, key);
+    if (!p) return -1;
+    char *end;
+    long v = strtol(p + strlen(key), &end, 10);
+    return end == p + strlen(key) ? -1 : v;
+}
+
+/* 1: one poll parsed, 0: line skipped */
+static int parse_poll(const char *line, unsigned *cc1, unsigned *cc2, unsigned *vbus) {
+    while (*line == ' ' || *line == '\t') line++;
+    if (!*line || *line == '\n' || *line == '#') return 0;
+    if (strstr(line, "COND:")) {
+        long a = field(line, "CC1:"), b = field(line, "CC2:"), v = field(line, "VBUS:");
+        if (a < 0 || b < 0 || v < 0) return 0;
+        *cc1 = (unsigned)a;
+        *cc2 = (unsigned)b;
+        *vbus = (unsigned)v;
+        return 1;
+    }
+    return sscanf(line, "%u %u %u", cc1, cc2, vbus) == 3;
+}
+
+static void print_events(unsigned n, uint8_t events, uint8_t before, const pd_cc_fsm_t *fsm) {
+    if (events & PD_CC_EVT_DETACH) printf("%6u  detach %s\n", n, pd_cc_conn_name(before));
+    if (events & PD_CC_EVT_ATTACH) {
+        if (fsm->conn == PD_CC_CONN_CC1 || fsm->conn == PD_CC_CONN_CC2)
+            printf("%6u  attach %s, Rp %s\n", n, pd_cc_conn_name(fsm->conn), pd_cc_adv_name(fsm->rp));
+        else
+            printf("%6u  attach %s\n", n, pd_cc_conn_name(fsm->conn));
+    }
+    if (events & PD_CC_EVT_RP_CHANGE) printf("%6u  Rp %s\n", n, pd_cc_adv_name(fsm->rp));
+}
+
+static int replay(FILE *f, const char *name) {
+    pd_cc_fsm_t fsm;
+    char line[256];
+    unsigned n = 0, lineno = 0;
+
+    pd_cc_fsm_init(&fsm);
+    while (fgets(line, sizeof(line), f)) {
+        unsigned cc1, cc2, vbus;
+        lineno++;
+        if (!parse_poll(line, &cc1, &cc2, &vbus)) continue;
+
+        pd_cc_adv_t a = pd_cc_classify((uint16_t)cc1, (uint16_t)cc2), b = pd_cc_classify((uint16_t)cc2, (uint16_t)cc1);
+        uint8_t before = fsm.conn;
+        uint8_t events = pd_cc_fsm_step(&fsm, a, b, vbus >= PD_CC_VBUS_ON_MV);
+        if (s_verbose)
+            printf("%6u  %-7s %-7s %5umV  -> %s\n", n, pd_cc_adv_name(a), pd_cc_adv_name(b), vbus,
+                   pd_cc_state_name(fsm.state));
+        print_events(n, events, before, &fsm);
+        n++;
+    }
+    printf("%s: %u polls, %s %s\n", name, n, pd_cc_state_name(fsm.state), pd_cc_conn_name(fsm.conn));
+    return 0;
+}
+
+/* --- -x ------------------------------------------------------------------ */
+
+static unsigned s_fail;
+
+static void check(int ok, const char *what, unsigned a, unsigned b, unsigned v, unsigned from) {
+    if (ok) return;
+    s_fail++;
+    printf("FAIL %s: %s/%s VBUS %s from %s\n", what, pd_cc_adv_name((uint8_t)a), pd_cc_adv_name((uint8_t)b),
+           v ? "on" : "off", pd_cc_conn_name((uint8_t)from));
+}
+
+/* A line pair that names conn, used to bring the FSM into ATTACHED */
+static void pair_for(uint8_t conn, pd_cc_adv_t *a, pd_cc_adv_t *b) {
+    static const pd_cc_adv_t pairs[][2] = {
+        {PD_CC_ADV_OPEN, PD_CC_ADV_OPEN},
+        {PD_CC_ADV_RP_3A0, PD_CC_ADV_OPEN},
+        {PD_CC_ADV_OPEN, PD_CC_ADV_RP_1A5},
+        {PD_CC_ADV_RP_DEFAULT, PD_CC_ADV_RP_DEFAULT},
+    };
+    *a = pairs[conn][0];
+    *b = pairs[conn][1];
+}
+
+static void hold(pd_cc_fsm_t *fsm, pd_cc_adv_t a, pd_cc_adv_t b, int vbus, unsigned n) {
+    while (n--) pd_cc_fsm_step(fsm, a, b, vbus);
+}
+
+/* One poll from comparator levels (Ra line, Rd line), Rd on CC2 unless flip */
+static uint8_t step_levels(pd_cc_fsm_t *fsm, uint16_t ra, uint16_t rd, unsigned flip) {
+    uint16_t cc1 = flip ? rd : ra, cc2 = flip ? ra : rd;
+    return pd_cc_fsm_step(fsm, pd_cc_classify(cc1, cc2), pd_cc_classify(cc2, cc1), 1);
+}
+
+static void exhaustive(void) {
+    const unsigned settle = (PD_CC_ATTACH_CONFIRM > PD_CC_DETACH_CONFIRM ? PD_CC_ATTACH_CONFIRM : PD_CC_DETACH_CONFIRM) * 2;
+
+    for (unsigned from = PD_CC_CONN_NONE; from <= PD_CC_CONN_DEBUG; from++) {
+        for (unsigned a = 0; a < PD_CC_ADV_COUNT; a++) {
+            for (unsigned b = 0; b < PD_CC_ADV_COUNT; b++) {
+                for (unsigned v = 0; v <= 1; v++) {
+                    pd_cc_fsm_t fsm;
+                    pd_cc_adv_t fa, fb;
+                    pd_cc_fsm_init(&fsm);
+                    pair_for((uint8_t)from, &fa, &fb);
+                    hold(&fsm, fa, fb, 1, settle);
+                    check(fsm.conn == from, "setup", fa, fb, 1, from);
+
+                    /* One differing poll: never a detach (VBUS loss excepted), a new attach or an Rp change */
+                    pd_cc_fsm_t glitch = fsm;
+                    uint8_t ev = pd_cc_fsm_step(&glitch, (pd_cc_adv_t)a, (pd_cc_adv_t)b, v);
+                    uint8_t want = v ? pd_cc_pair((pd_cc_adv_t)a, (pd_cc_adv_t)b) : PD_CC_CONN_NONE;
+                    if (v && from != PD_CC_CONN_NONE) check(!(ev & PD_CC_EVT_DETACH), "glitch detach", a, b, v, from);
+                    if (PD_CC_ATTACH_CONFIRM > 1) check(!(ev & PD_CC_EVT_RP_CHANGE), "glitch Rp", a, b, v, from);
+                    if (want != from && PD_CC_ATTACH_CONFIRM > 1) check(!(ev & PD_CC_EVT_ATTACH), "glitch attach", a, b, v, from);
+
+                    /* Held: settles on the pair */
+                    hold(&fsm, (pd_cc_adv_t)a, (pd_cc_adv_t)b, v, settle);
+                    check(fsm.conn == want, "settle", a, b, v, from);
+                    check(fsm.state == (want ? PD_CC_ATTACHED : PD_CC_UNATTACHED), "state", a, b, v, from);
+                }
+            }
+        }
+    }
+
+    /*
+     * E-marked cable, from comparator levels: Ra on the other line reads up
+     * to the level below the Rd range of the Rp. Rp drops to 1.5A for
+     * SinkTxNG and back, on either orientation.
+     */
+    static const uint16_t ra_levels[] = {0, 22, 45, 55, 66, 95};
+    pd_cc_fsm_t fsm;
+    uint8_t ev = 0;
+    for (unsigned i = 0; i < sizeof(ra_levels) / sizeof(ra_levels[0]); i++) {
+        for (unsigned flip = 0; flip <= 1; flip++) {
+            uint16_t ra = ra_levels[i];
+            uint8_t conn = flip ? PD_CC_CONN_CC1 : PD_CC_CONN_CC2;
+            pd_cc_fsm_init(&fsm);
+            ev = 0;
+            for (unsigned k = 0; k < PD_CC_ATTACH_CONFIRM; k++) ev |= step_levels(&fsm, ra, 123, flip);
+            check(fsm.conn == conn && (ev & PD_CC_EVT_ATTACH) && fsm.rp == PD_CC_ADV_RP_3A0, "e-marker attach 3.0A",
+                  pd_cc_classify(ra, 123), PD_CC_ADV_RP_3A0, 1, 0);
+            if (ra >= 66) continue; /* 1.5A Rd reads from 66 */
+            /* One poll in BMC traffic is not an Rp change */
+            ev = step_levels(&fsm, ra, 66, flip);
+            ev |= step_levels(&fsm, ra, 123, flip);
+            check(ev == 0 && fsm.rp == PD_CC_ADV_RP_3A0, "Rp glitch", pd_cc_classify(ra, 66), PD_CC_ADV_RP_1A5, 1, fsm.conn);
+            ev = 0;
+            for (unsigned k = 0; k < PD_CC_ATTACH_CONFIRM; k++) ev |= step_levels(&fsm, ra, 66, flip);
+            check(ev == PD_CC_EVT_RP_CHANGE && fsm.rp == PD_CC_ADV_RP_1A5, "SinkTxNG", pd_cc_classify(ra, 66),
+                  PD_CC_ADV_RP_1A5, 1, fsm.conn);
+            ev = 0;
+            for (unsigned k = 0; k < PD_CC_ATTACH_CONFIRM; k++) ev |= step_levels(&fsm, ra, 123, flip);
+            check(ev == PD_CC_EVT_RP_CHANGE && fsm.rp == PD_CC_ADV_RP_3A0, "SinkTxOk", pd_cc_classify(ra, 123),
+                  PD_CC_ADV_RP_3A0, 1, fsm.conn);
+        }
+    }
+    pd_cc_fsm_init(&fsm);
+    for (unsigned k = 0; k < PD_CC_ATTACH_CONFIRM; k++) step_levels(&fsm, 0, 123, 0);
+
+    /* Unplug with VBUS still up, then VBUS decays */
+    hold(&fsm, PD_CC_ADV_OPEN, PD_CC_ADV_OPEN, 1, PD_CC_DETACH_CONFIRM - 1);
+    check(fsm.conn == PD_CC_CONN_CC2, "detach early", PD_CC_ADV_OPEN, PD_CC_ADV_OPEN, 1, PD_CC_CONN_CC2);
+    ev = pd_cc_fsm_step(&fsm, PD_CC_ADV_OPEN, PD_CC_ADV_OPEN, 1);
+    check((ev & PD_CC_EVT_DETACH) && fsm.conn == PD_CC_CONN_NONE, "detach", PD_CC_ADV_OPEN, PD_CC_ADV_OPEN, 1, PD_CC_CONN_CC2);
+
+    /* Flipped plug without VBUS dropping: detach, then attach on the other line */
+    pd_cc_fsm_init(&fsm);
+    hold(&fsm, PD_CC_ADV_RP_DEFAULT, PD_CC_ADV_OPEN, 1, settle);
+    ev = 0;
+    for (unsigned i = 0; i < settle; i++) ev |= pd_cc_fsm_step(&fsm, PD_CC_ADV_OPEN, PD_CC_ADV_RP_DEFAULT, 1);
+    check((ev & (PD_CC_EVT_DETACH | PD_CC_EVT_ATTACH)) == (PD_CC_EVT_DETACH | PD_CC_EVT_ATTACH) && fsm.conn == PD_CC_CONN_CC2,
+          "flip", PD_CC_ADV_OPEN, PD_CC_ADV_RP_DEFAULT, 1, PD_CC_CONN_CC1);
+
+    /* Pair table */
+    printf("CC1\\CC2 ");
+    for (unsigned b = 0; b < PD_CC_ADV_COUNT; b++) printf(" %-8s", pd_cc_adv_name((uint8_t)b));
+    printf("\n");
+    for (unsigned a = 0; a < PD_CC_ADV_COUNT; a++) {
+        printf("%-8s", pd_cc_adv_name((uint8_t)a));
+        for (unsigned b = 0; b < PD_CC_ADV_COUNT; b++) printf(" %-8s", pd_cc_conn_name(pd_cc_pair((pd_cc_adv_t)a, (pd_cc_adv_t)b)));
+        printf("\n");
+    }
+    printf("%s (%u failures)\n", s_fail ? "FAIL" : "ok", s_fail);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-v] [trace ...]\n       %s -x\n", argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+    int exh = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vx")) != -1) {
+        switch (opt) {
+        case 'v':
+            s_verbose = 1;
+            break;
+        case 'x':
+            exh = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (exh) {
+        exhaustive();
+        return s_fail ? 1 : 0;
+    }
+
+    if (optind == argc) return replay(stdin, "stdin");
+    for (int i = optind; i < argc; i++) {
+        if (!strcmp(argv[i], "-")) {
+            replay(stdin, "stdin");
+            continue;
+        }
+        FILE *f = fopen(argv[i], "r");
+        if (!f) {
+            perror(argv[i]);
+            return 2;
+        }
+        replay(f, argv[i]);
+        fclose(f);
+    }
+    return 0;
+}
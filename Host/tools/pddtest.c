@@ -0,0 +1,189 @@
+/*
+ * pddtest - check the stream decoder (pdd.h) on device output that mixes
+ * framed command replies with text lines and binary records.
+ *
+ *   pddtest [-v]
+ *
+ * Replies (usb_pd_link.h, 0x00 ... 0x00) are written by the device between
+ * lines and records. Each stream is fed at every chunk size from 1 byte up
+ * to the whole stream; every PD message and notice must come out, the
+ * replies must be reported as link frames, and a reply with a bad CRC must
+ * be one error without losing what follows. -v prints each check.
+ * Exits 0 if all checks pass, 1 otherwise.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pdd.h"
+#include "pdd_synth.h"
+#include "usb_pd_link.h"
+#include "usb_pd_record.h"
+
+static int s_verbose;
+static unsigned s_fail;
+
+typedef struct {
+    unsigned messages;
+    unsigned notices;
+    unsigned links;
+    unsigned errors;
+    uint32_t seq_sum;  // device seq of every message
+    uint32_t link_sum; // op, seq and status of every link frame
+} tally_t;
+
+static void on_message(void *user, const pdd_message_t *msg) {
+    tally_t *t = user;
+    t->messages++;
+    t->seq_sum += msg->seq;
+}
+
+static void on_notice(void *user, const char *line, size_t len) {
+    (void)line;
+    (void)len;
+    ((tally_t *)user)->notices++;
+}
+
+static void on_error(void *user, pdd_error_t err, uint64_t offset) {
+    (void)err;
+    (void)offset;
+    ((tally_t *)user)->errors++;
+}
+
+static void on_link(void *user, uint8_t op, uint8_t seq, const uint8_t *data, size_t len) {
+    tally_t *t = user;
+    t->links++;
+    t->link_sum += (uint32_t)op * 65536u + (uint32_t)seq * 256u + (len ? data[0] : 0xFFu);
+}
+
+static void expect(int ok, const char *what) {
+    if (!ok) {
+        printf("  FAIL: %s\n", what);
+        s_fail++;
+    } else if (s_verbose) {
+        printf("  ok: %s\n", what);
+    }
+}
+
+/* --- stream builder ------------------------------------------------------------ */
+
+#define STREAM_MAX 8192
+
+typedef struct {
+    uint8_t data[STREAM_MAX];
+    size_t len;
+    tally_t want;
+} stream_t;
+
+static void put(stream_t *s, const void *p, size_t n) {
+    if (s->len + n > sizeof(s->data)) return;
+    memcpy(&s->data[s->len], p, n);
+    s->len += n;
+}
+
+static void put_message(stream_t *s, pdd_synth_t *synth, int binary) {
+    pdd_message_t msg;
+    uint8_t out[PDD_LINE_MAX];
+    pdd_synth_next(synth, &msg);
+    put(s, out, binary ? pdd_encode_binary(&msg, out, sizeof(out)) : pdd_format_text(&msg, (char *)out, sizeof(out)));
+    s->want.messages++;
+    s->want.seq_sum += msg.seq;
+}
+
+/* Reply as cdc_acm_poll() writes it; seq / status chosen to put '\n' and the record sync in the frame */
+static void put_reply(stream_t *s, uint8_t op, uint8_t seq, uint8_t status) {
+    uint8_t wire[PD_LINK_MAX_WIRE];
+    put(s, wire, pd_link_encode((uint8_t)(op | PD_LINK_OP_REPLY), seq, &status, 1, wire, sizeof(wire)));
+    s->want.links++;
+    s->want.link_sum += (uint32_t)(op | PD_LINK_OP_REPLY) * 65536u + (uint32_t)seq * 256u + status;
+}
+
+static void put_bad_reply(stream_t *s) {
+    uint8_t wire[PD_LINK_MAX_WIRE];
+    uint8_t status = PD_LINK_OK;
+    size_t n = pd_link_encode(PD_LINK_OP_CMD | PD_LINK_OP_REPLY, 7, &status, 1, wire, sizeof(wire));
+    wire[n - 2] ^= 0x01; /* last CRC byte; COBS leaves it non-zero */
+    if (!wire[n - 2]) wire[n - 2] = 0x02;
+    put(s, wire, n);
+    s->want.errors++;
+}
+
+static void put_notice(stream_t *s, int binary) {
+    static const char text[] = "# src: Accept PDO1 5000mV 3000mA";
+    if (binary) {
+        uint8_t rec[PD_RECORD_MAX_LEN];
+        put(s, rec, pd_record_encode_text(rec, text, sizeof(text) - 1));
+    } else {
+        put(s, text, sizeof(text) - 1);
+        put(s, "\n", 1);
+    }
+    s->want.notices++;
+}
+
+/* Text, binary or (mixed) alternating, with replies in between */
+static void build(stream_t *s, int mixed, int binary) {
+    pdd_synth_t synth;
+    pdd_synth_init(&synth, 42);
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; i < 24; i++) {
+        int bin = mixed ? (i & 1) : binary;
+        put_message(s, &synth, bin);
+        if (i % 3 == 0) put_reply(s, PD_LINK_OP_CMD, (uint8_t)('\n' + i), PD_LINK_OK);
+        if (i % 5 == 1) put_reply(s, PD_LINK_OP_PING, (uint8_t)i, PD_RECORD_SYNC);
+        if (i % 4 == 2) put_notice(s, bin);
+        if (i == 11) put_bad_reply(s);
+    }
+    /* Two replies back to back, then a last message */
+    put_reply(s, PD_LINK_OP_CMD, 0x00, PD_LINK_ERR_REJECTED);
+    put_reply(s, PD_LINK_OP_CMD, 0xFF, PD_LINK_OK);
+    put_message(s, &synth, binary);
+}
+
+/* --- checks ------------------------------------------------------------------ */
+
+static void check(const char *name, pdd_mode_t mode, int mixed, int binary) {
+    static stream_t s;
+    pdd_callbacks_t cb = {.on_message = on_message, .on_notice = on_notice, .on_error = on_error, .on_link = on_link};
+    unsigned bad = 0;
+
+    printf("%s\n", name);
+    build(&s, mixed, binary);
+    for (size_t chunk = 1; chunk <= s.len; chunk++) {
+        tally_t got = {0};
+        pdd_decoder_t dec;
+        pdd_init(&dec, mode, &cb, &got);
+        for (size_t off = 0; off < s.len; off += chunk) {
+            pdd_feed(&dec, s.data + off, off + chunk > s.len ? s.len - off : chunk);
+        }
+        if (memcmp(&got, &s.want, sizeof(got)) != 0) {
+            if (s_verbose || !bad) {
+                printf("  chunk %zu: %u/%u messages, %u/%u notices, %u/%u replies, %u/%u errors\n", chunk, got.messages,
+                       s.want.messages, got.notices, s.want.notices, got.links, s.want.links, got.errors,
+                       s.want.errors);
+            }
+            bad++;
+        }
+    }
+    expect(!bad, "every chunk size decodes all messages, notices and replies");
+}
+
+int main(int argc, char **argv) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+        case 'v':
+            s_verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    check("text lines and replies", PDD_MODE_TEXT, 0, 0);
+    check("binary records and replies", PDD_MODE_BINARY, 0, 1);
+    check("mixed stream and replies", PDD_MODE_AUTO, 1, 0);
+    printf("%s (%u failures)\n", s_fail ? "FAIL" : "ok", s_fail);
+    return s_fail ? 1 : 0;
+}
@@ -0,0 +1,572 @@
+/*
+ * pdscript - assemble on-device PD scripts, run them against a simulated
+ * source, or upload them over the CDC port.
+ *
+ *   pdscript asm    <script> [-o out.bin]          print (or write) the bytecode
+ *   pdscript run    <script> [-c pdo,...] [-l n] [-t ms]
+ *   pdscript upload <script> <tty>                 scrc, scrl..., scrr as framed commands
+ *
+ * Script syntax, one instruction per line ('#' starts a comment):
+ *   label:
+ *   send  <hex bytes>                 header + payload, e.g. send 82 10 2c b1 04 23
+ *   wait  ctrl|data|ext|any <type> [timeout_us]   type: number or name (Accept, SourceCap, ...)
+ *   delay <us>
+ *   jmp|jt|jf|djnz <label>
+ *   loop  <n>
+ *   reset hard|cable
+ *   end | fail
+ *
+ * "run" plays the script as the sink against the firmware source policy
+ * engine (usb_pd_src_pe) on a virtual µs clock with BMC frame durations;
+ * -l makes the source ignore the script's first n frames. Exits 0 if the
+ * script reaches END.
+ */
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "usb_pd_decode.h"
+#include "usb_pd_header.h"
+#include "usb_pd_link.h"
+#include "usb_pd_script_vm.h"
+#include "usb_pd_src_pe.h"
+
+#define MAX_LABELS     64
+#define UPLOAD_CHUNK   60  // scrl 每条命令携带的字节码
+#define UPLOAD_REPLY_MS 500
+
+typedef struct {
+    char name[32];
+    uint16_t addr;
+} label_t;
+
+typedef struct {
+    char name[32];
+    uint16_t at; /* operand offset to patch */
+    unsigned line;
+} fixup_t;
+
+typedef struct {
+    uint8_t code[PD_SCRIPT_MAX_LEN];
+    uint16_t len;
+    label_t labels[MAX_LABELS];
+    unsigned nlabels;
+    fixup_t fixups[MAX_LABELS];
+    unsigned nfixups;
+} asm_t;
+
+static int emit(asm_t *a, const uint8_t *b, unsigned n) {
+    if (a->len + n > PD_SCRIPT_MAX_LEN) return -1;
+    memcpy(&a->code[a->len], b, n);
+    a->len = (uint16_t)(a->len + n);
+    return 0;
+}
+
+static int emit_u32(asm_t *a, uint8_t op, uint32_t v) {
+    uint8_t b[5] = {op, (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+    return emit(a, b, sizeof(b));
+}
+
+static int parse_num(const char *s, unsigned long *v) {
+    char *end;
+    if (!s) return -1;
+    *v = strtoul(s, &end, 0);
+    return *end ? -1 : 0;
+}
+
+/* Message type by number or by the decoder's name for that kind */
+static int parse_type(const char *s, uint8_t kind, uint8_t *type) {
+    unsigned long v;
+    if (!parse_num(s, &v) && v < 32) {
+        *type = (uint8_t)v;
+        return 0;
+    }
+    for (uint8_t t = 0; t < 32; t++) {
+        const char *name = pd_msg_type_name(kind == PD_SCRIPT_KIND_EXT, kind == PD_SCRIPT_KIND_DATA, t);
+        if (name && !strcasecmp(name, s)) {
+            *type = t;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int asm_line(asm_t *a, char *line, unsigned lineno) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = 0;
+
+    char *tok[40];
+    unsigned n = 0;
+    for (char *t = strtok(line, " \t\r\n"); t && n < 40; t = strtok(NULL, " \t\r\n")) tok[n++] = t;
+    if (!n) return 0;
+
+    size_t l = strlen(tok[0]);
+    if (tok[0][l - 1] == ':') {
+        if (a->nlabels == MAX_LABELS || l > sizeof(a->labels[0].name)) return -1;
+        tok[0][l - 1] = 0;
+        strcpy(a->labels[a->nlabels].name, tok[0]);
+        a->labels[a->nlabels++].addr = a->len;
+        if (n == 1) return 0;
+        memmove(tok, tok + 1, --n * sizeof(tok[0]));
+    }
+
+    const char *op = tok[0];
+    unsigned long v;
+    if (!strcasecmp(op, "end") || !strcasecmp(op, "fail")) {
+        uint8_t b = !strcasecmp(op, "end") ? PD_SCRIPT_OP_END : PD_SCRIPT_OP_FAIL;
+        return emit(a, &b, 1);
+    }
+    if (!strcasecmp(op, "send")) {
+        uint8_t b[2 + PD_SCRIPT_FRAME_MAX] = {PD_SCRIPT_OP_SEND, (uint8_t)(n - 1)};
+        if (n - 1 < 2 || n - 1 > PD_SCRIPT_FRAME_MAX) return -1;
+        for (unsigned i = 1; i < n; i++) {
+            char *end;
+            v = strtoul(tok[i], &end, 16);
+            if (*end || v > 0xFF) return -1;
+            b[1 + i] = (uint8_t)v;
+        }
+        return emit(a, b, 1 + n);
+    }
+    if (!strcasecmp(op, "wait")) {
+        uint8_t kind;
+        if (n < 2) return -1;
+        if (!strcasecmp(tok[1], "ctrl")) kind = PD_SCRIPT_KIND_CTRL;
+        else if (!strcasecmp(tok[1], "data")) kind = PD_SCRIPT_KIND_DATA;
+        else if (!strcasecmp(tok[1], "ext")) kind = PD_SCRIPT_KIND_EXT;
+        else if (!strcasecmp(tok[1], "any")) kind = PD_SCRIPT_KIND_ANY;
+        else return -1;
+        uint8_t type = 0;
+        unsigned next = 2;
+        if (kind != PD_SCRIPT_KIND_ANY) {
+            if (n < 3 || parse_type(tok[2], kind, &type)) return -1;
+            next = 3;
+        }
+        unsigned long timeout = 0;
+        if (n > next && parse_num(tok[next], &timeout)) return -1;
+        uint8_t b[7] = {PD_SCRIPT_OP_WAIT, kind, type, (uint8_t)timeout, (uint8_t)(timeout >> 8),
+                        (uint8_t)(timeout >> 16), (uint8_t)(timeout >> 24)};
+        return emit(a, b, sizeof(b));
+    }
+    if (!strcasecmp(op, "delay")) {
+        if (n != 2 || parse_num(tok[1], &v)) return -1;
+        return emit_u32(a, PD_SCRIPT_OP_DELAY, (uint32_t)v);
+    }
+    if (!strcasecmp(op, "loop")) {
+        if (n != 2 || parse_num(tok[1], &v) || v > 0xFF) return -1;
+        uint8_t b[2] = {PD_SCRIPT_OP_LOOP, (uint8_t)v};
+        return emit(a, b, sizeof(b));
+    }
+    if (!strcasecmp(op, "reset")) {
+        if (n != 2 || (strcasecmp(tok[1], "hard") && strcasecmp(tok[1], "cable"))) return -1;
+        uint8_t b[2] = {PD_SCRIPT_OP_RESET, (uint8_t)!strcasecmp(tok[1], "cable")};
+        return emit(a, b, sizeof(b));
+    }
+    static const struct {
+        const char *name;
+        uint8_t op;
+    } jumps[] = {{"jmp", PD_SCRIPT_OP_JMP}, {"jt", PD_SCRIPT_OP_JT}, {"jf", PD_SCRIPT_OP_JF}, {"djnz", PD_SCRIPT_OP_DJNZ}};
+    for (unsigned i = 0; i < sizeof(jumps) / sizeof(jumps[0]); i++) {
+        if (strcasecmp(op, jumps[i].name)) continue;
+        if (n != 2 || a->nfixups == MAX_LABELS || strlen(tok[1]) >= sizeof(a->fixups[0].name)) return -1;
+        strcpy(a->fixups[a->nfixups].name, tok[1]);
+        a->fixups[a->nfixups].at = (uint16_t)(a->len + 1);
+        a->fixups[a->nfixups++].line = lineno;
+        uint8_t b[3] = {jumps[i].op, 0, 0};
+        return emit(a, b, sizeof(b));
+    }
+    return -1;
+}
+
+static int assemble(const char *path, asm_t *a) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    memset(a, 0, sizeof(*a));
+
+    char line[512];
+    unsigned lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        if (asm_line(a, line, lineno)) {
+            fprintf(stderr, "%s:%u: bad instruction or script too long\n", path, lineno);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+
+    for (unsigned i = 0; i < a->nfixups; i++) {
+        unsigned j;
+        for (j = 0; j < a->nlabels && strcmp(a->labels[j].name, a->fixups[i].name); j++) {
+        }
+        if (j == a->nlabels) {
+            fprintf(stderr, "%s:%u: unknown label '%s'\n", path, a->fixups[i].line, a->fixups[i].name);
+            return -1;
+        }
+        a->code[a->fixups[i].at] = (uint8_t)a->labels[j].addr;
+        a->code[a->fixups[i].at + 1] = (uint8_t)(a->labels[j].addr >> 8);
+    }
+
+    /* Same validation as the device */
+    static pd_script_t check;
+    uint16_t err_pc;
+    if (!pd_script_load(&check, a->code, a->len, &err_pc)) {
+        fprintf(stderr, "%s: rejected at byte %u (does the script end with end/fail/jmp?)\n", path, err_pc);
+        return -1;
+    }
+    return 0;
+}
+
+/* ---- simulation ---- */
+
+enum { EV_SRC_RX, EV_SRC_TX_RESULT, EV_SNK_RX, EV_SNK_TX_RESULT, EV_SRC_HARD_RESET, EV_SRC_ATTACH };
+
+typedef struct {
+    uint32_t t_us;
+    uint8_t type;
+    uint8_t acked;
+    uint8_t len;
+    uint8_t frame[PD_SCRIPT_FRAME_MAX];
+} sim_event_t;
+
+#define SIM_EVENTS 16
+
+static sim_event_t s_ev[SIM_EVENTS];
+static unsigned s_nev;
+static uint32_t s_now;
+static unsigned s_ignore; /* source ignores this many script frames */
+static uint32_t s_src_free; /* PHY idle from, after its last frame or GoodCRC */
+static uint32_t s_snk_free;
+
+#define SIM_GOODCRC_TURNAROUND_US 30
+#define SIM_T_RECEIVE_US          1000
+#define SIM_T_SRC_RECOVER_US      660000
+
+/* BMC duration: preamble, SOP, 4b5b payload + CRC, EOP at 300 kbit/s */
+static uint32_t airtime_us(uint8_t len) {
+    uint32_t bits = 64 + 20 + (len + 4u) * 10 + 5;
+    return bits * 10 / 3;
+}
+
+static void post(uint32_t t_us, uint8_t type, uint8_t acked, const uint8_t *frame, uint8_t len) {
+    if (s_nev == SIM_EVENTS) return;
+    sim_event_t *e = &s_ev[s_nev++];
+    e->t_us = t_us;
+    e->type = type;
+    e->acked = acked;
+    e->len = len;
+    if (frame) memcpy(e->frame, frame, len);
+}
+
+static void print_frame(const char *dir, const uint8_t *frame, const char *note) {
+    uint16_t hdr = pd_header_read(frame);
+    printf("%9u us  %s  %s%s\n", s_now, dir, pd_msg_type_name(PD_HDR_EXTENDED(hdr), PD_HDR_NUM_DO(hdr), PD_HDR_MSG_TYPE(hdr)),
+           note);
+}
+
+/* A frame goes out once the sender's PHY is idle (its GoodCRC first); the receiver's GoodCRC follows */
+static uint32_t transmit(uint32_t *tx_free, uint32_t *rx_free, uint8_t len, bool acked) {
+    uint32_t start = *tx_free > s_now ? *tx_free : s_now;
+    uint32_t end = start + airtime_us(len);
+    *tx_free = end;
+    if (acked) *rx_free = end + SIM_GOODCRC_TURNAROUND_US + airtime_us(2);
+    return end;
+}
+
+static bool snk_send(void *user, const uint8_t *frame, uint8_t len) {
+    (void)user;
+    uint32_t saved = s_now;
+    if (s_ignore) {
+        s_ignore--;
+        uint32_t end = transmit(&s_snk_free, &s_src_free, len, false);
+        s_now = end - airtime_us(len);
+        print_frame("SNK>SRC", frame, "  (ignored)");
+        s_now = saved;
+        /* nRetryCount (PD2.0) retransmissions, each waiting tReceive */
+        post(end + SIM_T_RECEIVE_US + 3 * (airtime_us(len) + SIM_T_RECEIVE_US), EV_SNK_TX_RESULT, 0, NULL, 0);
+        s_snk_free = end + 3 * (airtime_us(len) + SIM_T_RECEIVE_US);
+        return true;
+    }
+    uint32_t end = transmit(&s_snk_free, &s_src_free, len, true);
+    s_now = end - airtime_us(len);
+    print_frame("SNK>SRC", frame, "");
+    s_now = saved;
+    post(end, EV_SRC_RX, 0, frame, len);
+    post(s_src_free, EV_SNK_TX_RESULT, 1, NULL, 0);
+    return true;
+}
+
+static bool src_send(void *user, const uint8_t *frame, uint8_t len) {
+    (void)user;
+    uint32_t saved = s_now;
+    uint32_t end = transmit(&s_src_free, &s_snk_free, len, true);
+    s_now = end - airtime_us(len);
+    print_frame("SRC>SNK", frame, "");
+    s_now = saved;
+    post(end, EV_SNK_RX, 0, frame, len);
+    post(s_snk_free, EV_SRC_TX_RESULT, 1, NULL, 0);
+    return true;
+}
+
+/* Reset signaling: preamble and four K-codes, no GoodCRC */
+static bool snk_reset(void *user, uint8_t type) {
+    (void)user;
+    uint32_t start = s_snk_free > s_now ? s_snk_free : s_now;
+    uint32_t end = start + (64 + 20) * 10 / 3;
+    s_snk_free = end;
+    printf("%9u us  SNK>SRC  %s\n", start, type ? "Cable Reset" : "Hard Reset");
+    /* Cable Reset is addressed to the cable; the source ignores it */
+    if (!type) post(end, EV_SRC_HARD_RESET, 0, NULL, 0);
+    post(end, EV_SNK_TX_RESULT, 1, NULL, 0);
+    return true;
+}
+
+static void src_set_vbus(void *user, uint16_t mv, uint16_t ma) {
+    (void)user;
+    printf("%9u us  VBUS     %umV %umA\n", s_now, mv, ma);
+}
+
+static int parse_caps(const char *arg, uint32_t *caps) {
+    int n = 0;
+    while (*arg && n < PD_SRC_MAX_PDO) {
+        char *end;
+        caps[n++] = (uint32_t)strtoul(arg, &end, 16);
+        if (*end != ',') break;
+        arg = end + 1;
+    }
+    return n;
+}
+
+static int cmd_run(const asm_t *a, int argc, char **argv) {
+    uint32_t caps[PD_SRC_MAX_PDO] = {0x0001912C, 0x0002D12C, 0x0004B12C, 0x000640E1, 0xC1A4213C};
+    int ncaps = 5;
+    unsigned limit_ms = 5000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:l:t:")) != -1) {
+        switch (opt) {
+        case 'c':
+            ncaps = parse_caps(optarg, caps);
+            break;
+        case 'l':
+            s_ignore = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            limit_ms = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            return 2;
+        }
+    }
+
+    static const pd_src_pe_ops_t src_ops = {NULL, src_send, src_set_vbus};
+    static const pd_script_ops_t snk_ops = {NULL, snk_send, snk_reset};
+    static pd_src_pe_t src;
+    static pd_script_t vm;
+    uint16_t err_pc;
+
+    pd_src_pe_init(&src, &src_ops, 2);
+    pd_src_pe_set_caps(&src, caps, (uint8_t)ncaps, 0);
+    pd_script_init(&vm, &snk_ops);
+    pd_script_load(&vm, a->code, a->len, &err_pc);
+
+    pd_src_pe_attach(&src, 0);
+    pd_script_start(&vm, 0);
+
+    while (pd_script_running(&vm)) {
+        /* Next thing to happen: an event, a script deadline or a source timer */
+        uint32_t next = UINT32_MAX, d;
+        int idx = -1;
+        for (unsigned i = 0; i < s_nev; i++) {
+            if (s_ev[i].t_us < next) {
+                next = s_ev[i].t_us;
+                idx = (int)i;
+            }
+        }
+        if (pd_script_deadline(&vm, &d) && d < next) {
+            next = d;
+            idx = -1;
+        }
+        if (src.timer_on && src.deadline_ms * 1000u < next) {
+            next = src.deadline_ms * 1000u;
+            idx = -1;
+        }
+        if (next == UINT32_MAX || next > limit_ms * 1000u) break;
+        s_now = next;
+
+        if (idx >= 0) {
+            sim_event_t e = s_ev[idx];
+            s_ev[idx] = s_ev[--s_nev];
+            switch (e.type) {
+            case EV_SRC_RX:
+                pd_src_pe_on_rx(&src, e.frame, e.len, s_now / 1000);
+                break;
+            case EV_SRC_TX_RESULT:
+                pd_src_pe_on_tx_result(&src, e.acked, s_now / 1000);
+                break;
+            case EV_SNK_RX:
+                pd_script_on_rx(&vm, e.frame, e.len, s_now);
+                break;
+            case EV_SNK_TX_RESULT:
+                pd_script_on_tx_result(&vm, e.acked, s_now);
+                break;
+            case EV_SRC_HARD_RESET:
+                /* Frames in flight from the source are lost; VBUS off for tSrcRecover */
+                for (unsigned i = s_nev; i-- > 0;) {
+                    if (s_ev[i].type == EV_SNK_RX || s_ev[i].type == EV_SRC_TX_RESULT) s_ev[i] = s_ev[--s_nev];
+                }
+                pd_src_pe_detach(&src);
+                post(s_now + SIM_T_SRC_RECOVER_US, EV_SRC_ATTACH, 0, NULL, 0);
+                break;
+            case EV_SRC_ATTACH:
+                pd_src_pe_attach(&src, s_now / 1000);
+                break;
+            }
+        }
+        pd_src_pe_tick(&src, s_now / 1000);
+        pd_script_tick(&vm, s_now);
+    }
+    if (pd_script_running(&vm)) {
+        printf("%9u us  stopped: nothing left to do or -t reached\n", s_now);
+        pd_script_abort(&vm);
+    }
+
+    unsigned logged = vm.steps < PD_SCRIPT_LOG_SIZE ? vm.steps : PD_SCRIPT_LOG_SIZE;
+    printf("\n step  pc  op    result         time\n");
+    for (unsigned i = 0; i < logged; i++) {
+        const pd_script_step_t *st = &vm.log[i];
+        printf("%5u %3u  %-5s %-7s %9uus", i, st->pc, pd_script_op_name(st->op), pd_script_result_name(st->result),
+               st->t_us);
+        if (st->op == PD_SCRIPT_OP_WAIT && st->result == PD_SCRIPT_R_OK) printf("  hdr 0x%04X", st->hdr);
+        printf("\n");
+    }
+    printf("%s, %u steps\n", vm.state == PD_SCRIPT_DONE ? "passed" : "failed", vm.steps);
+    return vm.state == PD_SCRIPT_DONE ? 0 : 1;
+}
+
+/* Raw bytes both ways: no CR/LF translation, echo or line buffering */
+static void tty_raw(int fd) {
+    struct termios t;
+    if (tcgetattr(fd, &t)) return;
+    t.c_iflag &= ~(tcflag_t)(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+    t.c_oflag &= ~(tcflag_t)OPOST;
+    t.c_lflag &= ~(tcflag_t)(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    t.c_cflag = (t.c_cflag & ~(tcflag_t)(CSIZE | PARENB)) | CS8;
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &t);
+}
+
+/* Wait for the reply to seq among the device's other output; status, or -1 on timeout */
+static int wait_reply(int fd, uint8_t op, uint8_t seq) {
+    pd_link_rx_t rx;
+    pd_link_rx_init(&rx);
+    for (int waited = 0; waited < UPLOAD_REPLY_MS;) {
+        struct pollfd p = {fd, POLLIN, 0};
+        int r = poll(&p, 1, 10);
+        if (r <= 0) {
+            waited += 10;
+            continue;
+        }
+        uint8_t buf[256];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) return -1;
+        for (ssize_t i = 0; i < n; i++) {
+            if (pd_link_rx_feed(&rx, buf[i]) != PD_LINK_RX_FRAME) continue;
+            if (rx.op == (op | PD_LINK_OP_REPLY) && rx.seq == seq && rx.data_len >= 1) return rx.data[0];
+        }
+    }
+    return -1;
+}
+
+/* One framed command; replies are only checked on a tty */
+static int send_cmd(int fd, bool check, uint8_t seq, const uint8_t *cmd, uint8_t len) {
+    uint8_t wire[PD_LINK_MAX_WIRE];
+    size_t n = pd_link_encode(PD_LINK_OP_CMD, seq, cmd, len, wire, sizeof(wire));
+    if (!n || write(fd, wire, n) != (ssize_t)n) {
+        perror("write");
+        return 1;
+    }
+    if (!check) return 0;
+    int st = wait_reply(fd, PD_LINK_OP_CMD, seq);
+    if (st == PD_LINK_OK) return 0;
+    fprintf(stderr, "command %u (%.4s): %s\n", seq, (const char *)cmd,
+            st < 0 ? "no reply" : pd_link_status_name((uint8_t)st));
+    return 1;
+}
+
+/* scrc, scrl..., scrr as framed commands, so packet boundaries do not matter */
+static int cmd_upload(const asm_t *a, const char *tty) {
+    int fd = open(tty, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(tty);
+        return 1;
+    }
+    bool check = isatty(fd);
+    if (check) {
+        tty_raw(fd);
+        tcflush(fd, TCIFLUSH);
+    }
+
+    uint8_t seq = 0;
+    int rc = send_cmd(fd, check, seq++, (const uint8_t *)"scrc", 4);
+    for (uint16_t off = 0; !rc && off < a->len; off = (uint16_t)(off + UPLOAD_CHUNK)) {
+        uint8_t cmd[4 + UPLOAD_CHUNK] = "scrl";
+        uint16_t n = (uint16_t)(a->len - off < UPLOAD_CHUNK ? a->len - off : UPLOAD_CHUNK);
+        memcpy(cmd + 4, &a->code[off], n);
+        rc = send_cmd(fd, check, seq++, cmd, (uint8_t)(4 + n));
+    }
+    if (!rc) rc = send_cmd(fd, check, seq++, (const uint8_t *)"scrr", 4);
+    close(fd);
+    return rc;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s asm <script> [-o out.bin]\n"
+            "       %s run <script> [-c pdo,...] [-l n] [-t ms]\n"
+            "       %s upload <script> <tty>\n",
+            argv0, argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+    static asm_t a;
+
+    if (argc < 3) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (assemble(argv[2], &a)) return 1;
+
+    if (!strcmp(argv[1], "asm")) {
+        if (argc == 5 && !strcmp(argv[3], "-o")) {
+            FILE *fp = fopen(argv[4], "wb");
+            if (!fp || fwrite(a.code, 1, a.len, fp) != a.len) {
+                perror(argv[4]);
+                return 1;
+            }
+            fclose(fp);
+            return 0;
+        }
+        for (uint16_t i = 0; i < a.len; i++) printf("%02x%s", a.code[i], (i % 16 == 15 || i + 1 == a.len) ? "\n" : " ");
+        return 0;
+    }
+    if (!strcmp(argv[1], "run")) {
+        int rc = cmd_run(&a, argc - 2, argv + 2);
+        if (rc == 2) usage(argv[0]);
+        return rc;
+    }
+    if (!strcmp(argv[1], "upload") && argc == 4) return cmd_upload(&a, argv[3]);
+
+    usage(argv[0]);
+    return 2;
+}
@@ -0,0 +1,247 @@
+/*
+ * pdsrcsim - run the firmware source policy engine against a simulated sink.
+ *
+ *   pdsrcsim [-c pdo,...] [-p pos] [-v mV] [-i mA] [-l lost] [-d ms] [-n] [-t ms]
+ *
+ * -c  advertised PDOs in hex (default 5V/9V/15V 3A, 20V 2.25A, PPS 3.3-21V 3A)
+ * -p  object position the sink requests (default 2); out of range gives Reject
+ * -v  PPS / AVS output voltage, -i operating current (default: the PDO maximum)
+ * -l  drop the GoodCRC of the first N Source_Capabilities
+ * -d  sink response delay, -n sink never sends a Request, -t run time
+ *
+ * Uses a virtual millisecond clock; every frame takes 1 ms on the wire and
+ * is acknowledged by the receiver unless dropped. Prints the exchange and
+ * exits 0 once an explicit contract is reached, 1 otherwise.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "usb_pd_decode.h"
+#include "usb_pd_header.h"
+#include "usb_pd_pdo.h"
+#include "usb_pd_src_pe.h"
+
+#define SIM_QUEUE 8
+
+typedef struct {
+    uint32_t due_ms;
+    uint8_t len;
+    uint8_t frame[2 + 4 * PD_SRC_MAX_PDO];
+} sim_frame_t;
+
+typedef struct {
+    sim_frame_t q[SIM_QUEUE];
+    unsigned n;
+} sim_queue_t;
+
+static uint32_t s_now;
+static sim_queue_t s_to_sink;
+static sim_queue_t s_to_src;
+
+static unsigned s_pos = 2;
+static unsigned s_mv;
+static unsigned s_ma;
+static unsigned s_lost;
+static unsigned s_delay_ms = 5;
+static int s_no_request;
+
+static void push(sim_queue_t *q, const uint8_t *frame, uint8_t len, uint32_t due_ms) {
+    if (q->n == SIM_QUEUE) return;
+    sim_frame_t *f = &q->q[q->n++];
+    f->due_ms = due_ms;
+    f->len = len;
+    memcpy(f->frame, frame, len);
+}
+
+/* Pop the oldest frame that is due; 0 if none */
+static int pop_due(sim_queue_t *q, sim_frame_t *out) {
+    if (!q->n || q->q[0].due_ms > s_now) return 0;
+    *out = q->q[0];
+    memmove(&q->q[0], &q->q[1], (q->n - 1) * sizeof(q->q[0]));
+    q->n--;
+    return 1;
+}
+
+static uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void print_frame(const char *dir, const uint8_t *frame, uint8_t len, const char *note) {
+    uint16_t hdr = pd_header_read(frame);
+    uint8_t ndo = PD_HDR_NUM_DO(hdr);
+    printf("%5u ms  %s  %s%s\n", s_now, dir, pd_msg_type_name(PD_HDR_EXTENDED(hdr), ndo, PD_HDR_MSG_TYPE(hdr)), note);
+    if (PD_HDR_EXTENDED(hdr) || !ndo || len < 2 + 4 * ndo) return;
+    for (uint8_t i = 0; i < ndo; i++) {
+        uint32_t raw = rd32(&frame[2 + 4 * i]);
+        if (PD_HDR_MSG_TYPE(hdr) == 0x01) {
+            pd_pdo_t p;
+            pd_pdo_parse(raw, &p);
+            printf("            PDO%u %-7s %5u-%5umV %4umA\n", i + 1, pd_pdo_type_name(p.type), p.min_mv, p.max_mv, p.max_ma);
+        } else {
+            printf("            0x%08X\n", raw);
+        }
+    }
+}
+
+/* Sink side: RDO for s_pos against the advertised object */
+static uint32_t build_request(const uint8_t *caps, uint8_t ndo) {
+    uint32_t rdo = (uint32_t)(s_pos & 0x0F) << 28;
+    if (s_pos == 0 || s_pos > ndo) return rdo | (100u << 10) | 100u;
+
+    pd_pdo_t p;
+    pd_pdo_parse(rd32(&caps[4 * (s_pos - 1)]), &p);
+    unsigned ma = s_ma ? s_ma : p.max_ma;
+    unsigned mv = s_mv ? s_mv : p.max_mv;
+    switch (p.type) {
+    case PD_PDO_BATTERY: {
+        unsigned mw = s_ma ? s_ma * p.max_mv / 1000 : p.max_mw;
+        return rdo | ((mw / 250) << 10) | (mw / 250);
+    }
+    case PD_PDO_PPS:
+        return rdo | ((mv / 20) << 9) | (ma / 50);
+    case PD_PDO_SPR_AVS:
+    case PD_PDO_EPR_AVS:
+        return rdo | ((mv / 25) << 9) | (ma / 50);
+    default:
+        return rdo | ((ma / 10) << 10) | (ma / 10);
+    }
+}
+
+static void sink_on_frame(const uint8_t *frame, uint8_t len) {
+    uint16_t hdr = pd_header_read(frame);
+    if (PD_HDR_EXTENDED(hdr) || PD_HDR_MSG_TYPE(hdr) != 0x01 || !PD_HDR_NUM_DO(hdr) || s_no_request) return;
+    (void)len;
+
+    uint8_t req[6];
+    uint16_t rh = (uint16_t)(0x02 | (1u << 6) | (1u << 12)); /* Request, PD2.0 header, sink roles */
+    uint32_t rdo = build_request(&frame[2], PD_HDR_NUM_DO(hdr));
+    req[0] = (uint8_t)rh;
+    req[1] = (uint8_t)(rh >> 8);
+    req[2] = (uint8_t)rdo;
+    req[3] = (uint8_t)(rdo >> 8);
+    req[4] = (uint8_t)(rdo >> 16);
+    req[5] = (uint8_t)(rdo >> 24);
+    push(&s_to_src, req, sizeof(req), s_now + s_delay_ms);
+}
+
+static bool sim_send(void *user, const uint8_t *frame, uint8_t len) {
+    (void)user;
+    push(&s_to_sink, frame, len, s_now + 1);
+    return true;
+}
+
+static void sim_set_vbus(void *user, uint16_t mv, uint16_t ma) {
+    (void)user;
+    printf("%5u ms  VBUS     %umV %umA\n", s_now, mv, ma);
+}
+
+static unsigned parse_caps(const char *arg, uint32_t *caps) {
+    unsigned n = 0;
+    while (*arg && n < PD_SRC_MAX_PDO) {
+        char *end;
+        caps[n++] = (uint32_t)strtoul(arg, &end, 16);
+        if (*end != ',') break;
+        arg = end + 1;
+    }
+    return n;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-c pdo,...] [-p pos] [-v mV] [-i mA] [-l lost] [-d ms] [-n] [-t ms]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    uint32_t caps[PD_SRC_MAX_PDO] = {
+        0x0001912C, /* 5V 3A */
+        0x0002D12C, /* 9V 3A */
+        0x0004B12C, /* 15V 3A */
+        0x000640E1, /* 20V 2.25A */
+        0xC1A4213C, /* PPS 3.3-21V 3A */
+    };
+    unsigned ncaps = 5;
+    unsigned limit_ms = 2000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:p:v:i:l:d:nt:")) != -1) {
+        switch (opt) {
+        case 'c':
+            ncaps = parse_caps(optarg, caps);
+            break;
+        case 'p':
+            s_pos = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            s_mv = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            s_ma = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            s_lost = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            s_delay_ms = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            s_no_request = 1;
+            break;
+        case 't':
+            limit_ms = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc || !ncaps) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    static const pd_src_pe_ops_t ops = {NULL, sim_send, sim_set_vbus};
+    pd_src_pe_t pe;
+    pd_src_pe_init(&pe, &ops, 2);
+    pd_src_pe_set_caps(&pe, caps, (uint8_t)ncaps, 0);
+
+    printf("%5u ms  attach\n", s_now);
+    pd_src_pe_attach(&pe, s_now);
+
+    for (; s_now <= limit_ms; s_now++) {
+        sim_frame_t f;
+
+        pd_src_pe_tick(&pe, s_now);
+
+        while (pop_due(&s_to_sink, &f)) {
+            uint16_t hdr = pd_header_read(f.frame);
+            int caps_msg = !PD_HDR_EXTENDED(hdr) && PD_HDR_MSG_TYPE(hdr) == 0x01 && PD_HDR_NUM_DO(hdr);
+            int dropped = caps_msg && s_lost;
+            if (dropped) s_lost--;
+            print_frame("SRC>SNK", f.frame, f.len, dropped ? "  (no GoodCRC)" : "");
+            /* GoodCRC first, then the sink acts on the message */
+            pd_src_pe_on_tx_result(&pe, !dropped, s_now);
+            if (!dropped) sink_on_frame(f.frame, f.len);
+        }
+
+        while (pop_due(&s_to_src, &f)) {
+            print_frame("SNK>SRC", f.frame, f.len, "");
+            pd_src_pe_on_rx(&pe, f.frame, f.len, s_now);
+        }
+
+        if (pe.events & PD_SRC_EVT_NO_RESPONSE) printf("%5u ms  no GoodCRC after %u Source_Capabilities\n", s_now, PD_SRC_N_CAPS_COUNT);
+        if (pe.events & PD_SRC_EVT_TIMEOUT) printf("%5u ms  no Request within SenderResponseTimer\n", s_now);
+        if (pe.events & PD_SRC_EVT_REJECTED) printf("%5u ms  Request 0x%08X rejected\n", s_now, pe.rdo);
+        if (pe.events & PD_SRC_EVT_TX_FAILED) printf("%5u ms  Accept/PS_RDY not acknowledged\n", s_now);
+        pe.events = 0;
+
+        if ((pe.state == PD_SRC_READY || pe.state == PD_SRC_WAIT_NEW_CAPS) && !s_to_sink.n && !s_to_src.n) break;
+    }
+
+    if (pe.has_contract) {
+        printf("contract: PDO%u %umV %umA\n", pe.contract_pos, pe.contract_mv, pe.contract_ma);
+        return 0;
+    }
+    printf("no contract\n");
+    return 1;
+}
@@ -0,0 +1,179 @@
+/*
+ * pdtxtest - run the firmware PD transmit queue (usb_pd_tx.c) on the host.
+ *
+ *   pdtxtest [-v]
+ *
+ * The queue is built against the register stand-ins in Host/stub; a frame
+ * is "on the wire" from BMC_START until the test calls usb_pd_tx_on_tx_end(),
+ * and save_message() records what went out. Checks GoodCRC reservation:
+ * a held GoodCRC superseded by a newer frame must not stall the PHY, and
+ * frames queued behind a held GoodCRC wait for it. -v prints every frame.
+ * Exits 0 if all checks pass, 1 otherwise.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ch32x035_usbpd.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_header.h"
+#include "usb_pd_message.h"
+#include "usb_pd_timer.h"
+#include "usb_pd_tx.h"
+
+USBPD_TypeDef pd_stub_usbpd;
+
+static int s_verbose;
+static unsigned s_fail;
+
+/* --- firmware stand-ins --------------------------------------------------- */
+
+#define LOG_MAX 16
+
+static struct {
+    uint8_t sop;
+    uint8_t h0, h1;
+} s_log[LOG_MAX];
+static unsigned s_nlog;
+
+void save_message(uint32_t status, uint8_t *data, uint8_t len) {
+    if (s_verbose) printf("  wire: sop %lu %02X %02X (%u bytes)\n", (unsigned long)status, data[0], data[1], len);
+    if (s_nlog < LOG_MAX) {
+        s_log[s_nlog].sop = (uint8_t)status;
+        s_log[s_nlog].h0 = data[0];
+        s_log[s_nlog].h1 = data[1];
+    }
+    s_nlog++;
+}
+
+void usb_pd_timer_start(pd_timer_ch_t ch, uint16_t delay_us, pd_timer_cb_t cb) {
+    (void)ch;
+    (void)delay_us;
+    (void)cb;
+}
+
+void usb_pd_timer_cancel(pd_timer_ch_t ch) {
+    (void)ch;
+}
+
+bool cdc_acm_is_configured(void) {
+    return false;
+}
+
+void cdc_acm_printf(char *format, ...) {
+    (void)format;
+}
+
+/* --- helpers ---------------------------------------------------------------- */
+
+static void expect(int ok, const char *what) {
+    if (!ok) {
+        printf("  FAIL: %s\n", what);
+        s_fail++;
+    } else if (s_verbose) {
+        printf("  ok: %s\n", what);
+    }
+}
+
+/* True if a frame or reset was started since the last call */
+static int started(void) {
+    int s = (USBPD->CONTROL & BMC_START) != 0;
+    USBPD->CONTROL = 0;
+    return s;
+}
+
+/* Finish the frame on the wire; header byte 0 of what went out, -1 if nothing did */
+static int wire_end(void) {
+    unsigned n = s_nlog;
+    usb_pd_tx_on_tx_end();
+    return s_nlog > n && n < LOG_MAX ? s_log[n].h0 : -1;
+}
+
+static void reset_queue(void) {
+    usb_pd_tx_reset();
+    started();
+    s_nlog = 0;
+}
+
+static const uint8_t s_crc_a[2] = {0x41, 0x02}; /* GoodCRC, MessageID 1 */
+static const uint8_t s_crc_b[2] = {0x41, 0x04}; /* GoodCRC, MessageID 2 */
+static const uint8_t s_accept[2] = {0x43, 0x00};
+
+/* --- checks ------------------------------------------------------------------ */
+
+/* The monitor's path: a second frame arrives before the first GoodCRC is released */
+static void superseded(void) {
+    printf("superseded GoodCRC\n");
+    reset_queue();
+    pd_tx_handle_t a = usb_pd_tx_submit_held(s_crc_a, 2, PD_SOP0, PD_TX_PRIO_GOODCRC);
+    expect(a && !started(), "held GoodCRC waits");
+
+    usb_pd_tx_cancel(a);
+    pd_tx_handle_t b = usb_pd_tx_submit_held(s_crc_b, 2, PD_SOP0, PD_TX_PRIO_GOODCRC);
+    pd_tx_handle_t r = usb_pd_tx_submit(s_accept, 2, PD_SOP0, PD_TX_PRIO_REPLY);
+    expect(usb_pd_tx_status(a) == PD_TX_FAILED, "cancelled GoodCRC fails");
+    expect(b && r && !started(), "reply waits behind the held GoodCRC");
+
+    usb_pd_tx_release(b);
+    expect(started(), "released GoodCRC starts");
+    expect(wire_end() == s_crc_b[0] && s_log[0].h1 == s_crc_b[1], "newer GoodCRC goes out");
+    expect(started(), "reply starts after it");
+    expect(wire_end() == s_accept[0], "reply goes out");
+    expect(usb_pd_tx_status(r) == PD_TX_WAIT_ACK, "reply waits for GoodCRC");
+    usb_pd_tx_on_goodcrc(PD_SOP0, 0);
+    expect(usb_pd_tx_status(r) == PD_TX_DONE && !usb_pd_tx_busy(), "queue drains");
+}
+
+/* Two held GoodCRCs in a row without a cancel: the released one still goes out */
+static void two_held(void) {
+    printf("two held GoodCRCs\n");
+    reset_queue();
+    pd_tx_handle_t a = usb_pd_tx_submit_held(s_crc_a, 2, PD_SOP0, PD_TX_PRIO_GOODCRC);
+    pd_tx_handle_t b = usb_pd_tx_submit_held(s_crc_b, 2, PD_SOP0, PD_TX_PRIO_GOODCRC);
+    expect(a && b && !started(), "both wait");
+
+    usb_pd_tx_release(b);
+    expect(started(), "released GoodCRC starts past the earlier held one");
+    expect(wire_end() == s_crc_b[0] && s_log[0].h1 == s_crc_b[1], "it goes out");
+
+    pd_tx_handle_t r = usb_pd_tx_submit(s_accept, 2, PD_SOP0, PD_TX_PRIO_REPLY);
+    expect(r && !started(), "reply waits while a GoodCRC is held");
+    usb_pd_tx_release(a);
+    expect(started() && wire_end() == s_crc_a[0], "earlier GoodCRC goes out once released");
+    expect(started() && wire_end() == s_accept[0], "then the reply");
+    usb_pd_tx_flush();
+    expect(!usb_pd_tx_busy(), "queue empty");
+}
+
+/* A cancel does not touch a frame already on the wire */
+static void cancel_on_wire(void) {
+    printf("cancel on the wire\n");
+    reset_queue();
+    pd_tx_handle_t a = usb_pd_tx_submit(s_crc_a, 2, PD_SOP0, PD_TX_PRIO_GOODCRC);
+    expect(a && started(), "GoodCRC starts");
+    usb_pd_tx_cancel(a);
+    expect(usb_pd_tx_status(a) == PD_TX_SENDING, "still sending");
+    expect(wire_end() == s_crc_a[0] && usb_pd_tx_status(a) == PD_TX_DONE, "completes");
+}
+
+int main(int argc, char **argv) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+        case 'v':
+            s_verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    superseded();
+    two_held();
+    cancel_on_wire();
+    printf("%s (%u failures)\n", s_fail ? "FAIL" : "ok", s_fail);
+    return s_fail ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * pdvcal - check the fixed-point VBUS conversion against the float one.
+ *
+ *   pdvcal [-v] <vref_mV> <R1> <R2> [actual:measured ...]
+ *   pdvcal -x
+ *
+ * Builds the Q16 segment table for a divider and calibration points as
+ * the firmware does (usb_pd_vcal.h), converts every raw ADC value with it
+ * and with the float reference the firmware used before, and prints the
+ * largest difference; -v prints the table and every raw that differs.
+ * Round trips through pd_vcal_to_raw() are checked for every mV too.
+ *
+ * -x runs the check on the board's divider and calibration table and on
+ * random dividers and tables, and checks that the flash record's CRC
+ * catches every single-bit error. Exits 0 if every raw is within 1 mV,
+ * every round trip is exact and the record check holds, 1 otherwise.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "usb_pd_vcal.h"
+
+static int s_verbose;
+
+/* --- float reference (adc_raw_to_vbus_mv() before the Q16 table) --------- */
+
+typedef struct {
+    uint16_t vref_mv;
+    uint32_t r1, r2;
+    uint8_t n;
+    pd_vcal_point_t pts[PD_VCAL_MAX_POINTS];
+} config_t;
+
+static uint16_t ref_to_mv(const config_t *c, uint16_t raw) {
+    float scale = c->vref_mv / 4095.0f * ((float)(c->r1 + c->r2) / (float)c->r2);
+    float v = (float)raw * scale;
+    float out = v;
+
+    if (c->n >= 2) {
+        const pd_vcal_point_t *p = c->pts;
+        size_t seg = 0;
+        int found = 0;
+        if (v >= (float)p[0].measured && v <= (float)p[c->n - 1].measured) {
+            for (size_t i = 0; i + 1 < c->n; i++) {
+                if (v >= (float)p[i].measured && v <= (float)p[i + 1].measured) {
+                    seg = i;
+                    found = 1;
+                    break;
+                }
+            }
+        }
+        if (found) {
+            float t = (v - (float)p[seg].measured) / ((float)p[seg + 1].measured - (float)p[seg].measured);
+            out = (float)p[seg].actual + t * ((float)p[seg + 1].actual - (float)p[seg].actual);
+        } else if (v < (float)p[0].measured) {
+            float k = ((float)p[1].actual - (float)p[0].actual) / ((float)p[1].measured - (float)p[0].measured);
+            out = (float)p[0].actual + k * (v - (float)p[0].measured);
+        } else {
+            const pd_vcal_point_t *p1 = &p[c->n - 2], *p2 = &p[c->n - 1];
+            float k = ((float)p2->actual - (float)p1->actual) / ((float)p2->measured - (float)p1->measured);
+            out = (float)p2->actual + k * (v - (float)p2->measured);
+        }
+    }
+
+    out = out < 0.0f ? 0.0f : out;
+    out = out > 65535.0f ? 65535.0f : out;
+    return (uint16_t)(out + 0.5f);
+}
+
+/* --- check ------------------------------------------------------------------ */
+
+static unsigned s_fail;
+
+static void print_table(const pd_vcal_t *t) {
+    for (uint8_t s = 0; s < t->num_seg; s++) {
+        printf("seg %u: raw >= %4u  slope %8ld (%.4f mV/raw)  offset %9ld (%.2f mV)\n", s, t->start[s],
+               (long)t->slope[s], t->slope[s] / 65536.0, (long)t->offset[s], (t->offset[s] - 0x8000) / 65536.0);
+    }
+}
+
+/* 0 if every raw is within 1 mV of the reference and every round trip holds, 1 if not, -1 if rejected */
+static int check(const config_t *c, const char *name, int show_ok) {
+    pd_vcal_t t;
+    if (!pd_vcal_build(&t, c->pts, c->n, c->vref_mv, c->r1, c->r2)) {
+        if (show_ok) printf("%s: table rejected\n", name);
+        return -1;
+    }
+    if (s_verbose) print_table(&t);
+
+    int worst = 0;
+    unsigned off = 0, trips = 0;
+    for (uint32_t raw = 0; raw <= PD_VCAL_RAW_MAX; raw++) {
+        int d = (int)pd_vcal_to_mv(&t, (uint16_t)raw) - (int)ref_to_mv(c, (uint16_t)raw);
+        if (d < 0) d = -d;
+        if (d > worst) worst = d;
+        if (d) {
+            off++;
+            if (s_verbose) printf("  raw %4lu: %5u vs %5u\n", (unsigned long)raw, pd_vcal_to_mv(&t, (uint16_t)raw),
+                                  ref_to_mv(c, (uint16_t)raw));
+        }
+        /* The raw for a converted value converts back to it */
+        uint16_t mv = pd_vcal_to_mv(&t, (uint16_t)raw);
+        if (mv && mv < 0xFFFF && pd_vcal_to_mv(&t, pd_vcal_to_raw(&t, mv)) != mv) trips++;
+    }
+
+    int ok = worst <= 1 && !trips;
+    if (ok && !show_ok) return 0;
+    printf("%s: %u segment(s), max diff %d mV, %u raw differ, %u round trip(s) off: %s\n", name, t.num_seg, worst, off,
+           trips, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+static void exhaustive(void) {
+    /* The board: 68k / 4.7k on 3.3 V with the points from usb_vbus_measure.h */
+    static const config_t board = {3300, 68000, 4700, 5, {{0, 510}, {5007, 5372}, {8975, 9199}, {11961, 12070}, {20030, 19907}}};
+    if (check(&board, "board", 1)) s_fail++;
+    config_t plain = board;
+    plain.n = 0;
+    if (check(&plain, "divider only", 1)) s_fail++;
+
+    /* Random tables: only failures are printed unless -v */
+    srand(1);
+    unsigned rejected = 0;
+    for (unsigned k = 0; k < 2000; k++) {
+        config_t c;
+        c.vref_mv = (uint16_t)(3000 + rand() % 600);
+        c.r2 = (uint32_t)(2000 + rand() % 20000);
+        c.r1 = c.r2 * (uint32_t)(4 + rand() % 20);
+        c.n = (uint8_t)(rand() % 2 ? 0 : 2 + rand() % (PD_VCAL_MAX_POINTS - 1));
+        uint32_t m = (uint32_t)(rand() % 1000), a = (uint32_t)(rand() % 1000);
+        for (uint8_t i = 0; i < c.n; i++) {
+            c.pts[i].measured = (uint16_t)m;
+            c.pts[i].actual = (uint16_t)a;
+            uint32_t step = (uint32_t)(1500 + rand() % 6000);
+            m += step;
+            a += step * (uint32_t)(900 + rand() % 200) / 1000;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "random %u", k);
+        int r = check(&c, name, s_verbose);
+        if (r < 0) rejected++;
+        if (r > 0) s_fail++;
+    }
+    printf("%u random tables (%u rejected: segment narrower than a bucket)\n", 2000 - rejected, rejected);
+
+    /* Flash record: sealed is valid, any flipped bit is not */
+    pd_vcal_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.vref_mv = board.vref_mv;
+    rec.r1 = board.r1;
+    rec.r2 = board.r2;
+    rec.n = board.n;
+    memcpy(rec.pts, board.pts, sizeof(rec.pts));
+    pd_vcal_record_seal(&rec);
+    unsigned bad = pd_vcal_record_valid(&rec) ? 0 : 1;
+    for (size_t bit = 0; bit < offsetof(pd_vcal_record_t, crc) * 8; bit++) {
+        pd_vcal_record_t r = rec;
+        ((uint8_t *)&r)[bit / 8] ^= (uint8_t)(1u << (bit % 8));
+        if (pd_vcal_record_valid(&r)) bad++;
+    }
+    printf("record: %s\n", bad ? "FAIL" : "ok");
+    s_fail += bad;
+    printf("%s (%u failures)\n", s_fail ? "FAIL" : "ok", s_fail);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-v] <vref_mV> <R1> <R2> [actual:measured ...]\n       %s -x\n", argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+    int exh = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vx")) != -1) {
+        switch (opt) {
+        case 'v':
+            s_verbose = 1;
+            break;
+        case 'x':
+            exh = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (exh) {
+        exhaustive();
+        return s_fail ? 1 : 0;
+    }
+
+    if (argc - optind < 3 || argc - optind - 3 > PD_VCAL_MAX_POINTS) {
+        usage(argv[0]);
+        return 2;
+    }
+    config_t c;
+    c.vref_mv = (uint16_t)strtoul(argv[optind], NULL, 10);
+    c.r1 = (uint32_t)strtoul(argv[optind + 1], NULL, 10);
+    c.r2 = (uint32_t)strtoul(argv[optind + 2], NULL, 10);
+    c.n = 0;
+    for (int i = optind + 3; i < argc; i++) {
+        unsigned a, m;
+        if (sscanf(argv[i], "%u:%u", &a, &m) != 2) {
+            usage(argv[0]);
+            return 2;
+        }
+        c.pts[c.n].actual = (uint16_t)a;
+        c.pts[c.n].measured = (uint16_t)m;
+        c.n++;
+    }
+    return check(&c, "table", 1) ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ch32x035.h"
+
+/*
+ * Mask interrupts and return the previous state for irq_restore(), so a
+ * critical section may nest in another or run in interrupt context.
+ */
+static inline uint32_t irq_save(void) {
+    uint32_t irq;
+    __asm volatile("csrr %0, 0x800" : "=r"(irq));
+    __disable_irq();
+    return irq;
+}
+
+static inline void irq_restore(uint32_t irq) {
+    __asm volatile("csrw 0x800, %0" : : "r"(irq));
+}
@@ -61,6 +61,7 @@ int main(void) {
             last_process_millis = millis();
             usb_pd_monitor_process();
         }
+        cdc_acm_poll();
 
         // rd_en control
         // if (cdc_acm_get_dtr()) {
@@ -54,3 +54,23 @@ uint32_t millis(void) {
     }
     return _millis;
 }
+
+uint32_t millis_us(uint16_t *us) {
+    uint32_t ms;
+    uint16_t cnt;
+    do {
+        ms = _millis;
+        cnt = TIM1->CNT;
+    } while (ms != _millis);
+
+    /* Counter already wrapped but the update interrupt has not run yet (caller masks it) */
+    if ((TIM1->INTFR & TIM_UIF) && cnt < 500) ms++;
+    if (us) *us = cnt;
+    return ms;
+}
+
+uint32_t micros(void) {
+    uint16_t us;
+    uint32_t ms = millis_us(&us);
+    return ms * 1000 + us;
+}
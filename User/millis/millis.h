@@ -4,3 +4,9 @@
 
 void millis_init(void);
 uint32_t millis(void);
+
+/* ms since start and the µs within it, read together; safe in interrupts */
+uint32_t millis_us(uint16_t *us);
+
+/* µs since start (wraps after about 71 minutes); safe in interrupts */
+uint32_t micros(void);
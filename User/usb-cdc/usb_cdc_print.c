@@ -4,7 +4,21 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include "usb_cdc_print.h"
+#include "millis.h"
+#include "usb_pd_message.h"
+#include "usb_pd_monitor.h"
+#include "usb_pd_cable.h"
+#include "usb_pd_header.h"
+#include "usb_pd_link.h"
+#include "usb_pd_policy.h"
+#include "usb_pd_reset.h"
+#include "usb_pd_script.h"
 #include "usb_pd_snk.h"
+#include "usb_pd_src.h"
+#include "usb_pd_sweep.h"
+#include "usb_pd_cctl.h"
+#include "usb_pd_vcap.h"
+#include "usb_pd_calib.h"
 
 /*!< endpoint address */
 #define CDC_IN_EP  0x81
@@ -21,6 +35,10 @@
 
 #define CDC_MAX_MPS 64
 
+#define CDC_RX_SLOTS        4   // OUT 包环形缓冲
+#define CDC_REPLY_SLOTS     8   // 待发送的帧应答
+#define CDC_LINK_TIMEOUT_MS 100 // 未完成的帧超过此时间后丢弃
+
 #ifdef CONFIG_USBDEV_ADVANCE_DESC
 static const uint8_t device_descriptor[] = {
     USB_DEVICE_DESCRIPTOR_INIT(USB_2_0, 0xEF, 0x02, 0x01, USBD_VID, USBD_PID, 0x0100, 0x01),
@@ -87,6 +105,7 @@ USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t read_buffer[CDC_MAX_MPS];
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t write_buffer[256];
 
 volatile bool ep_tx_busy_flag = false;
+static volatile bool s_rx_stalled = false; // OUT 包环形缓冲满，端点暂停接收（NAK）
 
 void usb_dc_low_level_init(void) {
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
@@ -111,7 +130,7 @@ void usb_dc_low_level_init(void) {
 
     NVIC_InitTypeDef NVIC_InitStructure = {0};
     NVIC_InitStructure.NVIC_IRQChannel = USBFS_IRQn;
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1; /* PD timers (TIM2_CC) preempt USB */
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
@@ -132,6 +151,7 @@ static void usbd_event_handler(uint8_t busid, uint8_t event) {
         break;
     case USBD_EVENT_CONFIGURED:
         ep_tx_busy_flag = false;
+        s_rx_stalled = false;
         /* setup first out ep read transfer */
         usbd_ep_start_read(busid, CDC_OUT_EP, read_buffer, CDC_MAX_MPS);
         break;
@@ -145,45 +165,244 @@ static void usbd_event_handler(uint8_t busid, uint8_t event) {
     }
 }
 
-void usbd_cdc_acm_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes) {
-    USB_LOG_RAW("actual out len:%d\r\n", (unsigned int)nbytes);
+static inline bool is_digit(uint8_t c) {
+    return c >= '0' && c <= '9';
+}
 
-    /* Dispatch received data: commands in LISTEN mode, binary PD frames in SNK mode */
-    if (nbytes > 0) {
-        if (usb_pd_snk_is_active()) {
-            /* In SNK mode: check for "exit" command (ASCII), otherwise treat as raw PD bytes */
-            if (nbytes == 4 &&
-                read_buffer[0] == 'e' && read_buffer[1] == 'x' && read_buffer[2] == 'i' && read_buffer[3] == 't') {
-                usb_pd_snk_exit();
+/* Four-letter LISTEN command prefix */
+static bool cmd_is(const uint8_t *buf, const char *cmd) {
+    return buf[0] == cmd[0] && buf[1] == cmd[1] && buf[2] == cmd[2] && buf[3] == cmd[3];
+}
+
+/* Decimal argument starting at buf[start], saturated to 0xFFFF; 0 if absent */
+static uint16_t parse_u16(const uint8_t *buf, uint32_t n, uint32_t start) {
+    uint32_t v = 0;
+    for (uint32_t i = start; i < n && is_digit(buf[i]) && v <= 0xFFFF; i++) {
+        v = v * 10 + (uint32_t)(buf[i] - '0');
+    }
+    return v > 0xFFFF ? 0xFFFF : (uint16_t)v;
+}
+
+/* SNK/SRC mode and exactly 2 + 4 * NumDO bytes long: a PD frame whatever its first bytes spell */
+static bool is_pd_frame(const uint8_t *buf, uint32_t n) {
+    if (!usb_pd_snk_is_active() && !usb_pd_src_is_active()) return false;
+    return n >= 2 && n == 2u + 4u * PD_HDR_NUM_DO(pd_header_read(buf));
+}
+
+/**
+ * @brief  执行一条命令：LISTEN 模式下的 ASCII 命令，SNK/SRC 模式下为原始 PD 帧
+ *         在主循环中运行且不关中断，处理函数可以打印；与 PD 中断共享的状态由所属模块自行加锁
+ * @param  framed: 来自帧协议的命令；裸包中长度符合 PD 帧的不再按命令前缀匹配
+ * @return false: LISTEN 模式下无法识别的命令
+ */
+static bool dispatch_command(const uint8_t *buf, uint32_t n, bool framed) {
+    if (!framed && is_pd_frame(buf, n)) {
+        if (usb_pd_src_is_active()) {
+            usb_pd_src_on_cdc_bytes(buf, (uint8_t)n);
+        } else {
+            usb_pd_snk_on_cdc_bytes(buf, (uint8_t)n);
+        }
+    } else if (n >= 4 && buf[0] == 's' && buf[1] == 'c' && buf[2] == 'r') {
+        /* Script upload / control in any mode: scrc, scrl<bytes>, scrr, scra */
+        usb_pd_script_on_cdc_bytes(buf, (uint8_t)n);
+    } else if (n == 4 && (buf[0] == 'h' || buf[0] == 'c') &&
+               buf[1] == 'r' && buf[2] == 's' && buf[3] == 't') {
+        /* Hard Reset / Cable Reset signaling in SNK or SRC mode: hrst, crst */
+        usb_pd_reset_on_cdc_bytes(buf, (uint8_t)n);
+    } else if (n == 4 && buf[0] == 'c' && buf[1] == 'a' && buf[2] == 'b' &&
+               buf[3] == 'l') {
+        /* Cable e-marker query in SNK or SRC mode */
+        usb_pd_cable_on_cdc_bytes(buf, (uint8_t)n);
+    } else if (n >= 4 && buf[0] == 's' && buf[1] == 'w' && buf[2] == 'p') {
+        /* PPS / AVS voltage sweep in SNK mode: swp<from>,<to>,<step>[,<dwell>], swpx */
+        usb_pd_sweep_on_cdc_bytes(buf, (uint8_t)n);
+    } else if (n >= 4 && cmd_is(buf, "vcap")) {
+        /* VBUS waveform around the next Accept / PS_RDY / Hard Reset / detach in any mode: vcap[aphd][<n>], vcapx */
+        usb_pd_vcap_on_cdc_bytes(buf, (uint8_t)n);
+    } else if (usb_pd_src_is_active()) {
+        /* In SRC mode: "exit", Source_Capabilities to advertise, or raw PD bytes */
+        usb_pd_src_on_cdc_bytes(buf, (uint8_t)n);
+    } else if (usb_pd_snk_is_active()) {
+        /* In SNK mode: check for "exit" command (ASCII), otherwise treat as raw PD bytes */
+        if (n == 4 &&
+            buf[0] == 'e' && buf[1] == 'x' && buf[2] == 'i' && buf[3] == 't') {
+            usb_pd_snk_exit();
+        } else {
+            usb_pd_snk_on_cdc_bytes(buf, (uint8_t)n);
+        }
+    } else {
+        /* In LISTEN mode: accept ASCII command "snk2"/"snk3" or plain "snk" */
+        if ((n >= 4) &&
+            (buf[0] == 's' || buf[0] == 'S') &&
+            (buf[1] == 'n' || buf[1] == 'N') &&
+            (buf[2] == 'k' || buf[2] == 'K') &&
+            (buf[3] == '2')) {
+            usb_pd_snk_set_spec_rev(2);
+            usb_pd_snk_enter();
+        } else if ((n >= 4) &&
+                   (buf[0] == 's' || buf[0] == 'S') &&
+                   (buf[1] == 'n' || buf[1] == 'N') &&
+                   (buf[2] == 'k' || buf[2] == 'K') &&
+                   (buf[3] == '3')) {
+            usb_pd_snk_set_spec_rev(3);
+            usb_pd_snk_enter();
+        } else if (n >= 3 &&
+                   (buf[0] == 's' || buf[0] == 'S') &&
+                   (buf[1] == 'n' || buf[1] == 'N') &&
+                   (buf[2] == 'k' || buf[2] == 'K')) {
+            /* default to PD2.0 when plain 'snk' used */
+            usb_pd_snk_set_spec_rev(2);
+            usb_pd_snk_enter();
+        } else if (n >= 3 && buf[0] == 's' && buf[1] == 'r' && buf[2] == 'c') {
+            /* "src"/"src2"/"src3": source emulation, PD2.0 unless "src3" */
+            usb_pd_src_set_spec_rev(n >= 4 && buf[3] == '3' ? 3 : 2);
+            usb_pd_src_enter();
+        } else if (n >= 4 && buf[0] == 'r' && buf[1] == 'p' && is_digit(buf[2])) {
+            /* "rp<uA>": SRC mode Rp current, rp80 / rp180 / rp330 */
+            usb_pd_src_set_rp(parse_u16(buf, n, 2));
+        } else if (n >= 4 && cmd_is(buf, "cctl")) {
+            /* CC / VBUS timeline around the next attach/detach: cctl, cctlx */
+            usb_pd_cctl_on_cdc_bytes(buf, (uint8_t)n);
+        } else if (n >= 4 && cmd_is(buf, "vcal")) {
+            /* VBUS calibration: vcal, vcal<mV>, vcalc, vcalw, vcale */
+            usb_pd_calib_on_cdc_bytes(buf, (uint8_t)n);
+        } else if (n >= 3 && buf[0] == 'b' && buf[1] == 'i' && buf[2] == 'n') {
+            /* binary record output for host tools */
+            set_message_output_binary(true);
+        } else if (n >= 3 && buf[0] == 't' && buf[1] == 'x' && buf[2] == 't') {
+            set_message_output_binary(false);
+        } else if (n >= 5 && cmd_is(buf, "gcrc") && is_digit(buf[4])) {
+            /* "gcrc<us>": GoodCRC turnaround for SNK mode, e.g. gcrc30 */
+            usb_pd_monitor_set_goodcrc_delay(parse_u16(buf, n, 4));
+        } else if (n >= 4 && (cmd_is(buf, "vmax") || cmd_is(buf, "vfix") ||
+                                   cmd_is(buf, "vpps") || cmd_is(buf, "imax"))) {
+            /* SNK policy target: vmax[<mV>] max power (under mV), vfix<mV>, vpps<mV>, imax<mA> (0: no limit) */
+            pd_policy_target_t target;
+            usb_pd_policy_get_target(&target);
+            uint16_t value = parse_u16(buf, n, 4);
+            if (buf[0] == 'i') {
+                target.ma_max = value;
             } else {
-                usb_pd_snk_on_cdc_bytes(read_buffer, (uint8_t)nbytes);
+                target.mode = buf[1] == 'm' ? PD_POLICY_MAX_POWER
+                            : buf[1] == 'f' ? PD_POLICY_VOLTAGE
+                                                    : PD_POLICY_PPS;
+                target.mv = value;
             }
+            usb_pd_policy_set_target(&target);
         } else {
-            /* In LISTEN mode: accept ASCII command "snk2"/"snk3" or plain "snk" */
-            if ((nbytes >= 4) &&
-                (read_buffer[0] == 's' || read_buffer[0] == 'S') &&
-                (read_buffer[1] == 'n' || read_buffer[1] == 'N') &&
-                (read_buffer[2] == 'k' || read_buffer[2] == 'K') &&
-                (read_buffer[3] == '2')) {
-                usb_pd_snk_set_spec_rev(2);
-                usb_pd_snk_enter();
-            } else if ((nbytes >= 4) &&
-                       (read_buffer[0] == 's' || read_buffer[0] == 'S') &&
-                       (read_buffer[1] == 'n' || read_buffer[1] == 'N') &&
-                       (read_buffer[2] == 'k' || read_buffer[2] == 'K') &&
-                       (read_buffer[3] == '3')) {
-                usb_pd_snk_set_spec_rev(3);
-                usb_pd_snk_enter();
-            } else if (nbytes >= 3 &&
-                       (read_buffer[0] == 's' || read_buffer[0] == 'S') &&
-                       (read_buffer[1] == 'n' || read_buffer[1] == 'N') &&
-                       (read_buffer[2] == 'k' || read_buffer[2] == 'K')) {
-                /* default to PD2.0 when plain 'snk' used */
-                usb_pd_snk_set_spec_rev(2);
-                usb_pd_snk_enter();
-            }
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Received OUT packets, consumed by cdc_rx_drain() */
+static uint8_t s_rx_pkt[CDC_RX_SLOTS][CDC_MAX_MPS];
+static uint8_t s_rx_pkt_len[CDC_RX_SLOTS];
+static volatile uint8_t s_rx_head = 0;
+static volatile uint8_t s_rx_tail = 0;
+
+static pd_link_rx_t s_link;
+static uint32_t s_link_ms = 0; // 最近一次收到帧数据的时刻
+
+/* Replies waiting for cdc_acm_poll() */
+typedef struct {
+    uint8_t op;
+    uint8_t seq;
+    uint8_t status;
+} cdc_reply_t;
+
+static cdc_reply_t s_reply[CDC_REPLY_SLOTS];
+static volatile uint8_t s_reply_head = 0;
+static volatile uint8_t s_reply_tail = 0;
+
+static void queue_reply(uint8_t op, uint8_t seq, uint8_t status) {
+    uint8_t next = (uint8_t)((s_reply_head + 1) % CDC_REPLY_SLOTS);
+    if (next == s_reply_tail) return; /* Host is not reading; drop */
+    s_reply[s_reply_head].op = (uint8_t)(op | PD_LINK_OP_REPLY);
+    s_reply[s_reply_head].seq = seq;
+    s_reply[s_reply_head].status = status;
+    s_reply_head = next;
+}
+
+static void handle_frame(const pd_link_rx_t *rx) {
+    uint8_t status = PD_LINK_OK;
+    switch (rx->op) {
+    case PD_LINK_OP_PING:
+        break;
+    case PD_LINK_OP_CMD:
+        if (!rx->data_len) {
+            status = PD_LINK_ERR_FORMAT;
+        } else if (!dispatch_command(rx->data, rx->data_len, true)) {
+            status = PD_LINK_ERR_REJECTED;
+        }
+        break;
+    default:
+        status = PD_LINK_ERR_OPCODE;
+        break;
+    }
+    queue_reply(rx->op, rx->seq, status);
+}
+
+/*
+ * A packet that starts with 0x00, or continues a partly received frame,
+ * goes through the frame decoder; any other packet is one command as before.
+ */
+static void cdc_rx_packet(const uint8_t *buf, uint8_t n) {
+    uint32_t now = millis();
+    if (pd_link_rx_pending(&s_link) && now - s_link_ms > CDC_LINK_TIMEOUT_MS) pd_link_rx_init(&s_link);
+
+    if (!pd_link_rx_pending(&s_link) && buf[0] != 0x00) {
+        dispatch_command(buf, n, false);
+        return;
+    }
+
+    s_link_ms = now;
+    for (uint8_t i = 0; i < n; i++) {
+        pd_link_rx_result_t r = pd_link_rx_feed(&s_link, buf[i]);
+        if (r == PD_LINK_RX_FRAME) {
+            handle_frame(&s_link);
+        } else if (r == PD_LINK_RX_ERROR) {
+            queue_reply(s_link.op, s_link.seq, s_link.status);
         }
     }
+}
+
+/* Main loop: decode and run queued packets, then resume a stalled OUT endpoint */
+static void cdc_rx_drain(void) {
+    while (s_rx_tail != s_rx_head) {
+        uint8_t t = s_rx_tail;
+        cdc_rx_packet(s_rx_pkt[t], s_rx_pkt_len[t]);
+        s_rx_tail = (uint8_t)((t + 1) % CDC_RX_SLOTS);
+    }
+
+    if (s_rx_stalled) {
+        NVIC_DisableIRQ(USBFS_IRQn);
+        s_rx_stalled = false;
+        usbd_ep_start_read(0, CDC_OUT_EP, read_buffer, CDC_MAX_MPS);
+        NVIC_EnableIRQ(USBFS_IRQn);
+    }
+}
+
+/* USBFS interrupt: only copy the packet; commands are handled by cdc_acm_poll() */
+void usbd_cdc_acm_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes) {
+    USB_LOG_RAW("actual out len:%d\r\n", (unsigned int)nbytes);
+
+    uint8_t h = s_rx_head;
+    uint8_t next = (uint8_t)((h + 1) % CDC_RX_SLOTS);
+    if (nbytes > 0) {
+        if (nbytes > CDC_MAX_MPS) nbytes = CDC_MAX_MPS;
+        memcpy(s_rx_pkt[h], read_buffer, nbytes);
+        s_rx_pkt_len[h] = (uint8_t)nbytes;
+        s_rx_head = next;
+        next = (uint8_t)((next + 1) % CDC_RX_SLOTS);
+    }
+
+    /* No free slot for the next packet: leave the endpoint NAKing until the main loop catches up */
+    if (next == s_rx_tail) {
+        s_rx_stalled = true;
+        return;
+    }
 
     /* setup next out ep read transfer */
     usbd_ep_start_read(busid, ep, read_buffer, CDC_MAX_MPS);
@@ -233,8 +452,7 @@ void usbd_cdc_acm_set_dtr(uint8_t busid, uint8_t intf, bool dtr) {
     dtr_enable = dtr;
 }
 
-void cdc_acm_prints(char *str) {
-    uint32_t len = strlen(str);
+void cdc_acm_write(const uint8_t *data, uint32_t len) {
     uint32_t sent = 0;
 
     while (sent < len) {
@@ -245,7 +463,7 @@ void cdc_acm_prints(char *str) {
         }
 
         ep_tx_busy_flag = true;
-        usbd_ep_start_write(0, CDC_IN_EP, (uint8_t *)(str + sent), chunk_size);
+        usbd_ep_start_write(0, CDC_IN_EP, data + sent, chunk_size);
 
         // wait for the transfer to complete
         while (ep_tx_busy_flag) {
@@ -256,6 +474,10 @@ void cdc_acm_prints(char *str) {
     }
 }
 
+void cdc_acm_prints(const char *str) {
+    cdc_acm_write((const uint8_t *)str, strlen(str));
+}
+
 void cdc_acm_printf(char *format, ...) {
     va_list args;
 
@@ -263,7 +485,7 @@ void cdc_acm_printf(char *format, ...) {
     vsnprintf((char *)write_buffer, sizeof(write_buffer) - 1, format, args);
     va_end(args);
 
-    cdc_acm_prints((char *)write_buffer);
+    cdc_acm_prints((const char *)write_buffer);
 }
 
 uint8_t cdc_acm_get_dtr(void) {
@@ -273,3 +495,16 @@ uint8_t cdc_acm_get_dtr(void) {
 bool cdc_acm_is_configured(void) {
     return usb_device_is_configured(0);
 }
+
+void cdc_acm_poll(void) {
+    cdc_rx_drain();
+    if (!cdc_acm_is_configured()) return;
+
+    while (s_reply_tail != s_reply_head) {
+        const cdc_reply_t *r = &s_reply[s_reply_tail];
+        uint8_t wire[16];
+        size_t n = pd_link_encode(r->op, r->seq, &r->status, 1, wire, sizeof(wire));
+        s_reply_tail = (uint8_t)((s_reply_tail + 1) % CDC_REPLY_SLOTS);
+        if (n) cdc_acm_write(wire, (uint32_t)n);
+    }
+}
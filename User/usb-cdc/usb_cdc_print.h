@@ -9,7 +9,11 @@
 #include "usbd_cdc_acm.h"
 
 void cdc_acm_init(uint8_t busid, uintptr_t reg_base);
-void cdc_acm_prints(char *str);
+void cdc_acm_write(const uint8_t *data, uint32_t len);
+void cdc_acm_prints(const char *str);
 void cdc_acm_printf(char *format, ...);
 uint8_t cdc_acm_get_dtr(void);
 bool cdc_acm_is_configured(void);
+
+/* Run received commands and send their replies; call from the main loop */
+void cdc_acm_poll(void);
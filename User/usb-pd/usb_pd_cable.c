@@ -0,0 +1,179 @@
+#include "usb_pd_cable.h"
+
+#include "ch32x035_usbpd.h"
+#include "debug.h"
+#include "millis.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_header.h"
+#include "usb_pd_snk.h"
+#include "usb_pd_src.h"
+#include "usb_pd_tx.h"
+
+#define CABLE_MAX_VDO 7
+
+/* 查询状态 */
+enum {
+    CABLE_IDLE = 0,
+    CABLE_WAIT_TX,   // Discover Identity 已排队，等待 GoodCRC
+    CABLE_WAIT_RESP, // 等待 tVDMSenderResponse 内的应答
+};
+
+static volatile uint8_t s_state = CABLE_IDLE;
+static volatile uint8_t s_sop = PD_SOP1;
+static volatile pd_tx_handle_t s_handle = 0;
+static uint32_t s_t_ms = 0;
+static volatile bool s_no_mode = false;
+
+/* Response captured in the RX interrupt */
+static volatile bool s_rx_ready = false;
+static uint32_t s_vdos[CABLE_MAX_VDO];
+static uint8_t s_nvdo = 0;
+
+static pd_cable_info_t s_info;
+static bool s_info_valid = false;
+
+static inline uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void wr32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint8_t spec_flag(void) {
+    return usb_pd_src_is_active() ? usb_pd_src_get_spec_flag() : usb_pd_snk_get_spec_flag();
+}
+
+/* Discover Identity REQ on sop; MessageID is filled in by the transmit queue */
+static bool send_discover_identity(uint8_t sop) {
+    uint8_t flag = spec_flag();
+    uint8_t frame[6];
+    frame[0] = (uint8_t)(0x0F | flag); /* Vendor_Defined; bit5 reserved on SOP'/SOP'' */
+    frame[1] = 0x10;                   /* NumDO=1, Cable Plug=0 (from a port) */
+    wr32(&frame[2], pd_vdm_request(PD_VDM_CMD_DISCOVER_IDENTITY, flag == 0x80 ? 1 : 0));
+
+    s_rx_ready = false;
+    s_sop = sop;
+    s_handle = usb_pd_tx_submit(frame, sizeof(frame), sop, PD_TX_PRIO_REPLY);
+    if (!s_handle) return false;
+    s_t_ms = millis();
+    s_state = CABLE_WAIT_TX;
+    return true;
+}
+
+bool usb_pd_cable_query(void) {
+    if (!usb_pd_snk_is_active() && !usb_pd_src_is_active()) return false;
+    if (s_state != CABLE_IDLE) return false;
+    s_info_valid = false;
+    return send_discover_identity(PD_SOP1);
+}
+
+void usb_pd_cable_on_cdc_bytes(const uint8_t *data, uint8_t len) {
+    if (len != 4 || data[0] != 'c' || data[1] != 'a' || data[2] != 'b' || data[3] != 'l') return;
+    if (!usb_pd_cable_query()) s_no_mode = true;
+}
+
+bool usb_pd_cable_is_waiting(uint8_t sop) {
+    return s_state != CABLE_IDLE && sop == s_sop;
+}
+
+void usb_pd_cable_on_rx(uint8_t sop, const uint8_t *frame, uint8_t len) {
+    if (!usb_pd_cable_is_waiting(sop) || s_rx_ready || len < 6) return;
+    uint16_t hdr = pd_header_read(frame);
+    /* Vendor_Defined from the cable plug (Cable Plug bit set) */
+    if (PD_HDR_EXTENDED(hdr) || PD_HDR_MSG_TYPE(hdr) != 0x0F || !(frame[1] & 0x01)) return;
+
+    uint8_t n = PD_HDR_NUM_DO(hdr);
+    if (n > CABLE_MAX_VDO) n = CABLE_MAX_VDO;
+    if (2 + 4 * n > len) n = (uint8_t)((len - 2) / 4);
+    for (uint8_t i = 0; i < n; i++) s_vdos[i] = rd32(&frame[2 + 4 * i]);
+    s_nvdo = n;
+    s_rx_ready = true;
+}
+
+bool usb_pd_cable_info(pd_cable_info_t *info) {
+    if (!s_info_valid) return false;
+    *info = s_info;
+    return true;
+}
+
+static void finish(void) {
+    s_state = CABLE_IDLE;
+    s_handle = 0;
+}
+
+/* Print and decode a response; true if an SOP'' query should follow */
+static bool report_response(const char *label) {
+    uint32_t h = s_vdos[0];
+    cdc_acm_printf("# cable: %s", label);
+    for (uint8_t i = 0; i < s_nvdo; i++) cdc_acm_printf(" 0x%08lX", (unsigned long)s_vdos[i]);
+    cdc_acm_prints("\n");
+
+    if (PD_VDM_CMD_TYPE(h) == PD_VDM_NAK) {
+        cdc_acm_printf("# cable: %s Discover Identity NAK\n", label);
+        return false;
+    }
+    if (PD_VDM_CMD_TYPE(h) == PD_VDM_BUSY) {
+        cdc_acm_printf("# cable: %s busy, send 'cabl' again\n", label);
+        return false;
+    }
+
+    pd_cable_info_t info;
+    if (!pd_cable_decode(s_vdos, s_nvdo, &info)) {
+        cdc_acm_printf("# cable: %s not a cable identity\n", label);
+        return false;
+    }
+    char buf[96];
+    pd_cable_format(&info, buf, sizeof(buf));
+    cdc_acm_printf("# cable: %s %s\n", label, buf);
+    if (s_sop != PD_SOP1) return false;
+
+    s_info = info;
+    s_info_valid = true;
+    return info.sop2;
+}
+
+void usb_pd_cable_poll(void) {
+    if (s_no_mode && cdc_acm_is_configured()) {
+        s_no_mode = false;
+        cdc_acm_prints("# cable: enter SNK or SRC mode first, or a query is running\n");
+    }
+    if (s_state == CABLE_IDLE) return;
+
+    if (!usb_pd_snk_is_active() && !usb_pd_src_is_active()) {
+        finish();
+        return;
+    }
+
+    const char *label = pd_sop_label(s_sop);
+    uint32_t now = millis();
+
+    if (s_rx_ready) {
+        if (!cdc_acm_is_configured()) return;
+        bool next = report_response(label);
+        finish();
+        if (next && !send_discover_identity(PD_SOP2)) cdc_acm_prints("# cable: SOP'' query not queued\n");
+        return;
+    }
+
+    if (s_state == CABLE_WAIT_TX) {
+        pd_tx_status_t st = usb_pd_tx_status(s_handle);
+        if (st == PD_TX_DONE) {
+            /* tVDMSenderResponse runs from the GoodCRC */
+            s_state = CABLE_WAIT_RESP;
+            s_t_ms = now;
+        } else if (st == PD_TX_FAILED || st == PD_TX_UNKNOWN) {
+            finish();
+            if (cdc_acm_is_configured()) cdc_acm_printf("# cable: no GoodCRC on %s (no e-marker or no VCONN)\n", label);
+        }
+        return;
+    }
+
+    if (now - s_t_ms > PD_T_VDM_SENDER_RESPONSE_MS) {
+        finish();
+        if (cdc_acm_is_configured()) cdc_acm_printf("# cable: no Discover Identity response on %s\n", label);
+    }
+}
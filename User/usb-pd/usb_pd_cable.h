@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "usb_pd_vdm.h"
+
+/*
+ * Cable e-marker query in SNK or SRC mode: Discover Identity on SOP', then
+ * on SOP'' when an active cable reports an SOP'' controller. Frames go
+ * through the transmit queue, which keeps separate MessageID counters per
+ * SOP type. The cable's frames are only acknowledged while a query is
+ * outstanding, so a source talking to the cable itself is not disturbed.
+ * The e-marker needs VCONN, which this board does not switch: it has to
+ * come from the partner (or the cable must be self-powered).
+ */
+
+/* "cabl" from the host */
+void usb_pd_cable_on_cdc_bytes(const uint8_t *data, uint8_t len);
+
+/* Start a query; false outside SNK/SRC mode or while one is running */
+bool usb_pd_cable_query(void);
+
+/* A query is waiting for a frame on this SOP (PD_SOP1 / PD_SOP2); interrupt context */
+bool usb_pd_cable_is_waiting(uint8_t sop);
+
+/* Non-GoodCRC frame received on SOP'/SOP'' while waiting; interrupt context */
+void usb_pd_cable_on_rx(uint8_t sop, const uint8_t *frame, uint8_t len);
+
+/* Result of the last successful SOP' query; false if none */
+bool usb_pd_cable_info(pd_cable_info_t *info);
+
+/* Timeouts, next step and prints; call from the main loop */
+void usb_pd_cable_poll(void);
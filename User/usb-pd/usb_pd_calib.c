@@ -0,0 +1,169 @@
+#include "usb_pd_calib.h"
+
+#include <stdbool.h>
+
+#include "usb_cdc_print.h"
+#include "usb_pd_vcal.h"
+#include "usb_vbus_measure.h"
+
+/* 主机命令 */
+enum {
+    CMD_NONE = 0,
+    CMD_SHOW,
+    CMD_CAPTURE,
+    CMD_CLEAR,
+    CMD_WRITE,
+    CMD_ERASE,
+};
+
+static volatile uint8_t s_cmd = CMD_NONE;
+static volatile uint16_t s_cmd_mv = 0;
+
+/* Points being edited; a single point is kept here until a second one makes a table */
+static pd_vcal_record_t s_work;
+static bool s_work_valid = false;
+
+/* Capture in progress */
+static bool s_capturing = false;
+static uint16_t s_capture_mv = 0;
+static uint8_t s_capture_polls = 0;
+static uint32_t s_capture_sum = 0;
+
+void usb_pd_calib_on_cdc_bytes(const uint8_t *data, uint8_t len) {
+    if (len < 4 || data[0] != 'v' || data[1] != 'c' || data[2] != 'a' || data[3] != 'l') return;
+    if (len == 4) {
+        s_cmd = CMD_SHOW;
+    } else if (len == 5 && data[4] == 'c') {
+        s_cmd = CMD_CLEAR;
+    } else if (len == 5 && data[4] == 'w') {
+        s_cmd = CMD_WRITE;
+    } else if (len == 5 && data[4] == 'e') {
+        s_cmd = CMD_ERASE;
+    } else if (data[4] >= '0' && data[4] <= '9') {
+        uint32_t mv = 0;
+        for (uint8_t i = 4; i < len && data[i] >= '0' && data[i] <= '9' && mv <= 0xFFFF; i++) {
+            mv = mv * 10 + (uint32_t)(data[i] - '0');
+        }
+        s_cmd_mv = mv > 0xFFFF ? 0xFFFF : (uint16_t)mv;
+        s_cmd = CMD_CAPTURE;
+    }
+}
+
+static pd_vcal_record_t *work(void) {
+    if (!s_work_valid) {
+        adc_vbus_cal_get(&s_work);
+        s_work_valid = true;
+    }
+    return &s_work;
+}
+
+static void print_table(void) {
+    pd_vcal_record_t rec;
+    bool flash = adc_vbus_cal_get(&rec);
+    uint32_t sum = adc_get_vbus_raw_sum();
+
+    cdc_acm_printf("# vcal: %s, %umV ref, %lu/%lu divider, %u point(s)", flash ? "flash" : "built-in", rec.vref_mv,
+                   (unsigned long)rec.r1, (unsigned long)rec.r2, rec.n);
+    for (uint8_t i = 0; i < rec.n; i++) cdc_acm_printf(" %u<-%u", rec.pts[i].actual, rec.pts[i].measured);
+    if (s_work_valid && s_work.n == 1) {
+        cdc_acm_printf(", pending %u<-%u", s_work.pts[0].actual, s_work.pts[0].measured);
+    }
+    cdc_acm_printf("\n# vcal: now %umV (measured %umV)\n", adc_get_vbus_mv(),
+                   pd_vcal_divider_mv(sum, ADC_SAMPLE_COUNT, rec.vref_mv, rec.r1, rec.r2));
+}
+
+/* Replace the point within PD_CALIB_MERGE_MV of actual, or insert it in order; false if full */
+static bool set_point(pd_vcal_record_t *rec, uint16_t actual, uint16_t measured) {
+    uint8_t i = 0;
+    while (i < rec->n && rec->pts[i].actual + PD_CALIB_MERGE_MV <= actual) i++;
+    if (i < rec->n && rec->pts[i].actual < actual + PD_CALIB_MERGE_MV) {
+        rec->pts[i].actual = actual;
+        rec->pts[i].measured = measured;
+        return true;
+    }
+    if (rec->n >= PD_VCAL_MAX_POINTS) return false;
+    for (uint8_t k = rec->n; k > i; k--) rec->pts[k] = rec->pts[k - 1];
+    rec->pts[i].actual = actual;
+    rec->pts[i].measured = measured;
+    rec->n++;
+    return true;
+}
+
+/* Apply the captured point; prints only if cdc */
+static void capture_done(bool cdc) {
+    pd_vcal_record_t rec = *work();
+    uint16_t measured =
+        pd_vcal_divider_mv(s_capture_sum, (uint32_t)PD_CALIB_CAPTURE_POLLS * ADC_SAMPLE_COUNT, rec.vref_mv, rec.r1, rec.r2);
+
+    if (!set_point(&rec, s_capture_mv, measured)) {
+        if (cdc) {
+            cdc_acm_printf("# vcal: %umV measured %umV, table full (%u points)\n", s_capture_mv, measured,
+                           PD_VCAL_MAX_POINTS);
+        }
+        return;
+    }
+    // 只有一个点时无法插值，先仅按分压换算
+    if (rec.n == 1) {
+        pd_vcal_record_t plain = rec;
+        plain.n = 0;
+        adc_vbus_cal_apply(&plain);
+        s_work = rec;
+        if (cdc) cdc_acm_printf("# vcal: %umV measured %umV, capture one more point\n", s_capture_mv, measured);
+        return;
+    }
+    if (!adc_vbus_cal_apply(&rec)) {
+        if (cdc) {
+            cdc_acm_printf("# vcal: %umV measured %umV rejected (actual and measured must both rise, points >= %umV apart)\n",
+                           s_capture_mv, measured, PD_CALIB_MERGE_MV);
+        }
+        return;
+    }
+    s_work = rec;
+    if (cdc) {
+        cdc_acm_printf("# vcal: %umV measured %umV, %u points in use, 'vcalw' to keep\n", s_capture_mv, measured, rec.n);
+    }
+}
+
+void usb_pd_calib_poll(void) {
+    uint8_t cmd = s_cmd;
+    s_cmd = CMD_NONE;
+    bool cdc = cdc_acm_is_configured();
+
+    switch (cmd) {
+    case CMD_SHOW:
+        if (cdc) print_table();
+        break;
+    case CMD_CAPTURE:
+        s_capturing = true;
+        s_capture_mv = s_cmd_mv;
+        s_capture_polls = 0;
+        s_capture_sum = 0;
+        break;
+    case CMD_CLEAR:
+        work()->n = 0;
+        adc_vbus_cal_apply(&s_work);
+        if (cdc) cdc_acm_prints("# vcal: points cleared, divider only\n");
+        break;
+    case CMD_WRITE:
+        if (work()->n == 1) {
+            if (cdc) cdc_acm_prints("# vcal: one point only, capture another before writing\n");
+        } else {
+            bool ok = adc_vbus_cal_save(&s_work);
+            if (cdc) cdc_acm_printf("# vcal: %s\n", ok ? "written to flash" : "flash write failed");
+        }
+        break;
+    case CMD_ERASE:
+        adc_vbus_cal_erase();
+        s_work_valid = false;
+        if (cdc) cdc_acm_prints("# vcal: flash erased, built-in table in use\n");
+        break;
+    default:
+        break;
+    }
+
+    if (!s_capturing) return;
+    s_capture_sum += adc_get_vbus_raw_sum();
+    if (++s_capture_polls < PD_CALIB_CAPTURE_POLLS) return;
+    s_capturing = false;
+    capture_done(cdc);
+}
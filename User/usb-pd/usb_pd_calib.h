@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * VBUS calibration over the command channel (LISTEN mode). Apply a known
+ * voltage to VBUS, then send "vcal<mV>": the VBUS ADC mean over
+ * PD_CALIB_CAPTURE_POLLS polls becomes the point's measured value, the
+ * point replaces one within PD_CALIB_MERGE_MV or is inserted, and the new
+ * table is used at once. "vcalw" stores the table in the calibration
+ * flash page, which adc_init() loads at boot.
+ *
+ *   vcal        show the table in use and the current reading
+ *   vcal<mV>    capture a point at the applied voltage
+ *   vcalc       drop all points (divider only)
+ *   vcalw       write the table to flash
+ *   vcale       erase flash, back to the built-in table
+ */
+
+#define PD_CALIB_CAPTURE_POLLS 16   // 取平均的轮询次数（每次 ADC_SAMPLE_COUNT 个采样）
+#define PD_CALIB_MERGE_MV      1000 // 实际值相差小于此值时替换原校准点（段宽须大于换算表的一个索引桶）
+
+void usb_pd_calib_on_cdc_bytes(const uint8_t *data, uint8_t len);
+
+/* Capture, flash writes and prints; call from the main loop */
+void usb_pd_calib_poll(void);
@@ -2,14 +2,20 @@
 
 #include "ch32x035_usbpd.h"
 #include "debug.h"
+#include "irq_save.h"
 #include "led_strip.h"
 #include "millis.h"
 #include "usb_cdc_print.h"
+#include "usb_pd_cctl.h"
+#include "usb_pd_event.h"
+#include "usb_pd_vcap.h"
 #include "usb_vbus_measure.h"
 
 #define USE_CC_CTRL
 #define USE_CC_RD_CTRL
 
+#define CC_EXTI_LINES (EXTI_Line14 | EXTI_Line15) // PC14 / PC15
+
 extern void reset_message_counter(void);
 
 void usb_pd_cc_en(bool en) {
@@ -48,17 +54,16 @@ void usb_pd_cc_rd_en(bool en) {
 #endif
 }
 
+/* CC_CMP 阈值阶梯，由低到高；电平序号 i 对应 cc_vol_list[i]（0.01V） */
+static const uint16_t cc_cmp_list[PD_CC_CMP_STEPS] = {CC_CMP_22, CC_CMP_45, CC_CMP_55, CC_CMP_66, CC_CMP_95, CC_CMP_123};
+static const uint8_t cc_vol_list[PD_CC_LEVELS] = {0, 22, 45, 55, 66, 95, 123, 220};
+
 /**
- * @brief  获取 CC 电压
+ * @brief  探测 CC 电平：先读 GPIO（约 2.2V），再在 6 级比较器阈值上二分查找，最多 3 次比较
  * @param  cc_num: 1:CC1, 2:CC2
- * @param  is_connected: 是否已连接
- * @return uint16_t CC voltage
+ * @return uint8_t 电平序号 0~7：超过的比较器阈值个数，GPIO 高电平为 7；比较器阈值恢复原值
  */
-static uint16_t usb_pd_phy_cc_get_voltage(uint8_t cc_num, bool is_connected) {
-    // 从低到高依次检测电压
-    const uint16_t cc_cmp_list[] = {CC_CMP_22, CC_CMP_45, CC_CMP_55, CC_CMP_66};
-    const uint8_t cc_vol_list[] = {22, 45, 55, 66, 95, 123};
-
+uint8_t usb_pd_cc_probe(uint8_t cc_num) {
     register uint32_t PIN_CC;
     register volatile uint16_t *UBSPD_PORT_CC;
 
@@ -77,33 +82,84 @@ static uint16_t usb_pd_phy_cc_get_voltage(uint8_t cc_num, bool is_connected) {
 
     // 读取 GPIO 引脚状态
     if ((GPIOC->INDR & PIN_CC) != (uint32_t)Bit_RESET) {
-        return 220;
+        return PD_CC_LEVELS - 1;
     }
 
-    // 在已连接时，只比较 CC_CMP_66
-    if (is_connected) {
+    // 结果为超过的阈值个数 [lo, hi]：7 种结果，3 次比较；CC 时间线会在中断里探测，期间关中断
+    uint32_t irq = irq_save();
+    uint16_t saved = *UBSPD_PORT_CC & (CC_CMP_Mask | PA_CC_AI); // PHY 的比较器阈值，探测后恢复
+    uint16_t base = *UBSPD_PORT_CC & ~(CC_CMP_Mask | PA_CC_AI);
+    uint8_t lo = 0, hi = PD_CC_CMP_STEPS;
+    while (lo < hi) {
+        uint8_t mid = (uint8_t)((lo + hi) / 2);
+        *UBSPD_PORT_CC = base | cc_cmp_list[mid];
         if (*UBSPD_PORT_CC & PA_CC_AI) {
-            return 66;
+            lo = (uint8_t)(mid + 1);
+        } else {
+            hi = mid;
         }
     }
+    *UBSPD_PORT_CC = base | saved;
+    irq_restore(irq);
+    return lo;
+}
 
-    // 未连接时，从低到高依次检测电压
-    if (!is_connected) {
-        uint16_t cc_vol = 0;
-        for (uint8_t i = 0; i < sizeof(cc_cmp_list) / sizeof(cc_cmp_list[0]); i++) {
-            *UBSPD_PORT_CC &= ~(CC_CMP_Mask | PA_CC_AI);
-            *UBSPD_PORT_CC |= cc_cmp_list[i];
-            if (*UBSPD_PORT_CC & PA_CC_AI) {
-                cc_vol = cc_vol_list[i];
-            } else {
-                break;
-            }
-        }
-        *UBSPD_PORT_CC = (*UBSPD_PORT_CC & ~(CC_CMP_Mask | PA_CC_AI)) | CC_CMP_66;
-        return cc_vol;
+uint16_t usb_pd_cc_level_volt(uint8_t level) {
+    return level < PD_CC_LEVELS ? cc_vol_list[level] : 0;
+}
+
+/**
+ * @brief  获取 CC 电压
+ * @param  cc_num: 1:CC1, 2:CC2
+ * @return uint16_t 不低于的最高阈值（0.01V）：0, 22, 45, 55, 66, 95, 123 或 220
+ */
+static uint16_t usb_pd_phy_cc_get_voltage(uint8_t cc_num) {
+    return cc_vol_list[usb_pd_cc_probe(cc_num)];
+}
+
+/* Edge bookkeeping, written by the EXTI and ADC watchdog interrupts */
+static volatile bool s_pending = false;     // 有未去抖的边沿
+static volatile uint32_t s_edge_us = 0;     // 本轮第一条边沿的时刻（micros）
+static volatile uint32_t s_edge_ms = 0;
+static volatile uint32_t s_last_edge_ms = 0;
+static volatile uint32_t s_pins = 0;        // 边沿时的 CC 数字电平
+static uint32_t s_watch_until_ms = 0;       // 去抖后继续判定到此时刻，之后空闲
+static bool s_watching = false;
+static uint32_t s_watch_edge_us = 0;
+static uint32_t s_watch_edge_ms = 0;
+static uint32_t s_slow_poll_ms = 0;         // 已连接时上次慢速判定的时刻
+
+static void note_edge(void) {
+    uint32_t us = micros();
+    uint32_t ms = millis();
+    if (!s_pending && !s_watching) {
+        s_edge_us = us;
+        s_edge_ms = ms;
     }
+    s_last_edge_ms = ms;
+    s_pins = GPIOC->INDR & (PIN_CC1 | PIN_CC2);
+    s_pending = true;
+}
 
-    return 0;
+/* VBUS crossed the watchdog threshold (ADC interrupt) */
+static void on_vbus_change(bool present) {
+    pd_event_t e;
+    e.kind = PD_EVENT_VBUS;
+    e.u.vbus.present = present;
+    e.u.vbus.raw = adc_get_recent_raw(4);
+    usb_pd_event_push(&e);
+    note_edge();
+}
+
+/**
+ * @brief  CC 引脚电平翻转：记录时刻，去抖期间屏蔽，由 usb_pd_cc_check_connection 重新打开
+ */
+void EXTI15_8_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void EXTI15_8_IRQHandler(void) {
+    uint32_t lines = EXTI->INTFR & CC_EXTI_LINES;
+    EXTI->INTFR = lines;
+    EXTI->INTENR &= ~CC_EXTI_LINES;
+    note_edge();
 }
 
 /**
@@ -111,6 +167,8 @@ static uint16_t usb_pd_phy_cc_get_voltage(uint8_t cc_num, bool is_connected) {
  */
 void usb_pd_cc_init(void) {
     GPIO_InitTypeDef GPIO_InitStructure = {0};
+    EXTI_InitTypeDef EXTI_InitStructure = {0};
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
 
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC, ENABLE);
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
@@ -123,122 +181,172 @@ void usb_pd_cc_init(void) {
     AFIO->CTLR |= USBPD_IN_HVT | USBPD_PHY_V33;
     USBPD->PORT_CC1 &= ~CC_LVE;
     USBPD->PORT_CC2 &= ~CC_LVE;
+
+    // CC 引脚（高阈值数字输入）双边沿中断：Sink 插拔时 CC 越过该阈值
+    GPIO_EXTILineConfig(GPIO_PortSourceGPIOC, GPIO_PinSource14);
+    GPIO_EXTILineConfig(GPIO_PortSourceGPIOC, GPIO_PinSource15);
+    EXTI_InitStructure.EXTI_Line = CC_EXTI_LINES;
+    EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising_Falling;
+    EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+    EXTI_Init(&EXTI_InitStructure);
+
+    NVIC_InitStructure.NVIC_IRQChannel = EXTI15_8_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    // Source 上电 / 断电：VBUS 看门狗
+    adc_vbus_watch(PD_CC_VBUS_ON_MV, PD_CC_VBUS_OFF_MV, on_vbus_change);
+
+    // 上电后先判定一次
+    usb_pd_cc_rescan();
+}
+
+void usb_pd_cc_rescan(void) {
+    uint32_t irq = irq_save();
+    note_edge();
+    irq_restore(irq);
+}
+
+/* Queue a CC event; attach / detach carry the edge that caused them */
+static void push_cc(uint8_t what, uint8_t conn, uint16_t cc1_volt, uint16_t cc2_volt, uint16_t vbus_volt, uint8_t rp) {
+    pd_event_t e;
+    e.kind = PD_EVENT_CC;
+    e.u.cc.what = what;
+    e.u.cc.conn = conn;
+    e.u.cc.cc1 = (uint8_t)cc1_volt;
+    e.u.cc.cc2 = (uint8_t)cc2_volt;
+    e.u.cc.rp = rp;
+    e.u.cc.vbus_mv = vbus_volt;
+    e.u.cc.vdd_mv = 0;
+    e.u.cc.edge_ms = s_watch_edge_ms;
+    e.u.cc.edge_us = s_watch_edge_us;
+    usb_pd_event_push(&e);
 }
 
 /**
- * @brief  检测 CC 连接状态（懒得改了凑合用）
+ * @brief  一次 CC 判定：量化后交给 pd_cc_fsm_step，按事件切换 CC_SEL / LED 并打印
  * @param  cc_state: CC 状态
  */
-void usb_pd_cc_check_connection(cc_state_t *cc_state) {
-    uint16_t cc1_volt, cc2_volt;
-    bool cond;
+static void cc_evaluate(pd_cc_fsm_t *cc_state) {
     uint16_t vbus_volt = adc_get_vbus_mv();
+    bool vbus = vbus_volt >= PD_CC_VBUS_ON_MV;
+
+    // 当 vbus 有电压之后，才开启 cc_en
+    if (vbus) usb_pd_cc_en(true);
 
     // 获取 CC1 和 CC2 的电压
-    cc1_volt = usb_pd_phy_cc_get_voltage(1, cc_state->cc_connection);
-    cc2_volt = usb_pd_phy_cc_get_voltage(2, cc_state->cc_connection);
+    uint16_t cc1_volt = usb_pd_phy_cc_get_voltage(1);
+    uint16_t cc2_volt = usb_pd_phy_cc_get_voltage(2);
+
+    uint8_t before = cc_state->conn;
+    uint8_t events = pd_cc_fsm_step(cc_state, pd_cc_classify(cc1_volt, cc2_volt), pd_cc_classify(cc2_volt, cc1_volt), vbus);
+    if (s_watching) {
+        usb_pd_cctl_trigger(events, s_watch_edge_ms, s_watch_edge_us);
+    } else {
+        usb_pd_cctl_trigger(events, millis(), micros()); // 慢速轮询：没有边沿
+    }
+    if (events & PD_CC_EVT_DETACH) usb_pd_vcap_trigger(PD_VCAP_DETACH, 0, millis());
+
+    if (events & PD_CC_EVT_DETACH) {
+        push_cc(PD_EVENT_CC_DETACH, before, cc1_volt, cc2_volt, vbus_volt,
+                before == PD_CC_CONN_CC2 ? pd_cc_classify(cc2_volt, cc1_volt) : pd_cc_classify(cc1_volt, cc2_volt));
+        usb_pd_cc_detach(cc_state);
+    }
+    if (events & PD_CC_EVT_ATTACH) {
+        switch (cc_state->conn) {
+        case PD_CC_CONN_CC2:
+            USBPD->CONFIG |= CC_SEL;
+            led_strip_set_pixel_with_refresh(0, 0x00, 0x0A, 0x00); // RGB GREEN
+            break;
+        case PD_CC_CONN_CC1:
+            USBPD->CONFIG &= ~CC_SEL;
+            led_strip_set_pixel_with_refresh(0, 0x00, 0x00, 0x0A); // RGB BLUE
+            break;
+        default:
+            // 调试附件：没有 PD 通信
+            USBPD->CONFIG &= ~CC_SEL;
+            led_strip_set_pixel_with_refresh(0, 0x0A, 0x00, 0x0A); // RGB MAGENTA
+            break;
+        }
+        push_cc(PD_EVENT_CC_ATTACH, cc_state->conn, cc1_volt, cc2_volt, vbus_volt, cc_state->rp);
+    }
+    if (events & PD_CC_EVT_RP_CHANGE) {
+        push_cc(PD_EVENT_CC_RP, cc_state->conn, cc1_volt, cc2_volt, vbus_volt, cc_state->rp);
+    }
+}
+
+/**
+ * @brief  CC 连接检测：由 CC 边沿 / VBUS 看门狗中断触发，去抖后在一个短窗口内判定；已连接时慢速轮询 Rp，其余时间空闲
+ * @param  cc_state: CC 状态
+ */
+void usb_pd_cc_check_connection(pd_cc_fsm_t *cc_state) {
+    uint32_t now = millis();
 
     // 开启 DTR 时打印调试信息
     if (cdc_acm_get_dtr()) {
         static uint32_t last_print_time = 0;
-        if (millis() - last_print_time > 100) {
-            last_print_time = millis();
-            cdc_acm_printf("> \037COND:%u, CC1:%03umV, CC2:%03umV, VBUS:%05umV, VDD:%dmV\n", cc_state->cc_connection, cc1_volt, cc2_volt, vbus_volt, adc_get_vdd_mv());
+        if (now - last_print_time > 100) {
+            last_print_time = now;
+            pd_event_t e;
+            e.kind = PD_EVENT_CC;
+            e.u.cc.what = PD_EVENT_CC_SAMPLE;
+            e.u.cc.conn = cc_state->conn;
+            e.u.cc.cc1 = (uint8_t)usb_pd_phy_cc_get_voltage(1);
+            e.u.cc.cc2 = (uint8_t)usb_pd_phy_cc_get_voltage(2);
+            e.u.cc.rp = cc_state->rp;
+            e.u.cc.vbus_mv = adc_get_vbus_mv();
+            e.u.cc.vdd_mv = adc_get_vdd_mv();
+            e.u.cc.edge_ms = 0;
+            e.u.cc.edge_us = 0;
+            usb_pd_event_push(&e);
         }
     }
 
-    if (vbus_volt < 1000) {
-        if (cc_state->cc_connection) {
-            cdc_acm_printf("> \037%ums \037Detach:CC%u, CC1:%03umV, CC2:%03umV, VBUS:%05umV\n", millis(), cc_state->cc_connection, cc1_volt, cc2_volt, vbus_volt);
-            usb_pd_cc_detach(cc_state);
-        }
-        return;
-    }
+    if (s_pending) {
+        if (now - s_last_edge_ms < PD_CC_DEBOUNCE_MS) return;
 
-    // 当 vbus 有电压之后，才开启 cc_en
-    usb_pd_cc_en(vbus_volt > 1000);
-
-    if (cc_state->cc_connection) {
-        // 已连接状态下的检测
-        cond = (cc1_volt >= 45 && cc1_volt <= 123) || (cc2_volt >= 45 && cc2_volt <= 123);
-        // 0 220
-        if ((cc1_volt == 0 && cc2_volt == 220) || (cc1_volt == 220 && cc2_volt == 0)) {
-            cond = false;
-        }
-        // 0 66
-        if ((cc1_volt == 0 && cc2_volt == 66) || (cc1_volt == 66 && cc2_volt == 0)) {
-            cond = true;
+        // 屏蔽期间电平仍在变化：重新去抖
+        uint32_t pins = GPIOC->INDR & (PIN_CC1 | PIN_CC2);
+        if (pins != s_pins) {
+            s_pins = pins;
+            s_last_edge_ms = now;
+            return;
         }
-        cc_state->cc_connection_count = cond ? 0 : cc_state->cc_connection_count + 1;
 
-        // 如果连续检测到未连接，则认为连接断开
-        if (!cond && cc_state->cc_connection_count >= 10) {
-            cdc_acm_printf("> \037%ums \037Detach:CC%u, CC1:%03umV, CC2:%03umV, VBUS:%05umV\n", millis(), cc_state->cc_connection, cc1_volt, cc2_volt, vbus_volt);
-            usb_pd_cc_detach(cc_state);
-        }
-    } else {
-        // 未连接状态下的检测
-        cond = (cc1_volt >= 45 && cc1_volt <= 123 && (cc2_volt >= 220 || cc2_volt <= 22)) ||
-               (cc2_volt >= 45 && cc2_volt <= 123 && (cc1_volt >= 220 || cc1_volt <= 22));
-        // 220 220
-        if (cc1_volt == 220 || cc2_volt == 220) {
-            cond = false;
-        }
-        // 123 220
-        if ((cc1_volt == 123 && cc2_volt == 220) || (cc1_volt == 220 && cc2_volt == 123)) {
-            cond = true;
-        }
-        // 95 220
-        if ((cc1_volt == 95 && cc2_volt == 220) || (cc1_volt == 220 && cc2_volt == 95)) {
-            cond = true;
-        }
-        // 66 220
-        if ((cc1_volt == 66 && cc2_volt == 220) || (cc1_volt == 220 && cc2_volt == 66)) {
-            cond = true;
-        }
-        // 55 220
-        if ((cc1_volt == 55 && cc2_volt == 220) || (cc1_volt == 220 && cc2_volt == 55)) {
-            cond = true;
-        }
-        // 0 220
-        if ((cc1_volt == 0 && cc2_volt == 220) || (cc1_volt == 220 && cc2_volt == 0)) {
-            cond = false;
-        }
-        // 0 66
-        if ((cc1_volt == 0 && cc2_volt == 66) || (cc1_volt == 66 && cc2_volt == 0)) {
-            cond = true;
-        }
-        cc_state->cc_connection_count = cond ? cc_state->cc_connection_count + 1 : 0;
-
-        // 如果连续检测到连接，则认为连接成功
-        if (cond && cc_state->cc_connection_count >= 3) {
-            if ((cc1_volt == 123 || cc1_volt == 95 || cc1_volt == 66 || cc1_volt == 55) && cc2_volt == 220) {
-                cc_state->cc_connection = 1;
-            } else if ((cc2_volt == 123 || cc2_volt == 95 || cc2_volt == 66 || cc2_volt == 55) && cc1_volt == 220) {
-                cc_state->cc_connection = 2;
-            } else {
-                cc_state->cc_connection = cc1_volt > cc2_volt ? 1 : 2;
-            }
-
-            cc_state->cc_connection_count = 0;
-
-            if (cc_state->cc_connection == 1) {
-                USBPD->CONFIG &= ~CC_SEL;
-                led_strip_set_pixel_with_refresh(0, 0x00, 0x00, 0x0A); // RGB BLUE
-                cdc_acm_printf("> \037%ums \037Attach:CC1, CC1:%03umV, CC2:%03umV, VBUS:%05umV\n", millis(), cc1_volt, cc2_volt, vbus_volt);
-            }
-            if (cc_state->cc_connection == 2) {
-                USBPD->CONFIG |= CC_SEL;
-                led_strip_set_pixel_with_refresh(0, 0x00, 0x0A, 0x00); // RGB GREEN
-                cdc_acm_printf("> \037%ums \037Attach:CC2, CC1:%03umV, CC2:%03umV, VBUS:%05umV\n", millis(), cc1_volt, cc2_volt, vbus_volt);
-            }
+        // 稳定：重新打开边沿中断，开始判定窗口
+        uint32_t irq = irq_save();
+        s_pending = false;
+        if (!s_watching) {
+            s_watch_edge_us = s_edge_us;
+            s_watch_edge_ms = s_edge_ms;
         }
+        s_watching = true;
+        s_watch_until_ms = now + PD_CC_WATCH_MS;
+        EXTI->INTFR = CC_EXTI_LINES;
+        EXTI->INTENR |= CC_EXTI_LINES;
+        irq_restore(irq);
     }
+
+    if (!s_watching) {
+        // 已连接：Rp 变化不产生边沿，慢速轮询
+        if (cc_state->conn == PD_CC_CONN_NONE || now - s_slow_poll_ms < PD_CC_ATTACHED_POLL_MS) return;
+        s_slow_poll_ms = now;
+        cc_evaluate(cc_state);
+        return;
+    }
+
+    uint8_t before = cc_state->conn;
+    cc_evaluate(cc_state);
+    // 连接变化，或窗口结束且不在确认中：回到空闲
+    bool settled = cc_state->state == PD_CC_UNATTACHED || cc_state->state == PD_CC_ATTACHED;
+    if (cc_state->conn != before || (settled && (int32_t)(now - s_watch_until_ms) >= 0)) s_watching = false;
 }
 
-void usb_pd_cc_detach(cc_state_t *cc_state) {
-    cc_state->cc_connection = 0;
-    cc_state->cc_connection_count = 0;
+void usb_pd_cc_detach(pd_cc_fsm_t *cc_state) {
+    pd_cc_fsm_init(cc_state);
     reset_message_counter();
     led_strip_set_pixel_with_refresh(0, 0x0A, 0x00, 0x00); // RGB RED
 }
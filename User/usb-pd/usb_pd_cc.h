@@ -3,14 +3,35 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-typedef struct {
-    uint8_t cc_connection;        // 0:未连接，1:CC1, 2:CC2
-    uint8_t cc_connection_count;  // 已连接计数
-} cc_state_t;
+#include "usb_pd_cc_fsm.h"
+
+/*
+ * CC attach / detach for the sniffer. Edges on the CC pins (EXTI) and
+ * VBUS crossing the ADC watchdog thresholds are timestamped in their
+ * interrupts; usb_pd_cc_check_connection() debounces them and classifies
+ * the lines with the comparators and usb_pd_cc_fsm.h for a short window.
+ * An Rp change (1.5A / 3.0A, SinkTxOk / SinkTxNG) crosses no edge
+ * threshold, so while attached the lines are also classified every
+ * PD_CC_ATTACHED_POLL_MS; otherwise it stays idle. Notices carry the time
+ * of the first edge, in µs.
+ */
+
+#define PD_CC_DEBOUNCE_MS      10   // 边沿后稳定时间（tPDDebounce 下限；Source 打开 VBUS 前已完成 tCCDebounce）
+#define PD_CC_WATCH_MS         300  // 去抖后继续判定的时间窗口
+#define PD_CC_ATTACHED_POLL_MS 20   // 已连接时的慢速判定周期
+#define PD_CC_CMP_STEPS        6    // CC_CMP_22 .. CC_CMP_123
+#define PD_CC_LEVELS           8    // 电平序号：0 + 6 级比较器 + GPIO 高电平
 
 void usb_pd_cc_en(bool en);
 void usb_pd_cc_rd_en(bool en);
 
 void usb_pd_cc_init(void);
-void usb_pd_cc_check_connection(cc_state_t *cc_state);
-void usb_pd_cc_detach(cc_state_t *cc_state);
+void usb_pd_cc_check_connection(pd_cc_fsm_t *cc_state);
+/* Classify again on the next check (e.g. after SRC mode, which drives CC itself) */
+void usb_pd_cc_rescan(void);
+void usb_pd_cc_detach(pd_cc_fsm_t *cc_state);
+
+/* Comparator ladder level 0..7 of one line (1: CC1, 2: CC2); the threshold is restored; safe from interrupts */
+uint8_t usb_pd_cc_probe(uint8_t cc_num);
+/* Level to the value the notices print (0.01 V): 0, 22 .. 123, 220 */
+uint16_t usb_pd_cc_level_volt(uint8_t level);
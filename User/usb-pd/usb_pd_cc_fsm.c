@@ -0,0 +1,184 @@
+#include "usb_pd_cc_fsm.h"
+
+#define RA   PD_CC_ADV_RA
+#define OPEN PD_CC_ADV_OPEN
+
+static pd_cc_adv_t ladder(uint16_t cc_volt) {
+    if (cc_volt >= 220) return PD_CC_ADV_OPEN;
+    if (cc_volt >= 123) return PD_CC_ADV_RP_3A0;
+    if (cc_volt >= 66) return PD_CC_ADV_RP_1A5;
+    if (cc_volt >= 22) return PD_CC_ADV_RP_DEFAULT;
+    return PD_CC_ADV_RA;
+}
+
+/* Lowest level of Rd under the Rp the other line shows; anything below it is Ra */
+static const uint16_t s_rd_min[PD_CC_ADV_COUNT] = {
+    [PD_CC_ADV_RA] = 22,
+    [PD_CC_ADV_RP_DEFAULT] = 22,
+    [PD_CC_ADV_RP_1A5] = 66,
+    [PD_CC_ADV_RP_3A0] = 123,
+    [PD_CC_ADV_OPEN] = 22,
+};
+
+pd_cc_adv_t pd_cc_classify(uint16_t cc_volt, uint16_t other_volt) {
+    pd_cc_adv_t adv = ladder(cc_volt);
+    if (adv != OPEN && cc_volt < s_rd_min[ladder(other_volt)]) return RA;
+    return adv;
+}
+
+const char *pd_cc_adv_name(uint8_t adv) {
+    static const char *const names[] = {"vRa", "Default", "1.5A", "3.0A", "open"};
+    return adv < sizeof(names) / sizeof(names[0]) ? names[adv] : "?";
+}
+
+/* Rd under any Rp advertisement */
+static inline bool is_rd(pd_cc_adv_t adv) {
+    return adv != RA && adv != OPEN;
+}
+
+pd_cc_conn_t pd_cc_pair(pd_cc_adv_t cc1, pd_cc_adv_t cc2) {
+    if (cc1 >= PD_CC_ADV_COUNT || cc2 >= PD_CC_ADV_COUNT) return PD_CC_CONN_NONE;
+    if (is_rd(cc1) && is_rd(cc2)) return PD_CC_CONN_DEBUG;
+    if (is_rd(cc1)) return PD_CC_CONN_CC1; // 另一条线 Ra（带 e-marker 的线缆）或开路
+    if (is_rd(cc2)) return PD_CC_CONN_CC2;
+    /* Ra/Ra (audio adapter) gets no VBUS and reads like no source at all: not reported */
+    return PD_CC_CONN_NONE;                // 开路 / Ra + 开路 / Ra + Ra
+}
+
+const char *pd_cc_conn_name(uint8_t conn) {
+    static const char *const names[] = {"none", "CC1", "CC2", "Debug"};
+    return conn < sizeof(names) / sizeof(names[0]) ? names[conn] : "?";
+}
+
+const char *pd_cc_state_name(uint8_t state) {
+    static const char *const names[] = {"unattached", "attach-wait", "attached", "detach-wait"};
+    return state < sizeof(names) / sizeof(names[0]) ? names[state] : "?";
+}
+
+/* Input of one poll, relative to the connection being tracked */
+enum {
+    IN_VBUS_OFF = 0, // VBUS 不存在
+    IN_NONE,         // 无连接
+    IN_SAME,         // 与跟踪的连接相同
+    IN_OTHER,        // 另一种连接
+    IN_COUNT,
+};
+
+/* 动作 */
+enum {
+    ACT_NONE = 0,
+    ACT_START,  // 新候选，计数 1
+    ACT_CONFIRM_ATTACH,
+    ACT_CONFIRM_DETACH,
+    ACT_CLEAR,  // 丢弃候选 / 不一致计数
+    ACT_DETACH, // 立即断开
+};
+
+typedef struct {
+    uint8_t next;
+    uint8_t act;
+} transition_t;
+
+static const transition_t s_table[4][IN_COUNT] = {
+    [PD_CC_UNATTACHED] = {
+        [IN_VBUS_OFF] = {PD_CC_UNATTACHED, ACT_NONE},
+        [IN_NONE]     = {PD_CC_UNATTACHED, ACT_NONE},
+        [IN_SAME]     = {PD_CC_UNATTACHED, ACT_NONE}, // 不会出现：未跟踪任何连接
+        [IN_OTHER]    = {PD_CC_ATTACH_WAIT, ACT_START},
+    },
+    [PD_CC_ATTACH_WAIT] = {
+        [IN_VBUS_OFF] = {PD_CC_UNATTACHED, ACT_CLEAR},
+        [IN_NONE]     = {PD_CC_UNATTACHED, ACT_CLEAR},
+        [IN_SAME]     = {PD_CC_ATTACH_WAIT, ACT_CONFIRM_ATTACH},
+        [IN_OTHER]    = {PD_CC_ATTACH_WAIT, ACT_START},
+    },
+    [PD_CC_ATTACHED] = {
+        [IN_VBUS_OFF] = {PD_CC_UNATTACHED, ACT_DETACH},
+        [IN_NONE]     = {PD_CC_DETACH_WAIT, ACT_CONFIRM_DETACH},
+        [IN_SAME]     = {PD_CC_ATTACHED, ACT_NONE},
+        [IN_OTHER]    = {PD_CC_DETACH_WAIT, ACT_CONFIRM_DETACH},
+    },
+    [PD_CC_DETACH_WAIT] = {
+        [IN_VBUS_OFF] = {PD_CC_UNATTACHED, ACT_DETACH},
+        [IN_NONE]     = {PD_CC_DETACH_WAIT, ACT_CONFIRM_DETACH},
+        [IN_SAME]     = {PD_CC_ATTACHED, ACT_CLEAR},
+        [IN_OTHER]    = {PD_CC_DETACH_WAIT, ACT_CONFIRM_DETACH},
+    },
+};
+
+void pd_cc_fsm_init(pd_cc_fsm_t *fsm) {
+    fsm->state = PD_CC_UNATTACHED;
+    fsm->conn = PD_CC_CONN_NONE;
+    fsm->cand = PD_CC_CONN_NONE;
+    fsm->count = 0;
+    fsm->rp = RA;
+    fsm->rp_cand = RA;
+    fsm->rp_count = 0;
+}
+
+uint8_t pd_cc_fsm_step(pd_cc_fsm_t *fsm, pd_cc_adv_t cc1, pd_cc_adv_t cc2, bool vbus) {
+    pd_cc_conn_t pair = pd_cc_pair(cc1, cc2);
+    uint8_t tracked = fsm->state == PD_CC_ATTACH_WAIT ? fsm->cand : fsm->conn; // UNATTACHED: conn 为 NONE
+    uint8_t in;
+    if (!vbus) in = IN_VBUS_OFF;
+    else if (pair == PD_CC_CONN_NONE) in = IN_NONE;
+    else if (pair == tracked) in = IN_SAME;
+    else in = IN_OTHER;
+
+    const transition_t *t = &s_table[fsm->state][in];
+    uint8_t events = 0;
+    fsm->state = t->next;
+
+    switch (t->act) {
+    case ACT_START:
+        fsm->cand = pair;
+        fsm->count = 0;
+        /* fall through */
+    case ACT_CONFIRM_ATTACH:
+        if (++fsm->count >= PD_CC_ATTACH_CONFIRM) {
+            fsm->state = PD_CC_ATTACHED;
+            fsm->conn = fsm->cand;
+            fsm->cand = PD_CC_CONN_NONE;
+            fsm->count = 0;
+            fsm->rp = fsm->conn == PD_CC_CONN_CC2 ? cc2 : cc1;
+            fsm->rp_count = 0;
+            events |= PD_CC_EVT_ATTACH;
+        }
+        break;
+    case ACT_CONFIRM_DETACH:
+        if (++fsm->count < PD_CC_DETACH_CONFIRM) break;
+        /* fall through */
+    case ACT_DETACH:
+        fsm->state = PD_CC_UNATTACHED;
+        fsm->conn = PD_CC_CONN_NONE;
+        fsm->count = 0;
+        events |= PD_CC_EVT_DETACH;
+        break;
+    case ACT_CLEAR:
+        fsm->cand = PD_CC_CONN_NONE;
+        fsm->count = 0;
+        break;
+    default:
+        break;
+    }
+
+    /* Rp is only tracked on a CC1 / CC2 attach; accessories have no single line. A poll during BMC traffic is not a change. */
+    if (fsm->state == PD_CC_ATTACHED && in == IN_SAME &&
+        (fsm->conn == PD_CC_CONN_CC1 || fsm->conn == PD_CC_CONN_CC2)) {
+        uint8_t rp = fsm->conn == PD_CC_CONN_CC2 ? cc2 : cc1;
+        if (rp == fsm->rp) {
+            fsm->rp_count = 0;
+        } else {
+            if (rp != fsm->rp_cand) {
+                fsm->rp_cand = rp;
+                fsm->rp_count = 0;
+            }
+            if (++fsm->rp_count >= PD_CC_ATTACH_CONFIRM) {
+                fsm->rp = rp;
+                fsm->rp_count = 0;
+                events |= PD_CC_EVT_RP_CHANGE;
+            }
+        }
+    }
+    return events;
+}
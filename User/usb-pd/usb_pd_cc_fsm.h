@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CC attach / detach classifier for the in-line sniffer. Each poll feeds
+ * the quantized level of both CC lines and whether VBUS is present; a
+ * pair table names the connection, and a transition table over
+ * (state, input) confirms it over several polls. No hardware dependency:
+ * the firmware feeds comparator readings (usb_pd_cc.c), the host tool
+ * Host/tools/pdcctrace.c replays recorded traces.
+ */
+
+#define PD_CC_ATTACH_CONFIRM  2    // 连续相同的连接判定次数
+#define PD_CC_DETACH_CONFIRM  3    // 连续不一致的判定次数（VBUS 消失则立即断开）
+#define PD_CC_VBUS_ON_MV      1000 // VBUS 存在阈值（迟滞）
+#define PD_CC_VBUS_OFF_MV     900
+
+/*
+ * What one CC line shows, from the comparator level (0.01 V). Rd under
+ * each Rp advertisement falls between two ladder thresholds (vRd-USB
+ * 0.25-0.61 V, vRd-1.5 0.70-1.16 V, vRd-3.0 1.31-2.04 V); above the GPIO
+ * threshold is Rp with no load. vRa rises with the Rp current (up to about
+ * 0.4 V under 3.0A Rp), so a line is Ra below the vRd range of the Rp the
+ * other line shows (0.22 V when that line shows no Rd).
+ */
+typedef enum {
+    PD_CC_ADV_RA = 0,     // vRa 或无 Rp
+    PD_CC_ADV_RP_DEFAULT, // Rd + Default USB Rp
+    PD_CC_ADV_RP_1A5,     // Rd + 1.5A Rp
+    PD_CC_ADV_RP_3A0,     // Rd + 3.0A Rp
+    PD_CC_ADV_OPEN,       // 仅 Rp，未接 Rd
+    PD_CC_ADV_COUNT,
+} pd_cc_adv_t;
+
+/* 连接类型 */
+typedef enum {
+    PD_CC_CONN_NONE = 0,
+    PD_CC_CONN_CC1,   // Sink 的 Rd 在 CC1
+    PD_CC_CONN_CC2,
+    PD_CC_CONN_DEBUG, // Rd/Rd：调试附件
+} pd_cc_conn_t;
+
+/* 状态 */
+typedef enum {
+    PD_CC_UNATTACHED = 0,
+    PD_CC_ATTACH_WAIT, // 候选连接，等待确认
+    PD_CC_ATTACHED,
+    PD_CC_DETACH_WAIT, // 已连接，判定不一致，等待确认
+} pd_cc_state_t;
+
+/* Events returned by pd_cc_fsm_step() */
+#define PD_CC_EVT_ATTACH    0x01 // conn confirmed
+#define PD_CC_EVT_DETACH    0x02 // connection lost; conn is NONE again, read it before the step
+#define PD_CC_EVT_RP_CHANGE 0x04 // Rp on the attached line changed for PD_CC_ATTACH_CONFIRM polls (e.g. SinkTxOk / SinkTxNG)
+
+typedef struct {
+    uint8_t state; // pd_cc_state_t
+    uint8_t conn;  // pd_cc_conn_t，已确认的连接
+    uint8_t cand;  // ATTACH_WAIT 中的候选连接
+    uint8_t count; // 连续次数
+    uint8_t rp;    // 已连接线上的 pd_cc_adv_t
+    uint8_t rp_cand;  // 变化中的 Rp
+    uint8_t rp_count; // rp_cand 连续次数
+} pd_cc_fsm_t;
+
+/* Comparator level (0, 22 .. 123, 220) of a line to its state, given the other line's level */
+pd_cc_adv_t pd_cc_classify(uint16_t cc_volt, uint16_t other_volt);
+const char *pd_cc_adv_name(uint8_t adv);
+
+/* Connection named by one (CC1, CC2) pair, ignoring VBUS */
+pd_cc_conn_t pd_cc_pair(pd_cc_adv_t cc1, pd_cc_adv_t cc2);
+const char *pd_cc_conn_name(uint8_t conn);
+const char *pd_cc_state_name(uint8_t state);
+
+void pd_cc_fsm_init(pd_cc_fsm_t *fsm);
+
+/* One poll; returns PD_CC_EVT_* */
+uint8_t pd_cc_fsm_step(pd_cc_fsm_t *fsm, pd_cc_adv_t cc1, pd_cc_adv_t cc2, bool vbus);
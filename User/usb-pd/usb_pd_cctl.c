@@ -0,0 +1,230 @@
+#include "usb_pd_cctl.h"
+
+#include "ch32x035_usbpd.h"
+#include "irq_save.h"
+#include "millis.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_cc.h"
+#include "usb_pd_snk.h"
+#include "usb_pd_src.h"
+#include "usb_pd_timer.h"
+#include "usb_vbus_measure.h"
+
+/* Entry: dt since the previous entry (ticks), CC1 / CC2 level, VBUS ADC raw */
+#define ENT_DT_BITS  14
+#define ENT_DT_MAX   ((1u << ENT_DT_BITS) - 1)
+#define ENT(dt, cc1, cc2, vbus) \
+    ((uint32_t)(dt) | ((uint32_t)(cc1) << 14) | ((uint32_t)(cc2) << 17) | ((uint32_t)(vbus) << 20))
+#define ENT_DT(e)    ((e) & ENT_DT_MAX)
+#define ENT_CC1(e)   (((e) >> 14) & 0x07)
+#define ENT_CC2(e)   (((e) >> 17) & 0x07)
+#define ENT_VBUS(e)  ((uint16_t)((e) >> 20))
+
+#define POST_TICKS   ((uint32_t)PD_CCTL_POST_MS * 1000 / PD_CCTL_PERIOD_US)
+
+/* 状态 */
+enum {
+    CCTL_IDLE = 0,
+    CCTL_ARMED, // 采样中，等待触发
+    CCTL_POST,  // 已触发，采样到窗口结束
+    CCTL_DONE,  // 采样结束，等待打印
+    CCTL_DUMP,  // 打印中
+};
+
+/* 主机命令 */
+enum {
+    CMD_NONE = 0,
+    CMD_ARM,
+    CMD_DISARM,
+};
+
+static volatile uint8_t s_state = CCTL_IDLE;
+static volatile uint8_t s_cmd = CMD_NONE;
+
+/* Ring, filled from the TIM2 interrupt */
+static uint32_t s_ring[PD_CCTL_ENTRIES];
+static volatile uint32_t s_count = 0;     // 写入的条目总数
+static volatile uint32_t s_tick = 0;      // 采样序号
+static volatile uint32_t s_last_tick = 0; // 最新条目的采样序号
+static volatile uint32_t s_tick_us = 0;   // 最近一次采样的 micros()
+static uint8_t s_cc1, s_cc2;
+static uint16_t s_vbus;
+static uint16_t s_due = 0;
+
+/* Trigger */
+static volatile uint32_t s_trig_tick = 0;
+static volatile uint32_t s_trig_count = 0;
+static uint8_t s_trig_events = 0;
+static uint32_t s_trig_ms = 0;
+
+/* Dump cursor */
+static uint32_t s_dump_first = 0;
+static uint32_t s_dump_idx = 0;
+static uint32_t s_dump_tick = 0;
+static uint32_t s_dump_prev = 0; // 上一行的电平（不含 dt）
+
+static void sample_tick(void) {
+    uint8_t state = s_state;
+    if (state != CCTL_ARMED && state != CCTL_POST) return;
+    uint16_t now = usb_pd_timer_now();
+    uint32_t tick = ++s_tick;
+    s_tick_us = micros();
+
+    uint8_t cc1 = usb_pd_cc_probe(1);
+    uint8_t cc2 = usb_pd_cc_probe(2);
+    uint16_t vbus = adc_get_recent_raw(1);
+    uint32_t dt = tick - s_last_tick;
+    int32_t dv = (int32_t)vbus - (int32_t)s_vbus;
+
+    /* Only changes are stored; a long steady run gets a repeat entry so dt fits */
+    if (!s_count || cc1 != s_cc1 || cc2 != s_cc2 || dv >= PD_CCTL_VBUS_STEP_RAW || dv <= -PD_CCTL_VBUS_STEP_RAW ||
+        dt >= ENT_DT_MAX) {
+        uint32_t n = s_count;
+        s_ring[n % PD_CCTL_ENTRIES] = ENT(n ? dt : 0, cc1, cc2, vbus);
+        s_count = n + 1;
+        s_last_tick = tick;
+        s_cc1 = cc1;
+        s_cc2 = cc2;
+        s_vbus = vbus;
+    }
+
+    /* Keep at least half of the ring for the history before the trigger */
+    if (state == CCTL_POST &&
+        (tick - s_trig_tick >= POST_TICKS || s_count - s_trig_count >= PD_CCTL_ENTRIES / 2)) {
+        s_state = CCTL_DONE;
+        return;
+    }
+
+    /* Keep the grid; if the tick ran late, restart it from now instead of catching up */
+    s_due = (uint16_t)(s_due + PD_CCTL_PERIOD_US);
+    if ((int16_t)(s_due - now) < (int16_t)(PD_CCTL_PERIOD_US / 4)) s_due = (uint16_t)(now + PD_CCTL_PERIOD_US);
+    usb_pd_timer_start_at(PD_TIMER_CCTL, now, (uint16_t)(s_due - now), sample_tick);
+}
+
+static void arm(void) {
+    usb_pd_timer_cancel(PD_TIMER_CCTL);
+    s_count = 0;
+    s_tick = 0;
+    s_last_tick = 0;
+    s_due = usb_pd_timer_now();
+    s_state = CCTL_ARMED;
+    sample_tick();
+}
+
+static void disarm(void) {
+    s_state = CCTL_IDLE;
+    usb_pd_timer_cancel(PD_TIMER_CCTL);
+}
+
+void usb_pd_cctl_on_cdc_bytes(const uint8_t *data, uint8_t len) {
+    if (len < 4 || data[0] != 'c' || data[1] != 'c' || data[2] != 't' || data[3] != 'l') return;
+    s_cmd = (len >= 5 && data[4] == 'x') ? CMD_DISARM : CMD_ARM;
+}
+
+bool usb_pd_cctl_is_armed(void) {
+    return s_state != CCTL_IDLE;
+}
+
+void usb_pd_cctl_trigger(uint8_t events, uint32_t edge_ms, uint32_t edge_us) {
+    if (s_state != CCTL_ARMED || !events) return;
+    uint32_t irq = irq_save();
+    /* Confirmation comes a debounce and a main-loop pass later: put the trigger on the sample of the edge */
+    int32_t late = (int32_t)(s_tick_us - edge_us);
+    uint32_t back = late > 0 ? (uint32_t)late / PD_CCTL_PERIOD_US : 0;
+    s_trig_tick = back < s_tick ? s_tick - back : 0;
+    s_trig_count = s_count;
+    s_trig_events = events;
+    s_trig_ms = edge_ms;
+    s_state = CCTL_POST;
+    irq_restore(irq);
+}
+
+static const char *trigger_name(uint8_t events) {
+    if (events & PD_CC_EVT_DETACH) return "detach";
+    if (events & PD_CC_EVT_ATTACH) return "attach";
+    return "Rp change";
+}
+
+/* Print one row; t relative to the trigger, 0.1 ms steps */
+static void print_row(uint32_t tick, const char *fmt_tail, uint32_t e) {
+    int32_t us = (int32_t)(tick - s_trig_tick) * PD_CCTL_PERIOD_US;
+    char sign = us < 0 ? '-' : '+';
+    uint32_t a = (uint32_t)(us < 0 ? -us : us);
+    cdc_acm_printf("# cctl: %c%lu.%lu", sign, (unsigned long)(a / 1000), (unsigned long)(a % 1000 / 100));
+    if (fmt_tail) {
+        cdc_acm_prints(fmt_tail);
+    } else {
+        cdc_acm_printf(" %03u %03u %05u\n", usb_pd_cc_level_volt(ENT_CC1(e)), usb_pd_cc_level_volt(ENT_CC2(e)),
+                       adc_raw_to_vbus_mv(ENT_VBUS(e)));
+    }
+}
+
+static void begin_dump(void) {
+    uint32_t total = s_count;
+    uint32_t n = total < PD_CCTL_ENTRIES ? total : PD_CCTL_ENTRIES;
+
+    /* Tick of the oldest entry still in the ring: walk back from the newest */
+    uint32_t tick = s_last_tick;
+    for (uint32_t i = total - 1; n && i > total - n; i--) tick -= ENT_DT(s_ring[i % PD_CCTL_ENTRIES]);
+    s_dump_first = total - n;
+    s_dump_idx = s_dump_first;
+    s_dump_tick = tick;
+
+    cdc_acm_printf("# cctl: %s at %lums, %lu change(s)%s, every %uus\n", trigger_name(s_trig_events),
+                   (unsigned long)s_trig_ms, (unsigned long)n, total > n ? " (older ones overwritten)" : "",
+                   PD_CCTL_PERIOD_US);
+    cdc_acm_prints("# cctl: t_ms cc1 cc2 vbus_mV\n");
+    s_state = CCTL_DUMP;
+}
+
+void usb_pd_cctl_poll(void) {
+    uint8_t cmd = s_cmd;
+    s_cmd = CMD_NONE;
+    if (cmd == CMD_DISARM) {
+        if (s_state != CCTL_IDLE && cdc_acm_is_configured()) cdc_acm_prints("# cctl: disarmed\n");
+        disarm();
+    }
+    if (cmd == CMD_ARM) {
+        if (usb_pd_snk_is_active() || usb_pd_src_is_active()) {
+            if (cdc_acm_is_configured()) cdc_acm_prints("# cctl: LISTEN mode only\n");
+        } else {
+            arm();
+            if (cdc_acm_is_configured()) {
+                cdc_acm_printf("# cctl: armed, CC and VBUS every %uus, %ums after the next attach/detach\n",
+                               PD_CCTL_PERIOD_US, PD_CCTL_POST_MS);
+            }
+        }
+    }
+
+    /* SNK / SRC drive the comparators themselves (and SNK owns the sample timer for sweeps) */
+    if ((s_state == CCTL_ARMED || s_state == CCTL_POST) && (usb_pd_snk_is_active() || usb_pd_src_is_active())) {
+        disarm();
+        if (cdc_acm_is_configured()) cdc_acm_prints("# cctl: disarmed by mode change\n");
+        return;
+    }
+
+    if (s_state == CCTL_DONE) {
+        if (!cdc_acm_is_configured()) return;
+        begin_dump();
+    }
+    if (s_state != CCTL_DUMP) return;
+    if (!cdc_acm_is_configured()) {
+        s_state = CCTL_IDLE;
+        return;
+    }
+
+    for (uint8_t k = 0; k < PD_CCTL_ROWS_PER_POLL; k++) {
+        if (s_dump_idx == s_count) {
+            print_row(s_tick, " end\n", 0);
+            s_state = CCTL_IDLE;
+            return;
+        }
+        uint32_t e = s_ring[s_dump_idx % PD_CCTL_ENTRIES];
+        bool first = s_dump_idx == s_dump_first;
+        if (!first) s_dump_tick += ENT_DT(e);
+        // 长时间不变时的重复条目只用于计时，不打印
+        if (first || (e & ~ENT_DT_MAX) != s_dump_prev) print_row(s_dump_tick, 0, e);
+        s_dump_prev = e & ~ENT_DT_MAX;
+        s_dump_idx++;
+    }
+}
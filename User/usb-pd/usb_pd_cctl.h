@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CC / VBUS timeline around plug events in LISTEN mode. Once armed, both
+ * CC comparator ladders and the newest VBUS ADC sample are read on TIM2
+ * every PD_CCTL_PERIOD_US; only changes are stored, as run-length entries
+ * in a ring, so the ring holds the history before the trigger. An attach,
+ * detach or Rp change confirmed by usb_pd_cc.c is the trigger, placed at
+ * the sample of the edge that caused it; capture continues for
+ * PD_CCTL_POST_MS, then the timeline is printed as
+ * "# cctl: ..." rows relative to the trigger and the mode disarms.
+ */
+
+#define PD_CCTL_PERIOD_US     100  // 采样间隔
+#define PD_CCTL_ENTRIES       512  // 环形缓冲条目数（每条 4 字节）
+#define PD_CCTL_POST_MS       300  // 触发后继续采样的时间
+#define PD_CCTL_VBUS_STEP_RAW 16   // VBUS 变化超过该 ADC 值（约 200mV）才记录
+#define PD_CCTL_ROWS_PER_POLL 8    // 每次 poll 打印的行数
+
+/* "cctl" arms the capture (LISTEN mode), "cctlx" disarms it */
+void usb_pd_cctl_on_cdc_bytes(const uint8_t *data, uint8_t len);
+
+bool usb_pd_cctl_is_armed(void);
+
+/* Attach / detach / Rp change confirmed (PD_CC_EVT_*), caused by the edge at edge_ms / edge_us (micros); main loop */
+void usb_pd_cctl_trigger(uint8_t events, uint32_t edge_ms, uint32_t edge_us);
+
+/* Arming, disarming on mode changes and the timeline dump; call from the main loop */
+void usb_pd_cctl_poll(void);
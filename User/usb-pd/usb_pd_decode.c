@@ -0,0 +1,306 @@
+#include "usb_pd_decode.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "usb_pd_header.h"
+
+/* 控制消息类型描述表 */
+static const pd_msg_type_desc_t ctrl_msg_desc[] = {
+    {0b00001, "GoodCRC"},
+    {0b00010, "GotoMin"},
+    {0b00011, "Accept"},
+    {0b00100, "Reject"},
+    {0b00101, "Ping"},
+    {0b00110, "PSRDY"},
+    {0b00111, "GetSourceCap"},
+    {0b01000, "GetSinkCap"},
+    {0b01001, "DRSwap"},
+    {0b01010, "PRSwap"},
+    {0b01011, "VconnSwap"},
+    {0b01100, "Wait"},
+    {0b01101, "SoftReset"},
+    {0b01110, "DataReset"},
+    {0b01111, "DataResetComplete"},
+    {0b10000, "NotSupported"},
+    {0b10001, "GetSourceCapExt"},
+    {0b10010, "GetStatus"},
+    {0b10011, "FRSwap"},
+    {0b10100, "GetPPSStatus"},
+    {0b10101, "GetCountryCodes"},
+    {0b10110, "GetSinkCapExt"},
+    {0b10111, "GetSourceInfo"},
+    {0b11000, "GetRevision"},
+    {0, NULL},
+};
+
+/* 数据消息类型描述表 */
+static const pd_msg_type_desc_t data_msg_desc[] = {
+    {0b00001, "SourceCap"},
+    {0b00010, "Request"},
+    {0b00011, "BIST"},
+    {0b00100, "SinkCap"},
+    {0b00101, "BatteryStatus"},
+    {0b00110, "Alert"},
+    {0b00111, "GetCountryInfo"},
+    {0b01000, "EnterUSB"},
+    {0b01001, "EPRRequest"},
+    {0b01010, "EPRMode"},
+    {0b01011, "SourceInfo"},
+    {0b01100, "Revision"},
+    {0b01111, "VendorDefined"},
+    {0, NULL},
+};
+
+/* 扩展消息类型描述表 */
+static const pd_msg_type_desc_t ext_msg_desc[] = {
+    {0x01, "SourceCapExt"},
+    {0x02, "Status"},
+    {0x03, "GetBatteryCap"},
+    {0x04, "GetBatteryStatus"},
+    {0x05, "BatteryCap"},
+    {0x06, "GetMfrInfo"},
+    {0x07, "MfrInfo"},
+    {0x08, "SecurityReq"},
+    {0x09, "SecurityResp"},
+    {0x0A, "FWUpdateReq"},
+    {0x0B, "FWUpdateResp"},
+    {0x0C, "PPSStatus"},
+    {0x0D, "CountryInfo"},
+    {0x0E, "CountryCodes"},
+    {0x0F, "SinkCapExt"},
+    {0x10, "ExtControl"},
+    {0x11, "EPRSourceCap"},
+    {0x12, "EPRSinkCap"},
+    {0x1F, "VendorDefinedExt"},
+    {0, NULL},
+};
+
+const char *pd_msg_type_name(uint8_t extended, uint8_t num_do, uint8_t msg_type) {
+    const pd_msg_type_desc_t *desc_table;
+
+    if (extended) {
+        desc_table = ext_msg_desc;
+    } else if (num_do == 0) {
+        desc_table = ctrl_msg_desc;
+    } else {
+        desc_table = data_msg_desc;
+    }
+
+    for (int i = 0; desc_table[i].name != NULL; i++) {
+        if (desc_table[i].type == msg_type) {
+            return desc_table[i].name;
+        }
+    }
+    return NULL;
+}
+
+static inline uint16_t rd16(const uint8_t *p) {
+    return (uint16_t)((uint16_t)p[0] | ((uint16_t)p[1] << 8));
+}
+
+static inline uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void pd_ext_reasm_reset(pd_ext_reasm_t *r) {
+    r->active = 0;
+    r->next_chunk = 0;
+    r->received = 0;
+    r->data_size = 0;
+}
+
+int pd_ext_reasm_feed(pd_ext_reasm_t *r, uint8_t sop, const uint8_t *frame, uint8_t len) {
+    if (len < 4) return 0;
+
+    uint16_t hdr = pd_header_read(frame);
+    if (!PD_HDR_EXTENDED(hdr)) return 0;
+
+    uint16_t ext = rd16(&frame[2]);
+    uint16_t data_size = PD_EXT_HDR_DATA_SIZE(ext);
+    uint8_t chunk_no = PD_EXT_HDR_CHUNK_NO(ext);
+
+    /* 本帧可用数据：数据对象区减去扩展头 */
+    uint16_t avail = (uint16_t)(PD_HDR_NUM_DO(hdr) * 4);
+    if (avail > (uint16_t)(len - 2)) avail = (uint16_t)(len - 2);
+    avail = avail >= 2 ? (uint16_t)(avail - 2) : 0;
+
+    if (!PD_EXT_HDR_CHUNKED(ext)) {
+        /* Unchunked: the whole block must be in this frame */
+        if (data_size > PD_EXT_DATA_MAX || data_size > avail) {
+            pd_ext_reasm_reset(r);
+            return 0;
+        }
+        memcpy(r->data, &frame[4], data_size);
+        r->msg_type = PD_HDR_MSG_TYPE(hdr);
+        r->sop = sop;
+        r->data_size = data_size;
+        r->received = data_size;
+        r->active = 0;
+        return 1;
+    }
+
+    if (PD_EXT_HDR_REQ_CHUNK(ext)) return 0;
+
+    if (chunk_no == 0) {
+        pd_ext_reasm_reset(r);
+        if (data_size > PD_EXT_DATA_MAX) return 0;
+        r->active = 1;
+        r->msg_type = PD_HDR_MSG_TYPE(hdr);
+        r->sop = sop;
+        r->data_size = data_size;
+    } else if (!r->active || r->sop != sop || r->msg_type != PD_HDR_MSG_TYPE(hdr) ||
+               r->next_chunk != chunk_no || r->data_size != data_size) {
+        /* Out of sequence chunk: drop the partial message */
+        pd_ext_reasm_reset(r);
+        return 0;
+    }
+
+    uint16_t n = (uint16_t)(r->data_size - r->received);
+    if (n > PD_EXT_CHUNK_SIZE) n = PD_EXT_CHUNK_SIZE;
+    if (n > avail) n = avail;
+    memcpy(&r->data[r->received], &frame[4], n);
+    r->received += n;
+    r->next_chunk++;
+
+    if (r->received >= r->data_size) {
+        r->active = 0;
+        return 1;
+    }
+    return 0;
+}
+
+static const char *const temp_status_str[4] = {"n/a", "normal", "warn", "over"};
+
+static int decode_status(const uint8_t *p, uint16_t len, char *out, size_t n) {
+    static const char *const event_str[4] = {"OCP", "OTP", "OVP", "CF"};
+    if (len < 6) return 0;
+
+    /* Event Flags bit1..bit4 */
+    char ev[16] = "-";
+    size_t ev_len = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        if (p[3] & (0x02u << i)) {
+            ev_len += (size_t)snprintf(ev + ev_len, sizeof(ev) - ev_len, "%s%s", ev_len ? "|" : "", event_str[i]);
+        }
+    }
+
+    return snprintf(out, n, "Temp:%uC In:0x%02X Bat:0x%02X Ev:%s TS:%s PS:0x%02X",
+                    p[0], p[1], p[2], ev, temp_status_str[(p[4] >> 1) & 0x03], p[5]);
+}
+
+static int decode_pps_status(const uint8_t *p, uint16_t len, char *out, size_t n) {
+    if (len < 4) return 0;
+    uint16_t v = rd16(&p[0]);
+    uint8_t i = p[2];
+    uint8_t flags = p[3];
+    char vbuf[12];
+    char ibuf[12];
+    if (v == 0xFFFF) snprintf(vbuf, sizeof(vbuf), "n/a");
+    else snprintf(vbuf, sizeof(vbuf), "%umV", (unsigned)v * 20u);
+    if (i == 0xFF) snprintf(ibuf, sizeof(ibuf), "n/a");
+    else snprintf(ibuf, sizeof(ibuf), "%umA", (unsigned)i * 50u);
+    return snprintf(out, n, "Vout:%s Iout:%s PTF:%s %s",
+                    vbuf, ibuf, temp_status_str[(flags >> 1) & 0x03], (flags & 0x08) ? "CL" : "CV");
+}
+
+static int decode_battery_cap(const uint8_t *p, uint16_t len, char *out, size_t n) {
+    if (len < 9) return 0;
+    return snprintf(out, n, "VID:%04X PID:%04X Design:%u.%uWh Full:%u.%uWh%s",
+                    rd16(&p[0]), rd16(&p[2]),
+                    rd16(&p[4]) / 10u, rd16(&p[4]) % 10u,
+                    rd16(&p[6]) / 10u, rd16(&p[6]) % 10u,
+                    (p[8] & 0x01) ? " InvalidRef" : "");
+}
+
+static int decode_country_info(const uint8_t *p, uint16_t len, char *out, size_t n) {
+    if (len < 4) return 0;
+    /* Country code is sent as two ASCII characters, second one first */
+    return snprintf(out, n, "Country:%c%c Data:%uB", p[1], p[0], (unsigned)(len - 4));
+}
+
+static int decode_snk_cap_ext(const uint8_t *p, uint16_t len, char *out, size_t n) {
+    if (len < 21) return 0;
+    int w = snprintf(out, n, "VID:%04X PID:%04X FW:%u HW:%u Modes:0x%02X PDP:%u/%u/%uW",
+                     rd16(&p[0]), rd16(&p[2]), p[8], p[9], p[17], p[18], p[19], p[20]);
+    if (len >= 24 && w > 0 && (size_t)w < n) {
+        w += snprintf(out + w, n - (size_t)w, " EPR:%u/%u/%uW", p[21], p[22], p[23]);
+    }
+    return w;
+}
+
+static const char *const charging_str[4] = {"chg", "dischg", "idle", "rsvd"};
+
+static int decode_battery_status(const uint8_t *p, uint16_t len, char *out, size_t n) {
+    if (len < 4) return 0;
+    uint32_t bsdo = rd32(p);
+    uint16_t cap = (uint16_t)(bsdo >> 16);
+    uint8_t info = (uint8_t)(bsdo >> 8);
+    if (cap == 0xFFFF) {
+        return snprintf(out, n, "Cap:n/a %s %s", (info & 0x02) ? "present" : "absent", charging_str[(info >> 2) & 0x03]);
+    }
+    return snprintf(out, n, "Cap:%u.%uWh %s %s", cap / 10u, cap % 10u,
+                    (info & 0x02) ? "present" : "absent", charging_str[(info >> 2) & 0x03]);
+}
+
+static int decode_source_info(const uint8_t *p, uint16_t len, char *out, size_t n) {
+    if (len < 4) return 0;
+    uint32_t sido = rd32(p);
+    return snprintf(out, n, "%s Max:%luW Present:%luW Reported:%luW",
+                    (sido >> 31) ? "Guaranteed" : "Managed",
+                    (unsigned long)((sido >> 16) & 0xFF),
+                    (unsigned long)((sido >> 8) & 0xFF),
+                    (unsigned long)(sido & 0xFF));
+}
+
+static int decode_revision(const uint8_t *p, uint16_t len, char *out, size_t n) {
+    if (len < 4) return 0;
+    uint32_t rmdo = rd32(p);
+    return snprintf(out, n, "Rev:%lu.%lu Ver:%lu.%lu",
+                    (unsigned long)((rmdo >> 28) & 0x0F), (unsigned long)((rmdo >> 24) & 0x0F),
+                    (unsigned long)((rmdo >> 20) & 0x0F), (unsigned long)((rmdo >> 16) & 0x0F));
+}
+
+int pd_decode_status_class(uint8_t extended, uint8_t msg_type, const uint8_t *payload, uint16_t len, char *out, size_t out_size) {
+    int w = 0;
+
+    if (extended) {
+        switch (msg_type) {
+        case PD_EXT_STATUS:
+            w = decode_status(payload, len, out, out_size);
+            break;
+        case PD_EXT_PPS_STATUS:
+            w = decode_pps_status(payload, len, out, out_size);
+            break;
+        case PD_EXT_BATTERY_CAP:
+            w = decode_battery_cap(payload, len, out, out_size);
+            break;
+        case PD_EXT_COUNTRY_INFO:
+            w = decode_country_info(payload, len, out, out_size);
+            break;
+        case PD_EXT_SNK_CAP_EXT:
+            w = decode_snk_cap_ext(payload, len, out, out_size);
+            break;
+        default:
+            break;
+        }
+    } else {
+        switch (msg_type) {
+        case PD_DATA_BATTERY_STATUS:
+            w = decode_battery_status(payload, len, out, out_size);
+            break;
+        case PD_DATA_SOURCE_INFO:
+            w = decode_source_info(payload, len, out, out_size);
+            break;
+        case PD_DATA_REVISION:
+            w = decode_revision(payload, len, out, out_size);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (w < 0) return 0;
+    if ((size_t)w >= out_size) w = (int)out_size - 1;
+    return w;
+}
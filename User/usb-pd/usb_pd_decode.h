@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Message type tables, extended message reassembly and decoders for
+ * PD 3.x status-class messages. No hardware dependency; shared with host
+ * tools.
+ */
+
+/* PD 消息类型描述结构体 */
+typedef struct {
+    uint8_t type;     // 消息类型编号
+    const char *name; // 消息类型名称
+} pd_msg_type_desc_t;
+
+/* Message type name from the ctrl/data/ext tables; NULL if unknown */
+const char *pd_msg_type_name(uint8_t extended, uint8_t num_do, uint8_t msg_type);
+
+/* Extended header fields (16-bit, follows the message header) */
+#define PD_EXT_HDR_CHUNKED(e)   ((uint8_t)(((e) >> 15) & 0x01))
+#define PD_EXT_HDR_CHUNK_NO(e)  ((uint8_t)(((e) >> 11) & 0x0F))
+#define PD_EXT_HDR_REQ_CHUNK(e) ((uint8_t)(((e) >> 10) & 0x01))
+#define PD_EXT_HDR_DATA_SIZE(e) ((uint16_t)((e) & 0x01FF))
+
+#define PD_EXT_CHUNK_SIZE 26 // 每个 chunk 最大数据字节数
+#define PD_EXT_DATA_MAX   64 // 重组缓冲区大小（大于此长度的消息不重组）
+
+/* Extended message types */
+#define PD_EXT_SRC_CAP_EXT  0x01
+#define PD_EXT_STATUS       0x02
+#define PD_EXT_BATTERY_CAP  0x05
+#define PD_EXT_PPS_STATUS   0x0C
+#define PD_EXT_COUNTRY_INFO 0x0D
+#define PD_EXT_SNK_CAP_EXT  0x0F
+
+/* Data message types decoded here */
+#define PD_DATA_BATTERY_STATUS 0x05
+#define PD_DATA_SOURCE_INFO    0x0B
+#define PD_DATA_REVISION       0x0C
+
+/* Reassembly state of one chunked extended message */
+typedef struct {
+    uint8_t active;      // 正在重组
+    uint8_t msg_type;    // 扩展消息类型
+    uint8_t sop;         // SOP 类型
+    uint8_t next_chunk;  // 期望的下一个 chunk 编号
+    uint16_t data_size;  // 扩展数据总长度
+    uint16_t received;   // 已接收长度
+    uint8_t data[PD_EXT_DATA_MAX];
+} pd_ext_reasm_t;
+
+/**
+ * Feed one extended frame (header + payload, trailing CRC ignored).
+ * Returns 1 once the message is complete; r->data/r->data_size then hold the
+ * whole payload until the next call. Chunk requests are ignored.
+ */
+int pd_ext_reasm_feed(pd_ext_reasm_t *r, uint8_t sop, const uint8_t *frame, uint8_t len);
+
+void pd_ext_reasm_reset(pd_ext_reasm_t *r);
+
+/**
+ * Decode a status-class message into compact text.
+ * For extended messages payload is the reassembled data block, for data
+ * messages it is the data objects. Returns the number of characters written,
+ * or 0 if the message type is not handled.
+ */
+int pd_decode_status_class(uint8_t extended, uint8_t msg_type, const uint8_t *payload, uint16_t len, char *out, size_t out_size);
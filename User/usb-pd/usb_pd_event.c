@@ -0,0 +1,166 @@
+#include "usb_pd_event.h"
+
+#include <stdio.h>
+
+#include "ch32x035_usbpd.h"
+#include "irq_save.h"
+#include "millis.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_cc_fsm.h"
+#include "usb_pd_record.h"
+#include "usb_vbus_measure.h"
+
+static pd_event_t s_ring[PD_EVENT_RING_SIZE];
+static volatile uint8_t s_head = 0; // 写指针
+static volatile uint8_t s_tail = 0; // 读指针
+static volatile uint32_t s_lost = 0;
+
+pd_event_t *usb_pd_event_reserve(uint8_t kind, uint32_t *irq) {
+    *irq = irq_save();
+    uint8_t next = (uint8_t)((s_head + 1) % PD_EVENT_RING_SIZE);
+    // 缓冲区满时丢弃最旧事件
+    if (next == s_tail) {
+        s_tail = (uint8_t)((s_tail + 1) % PD_EVENT_RING_SIZE);
+        s_lost++;
+    }
+    pd_event_t *e = &s_ring[s_head];
+    e->kind = kind;
+    e->ms = millis_us(&e->us);
+    return e;
+}
+
+void usb_pd_event_commit(uint32_t irq) {
+    s_head = (uint8_t)((s_head + 1) % PD_EVENT_RING_SIZE);
+    irq_restore(irq);
+}
+
+void usb_pd_event_push(pd_event_t *e) {
+    uint32_t irq;
+    pd_event_t *slot = usb_pd_event_reserve(e->kind, &irq);
+    e->ms = slot->ms;
+    e->us = slot->us;
+    *slot = *e;
+    usb_pd_event_commit(irq);
+}
+
+void usb_pd_event_clear(void) {
+    uint32_t irq = irq_save();
+    s_tail = s_head;
+    s_lost = 0;
+    irq_restore(irq);
+}
+
+/* One text line (with '\n'); a text record in binary mode */
+static void emit(const char *line, int n) {
+    if (n <= 0) return;
+    if (!get_message_output_binary()) {
+        cdc_acm_prints(line);
+        return;
+    }
+    uint8_t rec[PD_RECORD_MAX_LEN];
+    size_t len = (size_t)n;
+    if (line[len - 1] == '\n') len--;
+    cdc_acm_write(rec, (uint32_t)pd_record_encode_text(rec, line, len));
+}
+
+/* Attached on one line and the other shows Ra: an e-marked cable or VCONN-powered accessory */
+static bool other_is_ra(const pd_event_t *e) {
+    if (e->u.cc.conn == PD_CC_CONN_CC1) return pd_cc_classify(e->u.cc.cc2, e->u.cc.cc1) == PD_CC_ADV_RA;
+    if (e->u.cc.conn == PD_CC_CONN_CC2) return pd_cc_classify(e->u.cc.cc1, e->u.cc.cc2) == PD_CC_ADV_RA;
+    return false;
+}
+
+static void print_cc(const pd_event_t *e, char *buf, size_t size) {
+    int n = 0;
+    switch (e->u.cc.what) {
+    case PD_EVENT_CC_ATTACH:
+    case PD_EVENT_CC_DETACH:
+        n = snprintf(buf, size, "> \037%lums \037%s:%s, CC1:%03umV, CC2:%03umV, VBUS:%05umV, Rp:%s, EDGE:%luus%s\n",
+                     (unsigned long)e->u.cc.edge_ms, e->u.cc.what == PD_EVENT_CC_ATTACH ? "Attach" : "Detach",
+                     pd_cc_conn_name(e->u.cc.conn), e->u.cc.cc1, e->u.cc.cc2, e->u.cc.vbus_mv,
+                     pd_cc_adv_name(e->u.cc.rp), (unsigned long)e->u.cc.edge_us,
+                     e->u.cc.what == PD_EVENT_CC_ATTACH && other_is_ra(e) ? " (Ra)" : "");
+        break;
+    case PD_EVENT_CC_RP:
+        n = snprintf(buf, size, "> \037%lums \037Rp:%s\n", (unsigned long)e->ms, pd_cc_adv_name(e->u.cc.rp));
+        break;
+    case PD_EVENT_CC_SAMPLE:
+        n = snprintf(buf, size, "> \037COND:%u, CC1:%03umV(%s), CC2:%03umV(%s), VBUS:%05umV, VDD:%umV\n",
+                     e->u.cc.conn, e->u.cc.cc1, pd_cc_adv_name(pd_cc_classify(e->u.cc.cc1, e->u.cc.cc2)), e->u.cc.cc2,
+                     pd_cc_adv_name(pd_cc_classify(e->u.cc.cc2, e->u.cc.cc1)), e->u.cc.vbus_mv, e->u.cc.vdd_mv);
+        break;
+    default:
+        break;
+    }
+    emit(buf, n);
+}
+
+static void print_mode(const pd_event_t *e, char *buf, size_t size) {
+    const char *rev = e->u.mode.spec_rev == 3 ? "PD3.0" : "PD2.0";
+    int n;
+    if (!e->u.mode.enter) {
+        n = snprintf(buf, size, "# exit %s mode\n", e->u.mode.mode == PD_EVENT_MODE_SRC ? "SRC" : "SNK");
+    } else if (e->u.mode.mode == PD_EVENT_MODE_SRC) {
+        n = snprintf(buf, size,
+                     "# enter SRC mode (%s, Rp %uuA): send Source_Capabilities or raw PD frame bytes over CDC; "
+                     "send 'exit' to leave\n",
+                     rev, e->u.mode.rp_ua);
+    } else {
+        n = snprintf(buf, size, "# enter SNK mode (%s): send raw PD frame bytes over CDC; send 'exit' to leave\n", rev);
+    }
+    emit(buf, n);
+}
+
+static void print_event(const pd_event_t *e) {
+    char buf[160];
+    int n;
+
+    switch (e->kind) {
+    case PD_EVENT_FRAME:
+        print_message((pd_msg_t *)&e->u.frame);
+        break;
+    case PD_EVENT_CC:
+        print_cc(e, buf, sizeof(buf));
+        break;
+    case PD_EVENT_VBUS:
+        n = snprintf(buf, sizeof(buf), "> \037%lums \037VBUS:%s, %05umV\n", (unsigned long)e->ms,
+                     e->u.vbus.present ? "on" : "off", adc_raw_to_vbus_mv(e->u.vbus.raw));
+        emit(buf, n);
+        break;
+    case PD_EVENT_MODE:
+        print_mode(e, buf, sizeof(buf));
+        break;
+    case PD_EVENT_ERROR:
+        n = snprintf(buf, sizeof(buf), "# event: %lu lost (ring full)\n", (unsigned long)e->u.error.arg);
+        emit(buf, n);
+        break;
+    default:
+        break;
+    }
+}
+
+void usb_pd_event_poll(void) {
+    if (!cdc_acm_is_configured()) return;
+
+    for (;;) {
+        pd_event_t e;
+        uint32_t irq = irq_save();
+        uint32_t lost = s_lost;
+        if (lost) {
+            // 丢失的是最旧的事件，在当前位置报告
+            s_lost = 0;
+            e.kind = PD_EVENT_ERROR;
+            e.ms = millis_us(&e.us);
+            e.u.error.code = PD_EVENT_ERR_LOST;
+            e.u.error.arg = lost;
+        } else if (s_tail != s_head) {
+            e = s_ring[s_tail];
+            s_tail = (uint8_t)((s_tail + 1) % PD_EVENT_RING_SIZE);
+        } else {
+            irq_restore(irq);
+            return;
+        }
+        irq_restore(irq);
+        print_event(&e);
+    }
+}
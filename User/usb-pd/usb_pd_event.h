@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "usb_pd_message.h"
+
+/*
+ * Single time-ordered event stream. PD frames (RX and our own TX), CC
+ * attach / detach / Rp changes, VBUS threshold crossings and SNK / SRC
+ * mode changes are pushed from any context into one ring, stamped with
+ * millis_us() at push time, and printed in push order by
+ * usb_pd_event_poll() from the main loop. Text output keeps the existing
+ * line formats; in binary mode frames are frame records and every other
+ * event is a text record, so both outputs keep the same order. When the
+ * ring is full the oldest event is dropped and an error event reports
+ * how many were lost.
+ */
+
+#define PD_EVENT_RING_SIZE 24 // 事件环形缓冲条目数
+
+/* 事件类型 */
+typedef enum {
+    PD_EVENT_FRAME = 0, // PD 帧或 RX_RESET
+    PD_EVENT_CC,        // CC 连接变化 / DTR 调试采样
+    PD_EVENT_VBUS,      // VBUS 越过看门狗阈值
+    PD_EVENT_MODE,      // 进入 / 退出 SNK、SRC 模式
+    PD_EVENT_ERROR,
+} pd_event_kind_t;
+
+/* PD_EVENT_CC */
+#define PD_EVENT_CC_ATTACH 0
+#define PD_EVENT_CC_DETACH 1
+#define PD_EVENT_CC_RP     2 // 已连接线上的 Rp 变化
+#define PD_EVENT_CC_SAMPLE 3 // DTR 打开时的周期采样
+
+/* PD_EVENT_MODE */
+#define PD_EVENT_MODE_SNK 1
+#define PD_EVENT_MODE_SRC 2
+
+/* PD_EVENT_ERROR */
+#define PD_EVENT_ERR_LOST 1 // 环形缓冲溢出，arg 为丢弃条数
+
+typedef struct {
+    uint8_t kind;       // pd_event_kind_t
+    uint16_t us;        // 毫秒内的 µs
+    uint32_t ms;        // millis_us() 时间戳
+    union {
+        pd_msg_t frame; // timestamp_ms 与 ms 相同
+        struct {
+            uint8_t what;     // PD_EVENT_CC_*
+            uint8_t conn;     // pd_cc_conn_t
+            uint8_t cc1, cc2; // 比较器电平（0.01V）
+            uint8_t rp;       // pd_cc_adv_t
+            uint16_t vbus_mv;
+            uint16_t vdd_mv;  // 仅 SAMPLE
+            uint32_t edge_ms; // 引起变化的第一条边沿（millis）
+            uint32_t edge_us; // 同上（micros）
+        } cc;
+        struct {
+            uint8_t present;
+            uint16_t raw;     // ADC 原始值，打印时换算
+        } vbus;
+        struct {
+            uint8_t mode;     // PD_EVENT_MODE_*
+            uint8_t enter;
+            uint8_t spec_rev; // 2 / 3
+            uint16_t rp_ua;   // 仅 SRC
+        } mode;
+        struct {
+            uint8_t code;     // PD_EVENT_ERR_*
+            uint32_t arg;
+        } error;
+    } u;
+} pd_event_t;
+
+/* Stamp e and append it; any context */
+void usb_pd_event_push(pd_event_t *e);
+
+/**
+ * Reserve the next slot with interrupts masked, for producers that fill
+ * large payloads in place (PD frames in the RX interrupt). The slot is
+ * stamped; usb_pd_event_commit() publishes it and restores interrupts.
+ */
+pd_event_t *usb_pd_event_reserve(uint8_t kind, uint32_t *irq);
+void usb_pd_event_commit(uint32_t irq);
+
+/* Drop everything not printed yet */
+void usb_pd_event_clear(void);
+
+/* Print pending events in order; call from the main loop */
+void usb_pd_event_poll(void);
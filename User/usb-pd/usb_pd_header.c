@@ -0,0 +1,25 @@
+#include "usb_pd_header.h"
+
+/* SOP 名称表，按 SOP 类型索引 */
+static const char *const sop_label_lut[4] = {
+    [PD_SOP_NONE] = "???",
+    [PD_SOP0] = "SOP",
+    [PD_SOP1] = "SOP'",
+    [PD_SOP2] = "SOP''",
+};
+
+/* 方向表，按 (SOP, PowerRole) 索引；SOP'/SOP'' 上该位为 Cable Plug 标志 */
+static const char *const direction_lut[4][2] = {
+    [PD_SOP_NONE] = {"SRC←SNK", "SRC→SNK"},
+    [PD_SOP0] = {"SRC←SNK", "SRC→SNK"},
+    [PD_SOP1] = {"CAB← ? ", "CAB→ ? "},
+    [PD_SOP2] = {"CAB← ? ", "CAB→ ? "},
+};
+
+const char *pd_sop_label(uint8_t sop) {
+    return sop_label_lut[sop & PD_SOP_MASK];
+}
+
+const char *pd_direction_label(uint8_t sop, uint8_t power_role) {
+    return direction_lut[sop & PD_SOP_MASK][power_role & 0x01];
+}
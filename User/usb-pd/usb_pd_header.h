@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * PD message header decode with explicit shifts/masks.
+ * Unlike a C bitfield the layout does not depend on the compiler, so the
+ * firmware and host tools decode the same 16-bit header identically.
+ * This header has no hardware dependency.
+ */
+
+/* Header field accessors (h = 16-bit little-endian header) */
+#define PD_HDR_MSG_TYPE(h)   ((uint8_t)((h) & 0x1F))
+#define PD_HDR_DATA_ROLE(h)  ((uint8_t)(((h) >> 5) & 0x01))
+#define PD_HDR_SPEC_REV(h)   ((uint8_t)(((h) >> 6) & 0x03))
+#define PD_HDR_POWER_ROLE(h) ((uint8_t)(((h) >> 8) & 0x01))
+#define PD_HDR_MSG_ID(h)     ((uint8_t)(((h) >> 9) & 0x07))
+#define PD_HDR_NUM_DO(h)     ((uint8_t)(((h) >> 12) & 0x07))
+#define PD_HDR_EXTENDED(h)   ((uint8_t)(((h) >> 15) & 0x01))
+
+/* SOP kind; values match USBPD->STATUS & MASK_PD_STAT */
+#define PD_SOP_NONE  0x00
+#define PD_SOP0      0x01
+#define PD_SOP1      0x02 /* SOP'  */
+#define PD_SOP2      0x03 /* SOP'' */
+#define PD_SOP_MASK  0x03
+
+/* Decoded PD message header */
+typedef struct {
+    uint8_t msg_type;   // 消息类型
+    uint8_t data_role;  // 数据角色
+    uint8_t spec_rev;   // 规范版本 (0:1.0 1:2.0 2:3.x)
+    uint8_t power_role; // 电源角色 (0:SNK 1:SRC)
+    uint8_t msg_id;     // 消息 ID
+    uint8_t num_do;     // 数据对象数量
+    uint8_t extended;   // 扩展消息标志
+} pd_header_t;
+
+/* Read the raw header from the first two bytes of a frame */
+static inline uint16_t pd_header_read(const uint8_t *frame) {
+    return (uint16_t)((uint16_t)frame[0] | ((uint16_t)frame[1] << 8));
+}
+
+static inline void pd_header_decode(uint16_t raw, pd_header_t *hdr) {
+    hdr->msg_type = PD_HDR_MSG_TYPE(raw);
+    hdr->data_role = PD_HDR_DATA_ROLE(raw);
+    hdr->spec_rev = PD_HDR_SPEC_REV(raw);
+    hdr->power_role = PD_HDR_POWER_ROLE(raw);
+    hdr->msg_id = PD_HDR_MSG_ID(raw);
+    hdr->num_do = PD_HDR_NUM_DO(raw);
+    hdr->extended = PD_HDR_EXTENDED(raw);
+}
+
+/* True for a control GoodCRC header */
+static inline uint8_t pd_header_is_goodcrc(uint16_t raw) {
+    return PD_HDR_NUM_DO(raw) == 0 && !PD_HDR_EXTENDED(raw) && PD_HDR_MSG_TYPE(raw) == 0x01;
+}
+
+/* Label for a SOP kind ("SOP", "SOP'", "SOP''", "???") */
+const char *pd_sop_label(uint8_t sop);
+/* Direction label keyed by (SOP, PortPowerRole/CablePlug bit) */
+const char *pd_direction_label(uint8_t sop, uint8_t power_role);
@@ -0,0 +1,129 @@
+#include "usb_pd_link.h"
+
+uint16_t pd_link_crc16(const uint8_t *p, size_t n) {
+    uint16_t crc = 0xFFFF;
+    while (n--) {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+size_t pd_link_cobs_encode(const uint8_t *in, size_t n, uint8_t *out) {
+    size_t code_pos = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < n; i++) {
+        if (in[i]) {
+            out[o++] = in[i];
+            code++;
+        }
+        if (!in[i] || code == 0xFF) {
+            out[code_pos] = code;
+            code_pos = o++;
+            code = 1;
+        }
+    }
+    out[code_pos] = code;
+    return o;
+}
+
+size_t pd_link_encode(uint8_t op, uint8_t seq, const uint8_t *data, uint8_t len, uint8_t *out, size_t out_size) {
+    if (len > PD_LINK_MAX_DATA) return 0;
+    uint8_t raw[PD_LINK_MAX_RAW];
+    raw[0] = op;
+    raw[1] = seq;
+    for (uint8_t i = 0; i < len; i++) raw[2 + i] = data[i];
+    uint16_t crc = pd_link_crc16(raw, 2u + len);
+    raw[2 + len] = (uint8_t)crc;
+    raw[3 + len] = (uint8_t)(crc >> 8);
+
+    size_t n = 4u + len;
+    if (out_size < n + n / 254 + 3) return 0;
+    out[0] = 0x00;
+    size_t w = pd_link_cobs_encode(raw, n, &out[1]);
+    out[1 + w] = 0x00;
+    return w + 2;
+}
+
+void pd_link_rx_init(pd_link_rx_t *rx) {
+    rx->len = 0;
+    rx->code = 0;
+    rx->left = 0;
+    rx->armed = 0;
+    rx->overflow = 0;
+}
+
+bool pd_link_rx_pending(const pd_link_rx_t *rx) {
+    return rx->armed && (rx->len || rx->code || rx->overflow);
+}
+
+static void rx_restart(pd_link_rx_t *rx) {
+    rx->len = 0;
+    rx->code = 0;
+    rx->left = 0;
+    rx->overflow = 0;
+    rx->armed = 1;
+}
+
+static inline bool rx_put(pd_link_rx_t *rx, uint8_t b) {
+    if (rx->len >= sizeof(rx->buf)) return false;
+    rx->buf[rx->len++] = b;
+    return true;
+}
+
+pd_link_rx_result_t pd_link_rx_feed(pd_link_rx_t *rx, uint8_t b) {
+    if (b == 0x00) {
+        /* Delimiter: ends the current frame and opens the next one */
+        bool was_armed = rx->armed;
+        bool had_data = rx->len || rx->code || rx->overflow;
+        uint8_t overflow = rx->overflow;
+        uint8_t left = rx->left;
+        uint8_t len = rx->len;
+        rx_restart(rx);
+        if (!was_armed || !had_data) return PD_LINK_RX_NONE;
+
+        /* Best effort op / seq for an error reply */
+        rx->op = len > 0 ? rx->buf[0] : 0;
+        rx->seq = len > 1 ? rx->buf[1] : 0;
+
+        if (overflow) {
+            rx->status = PD_LINK_ERR_OVERFLOW;
+            return PD_LINK_RX_ERROR;
+        }
+        if (left || len < 4) {
+            rx->status = PD_LINK_ERR_FORMAT;
+            return PD_LINK_RX_ERROR;
+        }
+        uint16_t crc = (uint16_t)rx->buf[len - 2] | ((uint16_t)rx->buf[len - 1] << 8);
+        if (pd_link_crc16(rx->buf, len - 2u) != crc) {
+            rx->status = PD_LINK_ERR_CRC;
+            return PD_LINK_RX_ERROR;
+        }
+        rx->op = rx->buf[0];
+        rx->seq = rx->buf[1];
+        rx->data = &rx->buf[2];
+        rx->data_len = (uint8_t)(len - 4);
+        rx->status = PD_LINK_OK;
+        return PD_LINK_RX_FRAME;
+    }
+
+    if (!rx->armed || rx->overflow) return PD_LINK_RX_NONE;
+
+    if (rx->left) {
+        if (!rx_put(rx, b)) rx->overflow = 1;
+        rx->left--;
+        return PD_LINK_RX_NONE;
+    }
+
+    /* New block: the previous one stood for a zero unless it was a full 254-byte run */
+    if (rx->code && rx->code != 0xFF && !rx_put(rx, 0x00)) rx->overflow = 1;
+    rx->code = b;
+    rx->left = (uint8_t)(b - 1);
+    return PD_LINK_RX_NONE;
+}
+
+const char *pd_link_status_name(uint8_t status) {
+    static const char *const names[] = {"ok", "crc", "format", "overflow", "opcode", "rejected"};
+    return status < sizeof(names) / sizeof(names[0]) ? names[status] : "?";
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Framed command link over the CDC port. A frame is
+ *
+ *   0x00  COBS( op, seq, data[0..64], crc16_lo, crc16_hi )  0x00
+ *
+ * with CRC-16/CCITT-FALSE over op, seq and data. Replies use op | 0x80,
+ * the same seq, and carry a status byte as data[0]. The decoder is fed
+ * one byte at a time, so frames may be split across USB packets or share
+ * a packet with other frames. No hardware dependency; shared with host
+ * tools.
+ */
+
+#define PD_LINK_MAX_DATA  64
+#define PD_LINK_MAX_RAW   (2 + PD_LINK_MAX_DATA + 2)       // op + seq + data + CRC
+#define PD_LINK_MAX_WIRE  (PD_LINK_MAX_RAW + PD_LINK_MAX_RAW / 254 + 3) // COBS + 两个分隔符
+
+/* 操作码 */
+#define PD_LINK_OP_PING  0x01 // 链路检查，空数据
+#define PD_LINK_OP_CMD   0x02 // 数据为一条原有的 CDC 命令或原始 PD 帧（如 "snk3"、"vpps9000"）
+#define PD_LINK_OP_REPLY 0x80 // 应答标志
+
+/* 应答状态 */
+typedef enum {
+    PD_LINK_OK = 0,
+    PD_LINK_ERR_CRC,      // CRC 错误
+    PD_LINK_ERR_FORMAT,   // COBS 错误或帧过短
+    PD_LINK_ERR_OVERFLOW, // 帧过长
+    PD_LINK_ERR_OPCODE,   // 未知操作码
+    PD_LINK_ERR_REJECTED, // 当前模式不接受该命令
+} pd_link_status_t;
+
+/* Result of feeding one byte */
+typedef enum {
+    PD_LINK_RX_NONE = 0,
+    PD_LINK_RX_FRAME, // 完整且 CRC 正确的帧
+    PD_LINK_RX_ERROR, // 帧被丢弃，原因见 status
+} pd_link_rx_result_t;
+
+typedef struct {
+    uint8_t buf[PD_LINK_MAX_RAW];
+    uint8_t len;
+    uint8_t code;     // 当前 COBS 块的长度码
+    uint8_t left;     // 当前块剩余字节
+    uint8_t armed;    // 已收到起始分隔符
+    uint8_t overflow; // 本帧超长，等待分隔符
+    /* Last complete frame */
+    uint8_t op;
+    uint8_t seq;
+    uint8_t status;   // PD_LINK_RX_ERROR 的原因
+    uint8_t data_len;
+    const uint8_t *data;
+} pd_link_rx_t;
+
+uint16_t pd_link_crc16(const uint8_t *p, size_t n);
+
+/* COBS-encode n bytes (no delimiters); out needs n + n / 254 + 1 bytes */
+size_t pd_link_cobs_encode(const uint8_t *in, size_t n, uint8_t *out);
+
+/* Complete wire frame including both delimiters; 0 if it does not fit */
+size_t pd_link_encode(uint8_t op, uint8_t seq, const uint8_t *data, uint8_t len, uint8_t *out, size_t out_size);
+
+void pd_link_rx_init(pd_link_rx_t *rx);
+
+/* Decoder holds part of a frame (bytes after the opening delimiter) */
+bool pd_link_rx_pending(const pd_link_rx_t *rx);
+
+/**
+ * Feed one byte; bytes before the first delimiter are ignored. After
+ * PD_LINK_RX_FRAME, op / seq / data are valid until the next byte is fed;
+ * after PD_LINK_RX_ERROR, op / seq are a best guess for the reply.
+ */
+pd_link_rx_result_t pd_link_rx_feed(pd_link_rx_t *rx, uint8_t b);
+
+const char *pd_link_status_name(uint8_t status);
@@ -4,159 +4,89 @@
 #include "debug.h"
 #include "millis.h"
 #include "usb_cdc_print.h"
+#include "usb_pd_decode.h"
+#include "usb_pd_event.h"
+#include "usb_pd_record.h"
+#include "usb_pd_vcap.h"
+#include "usb_pd_vdm.h"
 #include "usb_vbus_measure.h"
 
-static pd_msg_buffer_t msg_buffer = {0};
-
 static struct {
     uint32_t msg_counter; // 消息计数器
 } pdMessage = {0};
 
-/* 控制消息类型描述表 */
-static const pd_msg_type_desc_t ctrl_msg_desc[] = {
-    {0b00001, "GoodCRC"},
-    {0b00010, "GotoMin"},
-    {0b00011, "Accept"},
-    {0b00100, "Reject"},
-    {0b00101, "Ping"},
-    {0b00110, "PSRDY"},
-    {0b00111, "GetSourceCap"},
-    {0b01000, "GetSinkCap"},
-    {0b01001, "DRSwap"},
-    {0b01010, "PRSwap"},
-    {0b01011, "VconnSwap"},
-    {0b01100, "Wait"},
-    {0b01101, "SoftReset"},
-    {0b01110, "DataReset"},
-    {0b01111, "DataResetComplete"},
-    {0b10000, "NotSupported"},
-    {0b10001, "GetSourceCapExt"},
-    {0b10010, "GetStatus"},
-    {0b10011, "FRSwap"},
-    {0b10100, "GetPPSStatus"},
-    {0b10101, "GetCountryCodes"},
-    {0b10110, "GetSinkCapExt"},
-    {0b10111, "GetSourceInfo"},
-    {0b11000, "GetRevision"},
-    {0, NULL},
-};
-
-/* 数据消息类型描述表 */
-static const pd_msg_type_desc_t data_msg_desc[] = {
-    {0b00001, "SourceCap"},
-    {0b00010, "Request"},
-    {0b00011, "BIST"},
-    {0b00100, "SinkCap"},
-    {0b00101, "BatteryStatus"},
-    {0b00110, "Alert"},
-    {0b00111, "GetCountryInfo"},
-    {0b01000, "EnterUSB"},
-    {0b01001, "EPRRequest"},
-    {0b01010, "EPRMode"},
-    {0b01011, "SourceInfo"},
-    {0b01100, "Revision"},
-    {0b01111, "VendorDefined"},
-    {0, NULL},
-};
-
-/* 扩展消息类型描述表 */
-static const pd_msg_type_desc_t ext_msg_desc[] = {
-    {0x01, "SourceCapExt"},
-    {0x02, "Status"},
-    {0x03, "GetBatteryCap"},
-    {0x04, "GetBatteryStatus"},
-    {0x05, "BatteryCap"},
-    {0x06, "GetMfrInfo"},
-    {0x07, "MfrInfo"},
-    {0x08, "SecurityReq"},
-    {0x09, "SecurityResp"},
-    {0x0A, "FWUpdateReq"},
-    {0x0B, "FWUpdateResp"},
-    {0x0C, "PPSStatus"},
-    {0x0D, "CountryInfo"},
-    {0x0E, "CountryCodes"},
-    {0x0F, "SinkCapExt"},
-    {0x10, "ExtControl"},
-    {0x11, "EPRSourceCap"},
-    {0x12, "EPRSinkCap"},
-    {0x1F, "VendorDefinedExt"},
-    {0, NULL},
-};
+/* 扩展消息重组，按 PowerRole/CablePlug 分两路 */
+static pd_ext_reasm_t ext_reasm[2];
 
-/**
- * @brief  在消息类型描述表中查找消息类型
- * @param  type 消息类型编号
- * @param  desc_table 描述表
- * @param  prefix 消息类型前缀（Ctrl/Data/Ext）
- * @return const char* 消息类型名称
- */
-static const char *find_msg_type_name(uint8_t type, const pd_msg_type_desc_t *desc_table, const char *prefix) {
-    static char msg_type_buf[32];
-
-    for (int i = 0; desc_table[i].name != NULL; i++) {
-        if (desc_table[i].type == type) {
-            // snprintf(msg_type_buf, sizeof(msg_type_buf), "[%02d]%s", type, desc_table[i].name);
-            snprintf(msg_type_buf, sizeof(msg_type_buf), "%s", desc_table[i].name);
-            return msg_type_buf;
-        }
-    }
-
-    // snprintf(msg_type_buf, sizeof(msg_type_buf), "[%02d]Unknown_%s", type, prefix);
-    snprintf(msg_type_buf, sizeof(msg_type_buf), "Unknown_%s", prefix);
-
-    return msg_type_buf;
-}
+/* 输出格式：false 文本，true 二进制记录 */
+static volatile bool output_binary = false;
 
 /**
  * @brief  获取消息类型名称
  * @param  header 消息头指针
  * @return const char* 消息类型名称
  */
-static const char *get_message_type_name(pd_msg_header_t *header) {
-    if (header->NumberOfDataObjects == 0) {
-        return find_msg_type_name(header->MessageType, ctrl_msg_desc, "Ctrl");
-    } else {
-        return find_msg_type_name(header->MessageType, data_msg_desc, "Data");
+static const char *get_message_type_name(const pd_header_t *header) {
+    const char *name = pd_msg_type_name(header->extended, header->num_do, header->msg_type);
+    if (name != NULL) {
+        return name;
+    }
+    if (header->extended) {
+        return "Unknown_Ext";
     }
+    return header->num_do == 0 ? "Unknown_Ctrl" : "Unknown_Data";
 }
 
 /**
- * @brief  获取 SOP 类型名称
- * @param  status USBPD->STATUS 寄存器值
- * @return const char* SOP 类型名称
+ * @brief  解码并打印状态类消息字段（扩展消息先经 chunk 重组）
+ * @param  msg 消息指针
+ * @param  header 已解码的消息头
+ * @param  sop SOP 类型
  */
-static const char *get_sop_type_name(uint32_t status) {
-    uint32_t sop = status & MASK_PD_STAT;
-    switch (sop) {
-    case PD_RX_SOP0:
-        return "SOP";
-    case PD_RX_SOP1_HRST:
-        return "SOP'";
-    case PD_RX_SOP2_CRST:
-        return "SOP''";
-    default:
-        return "???";
+static void print_decoded_fields(const pd_msg_t *msg, const pd_header_t *header, uint8_t sop) {
+    char buf[96];
+    int n;
+
+    if (!header->extended && header->msg_type == 0x0F && sop != PD_SOP0 && header->power_role) {
+        /* Discover Identity ACK from a cable plug (PowerRole bit is Cable Plug on SOP'/SOP'') */
+        uint32_t vdos[7];
+        uint8_t nv = 0;
+        pd_cable_info_t info;
+        while (nv < header->num_do && nv < 7 && 2 + 4 * nv + 4 <= msg->len) {
+            const uint8_t *p = &msg->data[2 + 4 * nv];
+            vdos[nv++] = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+        if (!pd_cable_decode(vdos, nv, &info)) return;
+        n = pd_cable_format(&info, buf, sizeof(buf));
+    } else if (header->extended) {
+        pd_ext_reasm_t *r = &ext_reasm[header->power_role];
+        if (!pd_ext_reasm_feed(r, sop, msg->data, msg->len)) {
+            return;
+        }
+        n = pd_decode_status_class(1, r->msg_type, r->data, r->data_size, buf, sizeof(buf));
+    } else {
+        n = pd_decode_status_class(0, header->msg_type, &msg->data[2], (uint16_t)(header->num_do * 4), buf, sizeof(buf));
+    }
+
+    if (n > 0) {
+        cdc_acm_printf(" \037%s", buf);
     }
 }
 
 /**
- * @brief  获取消息方向字符串
- * @param  status STATUS 寄存器值
- * @param  header 消息头指针
- * @return const char* 方向字符串
+ * @brief  以二进制记录输出 PD MSG
+ * @param  msg 消息指针
  */
-static const char *get_direction_str(uint32_t status, pd_msg_header_t *header) {
-    if (header->PortPowerRole) {
-        if ((status & MASK_PD_STAT) == PD_RX_SOP1_HRST || (status & MASK_PD_STAT) == PD_RX_SOP2_CRST) {
-            return "CAB→ ? ";
-        }
-        return "SRC→SNK";
-    } else {
-        if ((status & MASK_PD_STAT) == PD_RX_SOP1_HRST || (status & MASK_PD_STAT) == PD_RX_SOP2_CRST) {
-            return "CAB← ? ";
-        }
-        return "SRC←SNK";
+static void print_message_binary(const pd_msg_t *msg) {
+    uint8_t rec[PD_RECORD_OVERHEAD + PD_RECORD_FRAME_FIXED + PD_MSG_MAX_LEN];
+    uint8_t status = (uint8_t)(msg->status & PD_SOP_MASK);
+    if (msg->status & IF_RX_RESET) {
+        status |= PD_RECORD_STATUS_RX_RESET;
     }
+
+    size_t n = pd_record_encode_frame(rec, msg->timestamp_ms, adc_raw_to_vbus_mv(msg->vbus_raw), msg->msg_id,
+                                      status, msg->data, msg->len);
+    cdc_acm_write(rec, n);
 }
 
 /**
@@ -164,6 +94,11 @@ static const char *get_direction_str(uint32_t status, pd_msg_header_t *header) {
  * @param  msg 消息指针
  */
 void print_message(pd_msg_t *msg) {
+    if (output_binary) {
+        print_message_binary(msg);
+        return;
+    }
+
     // 时间，电压，序号，SOP，原始数据
     // cdc_acm_printf("%u,%u,%u,%u,", msg->timestamp_ms, adc_raw_to_vbus_mv(msg->vbus_raw), msg->msg_id, msg->status & MASK_PD_STAT);
     // for (uint8_t i = 0; i < msg->len; i++) {
@@ -171,18 +106,20 @@ void print_message(pd_msg_t *msg) {
     // }
     // cdc_acm_printf("\n");
 
-    pd_msg_header_t header_tmp;
-    memcpy(&header_tmp, msg->data, sizeof(pd_msg_header_t));
-    pd_msg_header_t *header = &header_tmp;
+    pd_header_t hdr;
+    pd_header_t *header = &hdr;
+    uint16_t header_raw = pd_header_read(msg->data);
+    pd_header_decode(header_raw, header);
+    uint8_t sop = msg->status & PD_SOP_MASK;
 
-    bool is_goodcrc = (header->NumberOfDataObjects == 0 && header->MessageType == CTRL_GOODCRC);
+    bool is_goodcrc = pd_header_is_goodcrc(header_raw);
     static bool last_msg_was_goodcrc = true;
 
     // 计算数据部分的长度（不包括 CRC32）
-    uint8_t data_len = 2 + (header->NumberOfDataObjects * 4); // 头部 2 字节 + 数据对象长度
+    uint8_t data_len = 2 + (header->num_do * 4); // 头部 2 字节 + 数据对象长度
 
     // 时间 电压 序号 SOP
-    cdc_acm_printf("> \037%ums \037%05umV \037#%03u \037%-5s \037", msg->timestamp_ms, adc_raw_to_vbus_mv(msg->vbus_raw), msg->msg_id, get_sop_type_name(msg->status));
+    cdc_acm_printf("> \037%ums \037%05umV \037#%03u \037%-5s \037", msg->timestamp_ms, adc_raw_to_vbus_mv(msg->vbus_raw), msg->msg_id, pd_sop_label(sop));
 
     if (msg->status & IF_RX_RESET) {
         cdc_acm_prints("RX_RESET\n");
@@ -190,30 +127,26 @@ void print_message(pd_msg_t *msg) {
     }
 
     // 消息类型
-    if (header->Extended) {
-        cdc_acm_printf("%-15s \037", find_msg_type_name(header->MessageType, ext_msg_desc, "Ext"));
-    } else {
-        cdc_acm_printf("%-15s \037", get_message_type_name(header));
-    }
+    cdc_acm_printf("%-15s \037", get_message_type_name(header));
 
     // 消息 ID
-    cdc_acm_printf("%u \037", header->MessageID);
+    cdc_acm_printf("%u \037", header->msg_id);
 
     // 方向
-    cdc_acm_printf("%s \037", get_direction_str(msg->status, header));
+    cdc_acm_printf("%s \037", pd_direction_label(sop, header->power_role));
 
     // 版本
-    cdc_acm_printf("V%u \037", header->SpecificationRevision + 1);
+    cdc_acm_printf("V%u \037", header->spec_rev + 1);
 
     // 数据对象数量
-    // cdc_acm_printf("%-1u ", header->NumberOfDataObjects);
+    // cdc_acm_printf("%-1u ", header->num_do);
 
     // 消息头
     cdc_acm_printf("[H]0x%02X%02X", msg->data[1], msg->data[0]);
 
     // 数据对象
     if (msg->len > 2) {
-        for (uint8_t i = 0; i < header->NumberOfDataObjects; i++) {
+        for (uint8_t i = 0; i < header->num_do; i++) {
             cdc_acm_printf("[%u]0x%02X%02X%02X%02X",
                            i,
                            msg->data[2 + i * 4 + 3],
@@ -232,6 +165,9 @@ void print_message(pd_msg_t *msg) {
                        msg->data[data_len]);
     }
 
+    // 解码状态类消息
+    print_decoded_fields(msg, header, sop);
+
     // 检查连续的消息类型
     if (is_goodcrc && last_msg_was_goodcrc) {
         cdc_acm_printf(" \037←WARN!!");
@@ -247,53 +183,52 @@ void print_message(pd_msg_t *msg) {
 }
 
 /**
- * @brief  将消息保存到循环缓冲区
-
+ * @brief  将消息写入事件流
  * @param  status STATUS 寄存器值
  * @param  data 消息数据
  * @param  len 消息长度
  */
 void save_message(uint32_t status, uint8_t *data, uint8_t len) {
-    // 当前索引
-    uint16_t curr_idx = msg_buffer.write_idx;
-    // 下一个写入位置
-    uint16_t next_idx = (curr_idx + 1) % PD_MSG_BUFFER_SIZE;
-
-    // 缓冲区满时覆盖最旧消息
-    if (next_idx == msg_buffer.read_idx) {
-        msg_buffer.read_idx = (msg_buffer.read_idx + 1) % PD_MSG_BUFFER_SIZE;
-    }
+    uint16_t vbus_raw = adc_get_avg_raw();
+    uint32_t irq;
+    pd_event_t *e = usb_pd_event_reserve(PD_EVENT_FRAME, &irq);
+    pd_msg_t *m = &e->u.frame;
 
     // 保存
-    memcpy(msg_buffer.msgs[curr_idx].data, data, len);
-    msg_buffer.msgs[curr_idx].len = len;
-    msg_buffer.msgs[curr_idx].status = status;
-    msg_buffer.msgs[curr_idx].msg_id = ++pdMessage.msg_counter;
-    msg_buffer.msgs[curr_idx].timestamp_ms = millis();
-    msg_buffer.msgs[curr_idx].vbus_raw = adc_get_avg_raw();
-
-    // 更新写指针
-    msg_buffer.write_idx = next_idx;
+    if (len) memcpy(m->data, data, len);
+    m->len = len;
+    m->status = status;
+    m->msg_id = ++pdMessage.msg_counter;
+    m->timestamp_ms = e->ms;
+    m->vbus_raw = vbus_raw;
+    uint32_t seq = m->msg_id, ms = e->ms;
+
+    usb_pd_event_commit(irq);
+    usb_pd_vcap_on_frame(status, data, len, seq, ms);
 }
 
 /**
- * @brief  获取消息缓冲区
- * @return pd_msg_buffer_t* 消息缓冲区指针
+ * @brief  重置消息计数器
  */
-pd_msg_buffer_t *get_message_buffer(void) {
-    return &msg_buffer;
+void reset_message_counter(void) {
+    pdMessage.msg_counter = 0;
 }
 
 /**
- * @brief  重置消息计数器
+ * @brief  选择输出格式
+ * @param  binary true: 二进制记录; false: 文本
  */
-void reset_message_counter(void) {
-    pdMessage.msg_counter = 0;
+void set_message_output_binary(bool binary) {
+    output_binary = binary;
+}
+
+bool get_message_output_binary(void) {
+    return output_binary;
 }
 
 /**
- * @brief 清空消息缓冲区（丢弃未读消息）
+ * @brief 清空事件流（丢弃未打印的消息和事件）
  */
 void clear_message_buffer(void) {
-    msg_buffer.read_idx = msg_buffer.write_idx;
+    usb_pd_event_clear();
 }
@@ -2,20 +2,33 @@
 
 #include "ch32x035_usbpd.h"
 #include "debug.h"
+#include "irq_save.h"
 #include "usb_cdc_print.h"
 #include "usb_pd_cc.h"
+#include "usb_pd_cctl.h"
+#include "usb_pd_event.h"
 #include "usb_pd_message.h"
 #include "usb_pd_snk.h"
+#include "usb_pd_src.h"
+#include "usb_pd_sweep.h"
 #include "usb_pd_auto.h"
+#include "usb_pd_calib.h"
+#include "usb_pd_cable.h"
+#include "usb_pd_policy.h"
+#include "usb_pd_reset.h"
+#include "usb_pd_script.h"
+#include "usb_pd_timer.h"
+#include "usb_pd_tx.h"
+#include "usb_pd_vcap.h"
 
 /* PD RX Buuffer */
 __attribute__((aligned(4))) static uint8_t usb_pd_rx_buffer[PD_MSG_MAX_LEN];
-/* GoodCRC logging: store header until TX_END for proper ordering */
-static volatile uint8_t s_ack_hdr[2] = {0};
-static volatile uint8_t s_ack_pending = 0;
+/* GoodCRC queued (held) in the RX interrupt and released by the timer callback */
+static volatile pd_tx_handle_t s_ack_handle = 0;
+static volatile uint16_t s_goodcrc_delay_us = PD_GOODCRC_DELAY_DEFAULT_US;
 
 /* CC 连接状态 */
-static cc_state_t cc_state = {0};
+static pd_cc_fsm_t cc_state = {0};
 
 /**
  * @brief  配置为接收模式
@@ -31,6 +44,40 @@ static void set_rx_mode(void) {
     NVIC_EnableIRQ(USBPD_IRQn);
 }
 
+/**
+ * @brief  GoodCRC 定时回调：放行已排队的 GoodCRC
+ */
+static void goodcrc_tx_start(void) {
+    pd_tx_handle_t handle = s_ack_handle;
+    s_ack_handle = 0;
+    usb_pd_tx_release(handle);
+}
+
+/**
+ * @brief  排队 GoodCRC（保留到定时器放行）
+ */
+static void goodcrc_queue(const uint8_t *ack, uint8_t sop, uint16_t entry_us) {
+    /* An earlier GoodCRC not released yet is superseded by this one; left held it would block the PHY */
+    // TIM2 (goodcrc_tx_start) may preempt this interrupt
+    uint32_t irq = irq_save();
+    usb_pd_tx_cancel(s_ack_handle);
+    s_ack_handle = usb_pd_tx_submit_held(ack, 2, sop, PD_TX_PRIO_GOODCRC);
+    usb_pd_timer_start_at(PD_TIMER_GOODCRC, entry_us, s_goodcrc_delay_us, goodcrc_tx_start);
+    irq_restore(irq);
+}
+
+/**
+ * @brief  设置 GoodCRC 回复延时（从 RX 中断入口算起）
+ */
+void usb_pd_monitor_set_goodcrc_delay(uint16_t delay_us) {
+    if (delay_us > PD_GOODCRC_DELAY_MAX_US) delay_us = PD_GOODCRC_DELAY_MAX_US;
+    s_goodcrc_delay_us = delay_us;
+}
+
+uint16_t usb_pd_monitor_get_goodcrc_delay(void) {
+    return s_goodcrc_delay_us;
+}
+
 /**
  * @brief  初始化 USB PD 监听
  */
@@ -38,6 +85,9 @@ void usb_pd_monitor_init(void) {
     // 使能时钟
     RCC_AHBPeriphClockCmd(RCC_AHBPeriph_USBPD, ENABLE);
 
+    // PD 协议定时器（GoodCRC 等）
+    usb_pd_timer_init();
+
     // 初始化 CC 引脚
     usb_pd_cc_init();
 
@@ -51,20 +101,27 @@ void usb_pd_monitor_init(void) {
  * @brief  USB PD 监听处理函数
  */
 void usb_pd_monitor_process(void) {
-    /* flush any deferred SNK prints in non-ISR context */
-    usb_pd_snk_poll();
-    usb_pd_auto_poll();
-
-    // 从 buffer 读取并处理 PD 消息
-    pd_msg_buffer_t *msg_buffer = get_message_buffer();
-    while (msg_buffer->read_idx != msg_buffer->write_idx) {                     // 判断是否有新消息
-        pd_msg_t *m = &msg_buffer->msgs[msg_buffer->read_idx];
-        print_message(m);                                                       // 打印消息
-        msg_buffer->read_idx = (msg_buffer->read_idx + 1) % PD_MSG_BUFFER_SIZE; // 更新读指针
+    /* flush any deferred SNK/SRC prints in non-ISR context */
+    usb_pd_tx_poll();
+    usb_pd_policy_poll();
+    usb_pd_src_poll();
+    usb_pd_script_poll();
+    usb_pd_reset_poll();
+    usb_pd_cable_poll();
+    usb_pd_sweep_poll();
+    usb_pd_cctl_poll();
+    usb_pd_vcap_poll();
+    usb_pd_calib_poll();
+
+    // 按时间顺序打印事件流（PD 消息、CC、VBUS、模式切换）
+    usb_pd_event_poll();
+
+    // 检测 CC 连接状态（SRC 模式由 usb_pd_src_poll 自行检测 Rd）
+    if (!usb_pd_src_is_active()) {
+        usb_pd_cc_check_connection(&cc_state);
+    } else {
+        usb_pd_cc_rescan();
     }
-
-    // 检测 CC 连接状态
-    usb_pd_cc_check_connection(&cc_state);
 }
 
 /**
@@ -72,6 +129,7 @@ void usb_pd_monitor_process(void) {
  */
 void USBPD_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
 void USBPD_IRQHandler(void) {
+    uint16_t entry_us = usb_pd_timer_now();
     uint8_t status = USBPD->STATUS;
     uint16_t byte_cnt = USBPD->BMC_BYTE_CNT;
 
@@ -79,43 +137,51 @@ void USBPD_IRQHandler(void) {
         USBPD->STATUS |= IF_RX_ACT;
 
         if ((status & MASK_PD_STAT) && byte_cnt >= 6) {
-            /* Auto GoodCRC when SNK mode is active and RX is a non-GoodCRC SOP0 frame */
-            if (usb_pd_snk_is_active() && ((status & MASK_PD_STAT) == PD_RX_SOP0)) {
+            /* Auto GoodCRC when SNK or SRC mode is active and RX is a non-GoodCRC SOP0 frame */
+            bool src = usb_pd_src_is_active();
+            if ((usb_pd_snk_is_active() || src) && ((status & MASK_PD_STAT) == PD_RX_SOP0)) {
                 /* Header at rx buffer */
                 uint8_t *rx = usb_pd_rx_buffer; /* same DMA buffer registered */
                 bool is_goodcrc = ((rx[0] & 0x1F) == CTRL_GOODCRC) && (byte_cnt == 6);
                 if (!is_goodcrc) {
-                    /* Respond GoodCRC ~30us later */
-                    Delay_Us(30);
-                    static uint8_t ack[2];
-                    ack[0] = (uint8_t)(0x01 | usb_pd_snk_get_spec_flag()); /* GoodCRC with selected SpecRev */
-                    ack[1] = (rx[1] & 0x0E);                         /* echo MsgID, PRRole forced to 0 (SNK) */
-
-                    /* Drive selected CC */
-                    if ((USBPD->CONFIG & CC_SEL) == CC_SEL) {
-                        USBPD->PORT_CC2 |= CC_LVE;
+                    /* Reserve the PHY for GoodCRC; the timer releases it s_goodcrc_delay_us after ISR entry */
+                    uint8_t ack[2];
+                    if (src) {
+                        ack[0] = (uint8_t)(0x01 | 0x20 | usb_pd_src_get_spec_flag()); /* GoodCRC, DataRole DFP */
+                        ack[1] = (uint8_t)((rx[1] & 0x0E) | 0x01);                    /* echo MsgID, PRRole 1 (SRC) */
                     } else {
-                        USBPD->PORT_CC1 |= CC_LVE;
+                        ack[0] = (uint8_t)(0x01 | usb_pd_snk_get_spec_flag()); /* GoodCRC with selected SpecRev */
+                        ack[1] = (rx[1] & 0x0E);                               /* echo MsgID, PRRole forced to 0 (SNK) */
                     }
+                    goodcrc_queue(ack, PD_SOP0, entry_us);
 
-                    USBPD->CONFIG |= IE_TX_END;
-                    USBPD->BMC_CLK_CNT = UPD_TMR_TX_48M;
-                    USBPD->DMA = (uint32_t)(uint8_t *)ack;
-                    USBPD->TX_SEL = UPD_SOP0;
-                    USBPD->BMC_TX_SZ = 2;
-                    USBPD->CONTROL |= PD_TX_EN;
-                    USBPD->STATUS &= BMC_AUX_INVALID;
-                    USBPD->CONTROL |= BMC_START;
-
-                    /* Defer logging GoodCRC until TX_END so it appears after the triggering RX */
-                    s_ack_hdr[0] = ack[0];
-                    s_ack_hdr[1] = ack[1];
-                    s_ack_pending = 1;
-
-                    /* After scheduling GoodCRC, evaluate auto-replies and queue them */
-                    usb_pd_auto_on_rx(status, rx, byte_cnt);
+                    /* Evaluate auto-replies and queue them behind the GoodCRC; a running script replaces them */
+                    if (usb_pd_script_is_running()) {
+                        usb_pd_script_on_rx(rx, (uint8_t)byte_cnt, entry_us);
+                    } else if (src) {
+                        usb_pd_src_on_rx(rx, (uint8_t)byte_cnt);
+                    } else {
+                        usb_pd_auto_on_rx(status, rx, byte_cnt);
+                    }
+                } else {
+                    /* Partner acknowledged one of our frames */
+                    usb_pd_tx_on_goodcrc(status & MASK_PD_STAT, (uint8_t)((rx[1] >> 1) & 0x07));
+                }
+            } else if ((usb_pd_snk_is_active() || src) && usb_pd_cable_is_waiting(status & MASK_PD_STAT)) {
+                /* Cable plug on SOP'/SOP'' during our own query: acknowledge on the same SOP */
+                uint8_t sop = status & MASK_PD_STAT;
+                uint8_t *rx = usb_pd_rx_buffer;
+                if (((rx[0] & 0x1F) == CTRL_GOODCRC) && (byte_cnt == 6)) {
+                    usb_pd_tx_on_goodcrc(sop, (uint8_t)((rx[1] >> 1) & 0x07));
+                } else {
+                    uint8_t ack[2];
+                    ack[0] = (uint8_t)(0x01 | (src ? usb_pd_src_get_spec_flag() : usb_pd_snk_get_spec_flag()));
+                    ack[1] = (uint8_t)(rx[1] & 0x0E); /* echo MsgID, Cable Plug 0 */
+                    goodcrc_queue(ack, sop, entry_us);
+                    usb_pd_cable_on_rx(sop, rx, (uint8_t)byte_cnt);
                 }
             }
+            if ((status & MASK_PD_STAT) == PD_RX_SOP0) usb_pd_reset_on_rx(usb_pd_rx_buffer, (uint8_t)byte_cnt);
             save_message(status, usb_pd_rx_buffer, byte_cnt);
         }
     }
@@ -123,6 +189,8 @@ void USBPD_IRQHandler(void) {
     if (status & IF_RX_RESET) {
         USBPD->STATUS |= IF_RX_RESET;
         // usb_pd_cc_detach(&cc_state);
+        /* Hard Reset: restart the protocol layer and policy, time the recovery; Cable Reset: SOP'/SOP'' only */
+        usb_pd_reset_on_received(status);
         // 将 RX_RESET 事件保存到消息缓冲区
         save_message(status, NULL, 0);
     }
@@ -131,17 +199,8 @@ void USBPD_IRQHandler(void) {
         /* TX complete (e.g., GoodCRC or a data/control frame) */
         USBPD->STATUS |= IF_TX_END;
 
-        /* If a GoodCRC was just sent, log it now to preserve ordering */
-        if (s_ack_pending) {
-            uint8_t tmp[2] = { (uint8_t)s_ack_hdr[0], (uint8_t)s_ack_hdr[1] };
-            save_message(PD_RX_SOP0, tmp, 2);
-            s_ack_pending = 0;
-        }
-
-        /* If a pending auto-reply exists, start it immediately; otherwise, release CC drive and return to RX */
-        if (!usb_pd_snk_on_tx_end_handle_pending()) {
-            USBPD->PORT_CC1 &= ~CC_LVE;
-            USBPD->PORT_CC2 &= ~CC_LVE;
+        /* Start the next queued frame; otherwise return to RX */
+        if (!usb_pd_tx_on_tx_end()) {
             USBPD->CONTROL &= ~PD_TX_EN;
             USBPD->DMA = (uint32_t)(uint8_t *)usb_pd_rx_buffer;
             USBPD->BMC_CLK_CNT = UPD_TMR_RX_48M;
@@ -1,7 +1,14 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 void usb_pd_monitor_init(void);
 void usb_pd_monitor_process(void);
+
+#define PD_GOODCRC_DELAY_DEFAULT_US 30    // GoodCRC 回复延时默认值
+#define PD_GOODCRC_DELAY_MAX_US     10000 // 上限（用于测试对端 tReceive）
+
+void usb_pd_monitor_set_goodcrc_delay(uint16_t delay_us);
+uint16_t usb_pd_monitor_get_goodcrc_delay(void);
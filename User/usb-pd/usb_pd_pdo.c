@@ -0,0 +1,67 @@
+#include "usb_pd_pdo.h"
+
+static inline uint16_t min_u16(uint16_t a, uint16_t b) {
+    return a < b ? a : b;
+}
+
+void pd_pdo_parse(uint32_t raw, pd_pdo_t *pdo) {
+    pdo->min_mv = 0;
+    pdo->max_mv = 0;
+    pdo->max_ma = 0;
+    pdo->max_mw = 0;
+
+    switch (raw >> 30) {
+    case 0: // Fixed
+        pdo->type = PD_PDO_FIXED;
+        pdo->min_mv = pdo->max_mv = (uint16_t)(((raw >> 10) & 0x3FF) * 50);
+        pdo->max_ma = (uint16_t)((raw & 0x3FF) * 10);
+        break;
+    case 1: // Battery
+        pdo->type = PD_PDO_BATTERY;
+        pdo->max_mv = (uint16_t)(((raw >> 20) & 0x3FF) * 50);
+        pdo->min_mv = (uint16_t)(((raw >> 10) & 0x3FF) * 50);
+        pdo->max_mw = (raw & 0x3FF) * 250;
+        break;
+    case 2: // Variable
+        pdo->type = PD_PDO_VARIABLE;
+        pdo->max_mv = (uint16_t)(((raw >> 20) & 0x3FF) * 50);
+        pdo->min_mv = (uint16_t)(((raw >> 10) & 0x3FF) * 50);
+        pdo->max_ma = (uint16_t)((raw & 0x3FF) * 10);
+        break;
+    default: // APDO
+        switch ((raw >> 28) & 0x03) {
+        case 0:
+            pdo->type = PD_PDO_PPS;
+            pdo->max_mv = (uint16_t)(((raw >> 17) & 0xFF) * 100);
+            pdo->min_mv = (uint16_t)(((raw >> 8) & 0xFF) * 100);
+            pdo->max_ma = (uint16_t)((raw & 0x7F) * 50);
+            break;
+        case 1:
+            pdo->type = PD_PDO_EPR_AVS;
+            pdo->max_mv = (uint16_t)(((raw >> 17) & 0x1FF) * 100);
+            pdo->min_mv = (uint16_t)(((raw >> 8) & 0xFF) * 100);
+            pdo->max_mw = (raw & 0xFF) * 1000;
+            break;
+        case 2: {
+            /* SPR AVS: 9V..15V, and up to 20V when a 20V current is given */
+            uint16_t ma_15v = (uint16_t)(((raw >> 10) & 0x3FF) * 10);
+            uint16_t ma_20v = (uint16_t)((raw & 0x3FF) * 10);
+            pdo->type = PD_PDO_SPR_AVS;
+            pdo->min_mv = 9000;
+            pdo->max_mv = ma_20v ? 20000 : 15000;
+            pdo->max_ma = ma_20v ? min_u16(ma_15v, ma_20v) : ma_15v;
+            break;
+        }
+        default:
+            pdo->type = PD_PDO_UNKNOWN;
+            break;
+        }
+        break;
+    }
+}
+
+static const char *const pdo_type_str[] = {"Fixed", "Battery", "Variable", "PPS", "EPR_AVS", "SPR_AVS", "?"};
+
+const char *pd_pdo_type_name(uint8_t type) {
+    return pdo_type_str[type < PD_PDO_UNKNOWN ? type : PD_PDO_UNKNOWN];
+}
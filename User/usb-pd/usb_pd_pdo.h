@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Power / request data object decode (Source_Capabilities, Request).
+ * No hardware dependency; shared with host tools.
+ */
+
+/* PDO 类型 */
+typedef enum {
+    PD_PDO_FIXED = 0,
+    PD_PDO_BATTERY,
+    PD_PDO_VARIABLE,
+    PD_PDO_PPS,     // SPR PPS APDO
+    PD_PDO_EPR_AVS, // EPR AVS APDO
+    PD_PDO_SPR_AVS, // SPR AVS APDO
+    PD_PDO_UNKNOWN,
+} pd_pdo_type_t;
+
+/* Decoded power data object (mV / mA / mW) */
+typedef struct {
+    uint8_t type;    // pd_pdo_type_t
+    uint16_t min_mv; // Fixed: min_mv == max_mv
+    uint16_t max_mv;
+    uint16_t max_ma; // Battery / EPR AVS: 0，见 max_mw
+    uint32_t max_mw; // Battery / EPR AVS 的功率上限，其它类型为 0
+} pd_pdo_t;
+
+void pd_pdo_parse(uint32_t raw, pd_pdo_t *pdo);
+
+/* "Fixed", "Battery", "Variable", "PPS", "EPR_AVS", "SPR_AVS" or "?" */
+const char *pd_pdo_type_name(uint8_t type);
+
+/* Request data object fields */
+#define PD_RDO_POS(r)          ((uint8_t)(((r) >> 28) & 0x0F))
+#define PD_RDO_CAP_MISMATCH(r) ((uint8_t)(((r) >> 26) & 0x01))
+#define PD_RDO_EPR_CAPABLE(r)  ((uint8_t)(((r) >> 22) & 0x01))
+#define PD_RDO_OP_10MA(r)      ((uint16_t)(((r) >> 10) & 0x3FF)) // Fixed / Variable 工作电流，Battery 为 250mW 单位功率
+#define PD_RDO_APDO_OUT(r)     ((uint16_t)(((r) >> 9) & 0xFFF))  // PPS 20mV，AVS 25mV
+#define PD_RDO_APDO_OP_50MA(r) ((uint8_t)((r) & 0x7F))
@@ -0,0 +1,562 @@
+#include "usb_pd_policy.h"
+
+#include "ch32x035_usbpd.h"
+#include "irq_save.h"
+#include "millis.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_header.h"
+#include "usb_pd_script.h"
+#include "usb_pd_snk.h"
+#include "usb_pd_tx.h"
+
+#define MSG_CTRL_ACCEPT  0x03
+#define MSG_CTRL_REJECT  0x04
+#define MSG_CTRL_PS_RDY  0x06
+#define MSG_CTRL_WAIT    0x0C
+#define MSG_DATA_SRC_CAP     0x01
+#define MSG_DATA_REQUEST     0x02
+#define MSG_DATA_EPR_REQUEST 0x09
+#define MSG_DATA_EPR_MODE    0x0A
+#define MSG_EXT_CONTROL      0x10
+
+/* EPR_Mode Action */
+#define EPR_MODE_ENTER           1
+#define EPR_MODE_ENTER_ACK       2
+#define EPR_MODE_ENTER_SUCCEEDED 3
+#define EPR_MODE_ENTER_FAILED    4
+#define EPR_MODE_EXIT            5
+
+#define ECDB_EPR_KEEPALIVE 0x03
+#define PDO_EPR_CAPABLE    (1u << 23)
+
+/* RDO 标志位 */
+#define RDO_CAP_MISMATCH   (1u << 26)
+#define RDO_USB_COMM       (1u << 25)
+#define RDO_NO_USB_SUSPEND (1u << 24)
+#define RDO_EPR_CAPABLE    (1u << 22)
+
+/* 延迟打印事件 */
+#define EVT_REQUEST   0x01
+#define EVT_CONTRACT  0x02
+#define EVT_REJECT    0x04
+#define EVT_WAIT      0x08
+#define EVT_TIMEOUT   0x10
+#define EVT_TX_FAILED 0x20
+#define EVT_EPR_ENTER 0x40
+#define EVT_EPR_EXIT  0x80
+
+/* 默认与旧行为一致：请求 5V（PDO 1） */
+static pd_policy_target_t s_target = {PD_POLICY_VOLTAGE, 5000, 0};
+
+static volatile uint8_t s_state = PD_POLICY_WAIT_CAPS;
+static uint32_t s_caps[PD_POLICY_MAX_PDO];
+static uint8_t s_num_caps = 0;
+static pd_policy_choice_t s_pending;  // 已请求、尚未生效
+static pd_policy_choice_t s_contract; // 当前合约
+static volatile bool s_has_contract = false;
+static volatile pd_tx_handle_t s_req_handle = 0;
+static volatile uint32_t s_timer_start_ms = 0;
+static volatile uint32_t s_timer_ms = 0;      // 0: 无定时
+static volatile uint32_t s_rerequest_ms = 0;  // Wait / PPS 周期重发时刻，0: 无
+static volatile uint16_t s_last_rx_hdr = 0;   // 用于丢弃重传
+static volatile bool s_last_rx_valid = false;
+static volatile uint8_t s_events = 0;
+static volatile uint8_t s_timeout_state = 0;
+static volatile bool s_epr = false;          // 处于 EPR 模式
+static volatile bool s_epr_tried = false;    // 本次连接已尝试进入 EPR
+static volatile uint8_t s_epr_result = 0;    // 最近一次 EPR_Mode 结果（Action）
+static volatile uint8_t s_epr_reason = 0;    // Enter Failed 的原因（data 字段）
+static volatile uint8_t s_epr_cmd = 0;       // 主机请求：EPR_MODE_ENTER / EPR_MODE_EXIT
+static volatile uint32_t s_keepalive_ms = 0; // 下次 EPR_KeepAlive 时刻
+static volatile pd_policy_hook_t s_hook = 0;
+
+static inline uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Current to request from a PDO under the target limit (0: no limit) */
+static uint16_t limit_ma(uint16_t max_ma, uint16_t ma_max) {
+    return (ma_max && ma_max < max_ma) ? ma_max : max_ma;
+}
+
+bool pd_policy_select(const uint32_t *pdos, uint8_t n, const pd_policy_target_t *target, pd_policy_choice_t *choice) {
+    if (n == 0) return false;
+    if (n > PD_POLICY_MAX_PDO) n = PD_POLICY_MAX_PDO;
+
+    uint32_t best_score = 0;
+    choice->pos = 0;
+    choice->mismatch = 0;
+
+    for (uint8_t i = 0; i < n; i++) {
+        if (!pdos[i]) continue; // EPR 能力中未使用的 SPR 位置
+        pd_pdo_t p;
+        pd_pdo_parse(pdos[i], &p);
+        uint16_t mv = 0, ma = 0;
+        uint32_t score = 0;
+
+        switch (target->mode) {
+        case PD_POLICY_MAX_POWER:
+            /* Fixed supplies only: Variable / Battery outputs are not regulated */
+            if (p.type != PD_PDO_FIXED) continue;
+            if (target->mv && p.max_mv > target->mv) continue;
+            mv = p.max_mv;
+            ma = limit_ma(p.max_ma, target->ma_max);
+            /* ties go to the lower voltage, which comes first */
+            score = (uint32_t)mv * ma;
+            break;
+        case PD_POLICY_VOLTAGE:
+            if (p.type == PD_PDO_FIXED && p.max_mv == target->mv) {
+                mv = p.max_mv;
+                ma = limit_ma(p.max_ma, target->ma_max);
+                score = 0x80000000u | ma; // 同电压优先 Fixed
+            } else if ((p.type == PD_PDO_VARIABLE || p.type == PD_PDO_BATTERY) &&
+                       p.min_mv <= target->mv && target->mv <= p.max_mv) {
+                mv = target->mv;
+                ma = p.type != PD_PDO_BATTERY ? p.max_ma
+                     : p.max_mv ? (uint16_t)(p.max_mw * 1000 / p.max_mv) : 0;
+                ma = limit_ma(ma, target->ma_max);
+                score = ma;
+            } else {
+                continue;
+            }
+            break;
+        case PD_POLICY_PPS:
+            if (p.type == PD_PDO_PPS && p.min_mv <= target->mv && target->mv <= p.max_mv) {
+                mv = (uint16_t)(target->mv / 20 * 20);
+                ma = limit_ma(p.max_ma, target->ma_max);
+                score = 0x80000000u | ma; // PPS 优先于 AVS
+            } else if (p.type == PD_PDO_SPR_AVS && p.min_mv <= target->mv && target->mv <= p.max_mv) {
+                mv = (uint16_t)(target->mv / 100 * 100); // AVS 以 100mV 步进
+                ma = limit_ma(p.max_ma, target->ma_max);
+                score = ma;
+            } else if (p.type == PD_PDO_EPR_AVS && p.min_mv <= target->mv && target->mv <= p.max_mv) {
+                /* EPR AVS is limited by PDP and the 5A EPR cable */
+                mv = (uint16_t)(target->mv / 100 * 100);
+                uint32_t pdp_ma = p.max_mw * 1000 / mv / 50 * 50;
+                ma = limit_ma((uint16_t)(pdp_ma > 5000 ? 5000 : pdp_ma), target->ma_max);
+                score = ma;
+            } else {
+                continue;
+            }
+            break;
+        default:
+            continue;
+        }
+
+        if (score > best_score || !choice->pos) {
+            best_score = score;
+            choice->pos = (uint8_t)(i + 1);
+            choice->type = p.type;
+            choice->mv = mv;
+            choice->ma = ma;
+        }
+    }
+
+    if (!choice->pos) {
+        /* Nothing fits: vSafe5V with Capability Mismatch */
+        pd_pdo_t p;
+        pd_pdo_parse(pdos[0], &p);
+        choice->pos = 1;
+        choice->type = p.type;
+        choice->mismatch = 1;
+        choice->mv = p.max_mv;
+        choice->ma = limit_ma(p.max_ma, target->ma_max);
+    }
+    return true;
+}
+
+uint32_t pd_policy_build_rdo(const pd_policy_choice_t *choice, uint32_t pdo, bool epr_capable) {
+    uint32_t rdo = ((uint32_t)(choice->pos & 0x0F) << 28) | RDO_USB_COMM | RDO_NO_USB_SUSPEND;
+    if (choice->mismatch) rdo |= RDO_CAP_MISMATCH;
+    if (epr_capable) rdo |= RDO_EPR_CAPABLE;
+
+    pd_pdo_t p;
+    pd_pdo_parse(pdo, &p);
+    switch (p.type) {
+    case PD_PDO_FIXED:
+    case PD_PDO_VARIABLE: {
+        uint32_t cur = choice->ma / 10;     // 10mA
+        uint32_t max = p.max_ma / 10;
+        rdo |= (cur << 10) | (choice->mismatch ? cur : max);
+        break;
+    }
+    case PD_PDO_BATTERY: {
+        uint32_t mw = (uint32_t)choice->mv * choice->ma / 1000;
+        if (mw > p.max_mw) mw = p.max_mw;
+        uint32_t pw = mw / 250;             // 250mW
+        rdo |= (pw << 10) | (p.max_mw / 250);
+        break;
+    }
+    case PD_PDO_PPS:
+        rdo |= ((uint32_t)(choice->mv / 20) << 9) | (choice->ma / 50);  // 20mV / 50mA
+        break;
+    case PD_PDO_SPR_AVS:
+    case PD_PDO_EPR_AVS:
+        rdo |= ((uint32_t)(choice->mv / 25) << 9) | (choice->ma / 50);  // 25mV（100mV 对齐）/ 50mA
+        break;
+    default:
+        break;
+    }
+    return rdo;
+}
+
+static inline void notify(pd_policy_event_t ev) {
+    pd_policy_hook_t hook = s_hook;
+    if (hook) hook(ev);
+}
+
+static void start_timer(uint32_t ms) {
+    s_timer_start_ms = millis();
+    s_timer_ms = ms;
+}
+
+static inline void wr32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline bool source_epr_capable(void) {
+    return usb_pd_snk_get_spec_rev() == 3 && s_num_caps && (s_caps[0] & PDO_EPR_CAPABLE);
+}
+
+/* The target can only be met above 20V */
+static bool target_wants_epr(void) {
+    if (s_target.mode == PD_POLICY_MAX_POWER) return s_target.mv == 0 || s_target.mv > 20000;
+    return s_target.mv > 20000;
+}
+
+/* Select and queue a Request (EPR_Request in EPR mode) against the stored capabilities */
+static void send_request(void) {
+    pd_policy_choice_t choice;
+    if (!pd_policy_select(s_caps, s_num_caps, &s_target, &choice)) return;
+
+    /* EPR Mode Capable only advertised towards an EPR capable PD3 source */
+    uint32_t pdo = s_caps[choice.pos - 1];
+    uint32_t rdo = pd_policy_build_rdo(&choice, pdo, s_epr || source_epr_capable());
+
+    /* SpecRev / MsgID patched at TX; PRRole=SNK(0) */
+    uint8_t frame[10];
+    uint8_t len;
+    if (s_epr) {
+        /* EPR_Request: RDO followed by a copy of the requested PDO */
+        frame[0] = MSG_DATA_EPR_REQUEST;
+        frame[1] = 0x20; /* NumDO=2 */
+        wr32(&frame[6], pdo);
+        len = 10;
+    } else {
+        frame[0] = MSG_DATA_REQUEST;
+        frame[1] = 0x10; /* NumDO=1 */
+        len = 6;
+    }
+    wr32(&frame[2], rdo);
+
+    s_pending = choice;
+    s_req_handle = usb_pd_snk_queue_frame(frame, len);
+    s_rerequest_ms = 0;
+    if (!s_req_handle) {
+        s_events |= EVT_TX_FAILED;
+        s_state = PD_POLICY_WAIT_CAPS;
+        s_timer_ms = 0;
+        notify(PD_POLICY_EV_REFUSED);
+        return;
+    }
+    s_state = PD_POLICY_WAIT_ACCEPT;
+    start_timer(PD_T_SENDER_RESPONSE_MS);
+    s_events |= EVT_REQUEST;
+}
+
+/* Reject / Wait: keep an existing contract, otherwise wait for new capabilities */
+static void request_refused(void) {
+    s_state = s_has_contract ? PD_POLICY_READY : PD_POLICY_WAIT_CAPS;
+    s_timer_ms = 0;
+    notify(PD_POLICY_EV_REFUSED);
+}
+
+void usb_pd_policy_set_target(const pd_policy_target_t *target) {
+    s_target = *target;
+}
+
+void usb_pd_policy_get_target(pd_policy_target_t *target) {
+    *target = s_target;
+}
+
+void usb_pd_policy_request(void) {
+    uint32_t now = millis();
+    s_rerequest_ms = now ? now : 1;
+}
+
+void usb_pd_policy_set_hook(pd_policy_hook_t hook) {
+    s_hook = hook;
+}
+
+/* EPR_Mode with action and data field */
+static pd_tx_handle_t send_epr_mode(uint8_t action, uint8_t data) {
+    uint8_t frame[6];
+    frame[0] = MSG_DATA_EPR_MODE;
+    frame[1] = 0x10; /* NumDO=1 */
+    wr32(&frame[2], ((uint32_t)action << 24) | ((uint32_t)data << 16));
+    return usb_pd_snk_queue_frame(frame, sizeof(frame));
+}
+
+static pd_tx_handle_t send_epr_keepalive(void) {
+    /* Header(Ext=1, NDO=1, ExtControl), ExtHdr(Chunked=1, DataSize=2), ECDB: [Type, Data] */
+    uint8_t frame[6];
+    frame[0] = MSG_EXT_CONTROL;
+    frame[1] = 0x80 | 0x10;
+    frame[2] = 0x02;
+    frame[3] = 0x80;
+    frame[4] = ECDB_EPR_KEEPALIVE;
+    frame[5] = 0x00;
+    return usb_pd_snk_queue_frame(frame, sizeof(frame));
+}
+
+/* EPR Sink Operational PDP in W for EPR_Mode Enter */
+static uint8_t epr_pdp_w(void) {
+    uint32_t mv = s_target.mv ? s_target.mv : 48000;
+    uint32_t ma = s_target.ma_max ? s_target.ma_max : 5000;
+    uint32_t w = (mv * ma + 999999) / 1000000;
+    return (uint8_t)(w > 240 ? 240 : w);
+}
+
+static void epr_left(void) {
+    s_epr = false;
+    s_keepalive_ms = 0;
+}
+
+void usb_pd_policy_reset(void) {
+    s_state = PD_POLICY_WAIT_CAPS;
+    epr_left();
+    s_epr_tried = false;
+    s_epr_cmd = 0;
+    s_num_caps = 0;
+    s_has_contract = false;
+    s_req_handle = 0;
+    s_timer_ms = 0;
+    s_rerequest_ms = 0;
+    s_last_rx_valid = false;
+    s_events = 0;
+}
+
+void usb_pd_policy_on_rx(const uint8_t *frame, uint8_t len) {
+    if (len < 2) return;
+    uint16_t hdr = pd_header_read(frame);
+
+    /* Same header (and MessageID) as the previous message: a retransmission */
+    if (s_last_rx_valid && hdr == s_last_rx_hdr) return;
+    s_last_rx_hdr = hdr;
+    s_last_rx_valid = true;
+
+    if (PD_HDR_EXTENDED(hdr)) return;
+    uint8_t type = PD_HDR_MSG_TYPE(hdr);
+    uint8_t ndo = PD_HDR_NUM_DO(hdr);
+
+    if (ndo) {
+        if (len < 2 + 4 * ndo) return;
+        if (type == MSG_DATA_EPR_MODE) {
+            uint8_t action = frame[5];
+            if (action == EPR_MODE_EXIT) {
+                /* Source left EPR mode; SPR capabilities follow */
+                epr_left();
+                s_state = PD_POLICY_WAIT_CAPS;
+                s_timer_ms = 0;
+                s_epr_result = action;
+                s_events |= EVT_EPR_EXIT;
+            } else if (s_state == PD_POLICY_EPR_ENTER) {
+                if (action == EPR_MODE_ENTER_ACK) {
+                    start_timer(PD_T_ENTER_EPR_MS);
+                } else if (action == EPR_MODE_ENTER_SUCCEEDED) {
+                    /* EPR_Source_Capabilities follow */
+                    s_epr = true;
+                    s_state = PD_POLICY_WAIT_CAPS;
+                    s_timer_ms = 0;
+                    s_epr_result = action;
+                    s_events |= EVT_EPR_ENTER;
+                } else if (action == EPR_MODE_ENTER_FAILED) {
+                    s_state = PD_POLICY_READY;
+                    s_timer_ms = 0;
+                    s_epr_result = action;
+                    s_epr_reason = frame[4];
+                    s_events |= EVT_EPR_ENTER;
+                }
+            }
+            return;
+        }
+        if (type != MSG_DATA_SRC_CAP) return;
+        /* SPR capabilities end EPR mode; every Source_Capabilities is answered with a Request */
+        if (s_epr) epr_left();
+        s_num_caps = ndo > PD_POLICY_SPR_PDO ? PD_POLICY_SPR_PDO : ndo;
+        for (uint8_t i = 0; i < s_num_caps; i++) s_caps[i] = rd32(&frame[2 + 4 * i]);
+        send_request();
+        return;
+    }
+
+    switch (type) {
+    case MSG_CTRL_ACCEPT:
+        if (s_state != PD_POLICY_WAIT_ACCEPT) return;
+        s_state = PD_POLICY_TRANSITION;
+        start_timer(s_epr ? PD_T_PS_TRANSITION_EPR_MS : PD_T_PS_TRANSITION_MS);
+        notify(PD_POLICY_EV_ACCEPT);
+        break;
+    case MSG_CTRL_REJECT:
+        if (s_state != PD_POLICY_WAIT_ACCEPT) return;
+        request_refused();
+        s_events |= EVT_REJECT;
+        break;
+    case MSG_CTRL_WAIT:
+        if (s_state != PD_POLICY_WAIT_ACCEPT) return;
+        request_refused();
+        /* Try again after SinkRequestTimer */
+        s_rerequest_ms = millis() + PD_T_SINK_REQUEST_MS;
+        s_events |= EVT_WAIT;
+        break;
+    case MSG_CTRL_PS_RDY:
+        if (s_state != PD_POLICY_TRANSITION) return;
+        s_state = PD_POLICY_READY;
+        s_timer_ms = 0;
+        s_contract = s_pending;
+        s_has_contract = true;
+        /* A PPS / AVS contract lapses without a periodic Request */
+        if (s_contract.type == PD_PDO_PPS || s_contract.type == PD_PDO_SPR_AVS) {
+            s_rerequest_ms = millis() + PD_T_PPS_REQUEST_MS;
+        }
+        if (s_epr) s_keepalive_ms = millis() + PD_T_EPR_KEEPALIVE_MS;
+        s_events |= EVT_CONTRACT;
+        notify(PD_POLICY_EV_PS_RDY);
+        break;
+    default:
+        break;
+    }
+}
+
+void usb_pd_policy_on_epr_caps(const uint32_t *pdos, uint8_t n) {
+    /* Only meaningful in EPR mode */
+    if (!s_epr || n == 0) return;
+    s_num_caps = n > PD_POLICY_MAX_PDO ? PD_POLICY_MAX_PDO : n;
+    for (uint8_t i = 0; i < s_num_caps; i++) s_caps[i] = pdos[i];
+    send_request();
+}
+
+void usb_pd_policy_epr_enter(void) {
+    s_epr_cmd = EPR_MODE_ENTER;
+}
+
+void usb_pd_policy_epr_exit(void) {
+    s_epr_cmd = EPR_MODE_EXIT;
+}
+
+bool usb_pd_policy_in_epr(void) {
+    return s_epr;
+}
+
+void usb_pd_policy_poll(void) {
+    /* A running script owns the conversation */
+    if (!usb_pd_snk_is_active() || usb_pd_script_is_running()) return;
+    uint32_t now = millis();
+
+    /* State is shared with the USBPD and TIM2 interrupts */
+    uint32_t irq = irq_save();
+
+    /* Request never acknowledged by the source */
+    if (s_state == PD_POLICY_WAIT_ACCEPT && s_req_handle && usb_pd_tx_status(s_req_handle) == PD_TX_FAILED) {
+        s_req_handle = 0;
+        s_state = PD_POLICY_WAIT_CAPS;
+        s_timer_ms = 0;
+        s_events |= EVT_TX_FAILED;
+        notify(PD_POLICY_EV_REFUSED);
+    }
+
+    /* SenderResponseTimer / PSTransitionTimer; no Hard Reset is sent, wait for new capabilities */
+    if (s_timer_ms && (now - s_timer_start_ms) > s_timer_ms) {
+        s_timeout_state = s_state;
+        s_timer_ms = 0;
+        if (s_state == PD_POLICY_EPR_ENTER) {
+            /* SinkEPREnterTimer: stay in the SPR contract */
+            s_state = PD_POLICY_READY;
+        } else {
+            s_state = PD_POLICY_WAIT_CAPS;
+            s_has_contract = false;
+            notify(PD_POLICY_EV_REFUSED);
+        }
+        s_events |= EVT_TIMEOUT;
+    }
+
+    /* Host requests */
+    uint8_t cmd = s_epr_cmd;
+    s_epr_cmd = 0;
+    if (cmd == EPR_MODE_ENTER) s_epr_tried = false;
+    if (cmd == EPR_MODE_EXIT && s_epr && s_state == PD_POLICY_READY) {
+        if (send_epr_mode(EPR_MODE_EXIT, 0)) {
+            /* The source answers with SPR Source_Capabilities */
+            epr_left();
+            s_epr_tried = true;
+            s_state = PD_POLICY_WAIT_CAPS;
+            s_epr_result = EPR_MODE_EXIT;
+            s_events |= EVT_EPR_EXIT;
+        }
+    }
+
+    /* Enter EPR once per attach when the target needs it and an SPR contract is in place */
+    if (s_state == PD_POLICY_READY && !s_epr && !s_epr_tried && target_wants_epr() && source_epr_capable()) {
+        s_epr_tried = true;
+        if (send_epr_mode(EPR_MODE_ENTER, epr_pdp_w())) {
+            s_state = PD_POLICY_EPR_ENTER;
+            start_timer(PD_T_SENDER_RESPONSE_MS);
+        }
+    }
+
+    /* SinkEPRKeepAliveTimer */
+    if (s_epr && s_state == PD_POLICY_READY && s_keepalive_ms && (int32_t)(now - s_keepalive_ms) >= 0) {
+        if (send_epr_keepalive()) s_keepalive_ms = now + PD_T_EPR_KEEPALIVE_MS;
+    }
+
+    /* SinkRequestTimer after Wait, SinkPPSPeriodicTimer in a PPS contract */
+    if (s_rerequest_ms && (int32_t)(now - s_rerequest_ms) >= 0) {
+        s_rerequest_ms = 0;
+        if (s_num_caps && (s_state == PD_POLICY_READY || s_state == PD_POLICY_WAIT_CAPS)) send_request();
+    }
+
+    uint8_t ev = 0;
+    if (cdc_acm_is_configured()) {
+        ev = s_events;
+        s_events = 0;
+    }
+    irq_restore(irq);
+    if (!ev) return;
+
+    if (ev & EVT_REQUEST) {
+        cdc_acm_printf("# policy: request PDO%u %s %umV %umA%s\n", s_pending.pos,
+                       pd_pdo_type_name(s_pending.type), s_pending.mv, s_pending.ma,
+                       s_pending.mismatch ? " (capability mismatch)" : "");
+    }
+    if (ev & EVT_REJECT) cdc_acm_prints("# policy: request rejected\n");
+    if (ev & EVT_WAIT) cdc_acm_prints("# policy: source asked to wait\n");
+    if (ev & EVT_TX_FAILED) cdc_acm_prints("# policy: request not acknowledged\n");
+    if (ev & EVT_TIMEOUT) {
+        cdc_acm_printf("# policy: %s timeout\n", s_timeout_state == PD_POLICY_TRANSITION ? "PS_RDY"
+                                                : s_timeout_state == PD_POLICY_EPR_ENTER ? "EPR_Mode"
+                                                                                          : "Accept");
+    }
+    if (ev & EVT_EPR_ENTER) {
+        if (s_epr_result == EPR_MODE_ENTER_SUCCEEDED) {
+            cdc_acm_prints("# policy: EPR mode entered\n");
+        } else {
+            cdc_acm_printf("# policy: EPR mode enter failed (reason %u)\n", s_epr_reason);
+        }
+    }
+    if (ev & EVT_EPR_EXIT) cdc_acm_prints("# policy: EPR mode exited\n");
+    if (ev & EVT_CONTRACT) {
+        cdc_acm_printf("# policy: contract PDO%u %umV %umA\n", s_contract.pos, s_contract.mv, s_contract.ma);
+    }
+}
+
+pd_policy_state_t usb_pd_policy_state(void) {
+    return (pd_policy_state_t)s_state;
+}
+
+bool usb_pd_policy_contract(pd_policy_choice_t *choice) {
+    if (!s_has_contract) return false;
+    *choice = s_contract;
+    return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "usb_pd_pdo.h"
+
+/*
+ * Sink policy engine: picks a PDO from Source_Capabilities for the
+ * configured target, builds the matching RDO and follows the contract
+ * negotiation (Request -> Accept -> PS_RDY, Reject, Wait). Frames are
+ * queued through the SNK transmitter; RX hooks run in interrupt context,
+ * timers and prints in usb_pd_policy_poll().
+ *
+ * When the target needs more than 20V and a PD3 source advertises EPR,
+ * the engine enters EPR mode after the SPR contract (EPR_Mode Enter ->
+ * Enter Acknowledged -> Enter Succeeded), answers EPR_Source_Capabilities
+ * with an EPR_Request and keeps the mode alive with EPR_KeepAlive.
+ */
+
+#define PD_POLICY_MAX_PDO         11    // SPR 1~7 + EPR 8~11
+#define PD_POLICY_SPR_PDO         7
+#define PD_T_SENDER_RESPONSE_MS   30    // SenderResponseTimer
+#define PD_T_PS_TRANSITION_MS     550   // PSTransitionTimer
+#define PD_T_PS_TRANSITION_EPR_MS 925   // PSTransitionTimer（EPR）
+#define PD_T_ENTER_EPR_MS         500   // SinkEPREnterTimer
+#define PD_T_EPR_KEEPALIVE_MS     375   // SinkEPRKeepAliveTimer（0.25~0.5 s）
+#define PD_T_SINK_REQUEST_MS    100   // SinkRequestTimer（收到 Wait 后重发）
+#define PD_T_PPS_REQUEST_MS     10000 // SinkPPSPeriodicTimer（PPS 合约周期性重发 Request）
+
+/* 选择策略 */
+typedef enum {
+    PD_POLICY_MAX_POWER = 0, // 最大功率，mv 非 0 时为电压上限
+    PD_POLICY_VOLTAGE,       // 指定电压（Fixed 优先，其次 Variable / Battery）
+    PD_POLICY_PPS,           // PPS / AVS 可编程电压
+} pd_policy_mode_t;
+
+typedef struct {
+    uint8_t mode;    // pd_policy_mode_t
+    uint16_t mv;     // 目标电压
+    uint16_t ma_max; // 电流上限
+} pd_policy_target_t;
+
+/* Selection result: object position (1-based) and the operating point it was requested at */
+typedef struct {
+    uint8_t pos;
+    uint8_t type;     // pd_pdo_type_t of the selected PDO
+    uint8_t mismatch; // 目标无法满足，按 vSafe5V 请求并置 Capability Mismatch
+    uint16_t mv;
+    uint16_t ma;
+} pd_policy_choice_t;
+
+/**
+ * Pick the PDO for target from n raw PDOs. Always succeeds while n > 0:
+ * if nothing fits, PDO 1 (vSafe5V) is chosen with mismatch set.
+ */
+bool pd_policy_select(const uint32_t *pdos, uint8_t n, const pd_policy_target_t *target, pd_policy_choice_t *choice);
+
+/* Build the RDO for a choice against the PDO it refers to; epr_capable sets the EPR Mode Capable bit */
+uint32_t pd_policy_build_rdo(const pd_policy_choice_t *choice, uint32_t pdo, bool epr_capable);
+
+/* 协商状态 */
+typedef enum {
+    PD_POLICY_WAIT_CAPS = 0,
+    PD_POLICY_WAIT_ACCEPT,
+    PD_POLICY_TRANSITION, // Accept 后等待 PS_RDY
+    PD_POLICY_READY,      // 显式合约已建立
+    PD_POLICY_EPR_ENTER,  // 已发送 EPR_Mode Enter，等待 Enter Succeeded
+} pd_policy_state_t;
+
+void usb_pd_policy_set_target(const pd_policy_target_t *target);
+void usb_pd_policy_get_target(pd_policy_target_t *target);
+
+/* Request again against the stored capabilities, from the next usb_pd_policy_poll() */
+void usb_pd_policy_request(void);
+
+/* 协商事件，供扫描等观察者使用 */
+typedef enum {
+    PD_POLICY_EV_ACCEPT = 0, // 收到 Accept
+    PD_POLICY_EV_PS_RDY,     // 收到 PS_RDY，合约已更新
+    PD_POLICY_EV_REFUSED,    // Reject / Wait / 超时 / Request 未被确认
+} pd_policy_event_t;
+
+typedef void (*pd_policy_hook_t)(pd_policy_event_t ev);
+
+/* Called from the RX interrupt or from usb_pd_policy_poll(); 0 removes it */
+void usb_pd_policy_set_hook(pd_policy_hook_t hook);
+
+/* Forget the contract and wait for Source_Capabilities (mode entry, Hard Reset) */
+void usb_pd_policy_reset(void);
+
+/* SOP frame (not GoodCRC) received in SNK mode; interrupt context */
+void usb_pd_policy_on_rx(const uint8_t *frame, uint8_t len);
+
+/* Reassembled EPR_Source_Capabilities (interrupt context) */
+void usb_pd_policy_on_epr_caps(const uint32_t *pdos, uint8_t n);
+
+/* Ask to enter EPR mode again after a failure, or to leave it; handled from usb_pd_policy_poll() */
+void usb_pd_policy_epr_enter(void);
+void usb_pd_policy_epr_exit(void);
+bool usb_pd_policy_in_epr(void);
+
+/* Timers and deferred prints; call from the main loop */
+void usb_pd_policy_poll(void);
+
+pd_policy_state_t usb_pd_policy_state(void);
+/* Current explicit contract; false if none */
+bool usb_pd_policy_contract(pd_policy_choice_t *choice);
@@ -0,0 +1,52 @@
+#include "usb_pd_record.h"
+
+#include <string.h>
+
+uint8_t pd_record_crc8(uint8_t crc, const uint8_t *data, size_t len) {
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static inline uint8_t *put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+size_t pd_record_encode_frame(uint8_t *out, uint32_t timestamp_ms, uint16_t vbus_mv, uint32_t seq,
+                              uint8_t status, const uint8_t *frame, uint8_t len) {
+    uint8_t *p = out;
+    uint8_t payload_len = (uint8_t)(PD_RECORD_FRAME_FIXED + len);
+
+    *p++ = PD_RECORD_SYNC;
+    *p++ = PD_RECORD_KIND_FRAME;
+    *p++ = payload_len;
+    p = put32(p, timestamp_ms);
+    *p++ = (uint8_t)vbus_mv;
+    *p++ = (uint8_t)(vbus_mv >> 8);
+    p = put32(p, seq);
+    *p++ = status;
+    if (len) {
+        memcpy(p, frame, len);
+        p += len;
+    }
+    *p = pd_record_crc8(0, &out[1], (size_t)(p - &out[1]));
+    return (size_t)(p - out) + 1;
+}
+
+size_t pd_record_encode_text(uint8_t *out, const char *text, size_t len) {
+    if (len > 255) len = 255;
+    out[0] = PD_RECORD_SYNC;
+    out[1] = PD_RECORD_KIND_TEXT;
+    out[2] = (uint8_t)len;
+    memcpy(&out[3], text, len);
+    out[3 + len] = pd_record_crc8(0, &out[1], len + 2);
+    return len + PD_RECORD_OVERHEAD;
+}
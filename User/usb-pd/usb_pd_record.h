@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary record stream emitted on CDC IN when binary output is selected.
+ * No hardware dependency; shared with host tools.
+ *
+ *   SYNC(0xA5) KIND LEN PAYLOAD[LEN] CRC8
+ *
+ * CRC8 (poly 0x07, init 0x00) covers KIND, LEN and PAYLOAD. A record always
+ * starts at a line boundary, so text lines and records can share a stream.
+ */
+
+#define PD_RECORD_SYNC     0xA5
+#define PD_RECORD_OVERHEAD 4   // SYNC KIND LEN CRC8
+#define PD_RECORD_MAX_LEN  (PD_RECORD_OVERHEAD + 255)
+
+/* Record kinds */
+#define PD_RECORD_KIND_FRAME 0x01 // PD 帧
+#define PD_RECORD_KIND_TEXT  0x02 // 文本行（不含换行符）
+
+/*
+ * PD frame payload (little-endian):
+ *   u32 timestamp_ms, u16 vbus_mv, u32 seq, u8 status, frame bytes (header + DOs [+ CRC32])
+ * status: bits[1:0] SOP kind, bit6 RX reset
+ */
+#define PD_RECORD_FRAME_FIXED     11
+#define PD_RECORD_STATUS_SOP_MASK 0x03
+#define PD_RECORD_STATUS_RX_RESET 0x40
+
+uint8_t pd_record_crc8(uint8_t crc, const uint8_t *data, size_t len);
+
+/* Encode a PD frame record into out (>= PD_RECORD_OVERHEAD + PD_RECORD_FRAME_FIXED + len); returns bytes written */
+size_t pd_record_encode_frame(uint8_t *out, uint32_t timestamp_ms, uint16_t vbus_mv, uint32_t seq,
+                              uint8_t status, const uint8_t *frame, uint8_t len);
+
+/* Encode a text record (at most 255 bytes of text are kept); returns bytes written */
+size_t pd_record_encode_text(uint8_t *out, const char *text, size_t len);
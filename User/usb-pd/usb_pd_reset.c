@@ -0,0 +1,191 @@
+#include "usb_pd_reset.h"
+
+#include "ch32x035_usbpd.h"
+#include "debug.h"
+#include "millis.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_auto.h"
+#include "usb_pd_header.h"
+#include "usb_pd_policy.h"
+#include "usb_pd_script.h"
+#include "usb_pd_snk.h"
+#include "usb_pd_src.h"
+#include "usb_pd_vcap.h"
+#include "usb_vbus_measure.h"
+
+/* Deferred prints */
+#define NOTE_HARD_SENT  0x01
+#define NOTE_CABLE_SENT 0x02
+#define NOTE_RECEIVED   0x04
+#define NOTE_NO_MODE    0x08
+#define NOTE_BUSY       0x10
+#define NOTE_CABLE_RX   0x20
+
+static volatile uint8_t s_notes = 0;
+static volatile uint32_t s_sent_ms = 0;
+static volatile uint32_t s_rx_ms = 0;
+
+/* Recovery timeline, times relative to the reset */
+static volatile bool s_tl_active = false;
+static volatile uint32_t s_tl_t0 = 0;
+static volatile bool s_tl_caps = false; // 由 RX 中断置位
+static volatile uint32_t s_tl_caps_ms = 0;
+static volatile bool s_tl_off = false;
+static volatile bool s_tl_on = false;
+static volatile uint32_t s_tl_off_ms = 0;
+static volatile uint32_t s_tl_on_ms = 0;
+
+/* Protocol layer and policy back to their initial state; call with interrupts disabled */
+static void protocol_reset(void) {
+    if (usb_pd_snk_is_active()) {
+        usb_pd_tx_reset();
+        usb_pd_policy_reset();
+        usb_pd_auto_reset();
+    }
+    usb_pd_src_on_hard_reset();
+}
+
+/* In SRC mode the device is the source, nothing to measure */
+static void timeline_start(uint32_t now) {
+    if (usb_pd_src_is_active()) return;
+    s_tl_t0 = now;
+    s_tl_caps = false;
+    s_tl_off = false;
+    s_tl_on = false;
+    s_tl_active = true;
+}
+
+/* IF_TX_END of the reset signal */
+static void reset_sent(pd_tx_reset_t type) {
+    uint32_t now = millis();
+    s_sent_ms = now;
+    if (type == PD_TX_HARD_RESET) {
+        protocol_reset();
+        timeline_start(now);
+        s_notes |= NOTE_HARD_SENT;
+        usb_pd_vcap_trigger(PD_VCAP_HARD_RESET, 0, now);
+    } else {
+        s_notes |= NOTE_CABLE_SENT;
+    }
+    usb_pd_script_on_reset_sent();
+}
+
+bool usb_pd_reset_send(pd_tx_reset_t type) {
+    if (!usb_pd_snk_is_active() && !usb_pd_src_is_active()) return false;
+    return usb_pd_tx_send_reset(type, reset_sent);
+}
+
+void usb_pd_reset_on_cdc_bytes(const uint8_t *data, uint8_t len) {
+    if (len != 4 || data[1] != 'r' || data[2] != 's' || data[3] != 't') return;
+    if (data[0] != 'h' && data[0] != 'c') return;
+
+    if (!usb_pd_snk_is_active() && !usb_pd_src_is_active()) {
+        s_notes |= NOTE_NO_MODE;
+        return;
+    }
+    if (!usb_pd_reset_send(data[0] == 'h' ? PD_TX_HARD_RESET : PD_TX_CABLE_RESET)) s_notes |= NOTE_BUSY;
+}
+
+void usb_pd_reset_on_received(uint32_t status) {
+    uint32_t now = millis();
+    s_rx_ms = now;
+    if ((status & MASK_PD_STAT) == PD_RX_SOP2_CRST) {
+        /* Cable Reset: only the cable plug's protocol layer restarts */
+        usb_pd_tx_on_cable_reset();
+        s_notes |= NOTE_CABLE_RX;
+        return;
+    }
+    usb_pd_script_abort();
+    protocol_reset();
+    timeline_start(now);
+    s_notes |= NOTE_RECEIVED;
+}
+
+void usb_pd_reset_on_rx(const uint8_t *frame, uint8_t len) {
+    if (!s_tl_active || s_tl_caps || len < 6) return;
+    uint16_t hdr = pd_header_read(frame);
+    if (PD_HDR_EXTENDED(hdr) || !PD_HDR_NUM_DO(hdr) || PD_HDR_MSG_TYPE(hdr) != 0x01) return;
+    s_tl_caps_ms = millis() - s_tl_t0;
+    s_tl_caps = true;
+}
+
+static void print_ms(const char *what, bool seen, uint32_t ms) {
+    if (seen) {
+        cdc_acm_printf("%s +%lums", what, (unsigned long)ms);
+    } else {
+        cdc_acm_printf("%s -", what);
+    }
+}
+
+static void timeline_report(void) {
+    bool caps = s_tl_caps;
+    uint32_t caps_ms = s_tl_caps_ms;
+
+    cdc_acm_prints("# reset: recovery");
+    print_ms(" VBUS off", s_tl_off, s_tl_off_ms);
+    print_ms(", on", s_tl_on, s_tl_on_ms);
+    print_ms(", Source_Capabilities", caps, caps_ms);
+    cdc_acm_prints("\n");
+
+    bool ok = true;
+    if (!s_tl_off) {
+        cdc_acm_prints("# reset: VBUS not cycled\n");
+        ok = false;
+    } else if (s_tl_off_ms > PD_T_SAFE_0V_MS) {
+        cdc_acm_printf("# reset: VBUS off after %lums > tSafe0V %ums\n", (unsigned long)s_tl_off_ms, PD_T_SAFE_0V_MS);
+        ok = false;
+    }
+    if (s_tl_off && s_tl_on) {
+        uint32_t gap = s_tl_on_ms - s_tl_off_ms;
+        if (gap < PD_T_SRC_RECOVER_MIN_MS) {
+            cdc_acm_printf("# reset: VBUS off for %lums < tSrcRecover %ums\n", (unsigned long)gap, PD_T_SRC_RECOVER_MIN_MS);
+            ok = false;
+        } else if (gap > PD_T_SRC_RECOVER_MAX_MS + PD_T_SRC_TURN_ON_MS) {
+            cdc_acm_printf("# reset: VBUS off for %lums > tSrcRecover + tSrcTurnOn %ums\n", (unsigned long)gap,
+                           PD_T_SRC_RECOVER_MAX_MS + PD_T_SRC_TURN_ON_MS);
+            ok = false;
+        }
+    }
+    if (!caps) {
+        cdc_acm_printf("# reset: no Source_Capabilities within %ums\n", PD_RESET_TIMELINE_MS);
+        ok = false;
+    } else if (s_tl_on && caps_ms > s_tl_on_ms && caps_ms - s_tl_on_ms > PD_T_FIRST_SOURCE_CAP_MS) {
+        cdc_acm_printf("# reset: Source_Capabilities %lums after vSafe5V > tFirstSourceCap %ums\n",
+                       (unsigned long)(caps_ms - s_tl_on_ms), PD_T_FIRST_SOURCE_CAP_MS);
+        ok = false;
+    }
+    if (ok) cdc_acm_prints("# reset: recovery timing ok\n");
+}
+
+void usb_pd_reset_poll(void) {
+    if (s_tl_active) {
+        uint32_t t = millis() - s_tl_t0;
+        uint16_t mv = adc_get_vbus_mv();
+        if (!s_tl_off && mv < PD_VSAFE0V_MV) {
+            s_tl_off = true;
+            s_tl_off_ms = t;
+        } else if (s_tl_off && !s_tl_on && mv >= PD_VSAFE5V_MIN_MV) {
+            s_tl_on = true;
+            s_tl_on_ms = t;
+        }
+    }
+
+    if (!cdc_acm_is_configured()) return;
+
+    uint8_t notes = s_notes;
+    if (notes) {
+        s_notes &= (uint8_t)~notes;
+        if (notes & NOTE_HARD_SENT) cdc_acm_printf("# reset: %lums Hard Reset sent\n", (unsigned long)s_sent_ms);
+        if (notes & NOTE_CABLE_SENT) cdc_acm_printf("# reset: %lums Cable Reset sent\n", (unsigned long)s_sent_ms);
+        if (notes & NOTE_RECEIVED) cdc_acm_printf("# reset: %lums Hard Reset received\n", (unsigned long)s_rx_ms);
+        if (notes & NOTE_CABLE_RX) cdc_acm_printf("# reset: %lums Cable Reset received\n", (unsigned long)s_rx_ms);
+        if (notes & NOTE_NO_MODE) cdc_acm_prints("# reset: enter SNK or SRC mode first\n");
+        if (notes & NOTE_BUSY) cdc_acm_prints("# reset: already pending\n");
+    }
+
+    /* Done once the first Source_Capabilities arrived, or at the end of the window */
+    if (s_tl_active && (s_tl_caps || millis() - s_tl_t0 > PD_RESET_TIMELINE_MS)) {
+        s_tl_active = false;
+        timeline_report();
+    }
+}
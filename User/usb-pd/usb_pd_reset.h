@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "usb_pd_tx.h"
+
+/*
+ * Hard Reset / Cable Reset: sent on command in SNK or SRC mode ("hrst",
+ * "crst", or the script RESET op), and handled when received. A Hard Reset
+ * in either direction restarts the protocol layer (MessageIDs, transmit
+ * queue), the SNK policy and EPR state, or the SRC policy engine. A
+ * received Cable Reset only clears the SOP'/SOP'' MessageIDs.
+ *
+ * Outside SRC mode the source's recovery is timed from the main loop:
+ * VBUS down to vSafe0V, back to vSafe5V, and the first Source_Capabilities,
+ * checked against tSafe0V, tSrcRecover + tSrcTurnOn and tFirstSourceCap.
+ */
+
+#define PD_T_SAFE_0V_MS          650  // tSafe0V：VBUS 降至 vSafe0V
+#define PD_T_SRC_RECOVER_MIN_MS  660  // tSrcRecover 下限：VBUS 关断的最短时间
+#define PD_T_SRC_RECOVER_MAX_MS  1000 // tSrcRecover 上限
+#define PD_T_SRC_TURN_ON_MS      275  // tSrcTurnOn：VBUS 恢复至 vSafe5V
+#define PD_T_FIRST_SOURCE_CAP_MS 250  // tFirstSourceCap：vSafe5V 后首个 Source_Capabilities
+#define PD_RESET_TIMELINE_MS     3000 // 记录窗口
+#define PD_VSAFE0V_MV            800
+#define PD_VSAFE5V_MIN_MV        4750
+
+/* "hrst" / "crst" from the host; ignored outside SNK/SRC mode */
+void usb_pd_reset_on_cdc_bytes(const uint8_t *data, uint8_t len);
+
+/* Send reset signaling now; false outside SNK/SRC mode or while one is pending */
+bool usb_pd_reset_send(pd_tx_reset_t type);
+
+/* IF_RX_RESET; status & MASK_PD_STAT tells Hard from Cable Reset; interrupt context */
+void usb_pd_reset_on_received(uint32_t status);
+
+/* SOP frame received (any mode, not GoodCRC); interrupt context */
+void usb_pd_reset_on_rx(const uint8_t *frame, uint8_t len);
+
+/* Recovery timeline and deferred prints; call from the main loop */
+void usb_pd_reset_poll(void);
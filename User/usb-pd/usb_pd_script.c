@@ -0,0 +1,265 @@
+#include "usb_pd_script.h"
+
+#include "ch32x035_usbpd.h"
+#include "debug.h"
+#include "irq_save.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_header.h"
+#include "usb_pd_reset.h"
+#include "usb_pd_script_vm.h"
+#include "usb_pd_snk.h"
+#include "usb_pd_src.h"
+#include "usb_pd_timer.h"
+#include "usb_pd_tx.h"
+
+#define SCRIPT_TIMER_MAX_US 50000 // 单次定时上限，保证 32 位时间基准在 16 位计数回绕前更新
+
+/* Deferred notices, printed from the main loop */
+enum {
+    NOTE_NONE = 0,
+    NOTE_LOADED,   // arg: upload size
+    NOTE_OVERFLOW, // arg: buffer size
+    NOTE_INVALID,  // arg: offending pc
+    NOTE_BUSY,
+    NOTE_NO_MODE,
+    NOTE_CLEARED,
+};
+
+static pd_script_t s_vm;
+static uint8_t s_upload[PD_SCRIPT_MAX_LEN];
+static volatile uint16_t s_upload_len = 0;
+static volatile bool s_running = false;
+static volatile bool s_report = false; /* finished, log not printed yet */
+static volatile uint8_t s_note = NOTE_NONE;
+static volatile uint16_t s_note_arg = 0;
+
+static volatile pd_tx_handle_t s_handle = 0; /* frame queued by SEND */
+static volatile bool s_reset_wait = false;   /* signal requested by RESET */
+static pd_tx_done_cb_t s_prev_cb = 0;        /* mode's TX hook, chained while running */
+
+/* 32-bit µs time base extended from the 16-bit TIM2 count */
+static uint32_t s_now_us = 0;
+static uint16_t s_last_cnt = 0;
+
+/* Call with interrupts disabled, at least every 65 ms while running */
+static uint32_t script_now(void) {
+    uint16_t cnt = usb_pd_timer_now();
+    s_now_us += (uint16_t)(cnt - s_last_cnt);
+    s_last_cnt = cnt;
+    return s_now_us;
+}
+
+static void script_timer_cb(void);
+
+/* Re-arm the script channel after every VM call; detect the end of the script */
+static void script_update(uint32_t now_us) {
+    if (!s_running) return;
+
+    if (!pd_script_running(&s_vm)) {
+        s_running = false;
+        s_handle = 0;
+        s_reset_wait = false;
+        usb_pd_timer_cancel(PD_TIMER_SCRIPT);
+        usb_pd_tx_set_done_cb(s_prev_cb);
+        s_report = true;
+        return;
+    }
+
+    uint32_t deadline, delay = SCRIPT_TIMER_MAX_US;
+    if (pd_script_deadline(&s_vm, &deadline)) {
+        int32_t left = (int32_t)(deadline - now_us);
+        if (left < 0) left = 0;
+        if ((uint32_t)left < delay) delay = (uint32_t)left;
+    }
+    usb_pd_timer_start_at(PD_TIMER_SCRIPT, s_last_cnt, (uint16_t)delay, script_timer_cb);
+}
+
+static void script_timer_cb(void) {
+    uint32_t irq = irq_save();
+    if (s_running) {
+        uint32_t now = script_now();
+        pd_script_tick(&s_vm, now);
+        script_update(now);
+    }
+    irq_restore(irq);
+}
+
+/* TX hook while running: results of SEND frames go to the script, the rest to the mode */
+static void script_tx_done(pd_tx_handle_t handle, pd_tx_prio_t prio, pd_tx_status_t status) {
+    if (s_running && handle && handle == s_handle) {
+        uint32_t irq = irq_save();
+        s_handle = 0;
+        uint32_t now = script_now();
+        pd_script_on_tx_result(&s_vm, status == PD_TX_DONE, now);
+        script_update(now);
+        irq_restore(irq);
+        return;
+    }
+    if (s_prev_cb) s_prev_cb(handle, prio, status);
+}
+
+/* VM op: the frame is sent as written, only MessageID is filled in by the TX queue */
+static bool script_send(void *user, const uint8_t *frame, uint8_t len) {
+    (void)user;
+    s_handle = usb_pd_tx_submit(frame, len, PD_SOP0, PD_TX_PRIO_REPLY);
+    return s_handle != 0;
+}
+
+/* VM op: Hard Reset / Cable Reset; the step completes in usb_pd_script_on_reset_sent() */
+static bool script_reset(void *user, uint8_t type) {
+    (void)user;
+    s_reset_wait = usb_pd_reset_send(type ? PD_TX_CABLE_RESET : PD_TX_HARD_RESET);
+    return s_reset_wait;
+}
+
+static void note(uint8_t what, uint16_t arg) {
+    s_note_arg = arg;
+    s_note = what;
+}
+
+static void script_run(void) {
+    static const pd_script_ops_t ops = {NULL, script_send, script_reset};
+    uint16_t err_pc;
+
+    if (s_running || s_report) {
+        note(NOTE_BUSY, 0);
+        return;
+    }
+    if (!usb_pd_snk_is_active() && !usb_pd_src_is_active()) {
+        note(NOTE_NO_MODE, 0);
+        return;
+    }
+
+    uint32_t irq = irq_save();
+    pd_script_init(&s_vm, &ops);
+    if (!pd_script_load(&s_vm, s_upload, s_upload_len, &err_pc)) {
+        irq_restore(irq);
+        note(NOTE_INVALID, err_pc);
+        return;
+    }
+    s_prev_cb = usb_pd_tx_get_done_cb();
+    usb_pd_tx_set_done_cb(script_tx_done);
+    s_handle = 0;
+    s_reset_wait = false;
+    s_running = true;
+    uint32_t now = script_now();
+    pd_script_start(&s_vm, now);
+    script_update(now);
+    irq_restore(irq);
+}
+
+void usb_pd_script_on_cdc_bytes(const uint8_t *data, uint8_t len) {
+    if (len < 4 || data[0] != 's' || data[1] != 'c' || data[2] != 'r') return;
+
+    switch (data[3]) {
+    case 'c':
+        if (s_running) {
+            note(NOTE_BUSY, 0);
+            break;
+        }
+        s_upload_len = 0;
+        note(NOTE_CLEARED, 0);
+        break;
+    case 'l':
+        if (s_running) {
+            note(NOTE_BUSY, 0);
+            break;
+        }
+        if (s_upload_len + (len - 4) > PD_SCRIPT_MAX_LEN) {
+            note(NOTE_OVERFLOW, PD_SCRIPT_MAX_LEN);
+            break;
+        }
+        for (uint8_t i = 4; i < len; i++) s_upload[s_upload_len++] = data[i];
+        note(NOTE_LOADED, s_upload_len);
+        break;
+    case 'r':
+        script_run();
+        break;
+    case 'a':
+        usb_pd_script_abort();
+        break;
+    default:
+        break;
+    }
+}
+
+bool usb_pd_script_is_running(void) { return s_running; }
+
+void usb_pd_script_abort(void) {
+    uint32_t irq = irq_save();
+    if (s_running) {
+        pd_script_abort(&s_vm);
+        script_update(script_now());
+    }
+    irq_restore(irq);
+}
+
+void usb_pd_script_on_rx(const uint8_t *frame, uint8_t len, uint16_t rx_us) {
+    if (!s_running) return;
+    uint32_t irq = irq_save();
+    uint32_t now = script_now();
+    /* Time the message from the interrupt entry, not from when it got here */
+    uint32_t t = now - (uint16_t)(s_last_cnt - rx_us);
+    pd_script_on_rx(&s_vm, frame, len, t);
+    script_update(now);
+    irq_restore(irq);
+}
+
+void usb_pd_script_on_reset_sent(void) {
+    if (!s_running || !s_reset_wait) return;
+    uint32_t irq = irq_save();
+    s_reset_wait = false;
+    uint32_t now = script_now();
+    pd_script_on_tx_result(&s_vm, true, now);
+    script_update(now);
+    irq_restore(irq);
+}
+
+void usb_pd_script_poll(void) {
+    if (!cdc_acm_is_configured()) return;
+
+    uint8_t what = s_note;
+    if (what != NOTE_NONE) {
+        s_note = NOTE_NONE;
+        switch (what) {
+        case NOTE_LOADED:
+            cdc_acm_printf("# script: %u bytes\n", s_note_arg);
+            break;
+        case NOTE_OVERFLOW:
+            cdc_acm_printf("# script: too long (max %u bytes)\n", s_note_arg);
+            break;
+        case NOTE_INVALID:
+            cdc_acm_printf("# script: invalid instruction at %u\n", s_note_arg);
+            break;
+        case NOTE_BUSY:
+            cdc_acm_prints("# script: busy\n");
+            break;
+        case NOTE_NO_MODE:
+            cdc_acm_prints("# script: enter SNK or SRC mode first\n");
+            break;
+        case NOTE_CLEARED:
+            cdc_acm_prints("# script: cleared\n");
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!s_report) return;
+
+    /* The log is stable until the next run, which waits for s_report */
+    uint16_t logged = s_vm.steps < PD_SCRIPT_LOG_SIZE ? s_vm.steps : PD_SCRIPT_LOG_SIZE;
+    for (uint16_t i = 0; i < logged; i++) {
+        const pd_script_step_t *st = &s_vm.log[i];
+        if (st->op == PD_SCRIPT_OP_WAIT && st->result == PD_SCRIPT_R_OK) {
+            cdc_acm_printf("# script: %3u @%-3u %-5s %-7s %9luus hdr 0x%04X\n", i, st->pc, pd_script_op_name(st->op),
+                           pd_script_result_name(st->result), (unsigned long)st->t_us, st->hdr);
+        } else {
+            cdc_acm_printf("# script: %3u @%-3u %-5s %-7s %9luus\n", i, st->pc, pd_script_op_name(st->op),
+                           pd_script_result_name(st->result), (unsigned long)st->t_us);
+        }
+    }
+    cdc_acm_printf("# script: %s, %u steps (%u logged)\n", s_vm.state == PD_SCRIPT_DONE ? "passed" : "failed",
+                   s_vm.steps, logged);
+    s_report = false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * On-device PD scripts (usb_pd_script_vm): bytecode uploaded over CDC runs
+ * against the PHY in SNK or SRC mode with TIM2 timing, so sequences are not
+ * subject to USB round-trip jitter. While a script runs it owns the
+ * conversation: received frames go to the script instead of the automatic
+ * replies (GoodCRC is still sent). The step log is printed when it ends.
+ *
+ * CDC commands, in any mode:
+ *   scrc          clear the upload buffer
+ *   scrl<bytes>   append bytecode (one or more packets)
+ *   scrr          validate and run (SNK or SRC mode)
+ *   scra          abort
+ */
+
+void usb_pd_script_on_cdc_bytes(const uint8_t *data, uint8_t len);
+
+bool usb_pd_script_is_running(void);
+
+/* Stop a running script (mode exit, Hard Reset) */
+void usb_pd_script_abort(void);
+
+/* Non-GoodCRC SOP frame received while running; rx_us is the TIM2 count at RX interrupt entry */
+void usb_pd_script_on_rx(const uint8_t *frame, uint8_t len, uint16_t rx_us);
+
+/* Reset signaling has been sent (IF_TX_END); completes a RESET step */
+void usb_pd_script_on_reset_sent(void);
+
+/* Deferred prints; call from the main loop */
+void usb_pd_script_poll(void);
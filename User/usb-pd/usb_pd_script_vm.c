@@ -0,0 +1,334 @@
+#include "usb_pd_script_vm.h"
+
+#include <string.h>
+
+#include "usb_pd_header.h"
+
+static inline uint16_t rd16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Instruction length at pc; 0 if unknown or truncated */
+static uint16_t insn_len(const uint8_t *code, uint16_t len, uint16_t pc) {
+    uint16_t n;
+    switch (code[pc]) {
+    case PD_SCRIPT_OP_END:
+    case PD_SCRIPT_OP_FAIL:
+        n = 1;
+        break;
+    case PD_SCRIPT_OP_SEND:
+        if (pc + 1 >= len) return 0;
+        if (code[pc + 1] < 2 || code[pc + 1] > PD_SCRIPT_FRAME_MAX) return 0;
+        n = (uint16_t)(2 + code[pc + 1]);
+        break;
+    case PD_SCRIPT_OP_WAIT:
+        n = 7;
+        break;
+    case PD_SCRIPT_OP_DELAY:
+        n = 5;
+        break;
+    case PD_SCRIPT_OP_JMP:
+    case PD_SCRIPT_OP_JT:
+    case PD_SCRIPT_OP_JF:
+    case PD_SCRIPT_OP_DJNZ:
+        n = 3;
+        break;
+    case PD_SCRIPT_OP_LOOP:
+        n = 2;
+        break;
+    case PD_SCRIPT_OP_RESET:
+        if (pc + 1 >= len || code[pc + 1] > 1) return 0;
+        n = 2;
+        break;
+    default:
+        return 0;
+    }
+    return (uint32_t)pc + n <= len ? n : 0;
+}
+
+static bool is_jump(uint8_t op) {
+    return op == PD_SCRIPT_OP_JMP || op == PD_SCRIPT_OP_JT || op == PD_SCRIPT_OP_JF || op == PD_SCRIPT_OP_DJNZ;
+}
+
+/* Log a step; events past the log are only counted */
+static void log_step(pd_script_t *s, uint8_t result, uint32_t t_us, uint16_t hdr) {
+    if (s->steps < PD_SCRIPT_LOG_SIZE) {
+        pd_script_step_t *st = &s->log[s->steps];
+        st->pc = s->pc;
+        st->op = s->code[s->pc];
+        st->result = result;
+        st->t_us = t_us - s->t0_us;
+        st->hdr = hdr;
+    }
+    if (s->steps < 0xFFFF) s->steps++;
+}
+
+static void next(pd_script_t *s) {
+    s->pc = (uint16_t)(s->pc + insn_len(s->code, s->len, s->pc));
+}
+
+static bool rx_matches(uint16_t hdr, uint8_t kind, uint8_t type) {
+    if (kind == PD_SCRIPT_KIND_ANY) return true;
+    if (PD_HDR_MSG_TYPE(hdr) != type) return false;
+    if (PD_HDR_EXTENDED(hdr)) return kind == PD_SCRIPT_KIND_EXT;
+    return kind == (PD_HDR_NUM_DO(hdr) ? PD_SCRIPT_KIND_DATA : PD_SCRIPT_KIND_CTRL);
+}
+
+/* Consume queued messages up to the first match */
+static bool rx_take(pd_script_t *s, uint8_t kind, uint8_t type, uint16_t *hdr, uint32_t *t_us) {
+    while (s->rx_n) {
+        uint16_t h = s->rx[s->rx_r].hdr;
+        uint32_t t = s->rx[s->rx_r].t_us;
+        s->rx_r = (uint8_t)((s->rx_r + 1) % PD_SCRIPT_RX_QUEUE);
+        s->rx_n--;
+        if (rx_matches(h, kind, type)) {
+            *hdr = h;
+            *t_us = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Execute until the script blocks or stops */
+static void run(pd_script_t *s, uint32_t now_us) {
+    uint8_t burst = 0;
+
+    while (s->state == PD_SCRIPT_RUN) {
+        const uint8_t *p = &s->code[s->pc];
+
+        if (++burst > PD_SCRIPT_MAX_BURST) {
+            log_step(s, PD_SCRIPT_R_ERROR, now_us, 0);
+            s->state = PD_SCRIPT_FAILED;
+            return;
+        }
+
+        switch (p[0]) {
+        case PD_SCRIPT_OP_END:
+            log_step(s, PD_SCRIPT_R_OK, now_us, 0);
+            s->state = PD_SCRIPT_DONE;
+            return;
+        case PD_SCRIPT_OP_FAIL:
+            log_step(s, PD_SCRIPT_R_OK, now_us, 0);
+            s->state = PD_SCRIPT_FAILED;
+            return;
+        case PD_SCRIPT_OP_SEND:
+            if (s->ops.send(s->ops.user, &p[2], p[1])) {
+                s->state = PD_SCRIPT_WAIT_TX;
+                return;
+            }
+            /* Not queued: same as unacknowledged */
+            s->flag = 0;
+            s->t_last_us = now_us;
+            log_step(s, PD_SCRIPT_R_NAK, now_us, 0);
+            next(s);
+            break;
+        case PD_SCRIPT_OP_WAIT: {
+            uint16_t hdr;
+            uint32_t t;
+            if (rx_take(s, p[1], p[2], &hdr, &t)) {
+                s->flag = 1;
+                s->t_last_us = t;
+                log_step(s, PD_SCRIPT_R_OK, t, hdr);
+                next(s);
+                break;
+            }
+            uint32_t timeout = rd32(&p[3]);
+            s->state = PD_SCRIPT_WAIT_RX;
+            s->timer_on = timeout != 0;
+            s->deadline_us = now_us + timeout;
+            return;
+        }
+        case PD_SCRIPT_OP_DELAY: {
+            uint32_t t = s->t_last_us + rd32(&p[1]);
+            if ((int32_t)(now_us - t) < 0) {
+                s->state = PD_SCRIPT_DELAY;
+                s->timer_on = 1;
+                s->deadline_us = t;
+                return;
+            }
+            /* The base event is already further back than the delay */
+            s->t_last_us = t;
+            log_step(s, PD_SCRIPT_R_OK, t, 0);
+            next(s);
+            break;
+        }
+        case PD_SCRIPT_OP_RESET:
+            /* Anything received before the reset is stale */
+            s->rx_n = 0;
+            if (s->ops.reset && s->ops.reset(s->ops.user, p[1])) {
+                s->state = PD_SCRIPT_WAIT_TX;
+                return;
+            }
+            s->flag = 0;
+            s->t_last_us = now_us;
+            log_step(s, PD_SCRIPT_R_NAK, now_us, 0);
+            next(s);
+            break;
+        case PD_SCRIPT_OP_LOOP:
+            s->counter = p[1];
+            log_step(s, PD_SCRIPT_R_OK, now_us, 0);
+            next(s);
+            break;
+        default: {
+            bool take = p[0] == PD_SCRIPT_OP_JMP || (p[0] == PD_SCRIPT_OP_JT && s->flag) ||
+                        (p[0] == PD_SCRIPT_OP_JF && !s->flag);
+            if (p[0] == PD_SCRIPT_OP_DJNZ) take = s->counter && --s->counter;
+            log_step(s, take ? PD_SCRIPT_R_TAKEN : PD_SCRIPT_R_SKIP, now_us, 0);
+            if (take) {
+                s->pc = rd16(&p[1]);
+            } else {
+                next(s);
+            }
+            break;
+        }
+        }
+    }
+}
+
+void pd_script_init(pd_script_t *s, const pd_script_ops_t *ops) {
+    memset(s, 0, sizeof(*s));
+    s->ops = *ops;
+}
+
+bool pd_script_load(pd_script_t *s, const uint8_t *code, uint16_t len, uint16_t *err_pc) {
+    *err_pc = 0;
+    if (!len || len > PD_SCRIPT_MAX_LEN) return false;
+
+    /* First pass: instruction boundaries */
+    uint8_t starts[PD_SCRIPT_MAX_LEN / 8] = {0};
+    for (uint16_t pc = 0; pc < len;) {
+        uint16_t n = insn_len(code, len, pc);
+        if (!n) {
+            *err_pc = pc;
+            return false;
+        }
+        starts[pc / 8] |= (uint8_t)(1u << (pc % 8));
+        pc = (uint16_t)(pc + n);
+    }
+    /* Second pass: jump targets */
+    for (uint16_t pc = 0; pc < len; pc = (uint16_t)(pc + insn_len(code, len, pc))) {
+        if (!is_jump(code[pc])) continue;
+        uint16_t to = rd16(&code[pc + 1]);
+        if (to >= len || !(starts[to / 8] & (1u << (to % 8)))) {
+            *err_pc = pc;
+            return false;
+        }
+    }
+    /* Running off the end must not be possible */
+    uint16_t last = 0;
+    for (uint16_t pc = 0; pc < len; pc = (uint16_t)(pc + insn_len(code, len, pc))) last = pc;
+    if (code[last] != PD_SCRIPT_OP_END && code[last] != PD_SCRIPT_OP_FAIL && code[last] != PD_SCRIPT_OP_JMP) {
+        *err_pc = last;
+        return false;
+    }
+
+    memcpy(s->code, code, len);
+    s->len = len;
+    s->state = PD_SCRIPT_IDLE;
+    return true;
+}
+
+void pd_script_start(pd_script_t *s, uint32_t now_us) {
+    if (!s->len) return;
+    s->pc = 0;
+    s->flag = 0;
+    s->counter = 0;
+    s->timer_on = 0;
+    s->rx_n = 0;
+    s->rx_r = 0;
+    s->steps = 0;
+    s->t0_us = now_us;
+    s->t_last_us = now_us;
+    s->state = PD_SCRIPT_RUN;
+    run(s, now_us);
+}
+
+void pd_script_abort(pd_script_t *s) {
+    if (!pd_script_running(s)) return;
+    s->timer_on = 0;
+    s->state = PD_SCRIPT_FAILED;
+}
+
+bool pd_script_running(const pd_script_t *s) {
+    return s->state != PD_SCRIPT_IDLE && s->state != PD_SCRIPT_DONE && s->state != PD_SCRIPT_FAILED;
+}
+
+void pd_script_on_rx(pd_script_t *s, const uint8_t *frame, uint8_t len, uint32_t now_us) {
+    if (!pd_script_running(s) || len < 2) return;
+
+    uint8_t w = (uint8_t)((s->rx_r + s->rx_n) % PD_SCRIPT_RX_QUEUE);
+    if (s->rx_n == PD_SCRIPT_RX_QUEUE) {
+        /* 队列满：丢弃最早的 */
+        s->rx_r = (uint8_t)((s->rx_r + 1) % PD_SCRIPT_RX_QUEUE);
+        s->rx_n--;
+    }
+    s->rx[w].hdr = pd_header_read(frame);
+    s->rx[w].t_us = now_us;
+    s->rx_n++;
+
+    if (s->state == PD_SCRIPT_WAIT_RX) {
+        const uint8_t *p = &s->code[s->pc];
+        uint16_t hdr;
+        uint32_t t;
+        if (rx_take(s, p[1], p[2], &hdr, &t)) {
+            s->timer_on = 0;
+            s->flag = 1;
+            s->t_last_us = t;
+            log_step(s, PD_SCRIPT_R_OK, t, hdr);
+            next(s);
+            s->state = PD_SCRIPT_RUN;
+            run(s, now_us);
+        }
+    }
+}
+
+void pd_script_on_tx_result(pd_script_t *s, bool acked, uint32_t now_us) {
+    if (s->state != PD_SCRIPT_WAIT_TX) return;
+    s->flag = acked;
+    s->t_last_us = now_us;
+    log_step(s, acked ? PD_SCRIPT_R_OK : PD_SCRIPT_R_NAK, now_us, 0);
+    next(s);
+    s->state = PD_SCRIPT_RUN;
+    run(s, now_us);
+}
+
+void pd_script_tick(pd_script_t *s, uint32_t now_us) {
+    if (!s->timer_on || (int32_t)(now_us - s->deadline_us) < 0) return;
+    s->timer_on = 0;
+
+    /* Steps complete at their deadline, not when the tick happened to run */
+    uint32_t t = s->deadline_us;
+    if (s->state == PD_SCRIPT_WAIT_RX) {
+        s->flag = 0;
+        log_step(s, PD_SCRIPT_R_TIMEOUT, t, 0);
+    } else if (s->state == PD_SCRIPT_DELAY) {
+        log_step(s, PD_SCRIPT_R_OK, t, 0);
+    } else {
+        return;
+    }
+    s->t_last_us = t;
+    next(s);
+    s->state = PD_SCRIPT_RUN;
+    run(s, now_us);
+}
+
+bool pd_script_deadline(const pd_script_t *s, uint32_t *deadline_us) {
+    if (!pd_script_running(s) || !s->timer_on) return false;
+    *deadline_us = s->deadline_us;
+    return true;
+}
+
+const char *pd_script_op_name(uint8_t op) {
+    static const char *const names[] = {"END", "SEND", "WAIT", "DELAY", "JMP", "JT", "JF", "LOOP", "DJNZ", "FAIL", "RESET"};
+    return op < sizeof(names) / sizeof(names[0]) ? names[op] : "?";
+}
+
+const char *pd_script_result_name(uint8_t result) {
+    static const char *const names[] = {"ok", "nak", "timeout", "taken", "skip", "error"};
+    return result < sizeof(names) / sizeof(names[0]) ? names[result] : "?";
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * PD script interpreter: runs a compact bytecode sequence (send a frame,
+ * wait for a message, delay, branch, reset) against the PD PHY with timing taken
+ * from the events themselves, and keeps a per-step result log. No hardware
+ * dependency: the firmware (usb_pd_script) feeds it received frames,
+ * transmit results and a µs clock from TIM2; Host/tools/pdscript runs it
+ * against a simulated partner.
+ *
+ * Bytecode (multi-byte operands little endian, addresses are byte offsets):
+ *   END                                   stop, script passed
+ *   FAIL                                  stop, script failed
+ *   SEND  len frame[len]                  queue header+payload, wait for the GoodCRC; flag = acknowledged
+ *   WAIT  kind type timeout_us:u32        wait for a received message; flag = matched (timeout 0: forever)
+ *   DELAY us:u32                          wait us after the previous step's event (RX time, GoodCRC, ...)
+ *   JMP / JT / JF  addr:u16               jump always / if flag / if not flag
+ *   LOOP  n:u8                            set the loop counter
+ *   DJNZ  addr:u16                        decrement the counter, jump while not zero
+ *   RESET type:u8                         0 Hard Reset, 1 Cable Reset; wait until sent, drop queued messages
+ *
+ * WAIT kinds: 0 control, 1 data, 2 extended, 0xFF any message (type ignored).
+ * Messages received since the previous WAIT are matched first, oldest
+ * first; non-matching ones are discarded.
+ */
+
+#define PD_SCRIPT_MAX_LEN   512  // 字节码长度上限
+#define PD_SCRIPT_LOG_SIZE  64   // 记录的步数，超出部分只计数
+#define PD_SCRIPT_RX_QUEUE  4
+#define PD_SCRIPT_FRAME_MAX 34   // header + 7 DOs
+#define PD_SCRIPT_MAX_BURST 64   // 单次连续执行的无等待指令数（防止死循环）
+
+typedef enum {
+    PD_SCRIPT_OP_END = 0x00,
+    PD_SCRIPT_OP_SEND = 0x01,
+    PD_SCRIPT_OP_WAIT = 0x02,
+    PD_SCRIPT_OP_DELAY = 0x03,
+    PD_SCRIPT_OP_JMP = 0x04,
+    PD_SCRIPT_OP_JT = 0x05,
+    PD_SCRIPT_OP_JF = 0x06,
+    PD_SCRIPT_OP_LOOP = 0x07,
+    PD_SCRIPT_OP_DJNZ = 0x08,
+    PD_SCRIPT_OP_FAIL = 0x09,
+    PD_SCRIPT_OP_RESET = 0x0A,
+} pd_script_op_t;
+
+#define PD_SCRIPT_KIND_CTRL 0
+#define PD_SCRIPT_KIND_DATA 1
+#define PD_SCRIPT_KIND_EXT  2
+#define PD_SCRIPT_KIND_ANY  0xFF
+
+typedef enum {
+    PD_SCRIPT_IDLE = 0,
+    PD_SCRIPT_RUN,
+    PD_SCRIPT_WAIT_TX,
+    PD_SCRIPT_WAIT_RX,
+    PD_SCRIPT_DELAY,
+    PD_SCRIPT_DONE,   // END
+    PD_SCRIPT_FAILED, // FAIL，或运行错误
+} pd_script_state_t;
+
+/* 单步结果 */
+typedef enum {
+    PD_SCRIPT_R_OK = 0,
+    PD_SCRIPT_R_NAK,     // SEND 未收到 GoodCRC
+    PD_SCRIPT_R_TIMEOUT, // WAIT 超时
+    PD_SCRIPT_R_TAKEN,   // 跳转
+    PD_SCRIPT_R_SKIP,    // 条件不满足，未跳转
+    PD_SCRIPT_R_ERROR,   // 连续执行过多指令
+} pd_script_result_t;
+
+typedef struct {
+    uint16_t pc;
+    uint8_t op;     // pd_script_op_t
+    uint8_t result; // pd_script_result_t
+    uint32_t t_us;  // 相对脚本开始
+    uint16_t hdr;   // WAIT 匹配到的消息头
+} pd_script_step_t;
+
+typedef struct {
+    void *user;
+    /* Queue a frame (header + payload); false if it was not accepted */
+    bool (*send)(void *user, const uint8_t *frame, uint8_t len);
+    /* Send reset signaling (0 Hard, 1 Cable); completion is reported as an acknowledged TX result */
+    bool (*reset)(void *user, uint8_t type);
+} pd_script_ops_t;
+
+typedef struct {
+    pd_script_ops_t ops;
+    uint8_t code[PD_SCRIPT_MAX_LEN];
+    uint16_t len;
+    uint16_t pc;
+    uint8_t state;   // pd_script_state_t
+    uint8_t flag;
+    uint8_t counter;
+    uint8_t timer_on;
+    uint32_t t0_us;
+    uint32_t t_last_us; // 上一步事件时刻，DELAY 的起点
+    uint32_t deadline_us;
+    struct {
+        uint16_t hdr;
+        uint32_t t_us;
+    } rx[PD_SCRIPT_RX_QUEUE];
+    uint8_t rx_r;
+    uint8_t rx_n;
+    pd_script_step_t log[PD_SCRIPT_LOG_SIZE];
+    uint16_t steps;  // 已执行步数（含未记录的）
+} pd_script_t;
+
+void pd_script_init(pd_script_t *s, const pd_script_ops_t *ops);
+
+/**
+ * Copy and validate bytecode. Returns false with *err_pc at the offending
+ * instruction for truncated operands, bad frame lengths, unknown opcodes or
+ * jumps that do not land on an instruction.
+ */
+bool pd_script_load(pd_script_t *s, const uint8_t *code, uint16_t len, uint16_t *err_pc);
+
+void pd_script_start(pd_script_t *s, uint32_t now_us);
+void pd_script_abort(pd_script_t *s);
+bool pd_script_running(const pd_script_t *s);
+
+/* Received SOP message (not GoodCRC) */
+void pd_script_on_rx(pd_script_t *s, const uint8_t *frame, uint8_t len, uint32_t now_us);
+
+/* Result of the frame queued by SEND, or the signal sent by RESET */
+void pd_script_on_tx_result(pd_script_t *s, bool acked, uint32_t now_us);
+
+/* Expire WAIT timeouts and DELAYs */
+void pd_script_tick(pd_script_t *s, uint32_t now_us);
+
+/* Next time pd_script_tick() has work to do; false if none */
+bool pd_script_deadline(const pd_script_t *s, uint32_t *deadline_us);
+
+const char *pd_script_op_name(uint8_t op);
+const char *pd_script_result_name(uint8_t result);
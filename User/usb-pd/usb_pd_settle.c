@@ -0,0 +1,31 @@
+#include "usb_pd_settle.h"
+
+bool pd_settle_analyze(const uint16_t *mv, uint16_t n, uint16_t period_us, uint16_t from_mv, uint16_t target_mv,
+                       uint16_t band_mv, pd_settle_t *r) {
+    if (n < 2 * PD_SETTLE_FINAL_SAMPLES) return false;
+
+    uint32_t sum = 0;
+    for (uint16_t i = n - PD_SETTLE_FINAL_SAMPLES; i < n; i++) sum += mv[i];
+    uint16_t final = (uint16_t)((sum + PD_SETTLE_FINAL_SAMPLES / 2) / PD_SETTLE_FINAL_SAMPLES);
+    r->final_mv = final;
+    r->error_mv = (int16_t)((int32_t)final - (int32_t)target_mv);
+
+    /* Overshoot in the direction of the step; a rising step overshoots upwards */
+    bool rising = target_mv >= from_mv;
+    uint16_t over = 0;
+    for (uint16_t i = 0; i < n; i++) {
+        int32_t d = rising ? (int32_t)mv[i] - final : (int32_t)final - mv[i];
+        if (d > over) over = (uint16_t)d;
+    }
+    r->overshoot_mv = over;
+
+    /* Last sample outside the band; settled if that is not within the final average */
+    int32_t last_out = -1;
+    for (uint16_t i = 0; i < n; i++) {
+        int32_t d = (int32_t)mv[i] - final;
+        if (d > band_mv || d < -(int32_t)band_mv) last_out = i;
+    }
+    r->settled = last_out < (int32_t)(n - PD_SETTLE_FINAL_SAMPLES);
+    r->settle_us = (uint32_t)(last_out + 1) * period_us;
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * VBUS step response analysis for PPS / AVS sweeps: final value, error
+ * against the requested voltage, overshoot and settling time from an
+ * evenly sampled capture. No hardware dependency; shared with host tools.
+ */
+
+#define PD_SETTLE_FINAL_SAMPLES 16 // 取最后若干个采样的平均值作为终值
+
+typedef struct {
+    uint16_t final_mv;
+    int16_t error_mv;     // final - target
+    uint16_t overshoot_mv; // 沿阶跃方向超出终值的最大幅度
+    uint8_t settled;      // 捕获结束前进入并保持在 ±band 内
+    uint32_t settle_us;   // 自捕获开始，最后一次超出 ±band 之后的时刻
+} pd_settle_t;
+
+/**
+ * Analyze n samples (mV, one every period_us) of a step from from_mv to
+ * target_mv. Settling is judged against the final value, so a constant
+ * offset shows up as error only. False if there are too few samples.
+ */
+bool pd_settle_analyze(const uint16_t *mv, uint16_t n, uint16_t period_us, uint16_t from_mv, uint16_t target_mv,
+                       uint16_t band_mv, pd_settle_t *r);
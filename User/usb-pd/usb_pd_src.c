@@ -0,0 +1,362 @@
+#include "usb_pd_src.h"
+
+#include "ch32x035_usbpd.h"
+#include "debug.h"
+#include "irq_save.h"
+#include "millis.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_cc.h"
+#include "usb_pd_event.h"
+#include "usb_pd_header.h"
+#include "usb_pd_message.h"
+#include "usb_pd_pdo.h"
+#include "usb_pd_src_pe.h"
+#include "usb_pd_script.h"
+#include "usb_pd_tx.h"
+#include "usb_pd_vcap.h"
+#include "usb_vbus_measure.h"
+
+#define SRC_CC_DEBOUNCE_POLLS 15 // tCCDebounce（100~200 ms，10 ms 轮询）
+#define SRC_CC_DETACH_POLLS   2  // tPDDebounce（10~20 ms）
+
+/* CC 端口检测结果 */
+#define CC_OPEN 0
+#define CC_RA   1
+#define CC_RD   2
+
+static volatile bool s_src_active = false;
+static volatile uint8_t s_spec_rev = 2;      /* 2 for PD2.0, 3 for PD3.0; default PD2.0 */
+static uint16_t s_rp_ua = PD_SRC_RP_DEFAULT;
+static usb_pd_src_vbus_cb_t s_vbus_hook = NULL;
+
+static pd_src_pe_t s_pe;
+static volatile pd_tx_handle_t s_pe_handle = 0; /* last frame queued by the policy engine */
+static uint8_t s_cc = 0;                        /* 0: 未连接，1: CC1, 2: CC2 */
+static uint8_t s_cc_count = 0;
+static uint8_t s_cc_candidate = 0;
+static volatile bool s_recovering = false; /* Hard Reset: VBUS off until s_recover_ms */
+static volatile uint32_t s_recover_ms = 0;
+
+/* VBUS level requested by the engine, printed from the main loop */
+static volatile uint16_t s_vbus_mv = 0;
+static volatile uint16_t s_vbus_ma = 0;
+static volatile uint8_t s_vbus_changed = 0;
+
+/* Switch PHY to receive mode; keep current DMA pointer */
+static inline void pd_switch_to_rx_mode(void) {
+    USBPD->CONFIG |= PD_ALL_CLR;
+    USBPD->CONFIG &= ~PD_ALL_CLR;
+    USBPD->CONTROL &= ~PD_TX_EN;
+    USBPD->BMC_CLK_CNT = UPD_TMR_RX_48M;
+    USBPD->CONTROL |= BMC_START;
+    NVIC_EnableIRQ(USBPD_IRQn);
+}
+
+static uint16_t rp_bits(void) {
+    if (s_rp_ua == 80) return CC_PU_80;
+    if (s_rp_ua == 180) return CC_PU_180;
+    return CC_PU_330;
+}
+
+/* vRa / vRd boundary for the selected Rp: 0.22 V, 0.45 V, 0.66 V */
+static uint16_t rd_cmp_bits(void) {
+    if (s_rp_ua == 80) return CC_CMP_22;
+    if (s_rp_ua == 180) return CC_CMP_45;
+    return CC_CMP_66;
+}
+
+static void apply_rp(void) {
+    USBPD->PORT_CC1 = (uint16_t)((USBPD->PORT_CC1 & CC_LVE) | rp_bits() | rd_cmp_bits());
+    USBPD->PORT_CC2 = (uint16_t)((USBPD->PORT_CC2 & CC_LVE) | rp_bits() | rd_cmp_bits());
+}
+
+/**
+ * @brief  检测 CC 端口负载
+ * @return CC_OPEN: 高于 ~2.2V（GPIO 高电平），CC_RD: 高于 vRa 阈值，CC_RA: 其余
+ */
+static uint8_t cc_sense(volatile uint16_t *port, uint32_t pin) {
+    if ((GPIOC->INDR & pin) != (uint32_t)Bit_RESET) return CC_OPEN;
+    return (*port & PA_CC_AI) ? CC_RD : CC_RA;
+}
+
+/* Source header roles (PRRole=Source, DataRole=DFP) and the selected SpecRev */
+static pd_tx_handle_t pd_send_frame_patch_header(const uint8_t *frame, uint8_t len, pd_tx_prio_t prio) {
+    uint8_t tx_buf[PD_TX_FRAME_MAX];
+
+    if (len < 2 || len > PD_TX_FRAME_MAX) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < len; ++i) tx_buf[i] = frame[i];
+    tx_buf[0] = (uint8_t)((tx_buf[0] & ~0xC0u) | 0x20u | (s_spec_rev == 3 ? 0x80u : 0x40u));
+    tx_buf[1] |= 0x01u;
+
+    return usb_pd_tx_submit(tx_buf, len, PD_SOP0, prio);
+}
+
+/* Attach / detach notice, printed by usb_pd_event_poll() like the sniffer's; Rp is our own */
+static void push_cc(uint8_t what) {
+    pd_event_t e;
+    e.kind = PD_EVENT_CC;
+    e.u.cc.what = what;
+    e.u.cc.conn = s_cc == 2 ? PD_CC_CONN_CC2 : PD_CC_CONN_CC1;
+    e.u.cc.cc1 = (uint8_t)usb_pd_cc_level_volt(usb_pd_cc_probe(1));
+    e.u.cc.cc2 = (uint8_t)usb_pd_cc_level_volt(usb_pd_cc_probe(2));
+    e.u.cc.rp = s_rp_ua == 80 ? PD_CC_ADV_RP_DEFAULT : s_rp_ua == 180 ? PD_CC_ADV_RP_1A5 : PD_CC_ADV_RP_3A0;
+    e.u.cc.vbus_mv = adc_get_vbus_mv();
+    e.u.cc.vdd_mv = 0;
+    e.u.cc.edge_ms = millis(); /* no edge tracking here: the time the debounce confirmed it */
+    e.u.cc.edge_us = micros();
+    usb_pd_event_push(&e);
+}
+
+/* Policy engine ops; always called with interrupts disabled */
+static bool pe_send(void *user, const uint8_t *frame, uint8_t len) {
+    (void)user;
+    s_pe_handle = pd_send_frame_patch_header(frame, len, PD_TX_PRIO_REPLY);
+    return s_pe_handle != 0;
+}
+
+static void pe_set_vbus(void *user, uint16_t mv, uint16_t ma) {
+    (void)user;
+    if (s_vbus_hook) s_vbus_hook(mv, ma);
+    s_vbus_mv = mv;
+    s_vbus_ma = ma;
+    s_vbus_changed = 1;
+}
+
+/* TX queue completion hook (interrupt context) */
+static void pd_tx_done(pd_tx_handle_t handle, pd_tx_prio_t prio, pd_tx_status_t status) {
+    (void)prio;
+    if (s_src_active && handle == s_pe_handle) {
+        uint32_t irq = irq_save();
+        s_pe_handle = 0;
+        pd_src_pe_on_tx_result(&s_pe, status == PD_TX_DONE, millis());
+        irq_restore(irq);
+    }
+}
+
+void usb_pd_src_set_vbus_hook(usb_pd_src_vbus_cb_t cb) {
+    s_vbus_hook = cb;
+}
+
+/* Mode change notice, printed in order with the frames by usb_pd_event_poll() */
+static void push_mode(bool enter) {
+    pd_event_t e;
+    e.kind = PD_EVENT_MODE;
+    e.u.mode.mode = PD_EVENT_MODE_SRC;
+    e.u.mode.enter = enter;
+    e.u.mode.spec_rev = s_spec_rev;
+    e.u.mode.rp_ua = s_rp_ua;
+    usb_pd_event_push(&e);
+}
+
+void usb_pd_src_enter(void) {
+    static const pd_src_pe_ops_t ops = {NULL, pe_send, pe_set_vbus};
+    uint32_t caps[PD_SRC_MAX_PDO];
+    uint8_t n = 0;
+
+    /* Keep the advertised list across mode changes */
+    if (s_pe.ops.send) {
+        n = s_pe.num_caps;
+        for (uint8_t i = 0; i < n; i++) caps[i] = s_pe.caps[i];
+    }
+    pd_src_pe_init(&s_pe, &ops, s_spec_rev);
+    if (n) pd_src_pe_set_caps(&s_pe, caps, n, 0);
+
+    /* The PHY and the TX queue are shared with the USBPD and TIM2 interrupts */
+    uint32_t irq = irq_save();
+    s_cc = 0;
+    s_cc_count = 0;
+    s_cc_candidate = 0;
+    s_pe_handle = 0;
+    usb_pd_tx_reset();
+    usb_pd_tx_set_retry_count(s_spec_rev == 3 ? PD_N_RETRY_COUNT_PD3 : PD_N_RETRY_COUNT_PD2);
+    usb_pd_tx_set_done_cb(pd_tx_done);
+
+    /* Rp on both CC, no Rd */
+    usb_pd_cc_rd_en(false);
+    usb_pd_cc_en(true);
+    USBPD->PORT_CC1 = 0;
+    USBPD->PORT_CC2 = 0;
+    apply_rp();
+
+    pd_switch_to_rx_mode();
+    s_src_active = true;
+    push_mode(true);
+    irq_restore(irq);
+}
+
+void usb_pd_src_exit(void) {
+    /* Hand the TX hook back before the queue is flushed */
+    usb_pd_script_abort();
+    uint32_t irq = irq_save();
+    s_src_active = false;
+    s_recovering = false;
+    pd_src_pe_detach(&s_pe);
+    usb_pd_tx_reset();
+
+    clear_message_buffer();
+    reset_message_counter();
+
+    /* Remove Rp, keep comparator */
+    USBPD->PORT_CC1 = CC_CMP_66;
+    USBPD->PORT_CC2 = CC_CMP_66;
+    pd_switch_to_rx_mode();
+    s_cc = 0;
+    push_mode(false);
+    irq_restore(irq);
+}
+
+bool usb_pd_src_is_active(void) { return s_src_active; }
+
+void usb_pd_src_set_rp(uint16_t ua) {
+    s_rp_ua = (ua == 80 || ua == 180) ? ua : 330;
+    if (!s_src_active) return;
+    /* CC_LVE is set from the USBPD interrupt while a frame goes out */
+    uint32_t irq = irq_save();
+    apply_rp();
+    irq_restore(irq);
+}
+
+void usb_pd_src_on_cdc_bytes(const uint8_t *data, uint8_t len) {
+    if (!s_src_active || len == 0) return;
+
+    if (len == 4 && data[0] == 'e' && data[1] == 'x' && data[2] == 'i' && data[3] == 't') {
+        usb_pd_src_exit();
+        return;
+    }
+
+    /* Source_Capabilities from the host replaces the advertised list */
+    if (len >= 6) {
+        uint16_t hdr = pd_header_read(data);
+        uint8_t ndo = PD_HDR_NUM_DO(hdr);
+        if (!PD_HDR_EXTENDED(hdr) && PD_HDR_MSG_TYPE(hdr) == 0x01 && ndo && len == 2 + 4 * ndo) {
+            uint32_t pdos[PD_SRC_MAX_PDO];
+            if (ndo > PD_SRC_MAX_PDO) ndo = PD_SRC_MAX_PDO;
+            for (uint8_t i = 0; i < ndo; i++) {
+                const uint8_t *p = &data[2 + 4 * i];
+                pdos[i] = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+            }
+            uint32_t irq = irq_save();
+            pd_src_pe_set_caps(&s_pe, pdos, ndo, millis());
+            irq_restore(irq);
+            cdc_acm_printf("# src: %u PDOs set\n", ndo);
+            return;
+        }
+    }
+
+    usb_pd_tx_host_submitted(pd_send_frame_patch_header(data, len, PD_TX_PRIO_HOST));
+}
+
+void usb_pd_src_on_rx(const uint8_t *frame, uint8_t len) {
+    if (!s_src_active) return;
+    /* TIM2 (CRCReceiveTimer) may preempt this interrupt */
+    uint32_t irq = irq_save();
+    pd_src_pe_on_rx(&s_pe, frame, len, millis());
+    irq_restore(irq);
+}
+
+void usb_pd_src_on_hard_reset(void) {
+    if (!s_src_active) return;
+    /* VBUS to vSafe0V now, back to vSafe5V and the first Source_Capabilities after tSrcRecover */
+    uint32_t irq = irq_save();
+    usb_pd_tx_reset();
+    s_pe_handle = 0;
+    pd_src_pe_detach(&s_pe);
+    s_recover_ms = millis() + PD_SRC_T_SRC_RECOVER_MS;
+    s_recovering = true;
+    irq_restore(irq);
+}
+
+/* Attach/detach with debounce; the comparator is left at the vRd threshold by apply_rp() */
+static void src_check_connection(void) {
+    if (usb_pd_tx_busy()) return; /* BMC 发送期间 CC 电平无效 */
+
+    uint8_t cc1 = cc_sense(&USBPD->PORT_CC1, PIN_CC1);
+    uint8_t cc2 = cc_sense(&USBPD->PORT_CC2, PIN_CC2);
+
+    if (s_cc) {
+        uint8_t cc = (s_cc == 1) ? cc1 : cc2;
+        s_cc_count = (cc == CC_RD) ? 0 : (uint8_t)(s_cc_count + 1);
+        if (s_cc_count >= SRC_CC_DETACH_POLLS) {
+            uint32_t irq = irq_save();
+            pd_src_pe_detach(&s_pe);
+            usb_pd_tx_flush();
+            s_recovering = false;
+            irq_restore(irq);
+            usb_pd_vcap_trigger(PD_VCAP_DETACH, 0, millis());
+            push_cc(PD_EVENT_CC_DETACH);
+            s_cc = 0;
+            s_cc_count = 0;
+            s_cc_candidate = 0;
+        }
+        return;
+    }
+
+    /* 仅一路 Rd（另一路开路或 Ra）才视为连接 Sink */
+    uint8_t candidate = 0;
+    if (cc1 == CC_RD && cc2 != CC_RD) candidate = 1;
+    if (cc2 == CC_RD && cc1 != CC_RD) candidate = 2;
+    if (!candidate || candidate != s_cc_candidate) {
+        s_cc_candidate = candidate;
+        s_cc_count = 0;
+        return;
+    }
+    if (++s_cc_count < SRC_CC_DEBOUNCE_POLLS) return;
+
+    s_cc = candidate;
+    s_cc_count = 0;
+    if (s_cc == 1) {
+        USBPD->CONFIG &= ~CC_SEL;
+    } else {
+        USBPD->CONFIG |= CC_SEL;
+    }
+    push_cc(PD_EVENT_CC_ATTACH);
+
+    uint32_t irq = irq_save();
+    usb_pd_tx_reset();
+    pd_src_pe_attach(&s_pe, millis());
+    irq_restore(irq);
+}
+
+void usb_pd_src_poll(void) {
+    if (!s_src_active) return;
+
+    src_check_connection();
+
+    uint32_t irq = irq_save();
+    if (s_recovering && (int32_t)(millis() - s_recover_ms) >= 0) {
+        s_recovering = false;
+        if (s_cc) pd_src_pe_attach(&s_pe, millis());
+    }
+    /* A running script owns the conversation */
+    if (!usb_pd_script_is_running()) pd_src_pe_tick(&s_pe, millis());
+    uint8_t events = s_pe.events;
+    s_pe.events = 0;
+    uint8_t vbus_changed = s_vbus_changed;
+    s_vbus_changed = 0;
+    uint32_t rdo = s_pe.rdo;
+    uint8_t pos = s_pe.contract_pos;
+    uint16_t mv = s_pe.contract_mv, ma = s_pe.contract_ma;
+    uint8_t req_pos = s_pe.req_pos;
+    uint16_t req_mv = s_pe.req_mv, req_ma = s_pe.req_ma;
+    irq_restore(irq);
+
+    if (!cdc_acm_is_configured()) return;
+
+    if (events & PD_SRC_EVT_NO_RESPONSE) cdc_acm_printf("# src: no GoodCRC after %u Source_Capabilities\n", PD_SRC_N_CAPS_COUNT);
+    if (events & PD_SRC_EVT_TIMEOUT) cdc_acm_prints("# src: no Request (SenderResponseTimer)\n");
+    if (events & PD_SRC_EVT_REJECTED) cdc_acm_printf("# src: Reject RDO 0x%08lX (PDO%u)\n", (unsigned long)rdo, PD_RDO_POS(rdo));
+    if (events & PD_SRC_EVT_ACCEPTED) cdc_acm_printf("# src: Accept PDO%u %umV %umA\n", req_pos, req_mv, req_ma);
+    if (events & PD_SRC_EVT_TX_FAILED) cdc_acm_prints("# src: Accept/PS_RDY not acknowledged, re-advertising\n");
+    if (vbus_changed) cdc_acm_printf("# src: VBUS %umV %umA%s\n", s_vbus_mv, s_vbus_ma, s_vbus_hook ? "" : " (no VBUS hook)");
+    if (events & PD_SRC_EVT_CONTRACT) cdc_acm_printf("# src: contract PDO%u %umV %umA\n", pos, mv, ma);
+}
+
+void usb_pd_src_set_spec_rev(uint8_t rev) {
+    s_spec_rev = (rev == 3) ? 3 : 2;
+    s_pe.spec_rev = s_spec_rev;
+}
+
+uint8_t usb_pd_src_get_spec_flag(void) { return (s_spec_rev == 3 ? 0x80u : 0x40u); }
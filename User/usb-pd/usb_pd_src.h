@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * SRC emulation mode: Rp on both CC, Rd detection with tCCDebounce, then
+ * the source policy engine (usb_pd_src_pe) advertises the capability list
+ * and negotiates the contract. VBUS itself is switched by an optional
+ * board hook; without one the requested levels are only reported.
+ */
+
+/* Rp current source, in uA: 80 (Default USB), 180 (1.5A), 330 (3.0A) */
+#define PD_SRC_RP_DEFAULT 330
+
+#define PD_SRC_T_SRC_RECOVER_MS 660 // tSrcRecover（0.66~1 s）：Hard Reset 后 VBUS 关断的时长
+
+/* Called with interrupts disabled when the contract asks for a new VBUS level; 0 mV turns it off */
+typedef void (*usb_pd_src_vbus_cb_t)(uint16_t mv, uint16_t ma);
+
+void usb_pd_src_set_vbus_hook(usb_pd_src_vbus_cb_t cb);
+
+/* Enter SRC mode: Rp on CC1/CC2, wait for a sink */
+void usb_pd_src_enter(void);
+/* Exit SRC mode back to passive listen (VBUS off) */
+void usb_pd_src_exit(void);
+bool usb_pd_src_is_active(void);
+
+/* Rp advertisement: 80, 180 or 330 uA; applied immediately when active */
+void usb_pd_src_set_rp(uint16_t ua);
+
+/**
+ * Handle CDC-received bytes while in SRC mode: "exit", a Source_Capabilities
+ * frame (replaces the advertised list) or any other raw frame (sent at host
+ * priority with the source header roles).
+ */
+void usb_pd_src_on_cdc_bytes(const uint8_t *data, uint8_t len);
+
+/* Non-GoodCRC SOP frame received in SRC mode; interrupt context */
+void usb_pd_src_on_rx(const uint8_t *frame, uint8_t len);
+
+/* Hard Reset sent or received in SRC mode: VBUS off, back on after tSrcRecover; interrupt context */
+void usb_pd_src_on_hard_reset(void);
+
+/* Attach/detach detection, policy timers and deferred prints; call from the main loop */
+void usb_pd_src_poll(void);
+
+/* Set/Get selected PD Specification Revision for outgoings: 2 or 3 */
+void usb_pd_src_set_spec_rev(uint8_t rev);
+/* Header SpecRev bits to OR into byte0: 0x40 for PD2.0, 0x80 for PD3.0 */
+uint8_t usb_pd_src_get_spec_flag(void);
@@ -0,0 +1,227 @@
+#include "usb_pd_src_pe.h"
+
+#include <string.h>
+
+#include "usb_pd_header.h"
+#include "usb_pd_pdo.h"
+
+#define MSG_CTRL_ACCEPT      0x03
+#define MSG_CTRL_REJECT      0x04
+#define MSG_CTRL_PS_RDY      0x06
+#define MSG_CTRL_GET_SRC_CAP 0x07
+#define MSG_DATA_SRC_CAP     0x01
+#define MSG_DATA_REQUEST     0x02
+
+static inline uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void wr32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void start_timer(pd_src_pe_t *pe, uint32_t now_ms, uint32_t ms) {
+    pe->deadline_ms = now_ms + ms;
+    pe->timer_on = 1;
+}
+
+/* Source header: PRRole=Source, DataRole=DFP; the transmitter fills in MessageID */
+static bool send_msg(pd_src_pe_t *pe, uint8_t type, const uint32_t *dos, uint8_t ndo) {
+    uint8_t frame[2 + 4 * PD_SRC_MAX_PDO];
+    uint16_t hdr = (uint16_t)(type | (1u << 5) | ((pe->spec_rev == 3 ? 2u : 1u) << 6) | (1u << 8) |
+                              ((uint16_t)ndo << 12));
+    frame[0] = (uint8_t)hdr;
+    frame[1] = (uint8_t)(hdr >> 8);
+    for (uint8_t i = 0; i < ndo; i++) wr32(&frame[2 + 4 * i], dos[i]);
+    return pe->ops.send(pe->ops.user, frame, (uint8_t)(2 + 4 * ndo));
+}
+
+static void send_caps(pd_src_pe_t *pe, uint32_t now_ms) {
+    pe->timer_on = 0;
+    pe->state = PD_SRC_SEND_CAPS;
+    if (!pe->num_caps || !send_msg(pe, MSG_DATA_SRC_CAP, pe->caps, pe->num_caps)) {
+        /* Not queued: treat as unacknowledged */
+        pd_src_pe_on_tx_result(pe, false, now_ms);
+    }
+}
+
+/* No explicit contract to fall back to: keep vSafe5V and wait */
+static void no_contract(pd_src_pe_t *pe) {
+    pe->timer_on = 0;
+    pe->state = pe->has_contract ? PD_SRC_READY : PD_SRC_WAIT_NEW_CAPS;
+}
+
+bool pd_src_pe_evaluate(const uint32_t *caps, uint8_t n, uint32_t rdo, uint16_t *mv, uint16_t *ma) {
+    uint8_t pos = PD_RDO_POS(rdo);
+    if (pos == 0 || pos > n || !caps[pos - 1]) return false;
+
+    pd_pdo_t p;
+    pd_pdo_parse(caps[pos - 1], &p);
+    switch (p.type) {
+    case PD_PDO_FIXED:
+    case PD_PDO_VARIABLE:
+        *mv = p.max_mv;
+        *ma = (uint16_t)(PD_RDO_OP_10MA(rdo) * 10);
+        return *ma <= p.max_ma;
+    case PD_PDO_BATTERY: {
+        uint32_t mw = (uint32_t)PD_RDO_OP_10MA(rdo) * 250;
+        *mv = p.max_mv;
+        *ma = p.max_mv ? (uint16_t)(mw * 1000 / p.max_mv) : 0;
+        return mw <= p.max_mw;
+    }
+    case PD_PDO_PPS:
+        *mv = (uint16_t)(PD_RDO_APDO_OUT(rdo) * 20);
+        *ma = (uint16_t)(PD_RDO_APDO_OP_50MA(rdo) * 50);
+        return *mv >= p.min_mv && *mv <= p.max_mv && *ma <= p.max_ma;
+    case PD_PDO_SPR_AVS:
+        *mv = (uint16_t)(PD_RDO_APDO_OUT(rdo) * 25);
+        *ma = (uint16_t)(PD_RDO_APDO_OP_50MA(rdo) * 50);
+        return *mv >= p.min_mv && *mv <= p.max_mv && *mv % 100 == 0 && *ma <= p.max_ma;
+    default:
+        /* EPR objects are not offered in SPR mode */
+        return false;
+    }
+}
+
+void pd_src_pe_init(pd_src_pe_t *pe, const pd_src_pe_ops_t *ops, uint8_t spec_rev) {
+    memset(pe, 0, sizeof(*pe));
+    pe->ops = *ops;
+    pe->spec_rev = spec_rev;
+    /* 5V 3A */
+    pe->caps[0] = (100u << 10) | 300u;
+    pe->num_caps = 1;
+}
+
+void pd_src_pe_set_caps(pd_src_pe_t *pe, const uint32_t *pdos, uint8_t n, uint32_t now_ms) {
+    if (n > PD_SRC_MAX_PDO) n = PD_SRC_MAX_PDO;
+    for (uint8_t i = 0; i < n; i++) pe->caps[i] = pdos[i];
+    pe->num_caps = n;
+    if (pe->state == PD_SRC_DISABLED) return;
+    pe->caps_count = 0;
+    send_caps(pe, now_ms);
+}
+
+void pd_src_pe_attach(pd_src_pe_t *pe, uint32_t now_ms) {
+    pe->has_contract = 0;
+    pe->caps_count = 0;
+    pe->events = 0;
+    pe->ops.set_vbus(pe->ops.user, 5000, 0);
+    pe->state = PD_SRC_DISCOVERY;
+    start_timer(pe, now_ms, PD_SRC_T_SEND_SOURCE_CAP_MS);
+}
+
+void pd_src_pe_detach(pd_src_pe_t *pe) {
+    pe->ops.set_vbus(pe->ops.user, 0, 0);
+    pe->state = PD_SRC_DISABLED;
+    pe->timer_on = 0;
+    pe->has_contract = 0;
+}
+
+void pd_src_pe_on_rx(pd_src_pe_t *pe, const uint8_t *frame, uint8_t len, uint32_t now_ms) {
+    if (pe->state == PD_SRC_DISABLED || len < 2) return;
+    uint16_t hdr = pd_header_read(frame);
+    if (PD_HDR_EXTENDED(hdr)) return;
+    uint8_t type = PD_HDR_MSG_TYPE(hdr);
+    uint8_t ndo = PD_HDR_NUM_DO(hdr);
+
+    if (ndo == 1 && type == MSG_DATA_REQUEST && len >= 6) {
+        if (pe->state != PD_SRC_WAIT_REQUEST && pe->state != PD_SRC_READY && pe->state != PD_SRC_WAIT_NEW_CAPS) return;
+        pe->rdo = rd32(&frame[2]);
+        uint16_t mv, ma;
+        if (pd_src_pe_evaluate(pe->caps, pe->num_caps, pe->rdo, &mv, &ma)) {
+            pe->req_pos = PD_RDO_POS(pe->rdo);
+            pe->req_mv = mv;
+            pe->req_ma = ma;
+            pe->events |= PD_SRC_EVT_ACCEPTED;
+            pe->timer_on = 0;
+            pe->state = PD_SRC_ACCEPT;
+            if (!send_msg(pe, MSG_CTRL_ACCEPT, NULL, 0)) pd_src_pe_on_tx_result(pe, false, now_ms);
+        } else {
+            pe->events |= PD_SRC_EVT_REJECTED;
+            (void)send_msg(pe, MSG_CTRL_REJECT, NULL, 0);
+            no_contract(pe);
+        }
+        return;
+    }
+
+    if (ndo == 0 && type == MSG_CTRL_GET_SRC_CAP) {
+        if (pe->state == PD_SRC_READY || pe->state == PD_SRC_WAIT_NEW_CAPS) {
+            pe->caps_count = 0;
+            send_caps(pe, now_ms);
+        }
+    }
+}
+
+void pd_src_pe_on_tx_result(pd_src_pe_t *pe, bool acked, uint32_t now_ms) {
+    switch (pe->state) {
+    case PD_SRC_SEND_CAPS:
+        if (acked) {
+            pe->caps_count = 0;
+            pe->events |= PD_SRC_EVT_CAPS_SENT;
+            pe->state = PD_SRC_WAIT_REQUEST;
+            start_timer(pe, now_ms, PD_SRC_T_SENDER_RESPONSE_MS);
+        } else if (++pe->caps_count >= PD_SRC_N_CAPS_COUNT) {
+            /* Not a PD sink: stay at vSafe5V */
+            pe->events |= PD_SRC_EVT_NO_RESPONSE;
+            no_contract(pe);
+        } else {
+            pe->state = PD_SRC_DISCOVERY;
+            start_timer(pe, now_ms, PD_SRC_T_SEND_SOURCE_CAP_MS);
+        }
+        break;
+    case PD_SRC_ACCEPT:
+        if (acked) {
+            pe->state = PD_SRC_TRANSITION;
+            start_timer(pe, now_ms, PD_SRC_T_SRC_TRANSITION_MS);
+        } else {
+            /* A Hard Reset would follow; re-advertise instead */
+            pe->events |= PD_SRC_EVT_TX_FAILED;
+            pe->state = PD_SRC_DISCOVERY;
+            start_timer(pe, now_ms, PD_SRC_T_SEND_SOURCE_CAP_MS);
+        }
+        break;
+    case PD_SRC_PS_RDY:
+        if (acked) {
+            pe->has_contract = 1;
+            pe->contract_pos = pe->req_pos;
+            pe->contract_mv = pe->req_mv;
+            pe->contract_ma = pe->req_ma;
+            pe->events |= PD_SRC_EVT_CONTRACT;
+            pe->state = PD_SRC_READY;
+        } else {
+            pe->events |= PD_SRC_EVT_TX_FAILED;
+            pe->state = PD_SRC_DISCOVERY;
+            start_timer(pe, now_ms, PD_SRC_T_SEND_SOURCE_CAP_MS);
+        }
+        break;
+    default:
+        /* Reject and other one-shot messages need no follow-up */
+        break;
+    }
+}
+
+void pd_src_pe_tick(pd_src_pe_t *pe, uint32_t now_ms) {
+    if (!pe->timer_on || (int32_t)(now_ms - pe->deadline_ms) < 0) return;
+    pe->timer_on = 0;
+
+    switch (pe->state) {
+    case PD_SRC_DISCOVERY:
+        send_caps(pe, now_ms);
+        break;
+    case PD_SRC_WAIT_REQUEST:
+        /* A Hard Reset would follow; keep the current supply */
+        pe->events |= PD_SRC_EVT_TIMEOUT;
+        no_contract(pe);
+        break;
+    case PD_SRC_TRANSITION:
+        pe->ops.set_vbus(pe->ops.user, pe->req_mv, pe->req_ma);
+        pe->state = PD_SRC_PS_RDY;
+        if (!send_msg(pe, MSG_CTRL_PS_RDY, NULL, 0)) pd_src_pe_on_tx_result(pe, false, now_ms);
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Source policy engine: advertises Source_Capabilities, evaluates the
+ * sink's Request and runs Accept -> tSrcTransition -> PS_RDY.
+ * No hardware dependency: the firmware SRC mode and the host simulator
+ * (Host/tools/pdsrcsim.c) drive it with received messages, transmit
+ * results and a millisecond clock, and it acts through the ops callbacks.
+ * Calls must not overlap (the firmware serializes them).
+ */
+
+#define PD_SRC_MAX_PDO                7
+#define PD_SRC_N_CAPS_COUNT           50  // nCapsCount
+#define PD_SRC_T_SEND_SOURCE_CAP_MS   150 // tTypeCSendSourceCap（100~200 ms）
+#define PD_SRC_T_SENDER_RESPONSE_MS   30  // SenderResponseTimer
+#define PD_SRC_T_SRC_TRANSITION_MS    25  // tSrcTransition（25~35 ms）
+
+/* 状态 */
+typedef enum {
+    PD_SRC_DISABLED = 0,  // 未连接
+    PD_SRC_DISCOVERY,     // 等待下一次发送 Source_Capabilities
+    PD_SRC_SEND_CAPS,     // Source_Capabilities 已发出，等待 GoodCRC
+    PD_SRC_WAIT_REQUEST,
+    PD_SRC_ACCEPT,        // Accept 已发出，等待 GoodCRC
+    PD_SRC_TRANSITION,    // tSrcTransition 后切换 VBUS
+    PD_SRC_PS_RDY,        // PS_RDY 已发出，等待 GoodCRC
+    PD_SRC_READY,         // 显式合约
+    PD_SRC_WAIT_NEW_CAPS, // 无合约，等待能力变化或 Get_Source_Cap
+} pd_src_state_t;
+
+/* Events for the caller's log, collected in pd_src_pe_t.events */
+#define PD_SRC_EVT_CAPS_SENT   0x01 // Source_Capabilities acknowledged
+#define PD_SRC_EVT_NO_RESPONSE 0x02 // nCapsCount reached without GoodCRC
+#define PD_SRC_EVT_ACCEPTED    0x04 // Request accepted (req_*)
+#define PD_SRC_EVT_REJECTED    0x08 // Request rejected (rdo)
+#define PD_SRC_EVT_CONTRACT    0x10 // PS_RDY acknowledged (contract_*)
+#define PD_SRC_EVT_TIMEOUT     0x20 // no Request within SenderResponseTimer
+#define PD_SRC_EVT_TX_FAILED   0x40 // Accept / PS_RDY not acknowledged
+
+typedef struct {
+    void *user;
+    /* Queue a frame (header + data objects, MessageID left 0); false if it was not accepted */
+    bool (*send)(void *user, const uint8_t *frame, uint8_t len);
+    /* Switch VBUS; 0 mV turns it off */
+    void (*set_vbus)(void *user, uint16_t mv, uint16_t ma);
+} pd_src_pe_ops_t;
+
+typedef struct {
+    pd_src_pe_ops_t ops;
+    uint8_t state;         // pd_src_state_t
+    uint8_t spec_rev;      // 2: PD2.0, 3: PD3.0
+    uint8_t num_caps;
+    uint32_t caps[PD_SRC_MAX_PDO];
+    uint8_t caps_count;    // 未被确认的 Source_Capabilities 次数
+    uint8_t timer_on;
+    uint32_t deadline_ms;
+    uint32_t rdo;          // 最近一次 Request
+    uint8_t req_pos;       // 接受的 Request
+    uint16_t req_mv;
+    uint16_t req_ma;
+    uint8_t has_contract;
+    uint8_t contract_pos;
+    uint16_t contract_mv;
+    uint16_t contract_ma;
+    uint8_t events;        // PD_SRC_EVT_*，由调用方清除
+} pd_src_pe_t;
+
+void pd_src_pe_init(pd_src_pe_t *pe, const pd_src_pe_ops_t *ops, uint8_t spec_rev);
+
+/* Replace the advertised list (no validation, so odd lists can be tested); re-advertised at once when attached */
+void pd_src_pe_set_caps(pd_src_pe_t *pe, const uint32_t *pdos, uint8_t n, uint32_t now_ms);
+
+/* Sink attached: vSafe5V on, first Source_Capabilities after tTypeCSendSourceCap */
+void pd_src_pe_attach(pd_src_pe_t *pe, uint32_t now_ms);
+void pd_src_pe_detach(pd_src_pe_t *pe);
+
+/* SOP message from the sink (not GoodCRC); len may include the CRC */
+void pd_src_pe_on_rx(pd_src_pe_t *pe, const uint8_t *frame, uint8_t len, uint32_t now_ms);
+
+/* Result of the last frame sent through ops.send: acked by GoodCRC, or retries exhausted */
+void pd_src_pe_on_tx_result(pd_src_pe_t *pe, bool acked, uint32_t now_ms);
+
+/* Timers; call at least every few ms */
+void pd_src_pe_tick(pd_src_pe_t *pe, uint32_t now_ms);
+
+/**
+ * Check an RDO against the capabilities. On success returns true with the
+ * VBUS voltage and current to supply.
+ */
+bool pd_src_pe_evaluate(const uint32_t *caps, uint8_t n, uint32_t rdo, uint16_t *mv, uint16_t *ma);
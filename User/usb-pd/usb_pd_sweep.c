@@ -0,0 +1,316 @@
+#include "usb_pd_sweep.h"
+
+#include "ch32x035_usbpd.h"
+#include "millis.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_policy.h"
+#include "usb_pd_script.h"
+#include "usb_pd_settle.h"
+#include "usb_pd_snk.h"
+#include "usb_pd_timer.h"
+#include "usb_vbus_measure.h"
+
+#define NO_SAMPLE 0xFFFF
+
+/* 扫描状态 */
+enum {
+    SWEEP_IDLE = 0,
+    SWEEP_WAIT_ACCEPT, // 已请求，等待 Accept
+    SWEEP_CAPTURE,     // Accept 后采样，直到 PS_RDY 之后的窗口结束
+    SWEEP_DWELL,       // 本步已报告，停留后进入下一步
+};
+
+/* 主机命令 */
+enum {
+    CMD_NONE = 0,
+    CMD_START,
+    CMD_STOP,
+};
+
+static volatile uint8_t s_state = SWEEP_IDLE;
+static volatile uint8_t s_cmd = CMD_NONE;
+static volatile bool s_bad_args = false;
+
+/* Arguments of the pending / running sweep */
+static volatile uint16_t s_arg_from, s_arg_to, s_arg_step, s_arg_dwell;
+static uint16_t s_from, s_to, s_step, s_dwell;
+
+static pd_policy_target_t s_saved;
+static uint16_t s_mv;      // 当前步的目标电压
+static uint16_t s_prev_mv; // 请求前的 VBUS
+static uint8_t s_index = 0;
+static uint32_t s_step_ms = 0;
+static uint32_t s_dwell_until = 0;
+static volatile bool s_refused = false;
+
+/* VBUS capture, filled from the TIM2 interrupt */
+static uint16_t s_buf[PD_SWEEP_BUF_SAMPLES];
+static volatile uint16_t s_count = 0;
+static volatile uint16_t s_ps_rdy_idx = NO_SAMPLE;
+static volatile bool s_sampling = false;
+static volatile bool s_capture_done = false;
+static uint16_t s_due = 0;
+
+static void sample_tick(void) {
+    if (!s_sampling) return;
+    uint16_t now = usb_pd_timer_now();
+    uint16_t n = s_count;
+    s_buf[n % PD_SWEEP_BUF_SAMPLES] = adc_get_recent_raw(PD_SWEEP_ADC_AVG);
+    s_count = ++n;
+
+    uint16_t ps = s_ps_rdy_idx;
+    if (ps != NO_SAMPLE && n >= ps + PD_SWEEP_POST_SAMPLES) {
+        s_sampling = false;
+        s_capture_done = true;
+        return;
+    }
+
+    /* Keep the grid; if the tick ran late, restart it from now instead of catching up */
+    s_due = (uint16_t)(s_due + PD_SWEEP_PERIOD_US);
+    if ((int16_t)(s_due - now) < (int16_t)(PD_SWEEP_PERIOD_US / 4)) s_due = (uint16_t)(now + PD_SWEEP_PERIOD_US);
+    usb_pd_timer_start_at(PD_TIMER_SWEEP, now, (uint16_t)(s_due - now), sample_tick);
+}
+
+static void start_sampler(void) {
+    usb_pd_timer_cancel(PD_TIMER_SWEEP);
+    s_count = 0;
+    s_ps_rdy_idx = NO_SAMPLE;
+    s_capture_done = false;
+    s_due = usb_pd_timer_now();
+    s_sampling = true;
+    sample_tick();
+}
+
+static void stop_sampler(void) {
+    s_sampling = false;
+    usb_pd_timer_cancel(PD_TIMER_SWEEP);
+}
+
+/* Policy events: RX interrupt or usb_pd_policy_poll() */
+static void on_policy_event(pd_policy_event_t ev) {
+    switch (ev) {
+    case PD_POLICY_EV_ACCEPT:
+        if (s_state != SWEEP_WAIT_ACCEPT) return;
+        s_state = SWEEP_CAPTURE;
+        start_sampler();
+        break;
+    case PD_POLICY_EV_PS_RDY:
+        if (s_state == SWEEP_CAPTURE && s_ps_rdy_idx == NO_SAMPLE) s_ps_rdy_idx = s_count;
+        break;
+    case PD_POLICY_EV_REFUSED:
+        if (s_state != SWEEP_WAIT_ACCEPT && s_state != SWEEP_CAPTURE) return;
+        stop_sampler();
+        s_refused = true;
+        break;
+    default:
+        break;
+    }
+}
+
+/* Comma separated decimal values; number of values parsed, 0 on a syntax error */
+static uint8_t parse_args(const uint8_t *p, uint8_t len, uint16_t *v, uint8_t max) {
+    uint8_t n = 0;
+    uint32_t acc = 0;
+    bool digit = false;
+    for (uint8_t i = 0; i <= len; i++) {
+        if (i == len || p[i] == ',') {
+            if (!digit || n >= max) return 0;
+            v[n++] = (uint16_t)acc;
+            acc = 0;
+            digit = false;
+        } else if (p[i] >= '0' && p[i] <= '9') {
+            acc = acc * 10 + (uint32_t)(p[i] - '0');
+            if (acc > 0xFFFF) return 0;
+            digit = true;
+        } else if (p[i] != '\r' && p[i] != '\n') {
+            return 0;
+        }
+    }
+    return n;
+}
+
+void usb_pd_sweep_on_cdc_bytes(const uint8_t *data, uint8_t len) {
+    if (len < 4 || data[0] != 's' || data[1] != 'w' || data[2] != 'p') return;
+    if (len == 4 && data[3] == 'x') {
+        s_cmd = CMD_STOP;
+        return;
+    }
+
+    uint16_t v[4];
+    uint8_t n = parse_args(&data[3], (uint8_t)(len - 3), v, 4);
+    if (n < 3 || !v[0] || !v[1] || !v[2]) {
+        s_bad_args = true;
+        return;
+    }
+    s_arg_from = v[0];
+    s_arg_to = v[1];
+    s_arg_step = v[2];
+    s_arg_dwell = n > 3 ? v[3] : PD_SWEEP_DWELL_MS;
+    s_cmd = CMD_START;
+}
+
+bool usb_pd_sweep_is_running(void) {
+    return s_state != SWEEP_IDLE;
+}
+
+static void start_step(void) {
+    pd_policy_target_t t = s_saved;
+    t.mode = PD_POLICY_PPS;
+    t.mv = s_mv;
+    usb_pd_policy_set_target(&t);
+
+    s_prev_mv = adc_get_vbus_mv();
+    s_refused = false;
+    s_capture_done = false;
+    s_index++;
+    s_step_ms = millis();
+    s_state = SWEEP_WAIT_ACCEPT;
+    usb_pd_policy_request();
+}
+
+/* Next target towards s_to; false when the last step has been done */
+static bool next_mv(void) {
+    if (s_mv == s_to) return false;
+    if (s_to > s_mv) {
+        s_mv = (uint16_t)(s_to - s_mv > s_step ? s_mv + s_step : s_to);
+    } else {
+        s_mv = (uint16_t)(s_mv - s_to > s_step ? s_mv - s_step : s_to);
+    }
+    return true;
+}
+
+/* Stop, give the policy its previous target back and say why */
+static void finish(const char *why) {
+    NVIC_DisableIRQ(USBPD_IRQn);
+    stop_sampler();
+    s_state = SWEEP_IDLE;
+    NVIC_EnableIRQ(USBPD_IRQn);
+    usb_pd_policy_set_hook(0);
+
+    usb_pd_policy_set_target(&s_saved);
+    if (usb_pd_snk_is_active()) usb_pd_policy_request();
+    if (cdc_acm_is_configured()) cdc_acm_printf("# sweep: %s after %u step(s)\n", why, s_index);
+}
+
+static void begin(void) {
+    if (s_state != SWEEP_IDLE) {
+        if (cdc_acm_is_configured()) cdc_acm_prints("# sweep: already running, send 'swpx' to stop\n");
+        return;
+    }
+    pd_policy_choice_t c;
+    if (!usb_pd_snk_is_active() || usb_pd_script_is_running() || usb_pd_policy_state() != PD_POLICY_READY ||
+        !usb_pd_policy_contract(&c)) {
+        if (cdc_acm_is_configured()) cdc_acm_prints("# sweep: needs an explicit contract in SNK mode\n");
+        return;
+    }
+
+    s_from = s_arg_from;
+    s_to = s_arg_to;
+    s_step = s_arg_step;
+    s_dwell = s_arg_dwell;
+    s_mv = s_from;
+    s_index = 0;
+    usb_pd_policy_get_target(&s_saved);
+    usb_pd_policy_set_hook(on_policy_event);
+
+    if (cdc_acm_is_configured()) {
+        cdc_acm_printf("# sweep: %u..%umV step %umV dwell %ums, VBUS every %uus, band +-%umV\n", s_from, s_to,
+                       s_step, s_dwell, PD_SWEEP_PERIOD_US, PD_SWEEP_BAND_MV);
+        cdc_acm_prints("# sweep: step req_mV final_mV err_mV over_mV settle_ms ps_rdy_ms\n");
+    }
+    start_step();
+}
+
+/* Reverse s_buf[a..b) in place */
+static void reverse(uint16_t a, uint16_t b) {
+    while (a + 1 < b) {
+        uint16_t t = s_buf[a];
+        s_buf[a++] = s_buf[--b];
+        s_buf[b] = t;
+    }
+}
+
+/* Analyze the finished capture and print its row; false if the step did not land on PPS / AVS */
+static bool report_step(void) {
+    pd_policy_choice_t c;
+    if (!usb_pd_policy_contract(&c) || c.mismatch ||
+        (c.type != PD_PDO_PPS && c.type != PD_PDO_SPR_AVS && c.type != PD_PDO_EPR_AVS)) {
+        cdc_acm_printf("# sweep: no PPS/AVS PDO offers %umV\n", s_mv);
+        return false;
+    }
+
+    /* Unroll the ring: oldest sample first */
+    uint16_t total = s_count;
+    uint16_t n = total < PD_SWEEP_BUF_SAMPLES ? total : PD_SWEEP_BUF_SAMPLES;
+    uint16_t first = (uint16_t)(total - n); // 窗口起点（自 Accept 起的采样序号）
+    uint16_t split = (uint16_t)(total % PD_SWEEP_BUF_SAMPLES);
+    if (n == PD_SWEEP_BUF_SAMPLES && split) {
+        reverse(0, split);
+        reverse(split, n);
+        reverse(0, n);
+    }
+    for (uint16_t i = 0; i < n; i++) s_buf[i] = adc_raw_to_vbus_mv(s_buf[i]);
+
+    pd_settle_t r;
+    if (!pd_settle_analyze(s_buf, n, PD_SWEEP_PERIOD_US, s_prev_mv, c.mv, PD_SWEEP_BAND_MV, &r)) {
+        cdc_acm_printf("# sweep: %4u %6u capture too short\n", s_index, c.mv);
+        return true;
+    }
+
+    /* Times from the Accept */
+    uint32_t settle_us = (uint32_t)first * PD_SWEEP_PERIOD_US + r.settle_us;
+    uint32_t ps_rdy_us = (uint32_t)s_ps_rdy_idx * PD_SWEEP_PERIOD_US;
+    cdc_acm_printf("# sweep: %4u %6u %8u %+6d %7u %s%5lu.%02lu %6lu.%02lu\n", s_index, c.mv, r.final_mv, r.error_mv,
+                   r.overshoot_mv, r.settled ? " " : ">", (unsigned long)(settle_us / 1000),
+                   (unsigned long)(settle_us % 1000 / 10), (unsigned long)(ps_rdy_us / 1000),
+                   (unsigned long)(ps_rdy_us % 1000 / 10));
+    return true;
+}
+
+void usb_pd_sweep_poll(void) {
+    if (s_bad_args && cdc_acm_is_configured()) {
+        s_bad_args = false;
+        cdc_acm_prints("# sweep: usage swp<from_mV>,<to_mV>,<step_mV>[,<dwell_ms>], swpx to stop\n");
+    }
+
+    uint8_t cmd = s_cmd;
+    s_cmd = CMD_NONE;
+    if (cmd == CMD_STOP && s_state != SWEEP_IDLE) finish("stopped");
+    if (cmd == CMD_START) begin();
+    if (s_state == SWEEP_IDLE) return;
+
+    if (!usb_pd_snk_is_active() || usb_pd_script_is_running()) {
+        finish("interrupted");
+        return;
+    }
+
+    uint32_t now = millis();
+    switch (s_state) {
+    case SWEEP_WAIT_ACCEPT:
+    case SWEEP_CAPTURE:
+        if (s_refused) {
+            finish("request refused");
+        } else if (s_capture_done) {
+            if (!cdc_acm_is_configured()) return;
+            if (!report_step()) {
+                finish("stopped");
+                return;
+            }
+            s_dwell_until = now + s_dwell;
+            s_state = SWEEP_DWELL;
+        } else if (now - s_step_ms > PD_SWEEP_STEP_TIMEOUT_MS) {
+            finish("no PS_RDY");
+        }
+        break;
+    case SWEEP_DWELL:
+        if ((int32_t)(now - s_dwell_until) < 0) break;
+        if (next_mv()) {
+            start_step();
+        } else {
+            finish("done");
+        }
+        break;
+    default:
+        break;
+    }
+}
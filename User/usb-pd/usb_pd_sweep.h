@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * PPS / AVS voltage sweep in SNK mode: steps the policy target across a
+ * range, one Request per step, and samples VBUS from the ADC DMA stream
+ * on TIM2 from the Accept until a fixed window after PS_RDY. Each step is
+ * printed as one table row (settle time, overshoot, final error). Between
+ * steps the contract is kept alive by the policy's periodic Request, so
+ * long dwells are fine. The previous target is requested again at the end.
+ */
+
+#define PD_SWEEP_PERIOD_US    250  // VBUS 采样间隔
+#define PD_SWEEP_ADC_AVG      4    // 每次采样平均的 ADC 转换次数
+#define PD_SWEEP_BUF_SAMPLES  1024 // 环形采样缓冲，约 256ms
+#define PD_SWEEP_POST_SAMPLES 400  // PS_RDY 之后继续采样，约 100ms
+#define PD_SWEEP_BAND_MV      100  // 判定稳定的 ±带宽（相对终值）
+#define PD_SWEEP_DWELL_MS     500  // 默认每步停留时间
+#define PD_SWEEP_STEP_TIMEOUT_MS 1500 // 一步内未完成 Accept -> PS_RDY 则中止
+
+/* "swp<from>,<to>,<step>[,<dwell_ms>]" (mV) starts a sweep, "swpx" stops it */
+void usb_pd_sweep_on_cdc_bytes(const uint8_t *data, uint8_t len);
+
+bool usb_pd_sweep_is_running(void);
+
+/* Step sequencing, analysis and table rows; call from the main loop */
+void usb_pd_sweep_poll(void);
@@ -0,0 +1,93 @@
+#include "usb_pd_timer.h"
+
+#include "ch32x035.h"
+
+#define PD_TIMER_MIN_US 2 // 小于此值无法可靠设置比较值，直接执行
+
+static volatile pd_timer_cb_t s_cb[PD_TIMER_CH_COUNT];
+
+static volatile uint16_t *const s_ccr[PD_TIMER_CH_COUNT] = {
+    &TIM2->CH1CVR,
+    &TIM2->CH2CVR,
+    &TIM2->CH3CVR,
+    &TIM2->CH4CVR,
+};
+
+/* CCxIE / CCxIF bit of a channel */
+#define CH_BIT(ch) ((uint16_t)(TIM_CC1IE << (ch)))
+
+/**
+ * @brief  初始化 TIM2：1MHz 自由运行计数，比较通道仅产生中断
+ */
+void usb_pd_timer_init(void) {
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure = {0};
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+
+    TIM_TimeBaseStructure.TIM_Period = 0xFFFF;
+    TIM_TimeBaseStructure.TIM_Prescaler = (uint16_t)(SystemCoreClock / 1000000 - 1);
+    TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM2, &TIM_TimeBaseStructure);
+
+    /* Output compare channels stay in frozen (timing) mode: CHCTLR defaults */
+    TIM2->DMAINTENR = 0;
+    TIM2->INTFR = 0;
+
+    /* Highest preemption: the GoodCRC turnaround must not wait behind USBFS */
+    NVIC_InitStructure.NVIC_IRQChannel = TIM2_CC_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    TIM_Cmd(TIM2, ENABLE);
+}
+
+uint16_t usb_pd_timer_now(void) {
+    return TIM2->CNT;
+}
+
+void usb_pd_timer_start_at(pd_timer_ch_t ch, uint16_t from, uint16_t delay_us, pd_timer_cb_t cb) {
+    if (ch >= PD_TIMER_CH_COUNT || !cb) return;
+
+    TIM2->DMAINTENR &= (uint16_t)~CH_BIT(ch);
+    uint16_t elapsed = (uint16_t)(TIM2->CNT - from);
+    if (delay_us < PD_TIMER_MIN_US || elapsed + PD_TIMER_MIN_US >= delay_us) {
+        s_cb[ch] = 0;
+        cb();
+        return;
+    }
+
+    s_cb[ch] = cb;
+    *s_ccr[ch] = (uint16_t)(from + delay_us);
+    TIM2->INTFR = (uint16_t)~CH_BIT(ch); /* 写 0 清除，写 1 无效 */
+    TIM2->DMAINTENR |= CH_BIT(ch);
+}
+
+void usb_pd_timer_start(pd_timer_ch_t ch, uint16_t delay_us, pd_timer_cb_t cb) {
+    usb_pd_timer_start_at(ch, TIM2->CNT, delay_us, cb);
+}
+
+void usb_pd_timer_cancel(pd_timer_ch_t ch) {
+    if (ch >= PD_TIMER_CH_COUNT) return;
+    TIM2->DMAINTENR &= (uint16_t)~CH_BIT(ch);
+    s_cb[ch] = 0;
+}
+
+void TIM2_CC_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void TIM2_CC_IRQHandler(void) {
+    uint16_t pending = TIM2->INTFR & TIM2->DMAINTENR;
+
+    for (uint8_t ch = 0; ch < PD_TIMER_CH_COUNT; ch++) {
+        if (!(pending & CH_BIT(ch))) continue;
+
+        /* One-shot: disable before the callback so it may restart the channel */
+        TIM2->DMAINTENR &= (uint16_t)~CH_BIT(ch);
+        TIM2->INTFR = (uint16_t)~CH_BIT(ch);
+        pd_timer_cb_t cb = s_cb[ch];
+        s_cb[ch] = 0;
+        if (cb) cb();
+    }
+}
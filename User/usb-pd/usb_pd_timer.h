@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * PD protocol timers: TIM2 free-running at 1 MHz, one-shot callbacks on
+ * the four compare channels. Callbacks run in TIM2_CC_IRQHandler at the
+ * highest preemption priority, so they must stay short.
+ */
+
+/* 定时器通道分配 */
+typedef enum {
+    PD_TIMER_GOODCRC = 0,     // GoodCRC 发送时刻
+    PD_TIMER_CRC_RECEIVE = 1, // 等待对端 GoodCRC
+    PD_TIMER_SCRIPT = 2,      // 脚本 DELAY / WAIT 超时
+    PD_TIMER_SWEEP = 3,       // 扫描时的 VBUS 采样节拍（SNK 模式）
+    PD_TIMER_CCTL = 3,        // CC 时间线采样节拍（LISTEN 模式，与扫描不会同时使用）
+    PD_TIMER_CH_COUNT = 4,
+} pd_timer_ch_t;
+
+typedef void (*pd_timer_cb_t)(void);
+
+void usb_pd_timer_init(void);
+
+/* Current µs counter (wraps every 65.536 ms) */
+uint16_t usb_pd_timer_now(void);
+
+/**
+ * Run cb once, delay_us after now (up to 60000). Delays too short to
+ * program (< 2 µs) run cb immediately in the caller's context.
+ * Restarting a channel replaces the pending callback.
+ */
+void usb_pd_timer_start(pd_timer_ch_t ch, uint16_t delay_us, pd_timer_cb_t cb);
+
+/* Same, relative to a counter value taken earlier with usb_pd_timer_now() */
+void usb_pd_timer_start_at(pd_timer_ch_t ch, uint16_t from, uint16_t delay_us, pd_timer_cb_t cb);
+
+void usb_pd_timer_cancel(pd_timer_ch_t ch);
@@ -0,0 +1,394 @@
+#include "usb_pd_tx.h"
+
+#include "ch32x035_usbpd.h"
+#include "irq_save.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_header.h"
+#include "usb_pd_message.h"
+#include "usb_pd_timer.h"
+
+typedef struct {
+    uint8_t frame[PD_TX_FRAME_MAX] __attribute__((aligned(4))); // DMA 源，发送期间保持不变
+    pd_tx_handle_t handle; // 0: 空闲槽位
+    uint8_t prio;
+    uint8_t held;
+    uint8_t sop;
+    uint8_t len;
+    uint8_t seq;           // 同优先级内按提交顺序
+    uint8_t tracked;       // 需要对端 GoodCRC 确认
+    uint8_t retries;       // 已重传次数
+    uint8_t acked;         // GoodCRC 先于 IF_TX_END 处理
+} pd_tx_entry_t;
+
+/* Recent results, looked up by handle */
+#define PD_TX_STATUS_SLOTS 16
+
+static pd_tx_entry_t s_queue[PD_TX_QUEUE_SIZE];
+static volatile int8_t s_current = -1; // 正在发送的槽位
+static volatile int8_t s_wait = -1;    // 等待 GoodCRC 的槽位
+static pd_tx_handle_t s_next_handle = 1;
+static uint8_t s_next_seq = 0;
+static uint8_t s_msg_id[3];            // MessageIDCounter，按 SOP/SOP'/SOP'' 分开
+static uint8_t s_retry_count = PD_N_RETRY_COUNT_PD2;
+static struct {
+    pd_tx_handle_t handle;
+    uint8_t status;
+} s_status[PD_TX_STATUS_SLOTS];
+static pd_tx_done_cb_t s_done_cb = 0;
+static volatile int8_t s_reset = -1;   // 待发送的复位信号（pd_tx_reset_t）
+static volatile uint8_t s_reset_on_wire = 0;
+static void (*s_reset_cb)(pd_tx_reset_t type) = 0;
+
+/* Host-injected frame results, printed from the main loop */
+#define HOST_TX_EVT_SIZE 8
+static volatile struct {
+    pd_tx_handle_t handle;
+    uint8_t status;
+} s_host_evt[HOST_TX_EVT_SIZE];
+static volatile uint8_t s_host_evt_w = 0;
+static volatile uint8_t s_host_evt_r = 0;
+
+/* Submitters run in the main loop and the USBPD and TIM2 interrupts: every queue update runs under irq_save() */
+
+static void host_evt_push(pd_tx_handle_t handle, pd_tx_status_t status) {
+    uint32_t irq = irq_save();
+    uint8_t next = (uint8_t)((s_host_evt_w + 1) % HOST_TX_EVT_SIZE);
+    if (next != s_host_evt_r) { /* 满则丢弃 */
+        s_host_evt[s_host_evt_w].handle = handle;
+        s_host_evt[s_host_evt_w].status = (uint8_t)status;
+        s_host_evt_w = next;
+    }
+    irq_restore(irq);
+}
+
+static void set_status(pd_tx_handle_t handle, pd_tx_status_t status) {
+    s_status[handle % PD_TX_STATUS_SLOTS].handle = handle;
+    s_status[handle % PD_TX_STATUS_SLOTS].status = (uint8_t)status;
+}
+
+static void finish(pd_tx_entry_t *e, pd_tx_status_t status) {
+    set_status(e->handle, status);
+    if (e->prio == PD_TX_PRIO_HOST) host_evt_push(e->handle, status);
+    if (s_done_cb) s_done_cb(e->handle, (pd_tx_prio_t)e->prio, status);
+    e->handle = 0;
+}
+
+static inline uint8_t sop_index(uint8_t sop) {
+    return (uint8_t)((sop & PD_SOP_MASK) ? (sop & PD_SOP_MASK) - 1 : 0);
+}
+
+static void phy_start(pd_tx_entry_t *e) {
+    static const uint8_t tx_sel[4] = {UPD_SOP0, UPD_SOP0, UPD_SOP1, UPD_SOP2};
+
+    /* Drive selected CC */
+    if ((USBPD->CONFIG & CC_SEL) == CC_SEL) {
+        USBPD->PORT_CC2 |= CC_LVE;
+    } else {
+        USBPD->PORT_CC1 |= CC_LVE;
+    }
+
+    USBPD->CONFIG |= IE_TX_END;
+    USBPD->BMC_CLK_CNT = UPD_TMR_TX_48M;
+    USBPD->DMA = (uintptr_t)e->frame;
+    USBPD->TX_SEL = tx_sel[e->sop & PD_SOP_MASK];
+    USBPD->BMC_TX_SZ = e->len;
+    USBPD->CONTROL |= PD_TX_EN;
+    USBPD->STATUS &= BMC_AUX_INVALID;
+    USBPD->CONTROL |= BMC_START;
+}
+
+static void phy_start_reset(pd_tx_reset_t type) {
+    if ((USBPD->CONFIG & CC_SEL) == CC_SEL) {
+        USBPD->PORT_CC2 |= CC_LVE;
+    } else {
+        USBPD->PORT_CC1 |= CC_LVE;
+    }
+
+    USBPD->CONFIG |= IE_TX_END;
+    USBPD->BMC_CLK_CNT = UPD_TMR_TX_48M;
+    USBPD->TX_SEL = type == PD_TX_CABLE_RESET ? UPD_CABLE_RESET : UPD_HARD_RESET;
+    USBPD->BMC_TX_SZ = 0;
+    USBPD->CONTROL |= PD_TX_EN;
+    USBPD->STATUS &= BMC_AUX_INVALID;
+    USBPD->CONTROL |= BMC_START;
+}
+
+/* Start the most urgent frame if the PHY is idle; call with interrupts disabled */
+static void dispatch(void) {
+    if (s_current >= 0 || s_reset_on_wire) return;
+
+    /* Reset signaling goes before anything queued after it */
+    if (s_reset >= 0) {
+        s_reset_on_wire = 1;
+        phy_start_reset((pd_tx_reset_t)s_reset);
+        return;
+    }
+
+    int8_t best = -1;
+    uint8_t held_prio = 0xFF; // 最紧急的保留帧的优先级
+    for (int8_t i = 0; i < PD_TX_QUEUE_SIZE; i++) {
+        const pd_tx_entry_t *e = &s_queue[i];
+        if (!e->handle || i == s_wait) continue;
+        if (e->held) {
+            if (e->prio < held_prio) held_prio = e->prio;
+            continue;
+        }
+        /* One acknowledged frame at a time; GoodCRC is not tracked and still goes out */
+        if (e->tracked && s_wait >= 0) continue;
+        if (best < 0 || e->prio < s_queue[best].prio ||
+            (e->prio == s_queue[best].prio && (int8_t)(e->seq - s_queue[best].seq) < 0)) {
+            best = i;
+        }
+    }
+    /* A held frame keeps the PHY from anything less urgent, not from frames of its own priority */
+    if (best < 0 || s_queue[best].prio > held_prio) return;
+
+    pd_tx_entry_t *e = &s_queue[best];
+    if (e->tracked && e->retries == 0) {
+        /* A retransmission keeps the MessageID of the first attempt */
+        e->frame[1] = (uint8_t)((e->frame[1] & ~0x0Eu) | (s_msg_id[sop_index(e->sop)] << 1));
+    }
+    s_current = best;
+    set_status(e->handle, PD_TX_SENDING);
+    phy_start(e);
+}
+
+/* CRCReceiveTimer expired: retransmit or give up */
+static void crc_receive_timeout(void) {
+    uint32_t irq = irq_save();
+    if (s_wait >= 0) {
+        pd_tx_entry_t *e = &s_queue[s_wait];
+        s_wait = -1;
+        if (e->retries < s_retry_count) {
+            e->retries++;
+            set_status(e->handle, PD_TX_QUEUED);
+        } else {
+            finish(e, PD_TX_FAILED);
+        }
+        dispatch();
+    }
+    irq_restore(irq);
+}
+
+static pd_tx_handle_t submit(const uint8_t *frame, uint8_t len, uint8_t sop, pd_tx_prio_t prio, uint8_t held) {
+    if (len < 2 || len > PD_TX_FRAME_MAX) return 0;
+
+    uint32_t irq = irq_save();
+    pd_tx_entry_t *e = 0;
+    uint8_t free_slots = 0;
+    for (uint8_t i = 0; i < PD_TX_QUEUE_SIZE; i++) {
+        if (!s_queue[i].handle) {
+            if (!e) e = &s_queue[i];
+            free_slots++;
+        }
+    }
+    /* The last free slot is reserved so a GoodCRC is never refused */
+    if (!e || (prio != PD_TX_PRIO_GOODCRC && free_slots < 2)) {
+        irq_restore(irq);
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < len; i++) e->frame[i] = frame[i];
+    e->len = len;
+    e->sop = sop;
+    e->prio = (uint8_t)prio;
+    e->held = held;
+    e->tracked = prio != PD_TX_PRIO_GOODCRC;
+    e->retries = 0;
+    e->acked = 0;
+    e->seq = s_next_seq++;
+    e->handle = s_next_handle;
+    s_next_handle = (pd_tx_handle_t)(s_next_handle + 1);
+    if (s_next_handle == 0) s_next_handle = 1;
+    set_status(e->handle, PD_TX_QUEUED);
+
+    pd_tx_handle_t handle = e->handle;
+    dispatch();
+    irq_restore(irq);
+    return handle;
+}
+
+void usb_pd_tx_set_done_cb(pd_tx_done_cb_t cb) {
+    s_done_cb = cb;
+}
+
+pd_tx_done_cb_t usb_pd_tx_get_done_cb(void) {
+    return s_done_cb;
+}
+
+void usb_pd_tx_set_retry_count(uint8_t count) {
+    s_retry_count = count;
+}
+
+pd_tx_handle_t usb_pd_tx_submit(const uint8_t *frame, uint8_t len, uint8_t sop, pd_tx_prio_t prio) {
+    return submit(frame, len, sop, prio, 0);
+}
+
+pd_tx_handle_t usb_pd_tx_submit_held(const uint8_t *frame, uint8_t len, uint8_t sop, pd_tx_prio_t prio) {
+    return submit(frame, len, sop, prio, 1);
+}
+
+void usb_pd_tx_release(pd_tx_handle_t handle) {
+    if (!handle) return;
+    uint32_t irq = irq_save();
+    for (uint8_t i = 0; i < PD_TX_QUEUE_SIZE; i++) {
+        if (s_queue[i].handle == handle) {
+            s_queue[i].held = 0;
+            break;
+        }
+    }
+    dispatch();
+    irq_restore(irq);
+}
+
+void usb_pd_tx_cancel(pd_tx_handle_t handle) {
+    if (!handle) return;
+    uint32_t irq = irq_save();
+    for (int8_t i = 0; i < PD_TX_QUEUE_SIZE; i++) {
+        if (s_queue[i].handle != handle || i == s_current) continue;
+        if (i == s_wait) {
+            usb_pd_timer_cancel(PD_TIMER_CRC_RECEIVE);
+            s_wait = -1;
+        }
+        finish(&s_queue[i], PD_TX_FAILED);
+        break;
+    }
+    dispatch();
+    irq_restore(irq);
+}
+
+void usb_pd_tx_host_submitted(pd_tx_handle_t handle) {
+    host_evt_push(handle, handle ? PD_TX_QUEUED : PD_TX_FAILED);
+}
+
+static const char *const host_tx_status_str[] = {"unknown", "queued", "sending", "wait-ack", "done", "failed"};
+
+void usb_pd_tx_poll(void) {
+    if (!cdc_acm_is_configured()) return;
+
+    while (s_host_evt_r != s_host_evt_w) {
+        uint8_t r = s_host_evt_r;
+        if (s_host_evt[r].handle) {
+            cdc_acm_printf("# tx %u %s\n", s_host_evt[r].handle, host_tx_status_str[s_host_evt[r].status]);
+        } else {
+            cdc_acm_printf("# tx rejected (queue full)\n");
+        }
+        s_host_evt_r = (uint8_t)((r + 1) % HOST_TX_EVT_SIZE);
+    }
+}
+
+pd_tx_status_t usb_pd_tx_status(pd_tx_handle_t handle) {
+    if (!handle || s_status[handle % PD_TX_STATUS_SLOTS].handle != handle) return PD_TX_UNKNOWN;
+    return (pd_tx_status_t)s_status[handle % PD_TX_STATUS_SLOTS].status;
+}
+
+/* Hard Reset restarts every protocol layer, Cable Reset only the cable's */
+static void clear_msg_ids(pd_tx_reset_t type) {
+    for (uint8_t i = type == PD_TX_CABLE_RESET ? 1 : 0; i < sizeof(s_msg_id); i++) s_msg_id[i] = 0;
+}
+
+bool usb_pd_tx_on_tx_end(void) {
+    uint32_t irq = irq_save();
+    if (s_reset_on_wire) {
+        pd_tx_reset_t type = (pd_tx_reset_t)s_reset;
+        s_reset_on_wire = 0;
+        s_reset = -1;
+        clear_msg_ids(type);
+        if (s_reset_cb) s_reset_cb(type);
+    } else if (s_current >= 0) {
+        pd_tx_entry_t *e = &s_queue[s_current];
+        /* Log our own TX now that it is on the wire, before the partner's reply */
+        save_message(e->sop, e->frame, e->len);
+        if (e->tracked && !e->acked) {
+            s_wait = s_current;
+            set_status(e->handle, PD_TX_WAIT_ACK);
+            usb_pd_timer_start(PD_TIMER_CRC_RECEIVE, PD_T_RECEIVE_US, crc_receive_timeout);
+        } else {
+            if (e->tracked) s_msg_id[sop_index(e->sop)] = (uint8_t)((s_msg_id[sop_index(e->sop)] + 1) & 0x07);
+            finish(e, PD_TX_DONE);
+        }
+        s_current = -1;
+    }
+
+    dispatch();
+    bool started = s_current >= 0;
+    if (!started) {
+        USBPD->PORT_CC1 &= ~CC_LVE;
+        USBPD->PORT_CC2 &= ~CC_LVE;
+    }
+    irq_restore(irq);
+    return started;
+}
+
+void usb_pd_tx_on_goodcrc(uint8_t sop, uint8_t msg_id) {
+    uint32_t irq = irq_save();
+    int8_t idx = s_wait >= 0 ? s_wait : s_current;
+    if (idx >= 0) {
+        pd_tx_entry_t *e = &s_queue[idx];
+        uint8_t id = (uint8_t)((e->frame[1] >> 1) & 0x07);
+        if (e->tracked && !e->acked && sop_index(e->sop) == sop_index(sop) && id == msg_id) {
+            if (idx == s_current) {
+                /* IF_TX_END not handled yet; it completes the frame */
+                e->acked = 1;
+            } else {
+                usb_pd_timer_cancel(PD_TIMER_CRC_RECEIVE);
+                s_wait = -1;
+                s_msg_id[sop_index(e->sop)] = (uint8_t)((id + 1) & 0x07);
+                finish(e, PD_TX_DONE);
+                dispatch();
+            }
+        }
+    }
+    irq_restore(irq);
+}
+
+void usb_pd_tx_flush(void) {
+    uint32_t irq = irq_save();
+    if (s_wait >= 0) {
+        usb_pd_timer_cancel(PD_TIMER_CRC_RECEIVE);
+        s_wait = -1;
+    }
+    for (int8_t i = 0; i < PD_TX_QUEUE_SIZE; i++) {
+        if (!s_queue[i].handle) continue;
+        if (i == s_current) {
+            s_queue[i].tracked = 0; /* do not wait for its GoodCRC */
+        } else {
+            finish(&s_queue[i], PD_TX_FAILED);
+        }
+    }
+    irq_restore(irq);
+}
+
+void usb_pd_tx_reset(void) {
+    usb_pd_tx_flush();
+    if (!s_reset_on_wire) s_reset = -1; /* a reset signal not started yet is dropped too */
+    for (uint8_t i = 0; i < sizeof(s_msg_id); i++) s_msg_id[i] = 0;
+}
+
+void usb_pd_tx_on_cable_reset(void) {
+    uint32_t irq = irq_save();
+    clear_msg_ids(PD_TX_CABLE_RESET);
+    irq_restore(irq);
+}
+
+bool usb_pd_tx_send_reset(pd_tx_reset_t type, void (*sent_cb)(pd_tx_reset_t type)) {
+    uint32_t irq = irq_save();
+    if (s_reset >= 0) {
+        irq_restore(irq);
+        return false;
+    }
+    usb_pd_tx_flush();
+    s_reset = (int8_t)type;
+    s_reset_cb = sent_cb;
+    dispatch();
+    irq_restore(irq);
+    return true;
+}
+
+bool usb_pd_tx_busy(void) {
+    if (s_reset >= 0) return true;
+    for (uint8_t i = 0; i < PD_TX_QUEUE_SIZE; i++) {
+        if (s_queue[i].handle) return true;
+    }
+    return false;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * PD transmit queue: fixed slots, served by priority then submission order,
+ * one frame on the PHY at a time. The next frame starts from the IF_TX_END
+ * interrupt. Transmitted frames are logged to the message buffer on
+ * completion, so they appear after the frame they answer.
+ *
+ * Every frame except GoodCRC goes through the protocol-layer transmitter:
+ * the queue fills in its MessageID, waits tReceive for the partner's
+ * GoodCRC and retransmits up to nRetryCount times. Only one such frame is
+ * in flight; GoodCRCs still go out while it waits. The MessageID counter
+ * of a SOP type advances only when a frame is acknowledged.
+ */
+
+#define PD_TX_QUEUE_SIZE     4    // 发送队列槽位数
+#define PD_TX_FRAME_MAX      34   // header + 7 DOs（不含 CRC，由硬件追加）
+#define PD_T_RECEIVE_US      1000 // CRCReceiveTimer（tReceive 0.9~1.1 ms）
+#define PD_N_RETRY_COUNT_PD2 3
+#define PD_N_RETRY_COUNT_PD3 2
+
+/* 优先级：数值越小越优先 */
+typedef enum {
+    PD_TX_PRIO_GOODCRC = 0,
+    PD_TX_PRIO_REPLY = 1, // 协议自动回复
+    PD_TX_PRIO_HOST = 2,  // 上位机注入
+} pd_tx_prio_t;
+
+typedef enum {
+    PD_TX_UNKNOWN = 0, // 句柄无效或已过期
+    PD_TX_QUEUED,
+    PD_TX_SENDING,
+    PD_TX_WAIT_ACK,    // 已发出，等待对端 GoodCRC
+    PD_TX_DONE,        // GoodCRC 本身为发送完成，其余为收到匹配的 GoodCRC
+    PD_TX_FAILED,      // 重试耗尽，或队列被清空
+} pd_tx_status_t;
+
+/* Reset signaling: ordered sets only, never retransmitted or acknowledged */
+typedef enum {
+    PD_TX_HARD_RESET = 0,
+    PD_TX_CABLE_RESET,
+} pd_tx_reset_t;
+
+/* Frame handle; 0 means the frame was not accepted (queue full or bad length) */
+typedef uint8_t pd_tx_handle_t;
+
+/* Completion hook, called from interrupt context */
+typedef void (*pd_tx_done_cb_t)(pd_tx_handle_t handle, pd_tx_prio_t prio, pd_tx_status_t status);
+
+void usb_pd_tx_set_done_cb(pd_tx_done_cb_t cb);
+pd_tx_done_cb_t usb_pd_tx_get_done_cb(void);
+
+/* nRetryCount: PD_N_RETRY_COUNT_PD2 or PD_N_RETRY_COUNT_PD3 */
+void usb_pd_tx_set_retry_count(uint8_t count);
+
+/**
+ * Copy a frame (header + payload, no CRC) into the queue. sop is PD_SOP0..2.
+ * The MessageID bits of the header are replaced when the frame is first sent.
+ * Starts it at once if the PHY is idle and nothing more urgent is waiting.
+ * One slot is kept for GoodCRC, so other priorities see one slot less.
+ */
+pd_tx_handle_t usb_pd_tx_submit(const uint8_t *frame, uint8_t len, uint8_t sop, pd_tx_prio_t prio);
+
+/**
+ * Same, but the frame stays held until usb_pd_tx_release(). While it is
+ * held nothing less urgent is started (used to reserve the PHY for a
+ * timer-scheduled GoodCRC); frames of its own priority still go out.
+ */
+pd_tx_handle_t usb_pd_tx_submit_held(const uint8_t *frame, uint8_t len, uint8_t sop, pd_tx_prio_t prio);
+void usb_pd_tx_release(pd_tx_handle_t handle);
+
+/* Drop a frame that is not on the wire yet; it completes as PD_TX_FAILED */
+void usb_pd_tx_cancel(pd_tx_handle_t handle);
+
+pd_tx_status_t usb_pd_tx_status(pd_tx_handle_t handle);
+
+/**
+ * Report the submission of a host-injected (PD_TX_PRIO_HOST) frame; 0
+ * means it was rejected. The queue reports its completion itself. Both
+ * are printed as "# tx <handle> <status>" by usb_pd_tx_poll().
+ */
+void usb_pd_tx_host_submitted(pd_tx_handle_t handle);
+
+/* Print host frame results; call from the main loop */
+void usb_pd_tx_poll(void);
+
+/* IF_TX_END: complete the current frame, start the next; false if the PHY is now idle */
+bool usb_pd_tx_on_tx_end(void);
+
+/* Received GoodCRC (sop, MessageID) from the partner */
+void usb_pd_tx_on_goodcrc(uint8_t sop, uint8_t msg_id);
+
+/* Fail every queued frame (mode exit, reset); a frame already on the wire completes normally */
+void usb_pd_tx_flush(void);
+
+/* Flush and clear the MessageID counters (mode entry, Hard Reset) */
+void usb_pd_tx_reset(void);
+
+/* Cable Reset received from another port: clear the SOP'/SOP'' MessageID counters */
+void usb_pd_tx_on_cable_reset(void);
+
+/**
+ * Send Hard Reset or Cable Reset signaling. Every queued frame is failed
+ * and the signal goes out as soon as the frame on the wire (if any) ends.
+ * Once it is sent the MessageID counters it resets are cleared (all for
+ * Hard Reset, SOP'/SOP'' for Cable Reset) and sent_cb runs from the
+ * IF_TX_END interrupt. False if a reset is already pending.
+ */
+bool usb_pd_tx_send_reset(pd_tx_reset_t type, void (*sent_cb)(pd_tx_reset_t type));
+
+/* True while a frame or reset signal is on the wire or queued */
+bool usb_pd_tx_busy(void);
@@ -0,0 +1,95 @@
+#include "usb_pd_vcal.h"
+
+#include <stddef.h>
+
+#include "usb_pd_link.h"
+
+/* a / c rounded to nearest; c > 0 */
+static int64_t div_round(int64_t a, int64_t c) {
+    return a >= 0 ? (a + c / 2) / c : -((-a + c / 2) / c);
+}
+
+static void build_divider(pd_vcal_t *t, int64_t sn, int64_t sd) {
+    t->num_seg = 1;
+    t->start[0] = 0;
+    t->slope[0] = (int32_t)div_round(sn * 65536, sd);
+    t->offset[0] = 0x8000;
+    for (uint16_t b = 0; b < PD_VCAL_BUCKETS; b++) t->bucket[b] = 0;
+}
+
+bool pd_vcal_build(pd_vcal_t *t, const pd_vcal_point_t *pts, uint8_t n, uint16_t vref_mv, uint32_t r1, uint32_t r2) {
+    /* Uncalibrated mV per raw: S = sn / sd */
+    int64_t sn = (int64_t)vref_mv * (int64_t)(r1 + r2);
+    int64_t sd = (int64_t)PD_VCAL_RAW_MAX * (int64_t)(r2 ? r2 : 1);
+
+    build_divider(t, sn, sd);
+    if (!r2 || !vref_mv) return false;
+    if (n == 0) return true;
+    if (n < 2 || n > PD_VCAL_MAX_POINTS) return false;
+    for (uint8_t i = 0; i + 1 < n; i++) {
+        if (pts[i + 1].measured <= pts[i].measured || pts[i + 1].actual <= pts[i].actual) return false;
+    }
+
+    pd_vcal_t c;
+    c.num_seg = (uint8_t)(n - 1);
+    for (uint8_t i = 0; i < c.num_seg; i++) {
+        int64_t da = (int64_t)pts[i + 1].actual - pts[i].actual;
+        int64_t dm = (int64_t)pts[i + 1].measured - pts[i].measured;
+        // mv = raw * S * da / dm + (a_i - m_i * da / dm)
+        c.slope[i] = (int32_t)div_round(sn * da * 65536, sd * dm);
+        c.offset[i] = (int32_t)(div_round(((int64_t)pts[i].actual * dm - (int64_t)pts[i].measured * da) * 65536, dm) + 0x8000);
+        // 第一个 raw * S >= m_i 的 raw
+        int64_t s = i ? ((int64_t)pts[i].measured * sd + sn - 1) / sn : 0;
+        c.start[i] = (uint16_t)(s > PD_VCAL_RAW_MAX + 1 ? PD_VCAL_RAW_MAX + 1 : s);
+    }
+
+    /* Each bucket may hold at most one segment start past its first raw */
+    uint8_t seg = 0;
+    for (uint16_t b = 0; b < PD_VCAL_BUCKETS; b++) {
+        uint16_t lo = (uint16_t)(b << PD_VCAL_BUCKET_SHIFT);
+        uint16_t hi = (uint16_t)(lo + (1u << PD_VCAL_BUCKET_SHIFT) - 1);
+        while (seg + 1 < c.num_seg && c.start[seg + 1] <= lo) seg++;
+        if (seg + 2 < c.num_seg && c.start[seg + 2] <= hi) return false;
+        c.bucket[b] = seg;
+    }
+
+    *t = c;
+    return true;
+}
+
+uint16_t pd_vcal_to_raw(const pd_vcal_t *t, uint16_t mv) {
+    uint8_t seg = 0;
+    while (seg + 1 < t->num_seg && t->start[seg + 1] <= PD_VCAL_RAW_MAX &&
+           pd_vcal_to_mv(t, t->start[seg + 1]) <= mv) {
+        seg++;
+    }
+    if (t->slope[seg] <= 0) return 0;
+    int64_t raw = div_round((int64_t)mv * 65536 - (t->offset[seg] - 0x8000), t->slope[seg]);
+    return raw < 0 ? 0 : raw > PD_VCAL_RAW_MAX ? PD_VCAL_RAW_MAX : (uint16_t)raw;
+}
+
+uint16_t pd_vcal_divider_mv(uint32_t raw_sum, uint32_t count, uint16_t vref_mv, uint32_t r1, uint32_t r2) {
+    if (!count || !r2) return 0;
+    int64_t mv = div_round((int64_t)raw_sum * vref_mv * (int64_t)(r1 + r2), (int64_t)count * PD_VCAL_RAW_MAX * r2);
+    return mv > 0xFFFF ? 0xFFFF : (uint16_t)mv;
+}
+
+static uint16_t record_crc(const pd_vcal_record_t *r) {
+    return pd_link_crc16((const uint8_t *)r, offsetof(pd_vcal_record_t, crc));
+}
+
+void pd_vcal_record_seal(pd_vcal_record_t *r) {
+    r->magic = PD_VCAL_RECORD_MAGIC;
+    r->version = PD_VCAL_RECORD_VERSION;
+    r->reserved = 0;
+    r->crc = record_crc(r);
+}
+
+bool pd_vcal_record_valid(const pd_vcal_record_t *r) {
+    return r->magic == PD_VCAL_RECORD_MAGIC && r->version == PD_VCAL_RECORD_VERSION && r->n <= PD_VCAL_MAX_POINTS &&
+           r->crc == record_crc(r);
+}
+
+bool pd_vcal_build_record(pd_vcal_t *t, const pd_vcal_record_t *r) {
+    return pd_vcal_build(t, r->pts, r->n, r->vref_mv, r->r1, r->r2);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * VBUS ADC raw <-> mV without floating point. The divider and the
+ * piecewise-linear calibration points are folded once into one Q16
+ * slope / offset per segment; a small table indexed by raw >> 6 gives
+ * the segment, so a conversion is a shift, a compare, one multiply and
+ * one add. Below the first and above the last point the end segments
+ * are extrapolated. No hardware dependency; shared with host tools.
+ */
+
+#define PD_VCAL_MAX_POINTS   8
+#define PD_VCAL_RAW_MAX      4095
+#define PD_VCAL_BUCKET_SHIFT 6 // 每个索引桶 64 个 raw 值，段宽不得小于一个桶
+#define PD_VCAL_BUCKETS      ((PD_VCAL_RAW_MAX >> PD_VCAL_BUCKET_SHIFT) + 1)
+
+/* 校准点（按 measured 递增，actual 同样递增） */
+typedef struct {
+    uint16_t actual;   // 实际电压值 (mV)
+    uint16_t measured; // 未校准的测量值 (mV)
+} pd_vcal_point_t;
+
+typedef struct {
+    uint8_t num_seg;
+    uint8_t bucket[PD_VCAL_BUCKETS];        // raw >> PD_VCAL_BUCKET_SHIFT 起点所在的段
+    uint16_t start[PD_VCAL_MAX_POINTS - 1]; // 段起点 raw
+    int32_t slope[PD_VCAL_MAX_POINTS - 1];  // mV / raw，Q16
+    int32_t offset[PD_VCAL_MAX_POINTS - 1]; // mV，Q16，含 0.5 舍入
+} pd_vcal_t;
+
+/**
+ * Build the table for a divider r1 / r2 on a vref_mv, 12-bit ADC and n
+ * calibration points (n = 0: divider only). False if the points are not
+ * increasing, a segment is narrower than a bucket, or n is out of range;
+ * the table is then left as the divider-only one.
+ */
+bool pd_vcal_build(pd_vcal_t *t, const pd_vcal_point_t *pts, uint8_t n, uint16_t vref_mv, uint32_t r1, uint32_t r2);
+
+static inline uint16_t pd_vcal_to_mv(const pd_vcal_t *t, uint16_t raw) {
+    uint8_t seg = t->bucket[(raw & PD_VCAL_RAW_MAX) >> PD_VCAL_BUCKET_SHIFT];
+    if (seg + 1 < t->num_seg && raw >= t->start[seg + 1]) seg++;
+    int32_t mv = (int32_t)(((int64_t)t->slope[seg] * raw + t->offset[seg]) >> 16);
+    return mv < 0 ? 0 : mv > 0xFFFF ? 0xFFFF : (uint16_t)mv;
+}
+
+/* Inverse of pd_vcal_to_mv(): the nearest raw for mv, clamped to 0 ~ PD_VCAL_RAW_MAX */
+uint16_t pd_vcal_to_raw(const pd_vcal_t *t, uint16_t mv);
+
+/* Divider-only mV of the mean of count raw samples summed in raw_sum, with sub-LSB resolution */
+uint16_t pd_vcal_divider_mv(uint32_t raw_sum, uint32_t count, uint16_t vref_mv, uint32_t r1, uint32_t r2);
+
+/*
+ * Calibration as stored in flash: divider, points and a CRC-16/CCITT
+ * (pd_link_crc16) over everything before the crc field. A record with a
+ * different magic or version is ignored.
+ */
+#define PD_VCAL_RECORD_MAGIC   0x4C414356u // "VCAL"
+#define PD_VCAL_RECORD_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t vref_mv;
+    uint32_t r1, r2; // 分压电阻 (Ω)
+    uint8_t n;       // 校准点数，0 表示仅按分压换算
+    uint8_t reserved;
+    pd_vcal_point_t pts[PD_VCAL_MAX_POINTS];
+    uint16_t crc;
+} pd_vcal_record_t;
+
+/* Fill magic, version and crc */
+void pd_vcal_record_seal(pd_vcal_record_t *r);
+bool pd_vcal_record_valid(const pd_vcal_record_t *r);
+
+/* Build the table from a record; see pd_vcal_build() */
+bool pd_vcal_build_record(pd_vcal_t *t, const pd_vcal_record_t *r);
@@ -0,0 +1,271 @@
+#include "usb_pd_vcap.h"
+
+#include "ch32x035_usbpd.h"
+#include "irq_save.h"
+#include "millis.h"
+#include "usb_cdc_print.h"
+#include "usb_pd_header.h"
+#include "usb_vbus_measure.h"
+
+#define BLOCK_SAMPLES (ADC_SAMPLE_COUNT / 2) // 半缓冲中的 VBUS 采样数
+
+/* Control messages that trigger */
+#define MSG_CTRL_ACCEPT 0x03
+#define MSG_CTRL_PS_RDY 0x06
+
+/* One entry: VBUS ADC raw over PD_VCAP_DECIMATE halves */
+typedef struct {
+    uint16_t avg;
+    uint16_t min;
+    uint16_t max;
+} vcap_entry_t;
+
+/* 状态 */
+enum {
+    VCAP_IDLE = 0,
+    VCAP_ARMED, // 采集中，等待触发
+    VCAP_POST,  // 已触发，采集到窗口结束
+    VCAP_DONE,  // 采集结束，等待打印
+    VCAP_DUMP,  // 打印中
+};
+
+/* 主机命令 */
+enum {
+    CMD_NONE = 0,
+    CMD_ARM,
+    CMD_DISARM,
+};
+
+static volatile uint8_t s_state = VCAP_IDLE;
+static volatile uint8_t s_cmd = CMD_NONE;
+static uint8_t s_cmd_mask = PD_VCAP_ALL;
+static uint8_t s_cmd_decimate = PD_VCAP_DECIMATE;
+
+/* Ring, filled from the DMA interrupt */
+static vcap_entry_t s_ring[PD_VCAP_ENTRIES];
+static volatile uint32_t s_count = 0; // 写入的条目总数
+static uint8_t s_mask = PD_VCAP_ALL;
+static uint8_t s_decimate = PD_VCAP_DECIMATE;
+static uint32_t s_acc_sum = 0;
+static uint16_t s_acc_min = 0xFFFF;
+static uint16_t s_acc_max = 0;
+static uint8_t s_acc_blocks = 0;
+
+/* Trigger */
+static volatile uint32_t s_trig_count = 0; // 触发时正在累积的条目
+static uint32_t s_trig_us = 0;
+static uint32_t s_end_us = 0;
+static uint8_t s_trig_what = 0;
+static uint32_t s_trig_seq = 0;
+static uint32_t s_trig_ms = 0;
+
+/* Dump cursor */
+static uint32_t s_dump_idx = 0;
+static uint32_t s_dump_first = 0;
+static uint32_t s_dump_rows = 0;
+static uint32_t s_period_ns = 0; // 每条的时长
+static vcap_entry_t s_dump_prev;
+
+static void on_block(const uint16_t *block) {
+    uint8_t state = s_state;
+    if (state != VCAP_ARMED && state != VCAP_POST) return;
+
+    uint32_t sum = 0;
+    uint16_t lo = s_acc_min, hi = s_acc_max;
+    for (uint16_t i = 0; i < BLOCK_SAMPLES; i++) {
+        uint16_t v = block[i * ADC_CHANNEL_COUNT];
+        sum += v;
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+    }
+    s_acc_sum += sum;
+    s_acc_min = lo;
+    s_acc_max = hi;
+    if (++s_acc_blocks < s_decimate) return;
+
+    uint32_t n = s_count;
+    vcap_entry_t *e = &s_ring[n % PD_VCAP_ENTRIES];
+    e->avg = (uint16_t)(s_acc_sum / ((uint32_t)s_decimate * BLOCK_SAMPLES));
+    e->min = lo;
+    e->max = hi;
+    s_count = n + 1;
+    s_acc_sum = 0;
+    s_acc_min = 0xFFFF;
+    s_acc_max = 0;
+    s_acc_blocks = 0;
+
+    if (state == VCAP_POST && s_count - s_trig_count >= PD_VCAP_POST_ENTRIES) {
+        s_end_us = micros();
+        s_state = VCAP_DONE;
+    }
+}
+
+static void arm(void) {
+    adc_block_hook(0);
+    s_count = 0;
+    s_acc_sum = 0;
+    s_acc_min = 0xFFFF;
+    s_acc_max = 0;
+    s_acc_blocks = 0;
+    s_mask = s_cmd_mask;
+    s_decimate = s_cmd_decimate;
+    s_state = VCAP_ARMED;
+    adc_block_hook(on_block);
+}
+
+static void disarm(void) {
+    s_state = VCAP_IDLE;
+    adc_block_hook(0);
+}
+
+void usb_pd_vcap_on_cdc_bytes(const uint8_t *data, uint8_t len) {
+    if (len < 4 || data[0] != 'v' || data[1] != 'c' || data[2] != 'a' || data[3] != 'p') return;
+    if (len == 5 && data[4] == 'x') {
+        s_cmd = CMD_DISARM;
+        return;
+    }
+
+    uint8_t mask = 0;
+    uint16_t decimate = 0;
+    for (uint8_t i = 4; i < len; i++) {
+        switch (data[i]) {
+        case 'a': mask |= PD_VCAP_ACCEPT; break;
+        case 'p': mask |= PD_VCAP_PS_RDY; break;
+        case 'h': mask |= PD_VCAP_HARD_RESET; break;
+        case 'd': mask |= PD_VCAP_DETACH; break;
+        default:
+            if (data[i] >= '0' && data[i] <= '9' && decimate <= PD_VCAP_DECIMATE_MAX) {
+                decimate = (uint16_t)(decimate * 10 + (data[i] - '0'));
+            }
+            break;
+        }
+    }
+    if (!decimate) decimate = PD_VCAP_DECIMATE;
+    if (decimate > PD_VCAP_DECIMATE_MAX) decimate = PD_VCAP_DECIMATE_MAX;
+    s_cmd_mask = mask ? mask : PD_VCAP_ALL;
+    s_cmd_decimate = (uint8_t)decimate;
+    s_cmd = CMD_ARM;
+}
+
+bool usb_pd_vcap_is_armed(void) {
+    return s_state != VCAP_IDLE;
+}
+
+void usb_pd_vcap_trigger(uint8_t what, uint32_t seq, uint32_t ms) {
+    if (s_state != VCAP_ARMED || !(what & s_mask)) return;
+    uint32_t irq = irq_save();
+    if (s_state == VCAP_ARMED) {
+        s_trig_count = s_count;
+        s_trig_us = micros();
+        s_trig_what = what;
+        s_trig_seq = seq;
+        s_trig_ms = ms;
+        s_state = VCAP_POST;
+    }
+    irq_restore(irq);
+}
+
+void usb_pd_vcap_on_frame(uint32_t status, const uint8_t *data, uint8_t len, uint32_t seq, uint32_t ms) {
+    if (s_state != VCAP_ARMED) return;
+    if (status & IF_RX_RESET) {
+        /* The same flag reports a Cable Reset (PD_RX_SOP2_CRST); VBUS is not touched by it */
+        if ((status & MASK_PD_STAT) == PD_RX_SOP1_HRST) usb_pd_vcap_trigger(PD_VCAP_HARD_RESET, seq, ms);
+        return;
+    }
+    if (len < 2) return;
+    uint16_t hdr = pd_header_read(data);
+    if (PD_HDR_EXTENDED(hdr) || PD_HDR_NUM_DO(hdr)) return;
+    if (PD_HDR_MSG_TYPE(hdr) == MSG_CTRL_ACCEPT) usb_pd_vcap_trigger(PD_VCAP_ACCEPT, seq, ms);
+    if (PD_HDR_MSG_TYPE(hdr) == MSG_CTRL_PS_RDY) usb_pd_vcap_trigger(PD_VCAP_PS_RDY, seq, ms);
+}
+
+static const char *trigger_name(uint8_t what) {
+    switch (what) {
+    case PD_VCAP_ACCEPT: return "Accept";
+    case PD_VCAP_PS_RDY: return "PS_RDY";
+    case PD_VCAP_HARD_RESET: return "Hard Reset";
+    default: return "detach";
+    }
+}
+
+static bool moved(uint16_t a, uint16_t b) {
+    return (a > b ? a - b : b - a) >= PD_VCAP_STEP_RAW;
+}
+
+/* Print one row; t relative to the trigger, 0.1 ms steps */
+static void print_row(uint32_t idx, const vcap_entry_t *e) {
+    int32_t ticks = (int32_t)(idx - s_trig_count);
+    uint32_t a = (uint32_t)(ticks < 0 ? -ticks : ticks) * (s_period_ns / 100) / 1000;
+    cdc_acm_printf("# vcap: %c%lu.%lu %05u %05u %05u\n", ticks < 0 ? '-' : '+', (unsigned long)(a / 10),
+                   (unsigned long)(a % 10), adc_raw_to_vbus_mv(e->avg), adc_raw_to_vbus_mv(e->min),
+                   adc_raw_to_vbus_mv(e->max));
+    s_dump_rows++;
+}
+
+static void begin_dump(void) {
+    uint32_t total = s_count;
+    uint32_t n = total < PD_VCAP_ENTRIES ? total : PD_VCAP_ENTRIES;
+    uint32_t post = total - s_trig_count;
+
+    s_dump_first = total - n;
+    s_dump_idx = s_dump_first;
+    s_dump_rows = 0;
+    // 触发时刻到窗口结束测得每条的时长
+    uint32_t span = s_end_us - s_trig_us;
+    s_period_ns = post ? span / post * 1000 + span % post * 1000 / post : 0;
+
+    cdc_acm_printf("# vcap: %s", trigger_name(s_trig_what));
+    if (s_trig_seq) cdc_acm_printf(" #%03lu", (unsigned long)s_trig_seq);
+    cdc_acm_printf(" at %lums, %lu x %lu.%02lums, %u samples per row\n", (unsigned long)s_trig_ms, (unsigned long)n,
+                   (unsigned long)(s_period_ns / 1000000), (unsigned long)(s_period_ns / 10000 % 100),
+                   (unsigned)s_decimate * BLOCK_SAMPLES);
+    cdc_acm_prints("# vcap: t_ms avg_mV min_mV max_mV\n");
+    s_state = VCAP_DUMP;
+}
+
+void usb_pd_vcap_poll(void) {
+    uint8_t cmd = s_cmd;
+    s_cmd = CMD_NONE;
+    if (cmd == CMD_DISARM) {
+        if (s_state != VCAP_IDLE && cdc_acm_is_configured()) cdc_acm_prints("# vcap: disarmed\n");
+        disarm();
+    }
+    if (cmd == CMD_ARM) {
+        arm();
+        if (cdc_acm_is_configured()) {
+            cdc_acm_printf("# vcap: armed, %u VBUS samples per row, %u rows after the next%s%s%s%s\n",
+                           (unsigned)s_decimate * BLOCK_SAMPLES, PD_VCAP_POST_ENTRIES,
+                           (s_mask & PD_VCAP_ACCEPT) ? " Accept" : "", (s_mask & PD_VCAP_PS_RDY) ? " PS_RDY" : "",
+                           (s_mask & PD_VCAP_HARD_RESET) ? " HardReset" : "", (s_mask & PD_VCAP_DETACH) ? " detach" : "");
+        }
+    }
+
+    if (s_state == VCAP_DONE) {
+        if (!cdc_acm_is_configured()) return;
+        adc_block_hook(0);
+        begin_dump();
+    }
+    if (s_state != VCAP_DUMP) return;
+    if (!cdc_acm_is_configured()) {
+        s_state = VCAP_IDLE;
+        return;
+    }
+
+    for (uint8_t k = 0; k < PD_VCAP_ROWS_PER_POLL; k++) {
+        uint32_t idx = s_dump_idx;
+        if (idx == s_count) {
+            cdc_acm_printf("# vcap: end, %lu of %lu rows printed\n", (unsigned long)s_dump_rows,
+                           (unsigned long)(s_count - s_dump_first));
+            s_state = VCAP_IDLE;
+            return;
+        }
+        const vcap_entry_t *e = &s_ring[idx % PD_VCAP_ENTRIES];
+        // 与上一行相比没有变化的条目不打印；首行、触发行和末行总是打印
+        if (idx == s_dump_first || idx == s_trig_count || idx + 1 == s_count || moved(e->avg, s_dump_prev.avg) ||
+            moved(e->min, s_dump_prev.min) || moved(e->max, s_dump_prev.max)) {
+            print_row(idx, e);
+            s_dump_prev = *e;
+        }
+        s_dump_idx = idx + 1;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * VBUS waveform around PD events. The ADC DMA buffer alone holds about
+ * 1.4 ms of VBUS (5.5 us per sample), too short for a source transition.
+ * Once armed, every half of the circular
+ * ADC DMA buffer (ADC_SAMPLE_COUNT / 2 VBUS samples) is folded into a
+ * running min / max / sum, and every PD_VCAP_DECIMATE halves one entry is
+ * stored in a ring, so the ring holds the waveform before the trigger.
+ * Accept, PS_RDY (received or sent), a Hard Reset or a detach is the
+ * trigger; capture continues for PD_VCAP_POST_ENTRIES entries, then the
+ * window is printed as "# vcap: ..." rows relative to the triggering
+ * frame (its #seq and ms match the frame line), skipping rows that did
+ * not move, and the capture disarms.
+ */
+
+#define PD_VCAP_ENTRIES       256 // 环形缓冲条目数（每条 6 字节）
+#define PD_VCAP_POST_ENTRIES  128 // 触发后继续采集的条目数
+#define PD_VCAP_DECIMATE      4   // 默认每条合并的半缓冲数
+#define PD_VCAP_DECIMATE_MAX  64
+#define PD_VCAP_STEP_RAW      4   // avg/min/max 变化超过该 ADC 值（约 50mV）才打印
+#define PD_VCAP_ROWS_PER_POLL 8   // 每次 poll 打印的行数
+
+/* Triggers */
+#define PD_VCAP_ACCEPT     0x01
+#define PD_VCAP_PS_RDY     0x02
+#define PD_VCAP_HARD_RESET 0x04
+#define PD_VCAP_DETACH     0x08
+#define PD_VCAP_ALL        0x0F
+
+/*
+ * "vcap[a][p][h][d][<n>]" arms the capture (any mode): letters select the
+ * triggers (all when none is given), n halves per entry (1 ~ 64).
+ * "vcapx" disarms it.
+ */
+void usb_pd_vcap_on_cdc_bytes(const uint8_t *data, uint8_t len);
+
+bool usb_pd_vcap_is_armed(void);
+
+/* Frame logged to the event stream (RX or our own TX); any context */
+void usb_pd_vcap_on_frame(uint32_t status, const uint8_t *data, uint8_t len, uint32_t seq, uint32_t ms);
+
+/* PD_VCAP_* event that is not a frame (detach, Hard Reset sent); any context */
+void usb_pd_vcap_trigger(uint8_t what, uint32_t seq, uint32_t ms);
+
+/* Arming and the window dump; call from the main loop */
+void usb_pd_vcap_poll(void);
@@ -0,0 +1,137 @@
+#include "usb_pd_vdm.h"
+
+#include <stdio.h>
+
+/* Discover Identity ACK data objects */
+#define VDO_ID_HEADER 1
+#define VDO_PRODUCT   3
+#define VDO_CABLE     4
+
+uint32_t pd_vdm_request(uint8_t cmd, uint8_t vdm_ver) {
+    return ((uint32_t)PD_VDM_SVID_PD << 16) | (1u << 15) | ((uint32_t)(vdm_ver & 0x03) << 13) |
+           ((uint32_t)PD_VDM_REQ << 6) | (cmd & 0x1F);
+}
+
+bool pd_cable_decode(const uint32_t *vdos, uint8_t n, pd_cable_info_t *info) {
+    if (n <= VDO_CABLE) return false;
+    uint32_t h = vdos[0];
+    if (PD_VDM_SVID(h) != PD_VDM_SVID_PD || !PD_VDM_STRUCTURED(h) || PD_VDM_CMD_TYPE(h) != PD_VDM_ACK ||
+        PD_VDM_CMD(h) != PD_VDM_CMD_DISCOVER_IDENTITY) {
+        return false;
+    }
+
+    /* SOP' Product Type: 011 passive, 100 active, 110 VPD */
+    uint32_t id = vdos[VDO_ID_HEADER];
+    switch ((id >> 27) & 0x07) {
+    case 3:
+        info->type = PD_CABLE_PASSIVE;
+        break;
+    case 4:
+        info->type = PD_CABLE_ACTIVE;
+        break;
+    case 6:
+        info->type = PD_CABLE_VPD;
+        break;
+    default:
+        info->type = PD_CABLE_NONE;
+        return false;
+    }
+
+    uint32_t c = vdos[VDO_CABLE];
+    static const uint16_t max_mv[4] = {20000, 30000, 40000, 50000};
+    info->vid = (uint16_t)id;
+    info->pid = (uint16_t)(vdos[VDO_PRODUCT] >> 16);
+    info->hw_ver = (uint8_t)(c >> 28);
+    info->fw_ver = (uint8_t)((c >> 24) & 0x0F);
+    info->cable_vdo = c;
+    info->ct = 0;
+    info->vbus_mohm = 0;
+    info->gnd_mohm = 0;
+
+    /* VPD VDO: max VBUS B16..15, Charge Through current B14 and support B0, VBUS / GND impedance B12..7 / B6..1 */
+    if (info->type == PD_CABLE_VPD) {
+        info->max_mv = max_mv[(c >> 15) & 0x03];
+        info->ct = (uint8_t)(c & 0x01);
+        info->max_ma = info->ct ? ((c >> 14) & 0x01 ? 5000 : 3000) : 0;
+        info->vbus_mohm = (uint8_t)(((c >> 7) & 0x3F) * 2);
+        info->gnd_mohm = (uint8_t)((c >> 1) & 0x3F);
+        info->epr = 0;
+        info->latency = 0;
+        info->speed = 0;
+        info->vconn_req = 1;
+        info->sop2 = 0;
+        return true;
+    }
+
+    info->epr = (uint8_t)((c >> 17) & 0x01);
+    info->latency = (uint8_t)((c >> 13) & 0x0F);
+    info->max_mv = max_mv[(c >> 9) & 0x03];
+    info->max_ma = ((c >> 5) & 0x03) == 1 ? 3000 : ((c >> 5) & 0x03) == 2 ? 5000 : 0;
+    info->speed = (uint8_t)(c & 0x07);
+    if (info->type == PD_CABLE_ACTIVE) {
+        info->vconn_req = 1;
+        info->sop2 = (uint8_t)((c >> 3) & 0x01);
+    } else {
+        info->vconn_req = (uint8_t)(((c >> 11) & 0x03) == 1);
+        info->sop2 = 0;
+    }
+    return true;
+}
+
+const char *pd_cable_type_name(uint8_t type) {
+    static const char *const names[] = {"-", "passive", "active", "VPD"};
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "-";
+}
+
+const char *pd_cable_speed_name(uint8_t speed) {
+    static const char *const names[] = {"USB2.0", "Gen1", "Gen2", "Gen3", "Gen4"};
+    return speed < sizeof(names) / sizeof(names[0]) ? names[speed] : "?";
+}
+
+uint16_t pd_cable_latency_ns(uint8_t latency, uint16_t *length_m) {
+    if (latency >= 1 && latency <= 8) {
+        /* 10 ns steps, roughly 1 m each; 1000b is "more than 70 ns" */
+        *length_m = latency;
+        return (uint16_t)(latency * 10);
+    }
+    if (latency >= 9 && latency <= 11) {
+        /* Active cables: 1000 / 2000 / 3000 ns */
+        *length_m = (uint16_t)((latency - 8) * 200);
+        return (uint16_t)((latency - 8) * 1000);
+    }
+    *length_m = 0;
+    return 0;
+}
+
+int pd_cable_format(const pd_cable_info_t *info, char *out, size_t out_size) {
+    int w;
+    if (info->type == PD_CABLE_VPD) {
+        /* No speed or latency fields; Charge Through and the impedances instead */
+        char ct[12] = "no CT";
+        if (info->ct) snprintf(ct, sizeof(ct), "CT:%uA", info->max_ma / 1000u);
+        w = snprintf(out, out_size, "VPD VID:%04X PID:%04X %uV %s VBUS:%umOhm GND:%umOhm HW:%u FW:%u", info->vid,
+                     info->pid, info->max_mv / 1000u, ct, info->vbus_mohm, info->gnd_mohm, info->hw_ver, info->fw_ver);
+    } else {
+        char lat[20];
+        uint16_t m;
+        uint16_t ns = pd_cable_latency_ns(info->latency, &m);
+        if (!ns) {
+            snprintf(lat, sizeof(lat), "lat:%u", info->latency);
+        } else if (info->latency == 8) {
+            snprintf(lat, sizeof(lat), ">70ns(>7m)");
+        } else if (info->latency < 8) {
+            snprintf(lat, sizeof(lat), "<%uns(%um)", ns, m);
+        } else {
+            snprintf(lat, sizeof(lat), "%uns(%um)", ns, m);
+        }
+
+        w = snprintf(out, out_size, "%s VID:%04X PID:%04X %uA %uV %s%s %s%s%s HW:%u FW:%u",
+                     pd_cable_type_name(info->type), info->vid, info->pid, info->max_ma / 1000u, info->max_mv / 1000u,
+                     pd_cable_speed_name(info->speed), info->epr ? " EPR" : "", lat,
+                     info->vconn_req && info->type == PD_CABLE_PASSIVE ? " VCONN" : "", info->sop2 ? " SOP''" : "",
+                     info->hw_ver, info->fw_ver);
+    }
+    if (w < 0) return 0;
+    if ((size_t)w >= out_size) w = (int)out_size - 1;
+    return w;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Structured VDM header and Discover Identity decode, mainly the cable
+ * plug's answer on SOP'/SOP'' (ID Header, Cable VDO). No hardware
+ * dependency; shared with host tools.
+ */
+
+#define PD_VDM_SVID_PD 0xFF00 // PD SID
+
+/* Structured VDM header fields */
+#define PD_VDM_SVID(h)       ((uint16_t)((h) >> 16))
+#define PD_VDM_STRUCTURED(h) ((uint8_t)(((h) >> 15) & 0x01))
+#define PD_VDM_VERSION(h)    ((uint8_t)(((h) >> 13) & 0x03)) // 0: 1.0, 1: 2.x
+#define PD_VDM_CMD_TYPE(h)   ((uint8_t)(((h) >> 6) & 0x03))
+#define PD_VDM_CMD(h)        ((uint8_t)((h) & 0x1F))
+
+/* 命令类型 */
+#define PD_VDM_REQ  0
+#define PD_VDM_ACK  1
+#define PD_VDM_NAK  2
+#define PD_VDM_BUSY 3
+
+#define PD_VDM_CMD_DISCOVER_IDENTITY 1
+
+#define PD_T_VDM_SENDER_RESPONSE_MS 30 // tVDMSenderResponse（24~30 ms）
+
+/* Structured VDM header for a PD SID request; vdm_ver 0 (PD2.0, 1.0) or 1 (PD3.x, 2.0) */
+uint32_t pd_vdm_request(uint8_t cmd, uint8_t vdm_ver);
+
+/* SOP' product type in the ID Header VDO */
+typedef enum {
+    PD_CABLE_NONE = 0,  // 不是线缆（未定义或其他类型）
+    PD_CABLE_PASSIVE,
+    PD_CABLE_ACTIVE,
+    PD_CABLE_VPD,       // VCONN Powered Device
+} pd_cable_type_t;
+
+/* Decoded Discover Identity ACK from a cable plug */
+typedef struct {
+    uint8_t type;        // pd_cable_type_t
+    uint16_t vid;
+    uint16_t pid;
+    uint8_t hw_ver;
+    uint8_t fw_ver;
+    uint16_t max_ma;     // VBUS 电流能力：3000 / 5000，未知为 0
+    uint16_t max_mv;     // 最大 VBUS 电压：20000 / 30000 / 40000 / 50000
+    uint8_t speed;       // USB Highest Speed 字段（0: USB 2.0 ... 4: USB4 Gen4）
+    uint8_t latency;     // Cable Latency 字段
+    uint8_t epr;         // EPR Mode Capable
+    uint8_t vconn_req;   // 无源线缆需要 VCONN
+    uint8_t sop2;        // 有源线缆带 SOP'' 控制器
+    uint8_t ct;          // VPD：支持 Charge Through，max_ma 为其电流
+    uint8_t vbus_mohm;   // VPD：VBUS 阻抗（mΩ）
+    uint8_t gnd_mohm;    // VPD：GND 阻抗（mΩ）
+    uint32_t cable_vdo;  // 原始 Cable VDO（Active Cable VDO1 / VPD VDO）
+} pd_cable_info_t;
+
+/**
+ * Decode the data objects of a Discover Identity ACK (VDM header first).
+ * False if it is not a cable plug's ACK or a cable VDO is missing.
+ */
+bool pd_cable_decode(const uint32_t *vdos, uint8_t n, pd_cable_info_t *info);
+
+/* "passive", "active", "VPD" or "-" */
+const char *pd_cable_type_name(uint8_t type);
+
+/* "USB2.0", "Gen1", "Gen2", "Gen3", "Gen4" or "?" */
+const char *pd_cable_speed_name(uint8_t speed);
+
+/* Nominal one-way delay in ns for the latency field, and the length it stands for in m; 0 if reserved */
+uint16_t pd_cable_latency_ns(uint8_t latency, uint16_t *length_m);
+
+/*
+ * Compact text, e.g. "passive VID:05AC PID:1234 5A 50V Gen2 EPR <10ns(1m)", or for a VPD
+ * "VPD VID:05AC PID:1234 20V CT:3A VBUS:20mOhm GND:10mOhm"; returns the length written
+ */
+int pd_cable_format(const pd_cable_info_t *info, char *out, size_t out_size);
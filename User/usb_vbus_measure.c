@@ -1,10 +1,20 @@
 #include "usb_vbus_measure.h"
 
+#include <string.h>
+
 #include "ch32x035.h"
 #include "debug.h"
+#include "irq_save.h"
 
 uint16_t adc_buffer[ADC_BUFFER_SIZE] __attribute__((aligned(4)));
 
+/* 分压与校准点折算成的定点换算表，adc_init() 中生成 */
+static pd_vcal_t s_vcal;
+static pd_vcal_record_t s_cal;      // 生成 s_vcal 所用的校准
+static bool s_cal_from_flash = false;
+
+static void vbus_watch_rearm(void);
+
 static void dma_init(DMA_Channel_TypeDef *DMA_CHx, uint32_t padr, uint32_t madr, uint32_t bufsize) {
     DMA_InitTypeDef DMA_InitStructure;
 
@@ -26,7 +36,37 @@ static void dma_init(DMA_Channel_TypeDef *DMA_CHx, uint32_t padr, uint32_t madr,
     DMA_Cmd(DMA_CHx, ENABLE);
 }
 
+/* 编译期的分压与校准点 */
+static void cal_defaults(pd_vcal_record_t *rec) {
+    memset(rec, 0, sizeof(*rec));
+    rec->vref_mv = ADC_VREF_VOLTAGE;
+    rec->r1 = VBUS_DIV_R1;
+    rec->r2 = VBUS_DIV_R2;
+    rec->n = VBUS_CAL_ENABLE ? (uint8_t)VBUS_CAL_POINTS_COUNT : 0;
+    if (rec->n > PD_VCAL_MAX_POINTS) rec->n = PD_VCAL_MAX_POINTS;
+    for (uint8_t i = 0; i < rec->n; i++) rec->pts[i] = VBUS_CAL_POINTS[i];
+    pd_vcal_record_seal(rec);
+}
+
+/* Flash 中的校准有效时使用它，否则用编译期的；校准点无效时退回仅按分压换算 */
+static void cal_load(void) {
+    const pd_vcal_record_t *flash = (const pd_vcal_record_t *)VBUS_CAL_FLASH_ADDR;
+    pd_vcal_t t;
+
+    if (pd_vcal_record_valid(flash) && pd_vcal_build_record(&t, flash)) {
+        s_cal = *flash;
+        s_vcal = t;
+        s_cal_from_flash = true;
+        return;
+    }
+    cal_defaults(&s_cal);
+    pd_vcal_build_record(&s_vcal, &s_cal);
+    s_cal_from_flash = false;
+}
+
 void adc_init(void) {
+    cal_load();
+
     {
         GPIO_InitTypeDef GPIO_InitStructure = {0};
         ADC_InitTypeDef ADC_InitStructure = {0};
@@ -63,68 +103,110 @@ void adc_init(void) {
 }
 
 /**
- * @brief       在校准点数组中查找给定测量值所在的区间
- * @param       value 待查找的测量值
- * @param       index 返回区间起始点的索引
- * @return      true: 找到区间; false: 超出范围
+ * @brief       将 ADC 原始值转换为 VBUS 电压值（Q16 分段表，见 usb_pd_vcal.h）
+ * @param       adc_raw 原始 ADC 采样值
+ * @return      VBUS 电压值，单位 mV
+ */
+uint16_t adc_raw_to_vbus_mv(uint16_t adc_raw) {
+    return pd_vcal_to_mv(&s_vcal, adc_raw);
+}
+
+/**
+ * @brief       获取当前使用的校准
+ * @param       rec 输出
+ * @return      true: 来自 Flash; false: 编译期校准
  */
-static bool find_calibration_segment(float value, size_t *index) {
-    // 超出范围检查
-    if (value < (float)VBUS_CAL_POINTS[0].measured ||
-        value > (float)VBUS_CAL_POINTS[VBUS_CAL_POINTS_COUNT - 1].measured) {
-        return false;
-    }
-    // 查找区间
-    for (size_t i = 0; i < VBUS_CAL_POINTS_COUNT - 1; i++) {
-        if (value >= (float)VBUS_CAL_POINTS[i].measured &&
-            value <= (float)VBUS_CAL_POINTS[i + 1].measured) {
-            *index = i;
-            return true;
-        }
+bool adc_vbus_cal_get(pd_vcal_record_t *rec) {
+    *rec = s_cal;
+    return s_cal_from_flash;
+}
+
+/**
+ * @brief       立即使用新的校准（不保存），VBUS 看门狗阈值随之更新
+ * @param       rec 分压与校准点
+ * @return      false: 校准点无效，保持原校准
+ */
+bool adc_vbus_cal_apply(const pd_vcal_record_t *rec) {
+    pd_vcal_t t;
+    if (!pd_vcal_build_record(&t, rec)) return false;
+
+    uint32_t irq = irq_save();
+    s_cal = *rec;
+    pd_vcal_record_seal(&s_cal);
+    s_vcal = t;
+    s_cal_from_flash = false;
+    vbus_watch_rearm();
+    irq_restore(irq);
+    return true;
+}
+
+/**
+ * @brief       擦除校准页，写入时先装载整页（快速页编程，256 字节）
+ * @param       rec 要写入的校准，NULL 只擦除
+ * @return      true: 读回一致
+ */
+static bool cal_flash_write(const pd_vcal_record_t *rec) {
+    uint32_t page[VBUS_CAL_FLASH_PAGE / 4];
+    uint32_t irq;
+
+    memset(page, 0xFF, sizeof(page));
+    if (rec) memcpy(page, rec, sizeof(*rec));
+
+    // 擦写期间 CPU 取指暂停，关中断避免中断在擦写中途进入
+    irq = irq_save();
+    FLASH_Unlock_Fast();
+    FLASH_ErasePage_Fast(VBUS_CAL_FLASH_ADDR);
+    if (rec) {
+        FLASH_BufReset();
+        for (uint16_t i = 0; i < VBUS_CAL_FLASH_PAGE / 4; i++) FLASH_BufLoad(VBUS_CAL_FLASH_ADDR + 4 * i, page[i]);
+        FLASH_ProgramPage_Fast(VBUS_CAL_FLASH_ADDR);
     }
-    return false;
+    FLASH_Lock_Fast();
+    irq_restore(irq);
+
+    return !rec || memcmp((const void *)VBUS_CAL_FLASH_ADDR, rec, sizeof(*rec)) == 0;
 }
 
 /**
- * @brief       将 ADC 原始值转换为 VBUS 电压值
- * @param       adc_raw 原始 ADC 采样值
- * @return      VBUS 电压值，单位 mV
+ * @brief       写入 Flash 并生效
+ * @param       rec 分压与校准点（magic、version、crc 在此填写）
+ * @return      false: 校准点无效或写入失败
  */
-uint16_t adc_raw_to_vbus_mv(uint16_t adc_raw) {
-    float vbus_uncalibrated = (float)adc_raw * VBUS_CONVERT_SCALE;
-    float vbus_calibrated;
-
-    if (VBUS_CAL_ENABLE) {
-        size_t segment_index;
-        if (find_calibration_segment(vbus_uncalibrated, &segment_index)) {
-            // 分段线性插值
-            const CalibrationPoint *p1 = &VBUS_CAL_POINTS[segment_index];
-            const CalibrationPoint *p2 = &VBUS_CAL_POINTS[segment_index + 1];
-
-            float t = (vbus_uncalibrated - (float)p1->measured) / ((float)p2->measured - (float)p1->measured);
-            vbus_calibrated = (float)p1->actual + t * ((float)p2->actual - (float)p1->actual);
-        } else {
-            // 超出校准范围时，使用最近的校准点进行线性外推
-            if (vbus_uncalibrated < (float)VBUS_CAL_POINTS[0].measured) {
-                const CalibrationPoint *p1 = &VBUS_CAL_POINTS[0];
-                const CalibrationPoint *p2 = &VBUS_CAL_POINTS[1];
-                float k = ((float)p2->actual - (float)p1->actual) / ((float)p2->measured - (float)p1->measured);
-                vbus_calibrated = (float)p1->actual + k * (vbus_uncalibrated - (float)p1->measured);
-            } else {
-                const CalibrationPoint *p1 = &VBUS_CAL_POINTS[VBUS_CAL_POINTS_COUNT - 2];
-                const CalibrationPoint *p2 = &VBUS_CAL_POINTS[VBUS_CAL_POINTS_COUNT - 1];
-                float k = ((float)p2->actual - (float)p1->actual) / ((float)p2->measured - (float)p1->measured);
-                vbus_calibrated = (float)p2->actual + k * (vbus_uncalibrated - (float)p2->measured);
-            }
-        }
-    } else {
-        vbus_calibrated = vbus_uncalibrated;
+bool adc_vbus_cal_save(const pd_vcal_record_t *rec) {
+    pd_vcal_record_t r = *rec;
+    pd_vcal_t t;
+
+    pd_vcal_record_seal(&r);
+    if (!pd_vcal_build_record(&t, &r)) return false;
+    if (!cal_flash_write(&r)) return false;
+    adc_vbus_cal_apply(&r);
+    s_cal_from_flash = true;
+    return true;
+}
+
+/**
+ * @brief       擦除 Flash 中的校准，恢复编译期校准
+ */
+void adc_vbus_cal_erase(void) {
+    pd_vcal_record_t r;
+    cal_flash_write(NULL);
+    cal_defaults(&r);
+    adc_vbus_cal_apply(&r);
+}
+
+/**
+ * @brief       缓冲中全部 VBUS 采样之和，用于校准时取高分辨率平均值
+ * @param       None
+ * @return      ADC_SAMPLE_COUNT 个 adc_raw 之和
+ */
+uint32_t adc_get_vbus_raw_sum(void) {
+    uint32_t sum = 0;
+
+    for (uint16_t i = 0; i < ADC_SAMPLE_COUNT; i++) {
+        sum += adc_buffer[i * ADC_CHANNEL_COUNT + 0];
     }
 
-    // 限幅并四舍五入
-    vbus_calibrated = vbus_calibrated < 0.0f ? 0.0f : vbus_calibrated;
-    vbus_calibrated = vbus_calibrated > 65535.0f ? 65535.0f : vbus_calibrated;
-    return (uint16_t)(vbus_calibrated + 0.5f);
+    return sum;
 }
 
 /**
@@ -142,6 +224,28 @@ uint16_t adc_get_avg_raw() {
     return (uint16_t)(sum / ADC_SAMPLE_COUNT);
 }
 
+/**
+ * @brief       取 DMA 写入位置之前最新 n 个 VBUS 采样的平均值（可在中断中调用）
+ * @param       n 采样个数，1 ~ ADC_SAMPLE_COUNT
+ * @return      adc_raw 平均值
+ */
+uint16_t adc_get_recent_raw(uint16_t n) {
+    if (n == 0) n = 1;
+    if (n > ADC_SAMPLE_COUNT) n = ADC_SAMPLE_COUNT;
+
+    /* CNTR counts down; the element before the write position is the newest, VBUS sits at even indexes */
+    uint16_t pos = (uint16_t)(ADC_BUFFER_SIZE - DMA1_Channel1->CNTR);
+    uint16_t i = (uint16_t)(((pos + ADC_BUFFER_SIZE - 1) % ADC_BUFFER_SIZE) & ~1u);
+    uint32_t sum = 0;
+
+    for (uint16_t k = 0; k < n; k++) {
+        sum += adc_buffer[i];
+        i = (uint16_t)((i + ADC_BUFFER_SIZE - ADC_CHANNEL_COUNT) % ADC_BUFFER_SIZE);
+    }
+
+    return (uint16_t)(sum / n);
+}
+
 /**
  * @brief       获取 VBUS 电压值
  * @param       None
@@ -171,4 +275,117 @@ uint16_t adc_get_vdd_mv(void) {
     uint16_t vdd_adc_raw = sum / ADC_SAMPLE_COUNT;
     uint16_t vdd_mv = 1200 * 4095 / vdd_adc_raw;
     return vdd_mv;
-}
\ No newline at end of file
+}
+
+/* VBUS 模拟看门狗：窗口随当前状态切换，形成迟滞 */
+static adc_vbus_cb_t s_vbus_cb = 0;
+static volatile bool s_vbus_present = false;
+static uint16_t s_vbus_on_raw = 0;
+static uint16_t s_vbus_off_raw = 0;
+static uint16_t s_vbus_on_mv = 0;
+static uint16_t s_vbus_off_mv = 0;
+
+/**
+ * @brief       将 VBUS 电压值换算为 ADC 原始值（adc_raw_to_vbus_mv 的逆运算）
+ * @param       mv VBUS 电压值，单位 mV
+ * @return      adc_raw
+ */
+static uint16_t vbus_mv_to_raw(uint16_t mv) {
+    return pd_vcal_to_raw(&s_vcal, mv);
+}
+
+static void vbus_watch_arm(bool present) {
+    // 有 VBUS 时低于 off 触发，无 VBUS 时高于 on 触发
+    if (present) {
+        ADC_AnalogWatchdogThresholdsConfig(ADC1, 0x0FFF, s_vbus_off_raw);
+    } else {
+        ADC_AnalogWatchdogThresholdsConfig(ADC1, s_vbus_on_raw, 0);
+    }
+}
+
+/* 校准更换后按新换算表重算阈值 */
+static void vbus_watch_rearm(void) {
+    if (!s_vbus_cb) return;
+    s_vbus_on_raw = vbus_mv_to_raw(s_vbus_on_mv);
+    s_vbus_off_raw = vbus_mv_to_raw(s_vbus_off_mv);
+    vbus_watch_arm(s_vbus_present);
+}
+
+/**
+ * @brief       用 ADC 模拟看门狗监视 VBUS，越过阈值时在中断中回调
+ * @param       on_mv 高于此值视为有 VBUS
+ * @param       off_mv 低于此值视为无 VBUS
+ * @param       cb 状态变化回调（中断上下文）
+ */
+void adc_vbus_watch(uint16_t on_mv, uint16_t off_mv, adc_vbus_cb_t cb) {
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
+
+    s_vbus_on_mv = on_mv;
+    s_vbus_off_mv = off_mv;
+    s_vbus_on_raw = vbus_mv_to_raw(on_mv);
+    s_vbus_off_raw = vbus_mv_to_raw(off_mv);
+    s_vbus_cb = cb;
+    s_vbus_present = adc_get_vbus_mv() >= on_mv;
+    vbus_watch_arm(s_vbus_present);
+
+    ADC_AnalogWatchdogSingleChannelConfig(ADC1, ADC_CHANNEL);
+    ADC_AnalogWatchdogCmd(ADC1, ADC_AnalogWatchdog_SingleRegEnable);
+    ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+    ADC_ITConfig(ADC1, ADC_IT_AWD, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = ADC1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+bool adc_vbus_present(void) {
+    return s_vbus_present;
+}
+
+void ADC1_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void ADC1_IRQHandler(void) {
+    if (ADC_GetITStatus(ADC1, ADC_IT_AWD) != RESET) {
+        ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+        s_vbus_present = !s_vbus_present;
+        vbus_watch_arm(s_vbus_present);
+        if (s_vbus_cb) s_vbus_cb(s_vbus_present);
+    }
+}
+
+/* DMA 半满 / 全满中断：把刚写完的半个缓冲交给回调 */
+static volatile adc_block_cb_t s_block_cb = 0;
+
+/**
+ * @brief       每写完半个 DMA 缓冲回调一次，回调在 DMA 写另一半时读取刚完成的一半
+ * @param       cb 回调（中断上下文），NULL 关闭中断
+ */
+void adc_block_hook(adc_block_cb_t cb) {
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
+
+    DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, DISABLE);
+    s_block_cb = cb;
+    if (!cb) return;
+
+    DMA_ClearITPendingBit(DMA1_IT_HT1 | DMA1_IT_TC1);
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
+}
+
+void DMA1_Channel1_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void DMA1_Channel1_IRQHandler(void) {
+    adc_block_cb_t cb = s_block_cb;
+    if (DMA_GetITStatus(DMA1_IT_HT1) != RESET) {
+        DMA_ClearITPendingBit(DMA1_IT_HT1);
+        if (cb) cb(&adc_buffer[0]);
+    }
+    if (DMA_GetITStatus(DMA1_IT_TC1) != RESET) {
+        DMA_ClearITPendingBit(DMA1_IT_TC1);
+        if (cb) cb(&adc_buffer[ADC_BUFFER_SIZE / 2]);
+    }
+}
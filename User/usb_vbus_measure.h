@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #include "ch32x035_gpio.h"
+#include "usb_pd_vcal.h"
 
 // ADC 引脚配置
 #define ADC_GPIO_PORT GPIOA
@@ -20,12 +21,9 @@
 #define ADC_BUFFER_SIZE   (ADC_CHANNEL_COUNT * ADC_SAMPLE_COUNT)
 
 // 校准点结构体
-typedef struct {
-    uint16_t actual;   // 实际电压值 (mV)
-    uint16_t measured; // ADC 测量值 (mV)
-} CalibrationPoint;
+typedef pd_vcal_point_t CalibrationPoint;
 
-// 校准点数据 (需按 measured 值从小到大排序，关闭校准后测量)
+// 校准点数据 (需按 measured 值从小到大排序，关闭校准后测量)；Flash 中有有效校准时以 Flash 为准
 static const CalibrationPoint VBUS_CAL_POINTS[] = {
     {0, 510},
     {5007, 5372},
@@ -45,11 +43,32 @@ static const bool VBUS_CAL_ENABLE = 1;         // 是否启用校准
 // static const uint32_t VBUS_DIV_R2 = 10000;     // VBUS 下分压电阻 (Ω)
 // static const bool VBUS_CAL_ENABLE = 0;         // 是否启用校准
 
+// 运行时校准保存在用户 Flash 的最后一页（Link.ld 中已从 FLASH 区域去掉）
+#define VBUS_CAL_FLASH_PAGE 256
+#define VBUS_CAL_FLASH_ADDR (FLASH_BASE + 62 * 1024 - VBUS_CAL_FLASH_PAGE)
+
 static const size_t VBUS_CAL_POINTS_COUNT = sizeof(VBUS_CAL_POINTS) / sizeof(CalibrationPoint);
-static const float VBUS_CONVERT_SCALE = ADC_VREF_VOLTAGE / 4095.0f * ((float)(VBUS_DIV_R1 + VBUS_DIV_R2) / (float)VBUS_DIV_R2);
 
 void adc_init();
 uint16_t adc_get_avg_raw(void);
+uint16_t adc_get_recent_raw(uint16_t n);
 uint16_t adc_raw_to_vbus_mv(uint16_t adc_raw);
 uint16_t adc_get_vbus_mv(void);
 uint16_t adc_get_vdd_mv(void);
+
+typedef void (*adc_vbus_cb_t)(bool present);
+
+void adc_vbus_watch(uint16_t on_mv, uint16_t off_mv, adc_vbus_cb_t cb);
+bool adc_vbus_present(void);
+
+/* 半个 DMA 缓冲（ADC_SAMPLE_COUNT / 2 组交错采样）写满时的回调（中断上下文） */
+typedef void (*adc_block_cb_t)(const uint16_t *block);
+
+void adc_block_hook(adc_block_cb_t cb);
+
+/* VBUS 校准：启动时从 Flash 读取，无效时使用编译期的分压与校准点 */
+bool adc_vbus_cal_get(pd_vcal_record_t *rec); // 当前使用的校准；true: 来自 Flash
+bool adc_vbus_cal_apply(const pd_vcal_record_t *rec);
+bool adc_vbus_cal_save(const pd_vcal_record_t *rec); // 写入 Flash 并生效
+void adc_vbus_cal_erase(void);                       // 擦除 Flash，恢复编译期校准
+uint32_t adc_get_vbus_raw_sum(void);                 // 缓冲中 ADC_SAMPLE_COUNT 个 VBUS 采样之和